@@ -0,0 +1,650 @@
+#include "Benchmark.h"
+#include "Math.h"
+#include "SceneGeometry.h"
+#include "ShadowProjection.h"
+#include "SoftwareRasterizer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace {
+
+double Now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+	timeval time;
+	gettimeofday(&time, NULL);
+	return time.tv_sec + time.tv_usec * 1e-6;
+#endif
+}
+
+float Random(float minValue, float maxValue)
+{
+	return minValue + (maxValue - minValue) * (rand() / float(RAND_MAX));
+}
+
+/**
+ * The matrix product as Matrix4f::operator* used to compute it, the reference for the SIMD version.
+ */
+void ScalarMultiply(const Matrix4f& left, const Matrix4f& right, Matrix4f& result)
+{
+	for (unsigned int i = 0 ; i < 4 ; i++) {
+		for (unsigned int j = 0 ; j < 4 ; j++) {
+			result.m[i][j] = left.m[i][0] * right.m[0][j] +
+				left.m[i][1] * right.m[1][j] +
+				left.m[i][2] * right.m[2][j] +
+				left.m[i][3] * right.m[3][j];
+		}
+	}
+}
+
+void ScalarTranspose(const Matrix4f& matrix, Matrix4f& result)
+{
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			result.m[i][j] = matrix.m[j][i];
+}
+
+/**
+ * Cofactor expansion.
+ */
+bool ScalarInverse(const Matrix4f& matrix, Matrix4f& result)
+{
+	const float* m = &matrix.m[0][0];
+	float inv[16];
+
+	inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+	inv[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+	inv[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+	inv[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+	inv[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+	inv[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+	inv[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+	float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if (det == 0)
+		return false;
+
+	det = 1.0f / det;
+	for (int i = 0; i < 16; ++i)
+		(&result.m[0][0])[i] = inv[i] * det;
+
+	return true;
+}
+
+float MaxDifference(const Matrix4f& a, const Matrix4f& b)
+{
+	float maxDiff = 0;
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			maxDiff = std::max(maxDiff, fabsf(a.m[i][j] - b.m[i][j]) / std::max(1.0f, fabsf(b.m[i][j])));
+	return maxDiff;
+}
+
+/**
+ * World matrices built the way the demo builds its cubes, shadow matrices for a light above the ground
+ * plane mixed in so the transforms are projective.
+ */
+void BuildMatrices(std::vector<Matrix4f>& matrices)
+{
+	for (size_t i = 0; i < matrices.size(); ++i)
+	{
+		Matrix4f scale, translate;
+		const float s = Random(0.5f, 2.0f);
+		MakeScaleMatrix(s, s, s, scale);
+		MakeTranslateMatrix(Random(-10.0f, 10.0f), Random(0.0f, 10.0f), Random(-10.0f, 10.0f), translate);
+		matrices[i] = translate * scale;
+
+		if (i % 2)
+		{
+			Matrix4f shadowMatrix;
+			MakePlanarShadowMatrix(0, 1, 0, 0, Random(-20.0f, 20.0f), Random(20.0f, 40.0f), Random(-20.0f, 20.0f), shadowMatrix);
+			matrices[i] = shadowMatrix * matrices[i];
+		}
+	}
+}
+
+void BenchmarkMatrices()
+{
+	// Small enough to stay in cache, otherwise both versions just measure memory bandwidth
+	const size_t NumMatrices = 1024;
+	const int NumIterations = 2000;
+
+	std::vector<Matrix4f> matrices(NumMatrices), scalarResult(NumMatrices), simdResult(NumMatrices);
+	BuildMatrices(matrices);
+
+	Matrix4f view, projection;
+	BuildLookAtMatrix(0, 15, 25, 0, 0, 0, 0, 1, 0, view);
+	BuildPerspectiveMatrix(60.0f, 640.0f / 480.0f, 1.0f, 100.0f, projection);
+	const Matrix4f viewProj = projection * view;
+
+	// Multiply
+	double scalarTime = 0, simdTime = 0;
+	for (int iteration = 0; iteration < NumIterations; ++iteration)
+	{
+		double start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			ScalarMultiply(viewProj, matrices[i], scalarResult[i]);
+		scalarTime += Now() - start;
+
+		start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			simdResult[i] = viewProj * matrices[i];
+		simdTime += Now() - start;
+	}
+
+	float maxError = 0;
+	for (size_t i = 0; i < NumMatrices; ++i)
+		maxError = std::max(maxError, MaxDifference(simdResult[i], scalarResult[i]));
+
+	const double numMatrices = double(NumMatrices) * NumIterations;
+	printf("Matrix4f multiply  %d matrices: scalar %6.1f M/s, SIMD %6.1f M/s, max error %g\n", int(NumMatrices),
+		numMatrices / scalarTime * 1e-6, numMatrices / simdTime * 1e-6, maxError);
+
+	// Transpose
+	scalarTime = simdTime = 0;
+	for (int iteration = 0; iteration < NumIterations; ++iteration)
+	{
+		double start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			ScalarTranspose(matrices[i], scalarResult[i]);
+		scalarTime += Now() - start;
+
+		start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			TransposeMatrix(matrices[i], simdResult[i]);
+		simdTime += Now() - start;
+	}
+
+	int mismatches = 0;
+	for (size_t i = 0; i < NumMatrices; ++i)
+		mismatches += MaxDifference(simdResult[i], scalarResult[i]) != 0;
+
+	printf("Matrix4f transpose %d matrices: scalar %6.1f M/s, SIMD %6.1f M/s, %d mismatches\n", int(NumMatrices),
+		numMatrices / scalarTime * 1e-6, numMatrices / simdTime * 1e-6, mismatches);
+
+	// Inverse, the planar shadow projections are singular up to rounding
+	scalarTime = simdTime = 0;
+	int scalarSingular = 0, simdSingular = 0;
+	for (int iteration = 0; iteration < NumIterations; ++iteration)
+	{
+		scalarSingular = simdSingular = 0;
+
+		double start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			scalarSingular += !ScalarInverse(matrices[i], scalarResult[i]);
+		scalarTime += Now() - start;
+
+		start = Now();
+		for (size_t i = 0; i < NumMatrices; ++i)
+			simdSingular += !InvertMatrix(matrices[i], simdResult[i]);
+		simdTime += Now() - start;
+	}
+
+	// Compare on the invertible ones, by how far matrix * inverse is from the identity
+	maxError = 0;
+	for (size_t i = 0; i < NumMatrices; i += 2)
+	{
+		Matrix4f identity;
+		identity.InitIdentity();
+		maxError = std::max(maxError, MaxDifference(matrices[i] * simdResult[i], identity));
+	}
+
+	printf("Matrix4f inverse   %d matrices: scalar %6.1f M/s, SIMD %6.1f M/s, singular %d / %d, identity error %g\n", int(NumMatrices),
+		numMatrices / scalarTime * 1e-6, numMatrices / simdTime * 1e-6, scalarSingular, simdSingular, maxError);
+}
+
+void BenchmarkTransformPoints()
+{
+	const size_t NumPoints = 4099; // Odd so the remainder loop runs
+	const int NumIterations = 5000;
+
+	std::vector<Vector3> points(NumPoints), scalarResult(NumPoints), simdResult(NumPoints);
+	for (size_t i = 0; i < NumPoints; ++i)
+		points[i] = Vector3(Random(-10.0f, 10.0f), Random(0.0f, 10.0f), Random(-10.0f, 10.0f));
+
+	Matrix4f shadowMatrix;
+	MakePlanarShadowMatrix(0, 1, 0, 0, 5.0f, 30.0f, -5.0f, shadowMatrix);
+
+	double scalarTime = 0, simdTime = 0;
+	for (int iteration = 0; iteration < NumIterations; ++iteration)
+	{
+		double start = Now();
+		for (size_t i = 0; i < NumPoints; ++i)
+			scalarResult[i] = shadowMatrix.TransformPoint(points[i]);
+		scalarTime += Now() - start;
+
+		start = Now();
+		shadowMatrix.TransformPoints(&points[0], &simdResult[0], NumPoints);
+		simdTime += Now() - start;
+	}
+
+	int mismatches = 0;
+	for (size_t i = 0; i < NumPoints; ++i)
+		mismatches += simdResult[i] != scalarResult[i];
+
+	const double numPoints = double(NumPoints) * NumIterations;
+	printf("TransformPoints    %d points: scalar %6.1f M/s, SIMD %6.1f M/s, %d mismatches\n", int(NumPoints),
+		numPoints / scalarTime * 1e-6, numPoints / simdTime * 1e-6, mismatches);
+}
+
+// Same camera and light path as Display() and LightMove() in Main.cpp
+const Vector3 EyePosition(0, 60, 60);
+
+Vector3 LightPosition(float angle)
+{
+	return Vector3(40 * sin(angle), 40, 40 * cos(angle));
+}
+
+void BuildSceneViewProjection(int width, int height, Matrix4f& view, Matrix4f& projection)
+{
+	Vector3 viewVec = Vector3(0, 0, 0) - EyePosition;
+	Vector3 upVec = Vector3(0, 1, 0);
+	Vector3 rightVec = cross(upVec, viewVec);
+	upVec = normalize(cross(viewVec, rightVec));
+
+	BuildLookAtMatrix(EyePosition.x, EyePosition.y, EyePosition.z, 0, 0, 0, upVec.x, upVec.y, upVec.z, view);
+	BuildPerspectiveMatrix(60.0f, float(width) / float(height), 1.0f, 1000.0f, projection);
+}
+
+/**
+ * The passes of Display(): plane, cube, then the cube flattened by the shadow matrix. The shadow darkens
+ * the plane by half instead of the opaque black of the effect and is drawn without culling, as needed for
+ * casters that are not closed. The flattened front and back faces then overlap, with useStencil false those
+ * pixels get darkened more than once and show up in the stencil buffer as counts above 1.
+ */
+void RenderShadowScene(SoftwareRasterizer& rasterizer, const RasterTexture& planeTexture, const RasterTexture& cubeTexture,
+					   float lightAngle, bool useStencil, bool multithreaded)
+{
+	Matrix4f view, projection;
+	BuildSceneViewProjection(rasterizer.GetWidth(), rasterizer.GetHeight(), view, projection);
+
+	const Vector3 lightPos = LightPosition(lightAngle);
+	rasterizer.SetViewProjection(view, projection);
+	rasterizer.SetLight(lightPos, Vector3::Ones);
+	rasterizer.Clear(Vector3(0.1f, 0.1f, 0.1f), 1.0f, 0);
+
+	RasterState planeState;
+	planeState.DiffuseMap = &planeTexture;
+	rasterizer.DrawIndexed(PlaneVertices, PlaneIndices, NumPlaneIndices, planeState);
+
+	RasterState cubeState;
+	BuildCubeWorldMatrix(cubeState.World);
+	cubeState.DiffuseMap = &cubeTexture;
+	rasterizer.DrawIndexed(CubeVertices, CubeIndices, NumCubeIndices, cubeState);
+
+	Matrix4f shadowMatrix;
+	MakePlanarShadowMatrix(0, 1, 0, 0, lightPos.x, lightPos.y, lightPos.z, shadowMatrix);
+
+	RasterState shadowState;
+	shadowState.World = shadowMatrix * cubeState.World;
+	shadowState.Shadow = true;
+	shadowState.ShadowAttenuation = 0.5f;
+	shadowState.DepthBias = -1e-5f;
+	shadowState.CullBackFace = false;
+	shadowState.StencilFunction = useStencil ? StencilFunc_Equal : StencilFunc_Always;
+	shadowState.StencilRef = 0;
+	shadowState.StencilPass = StencilOp_Increment;
+	rasterizer.DrawIndexed(CubeVertices, CubeIndices, NumCubeIndices, shadowState);
+
+	rasterizer.Flush(multithreaded);
+}
+
+// Ray against an axis aligned box, hit within [0, maxT]
+bool RayHitsBox(const Vector3& origin, const Vector3& dir, const Vector3& boxMin, const Vector3& boxMax, float maxT)
+{
+	float tMin = 0, tMax = maxT;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (dir[i] == 0)
+		{
+			if (origin[i] < boxMin[i] || origin[i] > boxMax[i])
+				return false;
+			continue;
+		}
+
+		float t0 = (boxMin[i] - origin[i]) / dir[i];
+		float t1 = (boxMax[i] - origin[i]) / dir[i];
+		if (t0 > t1)
+			std::swap(t0, t1);
+		tMin = std::max(tMin, t0);
+		tMax = std::min(tMax, t1);
+		if (tMin > tMax)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Checks the rendered shadow against ray casting. Every pixel that sees the ground plane is tested for a
+ * segment from its plane point to the light hitting the cube, which is what the shadow matrix should have
+ * produced in the stencil buffer. Pixels within Margin of the cube silhouette or its shadow edge are skipped.
+ * Returns the number of pixels that disagree.
+ */
+int VerifyShadow(const SoftwareRasterizer& rasterizer, float lightAngle, int& numTested)
+{
+	const float Margin = 0.3f;
+
+	Matrix4f view, projection, invViewProj;
+	BuildSceneViewProjection(rasterizer.GetWidth(), rasterizer.GetHeight(), view, projection);
+	InvertMatrix(projection * view, invViewProj);
+
+	const Vector3 lightPos = LightPosition(lightAngle);
+	const Vector3 boxMin(-5, 0, -5), boxMax(5, 10, 5);
+	const Vector3 margin(Margin, Margin, Margin);
+
+	const std::vector<unsigned char>& stencil = rasterizer.GetStencilBuffer();
+
+	int mismatches = 0;
+	numTested = 0;
+
+	for (int y = 0; y < rasterizer.GetHeight(); ++y)
+	{
+		for (int x = 0; x < rasterizer.GetWidth(); ++x)
+		{
+			const float ndcX = (x + 0.5f) / rasterizer.GetWidth() * 2 - 1;
+			const float ndcY = 1 - (y + 0.5f) / rasterizer.GetHeight() * 2;
+
+			const Vector3 nearPoint = invViewProj.TransformPoint(Vector3(ndcX, ndcY, -1));
+			const Vector3 farPoint = invViewProj.TransformPoint(Vector3(ndcX, ndcY, 1));
+			const Vector3 dir = farPoint - nearPoint;
+			if (dir.y >= 0)
+				continue;
+
+			const float t = -nearPoint.y / dir.y;
+			const Vector3 planePoint = nearPoint + dir * t;
+			if (fabsf(planePoint.x) > 50 - Margin || fabsf(planePoint.z) > 50 - Margin)
+				continue;
+
+			// Cube in front of the plane, or close to its silhouette
+			if (RayHitsBox(nearPoint, dir, boxMin - margin, boxMax + margin, t))
+				continue;
+
+			const Vector3 toLight = lightPos - planePoint;
+			const bool surelyShadowed = RayHitsBox(planePoint, toLight, boxMin + margin, boxMax - margin, 1.0f);
+			const bool maybeShadowed = RayHitsBox(planePoint, toLight, boxMin - margin, boxMax + margin, 1.0f);
+			if (surelyShadowed != maybeShadowed)
+				continue;
+
+			numTested++;
+			if ((stencil[y * rasterizer.GetWidth() + x] != 0) != surelyShadowed)
+				mismatches++;
+		}
+	}
+
+	return mismatches;
+}
+
+void BenchmarkSoftwareRasterizer()
+{
+	const int Width = 1280, Height = 720;
+	const int NumFrames = 200;
+
+	RasterTexture planeTexture, cubeTexture;
+	planeTexture.CreateChecker(256, 16, Vector3(0.2f, 0.6f, 0.2f), Vector3(0.3f, 0.8f, 0.3f));
+	cubeTexture.CreateChecker(128, 4, Vector3(0.6f, 0.8f, 1.0f), Vector3(0.3f, 0.5f, 0.9f));
+
+	SoftwareRasterizer rasterizer(Width, Height);
+
+	// Correctness at a few light angles: ray cast check, stencil against double darkening, same image
+	// single and multithreaded
+	int mismatches = 0, tested = 0, overlapping = 0, nondeterministic = 0;
+	for (int i = 0; i < 8; ++i)
+	{
+		const float angle = i * 2 * PI / 8;
+
+		RenderShadowScene(rasterizer, planeTexture, cubeTexture, angle, false, true);
+		for (size_t p = 0; p < rasterizer.GetStencilBuffer().size(); ++p)
+			overlapping += rasterizer.GetStencilBuffer()[p] > 1;
+
+		RenderShadowScene(rasterizer, planeTexture, cubeTexture, angle, true, false);
+		const unsigned int singleThreaded = rasterizer.Checksum();
+
+		RenderShadowScene(rasterizer, planeTexture, cubeTexture, angle, true, true);
+		nondeterministic += rasterizer.Checksum() != singleThreaded;
+
+		int numTested;
+		mismatches += VerifyShadow(rasterizer, angle, numTested);
+		tested += numTested;
+
+		char fileName[64];
+		sprintf(fileName, "PlanarShadow%d.tga", i);
+		rasterizer.SaveTGA(fileName);
+		printf("SoftwareRasterizer light angle %d/8: checksum %08x, written to %s\n", i, rasterizer.Checksum(), fileName);
+	}
+
+	printf("SoftwareRasterizer %dx%d: %d of %d shadow pixels disagree with ray casting, %d pixels darkened twice without stencil, %d frames differ between thread counts\n",
+		Width, Height, mismatches, tested, overlapping, nondeterministic);
+
+	// Throughput with the light moving as in LightMove()
+	double singleTime = 0, multiTime = 0;
+	for (int frame = 0; frame < NumFrames; ++frame)
+	{
+		double start = Now();
+		RenderShadowScene(rasterizer, planeTexture, cubeTexture, frame * 0.01f, true, false);
+		singleTime += Now() - start;
+
+		start = Now();
+		RenderShadowScene(rasterizer, planeTexture, cubeTexture, frame * 0.01f, true, true);
+		multiTime += Now() - start;
+	}
+
+	const double pixels = double(Width) * Height * NumFrames;
+	printf("SoftwareRasterizer %dx%d: 1 thread %.2f ms/frame (%.1f MPixels/s), tiles in parallel %.2f ms/frame (%.1f MPixels/s)\n",
+		Width, Height, singleTime * 1000.0 / NumFrames, pixels / singleTime * 1e-6, multiTime * 1000.0 / NumFrames, pixels / multiTime * 1e-6);
+}
+
+Vector3 RingLightPosition(int light, int numLights)
+{
+	return LightPosition(light * 2 * PI / numLights);
+}
+
+/**
+ * Plane and cube, then the shadows of numLights lights on the ground. Without merging it is one stencil
+ * tested pass per light, each pixel darkened at most once. With merging the projector's pieces are drawn
+ * in a single pass with the stencil test off, the stencil only counts how often each pixel got drawn.
+ */
+void RenderMultiLightScene(SoftwareRasterizer& rasterizer, const RasterTexture& planeTexture, const RasterTexture& cubeTexture,
+						   PlanarShadowProjector& projector, bool merged)
+{
+	Matrix4f view, projection;
+	BuildSceneViewProjection(rasterizer.GetWidth(), rasterizer.GetHeight(), view, projection);
+
+	rasterizer.SetViewProjection(view, projection);
+	rasterizer.SetLight(RingLightPosition(0, projector.GetNumLights()), Vector3::Ones);
+	rasterizer.Clear(Vector3(0.1f, 0.1f, 0.1f), 1.0f, 0);
+
+	RasterState planeState;
+	planeState.DiffuseMap = &planeTexture;
+	rasterizer.DrawIndexed(PlaneVertices, PlaneIndices, NumPlaneIndices, planeState);
+
+	RasterState cubeState;
+	BuildCubeWorldMatrix(cubeState.World);
+	cubeState.DiffuseMap = &cubeTexture;
+	rasterizer.DrawIndexed(CubeVertices, CubeIndices, NumCubeIndices, cubeState);
+
+	RasterState shadowState;
+	shadowState.Shadow = true;
+	shadowState.ShadowAttenuation = 0.5f;
+	shadowState.DepthBias = -1e-5f;
+	shadowState.CullBackFace = false;
+	shadowState.StencilPass = StencilOp_Increment;
+
+	if (merged)
+	{
+		Vector3 casterPoints[NumCubeVertices];
+		for (int i = 0; i < NumCubeVertices; ++i)
+			casterPoints[i] = cubeState.World.TransformPoint(CubeVertices[i].Positon);
+		projector.Project(casterPoints, NumCubeVertices);
+
+		const std::vector<Vector3>& triangles = projector.GetShadowTriangles(0);
+		std::vector<SimpleVertex> vertices(triangles.size());
+		for (size_t i = 0; i < triangles.size(); ++i)
+		{
+			vertices[i].Positon = triangles[i];
+			vertices[i].Normal = Vector3::UnitY;
+			vertices[i].Tex = Vector2::Zero;
+		}
+
+		shadowState.StencilFunction = StencilFunc_Always;
+		if (!vertices.empty())
+			rasterizer.Draw(&vertices[0], int(vertices.size()), shadowState);
+	}
+	else
+	{
+		shadowState.StencilFunction = StencilFunc_Equal;
+		shadowState.StencilRef = 0;
+		for (int light = 0; light < projector.GetNumLights(); ++light)
+		{
+			Matrix4f shadowMatrix;
+			const Vector3 lightPos = RingLightPosition(light, projector.GetNumLights());
+			MakePlanarShadowMatrix(0, 1, 0, 0, lightPos.x, lightPos.y, lightPos.z, shadowMatrix);
+
+			shadowState.World = shadowMatrix * cubeState.World;
+			rasterizer.DrawIndexed(CubeVertices, CubeIndices, NumCubeIndices, shadowState);
+		}
+	}
+
+	rasterizer.Flush(true);
+}
+
+/**
+ * Shadows of 1 to 64 lights: batched shadow matrices against the per pair function, then one stencil pass
+ * per light against the merged single pass. The merged pieces must cover what the stencil passes cover and
+ * no pixel may be drawn twice. Pixels on the shadow outline may still differ, the merged polygons are cut
+ * at other vertices than the projected cube triangles and snap differently.
+ */
+void BenchmarkMultiLightShadows()
+{
+	const int Width = 1280, Height = 720;
+	const int NumFrames = 20;
+	const int NumMatrixIterations = 2000;
+
+	// Ground and the four sides of a room, for the matrix check
+	const Vector3 planeNormals[] = { Vector3(0, 1, 0), Vector3(1, 0, 0), Vector3(-1, 0, 0), Vector3(0, 0, 1), Vector3(0, 0, -1) };
+	const float planeDists[] = { 0, 50, 50, 50, 50 };
+	const int NumPlanes = sizeof(planeDists) / sizeof(planeDists[0]);
+
+	RasterTexture planeTexture, cubeTexture;
+	planeTexture.CreateChecker(256, 16, Vector3(0.2f, 0.6f, 0.2f), Vector3(0.3f, 0.8f, 0.3f));
+	cubeTexture.CreateChecker(128, 4, Vector3(0.6f, 0.8f, 1.0f), Vector3(0.3f, 0.5f, 0.9f));
+
+	SoftwareRasterizer rasterizer(Width, Height);
+	std::vector<unsigned char> stencilPasses;
+
+	for (int numLights = 1; numLights <= 64; numLights *= 2)
+	{
+		std::vector<Vector3> lights(numLights);
+		for (int i = 0; i < numLights; ++i)
+			lights[i] = RingLightPosition(i, numLights);
+
+		// Matrices
+		std::vector<Matrix4f> reference(NumPlanes * numLights), batched(NumPlanes * numLights);
+
+		double start = Now();
+		for (int iteration = 0; iteration < NumMatrixIterations; ++iteration)
+		{
+			for (int plane = 0; plane < NumPlanes; ++plane)
+			{
+				for (int light = 0; light < numLights; ++light)
+				{
+					const Vector3& n = planeNormals[plane];
+					MakePlanarShadowMatrix(n.x, n.y, n.z, planeDists[plane], lights[light].x, lights[light].y, lights[light].z,
+						reference[plane * numLights + light]);
+				}
+			}
+		}
+		const double scalarTime = Now() - start;
+
+		start = Now();
+		for (int iteration = 0; iteration < NumMatrixIterations; ++iteration)
+			MakePlanarShadowMatrices(&lights[0], numLights, planeNormals, planeDists, NumPlanes, &batched[0]);
+		const double batchedTime = Now() - start;
+
+		int matrixMismatches = 0;
+		for (size_t i = 0; i < reference.size(); ++i)
+			for (int j = 0; j < 16; ++j)
+				matrixMismatches += reference[i].m[j / 4][j % 4] != batched[i].m[j / 4][j % 4];
+
+		// Shadows on the ground
+		PlanarShadowProjector projector;
+		projector.SetReceivers(planeNormals, planeDists, 1);
+		projector.SetLights(&lights[0], numLights);
+
+		RenderMultiLightScene(rasterizer, planeTexture, cubeTexture, projector, false);
+		stencilPasses = rasterizer.GetStencilBuffer();
+
+		RenderMultiLightScene(rasterizer, planeTexture, cubeTexture, projector, true);
+		const std::vector<unsigned char>& merged = rasterizer.GetStencilBuffer();
+
+		int coverageMismatches = 0, drawnTwice = 0, covered = 0;
+		for (size_t p = 0; p < merged.size(); ++p)
+		{
+			covered += stencilPasses[p] != 0;
+			coverageMismatches += (stencilPasses[p] != 0) != (merged[p] != 0);
+			drawnTwice += merged[p] > 1;
+		}
+
+		char fileName[64];
+		sprintf(fileName, "PlanarShadowLights%d.tga", numLights);
+		rasterizer.SaveTGA(fileName);
+
+		// Timing, the merged frame includes projecting and merging
+		Vector3 casterPoints[NumCubeVertices];
+		Matrix4f cubeWorld;
+		BuildCubeWorldMatrix(cubeWorld);
+		for (int i = 0; i < NumCubeVertices; ++i)
+			casterPoints[i] = cubeWorld.TransformPoint(CubeVertices[i].Positon);
+
+		start = Now();
+		for (int frame = 0; frame < NumFrames; ++frame)
+			projector.Project(casterPoints, NumCubeVertices);
+		const double projectTime = Now() - start;
+
+		start = Now();
+		for (int frame = 0; frame < NumFrames; ++frame)
+			RenderMultiLightScene(rasterizer, planeTexture, cubeTexture, projector, false);
+		const double passesTime = Now() - start;
+
+		start = Now();
+		for (int frame = 0; frame < NumFrames; ++frame)
+			RenderMultiLightScene(rasterizer, planeTexture, cubeTexture, projector, true);
+		const double mergedTime = Now() - start;
+
+		printf("Shadows of %2d lights: matrices %.3f us scalar, %.3f us batched, %d mismatches; project and merge %.3f ms, %d pieces; "
+			"%d shadow pixels, %d differ, %d drawn twice; frame %.2f ms with %d stencil passes, %.2f ms merged\n",
+			numLights, scalarTime * 1e6 / NumMatrixIterations, batchedTime * 1e6 / NumMatrixIterations, matrixMismatches,
+			projectTime * 1000.0 / NumFrames, projector.GetNumPieces(0), covered, coverageMismatches, drawnTwice,
+			passesTime * 1000.0 / NumFrames, numLights, mergedTime * 1000.0 / NumFrames);
+	}
+}
+}
+
+void RunBenchmarks()
+{
+	srand(1);
+	BenchmarkMatrices();
+	BenchmarkTransformPoints();
+	BenchmarkSoftwareRasterizer();
+	BenchmarkMultiLightShadows();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+/**
+ * CPU benchmarks of the math code, the software rasterizer and the planar shadows, printed to stdout.
+ * Run with PlanarShadow.exe -benchmark.
+ */
+void RunBenchmarks();
@@ -1,10 +1,13 @@
 #include <iostream>
+#include <cstring>
 #include <gl/glew.h>
 #include <gl/glut.h>
 #include <Cg/cg.h>
 #include <Cg/cgGL.h>
 #include <nvImage.h>
 #include "Math.h"
+#include "Benchmark.h"
+#include "SceneGeometry.h"
 
 using namespace std;
 
@@ -45,13 +48,6 @@ Vector3 myLightColor(1.0f, 1.0f, 1.0f);
 Vector3 myPlaneNormal;
 float myPlaneDist;
 
-struct SimpleVertex
-{
-	Vector3 Positon;
-	Vector3 Normal;
-	Vector2 Tex;
-};
-
 
 void Reshape(int width, int height);
 void Display(void);
@@ -92,6 +88,11 @@ void UseSamplerParameter(CGeffect effect, const char *paramName, GLuint texobj)
 
 int main(int argc, char **argv)
 {
+	if (argc > 1 && strcmp(argv[1], "-benchmark") == 0) {
+		RunBenchmarks();
+		return 0;
+	}
+
 	glutInitWindowSize(640, 480);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
 	glutInit(&argc, argv);
@@ -194,72 +195,12 @@ void InitContent( void )
 	glGenBuffers(1, &myCubeVBO);
 	glBindBuffer(GL_ARRAY_BUFFER, myCubeVBO);
 
-	SimpleVertex vertices[] = 
-	{
-		// Top
-		{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 0.0f ) },
-		{ Vector3(  1.0f,  1.0f, -1.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 0.0f ) },
-		{ Vector3(  1.0f,  1.0f,  1.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 1.0f ) },
-		{ Vector3( -1.0f,  1.0f,  1.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 1.0f ) },
-
-		// Botton
-		{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(0, -1, 0), Vector2( 0.0f, 0.0f ) },
-		{ Vector3(  1.0f, -1.0f, -1.0f ), Vector3(0, -1, 0), Vector2( 1.0f, 0.0f ) },
-		{ Vector3(  1.0f, -1.0f,  1.0f ), Vector3(0, -1, 0), Vector2( 1.0f, 1.0f ) },
-		{ Vector3( -1.0f, -1.0f,  1.0f ), Vector3(0, -1, 0), Vector2( 0.0f, 1.0f ) },
-
-		// Left
-		{ Vector3( -1.0f, -1.0f,  1.0f ), Vector3(-1, 0, 0), Vector2( 1.0f, 0.0f ) },
-		{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(-1, 0, 0), Vector2( 0.0f, 0.0f ) },
-		{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(-1, 0, 0), Vector2( 0.0f, 1.0f ) },
-		{ Vector3( -1.0f,  1.0f,  1.0f ), Vector3(-1, 0, 0), Vector2( 1.0f, 1.0f ) },
-
-		// Right
-		{ Vector3( 1.0f, -1.0f,  1.0f ), Vector3(1, 0, 0), Vector2( 0.0f, 0.0f ) },
-		{ Vector3( 1.0f, -1.0f, -1.0f ), Vector3(1, 0, 0), Vector2( 1.0f, 0.0f ) },
-		{ Vector3( 1.0f,  1.0f, -1.0f ), Vector3(1, 0, 0), Vector2( 1.0f, 1.0f ) },
-		{ Vector3( 1.0f,  1.0f,  1.0f ), Vector3(1, 0, 0), Vector2( 0.0f, 1.0f ) },
-
-		// Back
-		{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 1.0f, 0.0f ) },
-		{ Vector3(  1.0f, -1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 0.0f, 0.0f ) },
-		{ Vector3(  1.0f,  1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 0.0f, 1.0f ) },
-		{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 1.0f, 1.0f ) },
-
-		// Front 
-		{ Vector3( -1.0f, -1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 0.0f, 0.0f ) },
-		{ Vector3(  1.0f, -1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 1.0f, 0.0f ) },
-		{ Vector3(  1.0f,  1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 1.0f, 1.0f ) },
-		{ Vector3( -1.0f,  1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 0.0f, 1.0f ) },
-
-	};
-
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(CubeVertices), CubeVertices, GL_STATIC_DRAW);
 
 	glGenBuffers(1, &myCubeIBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, myCubeIBO);
 
-	GLubyte indices[] =
-	{
-		3,1,0,
-		2,1,3,
-
-		6,4,5,
-		7,4,6,
-
-		11,9,8,
-		10,9,11,
-
-		14,12,13,
-		15,12,14,
-
-		19,17,16,
-		18,17,19,
-
-		22,20,21,
-		23,20,22
-	};
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CubeIndices), CubeIndices, GL_STATIC_DRAW);
 
 
 
@@ -327,7 +268,7 @@ void DrawCubeModel(const Matrix4f& World)
 		glNormalPointer(GL_FLOAT, sizeof(SimpleVertex), BUFFER_OFFSET(sizeof(Vector3)));
 		glTexCoordPointer(2, GL_FLOAT, sizeof(SimpleVertex), BUFFER_OFFSET(sizeof(Vector3)*2));
 		
-		glDrawElements(GL_TRIANGLES, 6 * 2 * 3, GL_UNSIGNED_BYTE, 0);
+		glDrawElements(GL_TRIANGLES, NumCubeIndices, GL_UNSIGNED_BYTE, 0);
 
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -387,17 +328,10 @@ void Display( void )
 		glBegin(GL_QUADS);
 		glNormal3f(0, 1, 0);
 
-		glTexCoord2f(0, 1);
-		glVertex3f(-50, 0.0f, -50);
-
-		glTexCoord2f(0, 0);
-		glVertex3f(-50, 0.0f, 50);
-
-		glTexCoord2f(1, 0);
-		glVertex3f(50, 0.0f, 50);
-
-		glTexCoord2f(1, 1);
-		glVertex3f(50, 0.0f, -50);
+		for (int i = 0; i < NumPlaneVertices; ++i) {
+			glTexCoord2f(PlaneVertices[i].Tex.x, PlaneVertices[i].Tex.y);
+			glVertex3f(PlaneVertices[i].Positon.x, PlaneVertices[i].Positon.y, PlaneVertices[i].Positon.z);
+		}
 		glEnd();
 
 		cgResetPassState(pass);
@@ -409,10 +343,8 @@ void Display( void )
 	cgGLSetTextureParameter(myCgParam_DiffuseMap, myCubeTex);
 	cgSetSamplerState(myCgParam_DiffuseMap);
 
-	Matrix4f scale, translate, world;
-	MakeTranslateMatrix(0, 5, 0, translate);
-	MakeScaleMatrix(5, 5, 5, scale);
-	world = translate * scale;
+	Matrix4f world;
+	BuildCubeWorldMatrix(world);
 	DrawCubeModel(world);
 
 	cgSetParameter1i(myCgParam_Shadow, 1);
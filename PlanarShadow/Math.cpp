@@ -1,6 +1,9 @@
 #include "Math.h"
 #include <iostream>
 
+// _mm_shuffle_ps lanes in memory order: x, y from a, z, w from b
+#define SHUFFLE_MASK(x, y, z, w) ((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+
 const Vector2 Vector2::Zero = Vector2( 0, 0 );
 const Vector2 Vector2::Ones = Vector2( 1, 1 );
 const Vector2 Vector2::UnitX = Vector2( 1, 0 );
@@ -177,6 +180,58 @@ void MakePlanarShadowMatrix( float planeNormalX, float planeNormalY, float plane
 
 }
 
+void MakePlanarShadowMatrices( const Vector3* lights, int numLights, const Vector3* planeNormals, const float* planeDists, 
+							  int numPlanes, Matrix4f* shadowMatrices )
+{
+	for (int light = 0; light < numLights; light += 4)
+	{
+		// Lights across the lanes, the last one repeated to fill the register
+		float x[4], y[4], z[4];
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			const Vector3& l = lights[std::min(light + lane, numLights - 1)];
+			x[lane] = l.x;
+			y[lane] = l.y;
+			z[lane] = l.z;
+		}
+
+		const __m128 lightX = _mm_loadu_ps(x), lightY = _mm_loadu_ps(y), lightZ = _mm_loadu_ps(z);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 negLightX = _mm_sub_ps(zero, lightX), negLightY = _mm_sub_ps(zero, lightY), negLightZ = _mm_sub_ps(zero, lightZ);
+
+		const int numValid = std::min(numLights - light, 4);
+
+		for (int plane = 0; plane < numPlanes; ++plane)
+		{
+			const __m128 nx = _mm_set1_ps(planeNormals[plane].x);
+			const __m128 ny = _mm_set1_ps(planeNormals[plane].y);
+			const __m128 nz = _mm_set1_ps(planeNormals[plane].z);
+			const __m128 d = _mm_set1_ps(planeDists[plane]);
+
+			// Same operations and order as MakePlanarShadowMatrix, the results match it exactly
+			const __m128 nDotl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, lightX), _mm_mul_ps(ny, lightY)), _mm_mul_ps(nz, lightZ));
+			const __m128 diagonal = _mm_add_ps(nDotl, d);
+
+			__m128 rows[4][4] = 
+			{
+				{ _mm_sub_ps(diagonal, _mm_mul_ps(nx, lightX)), _mm_mul_ps(negLightX, ny), _mm_mul_ps(negLightX, nz), _mm_mul_ps(negLightX, d) },
+				{ _mm_mul_ps(negLightY, nx), _mm_sub_ps(diagonal, _mm_mul_ps(lightY, ny)), _mm_mul_ps(negLightY, nz), _mm_mul_ps(negLightY, d) },
+				{ _mm_mul_ps(negLightZ, nx), _mm_mul_ps(negLightZ, ny), _mm_sub_ps(diagonal, _mm_mul_ps(lightZ, nz)), _mm_mul_ps(negLightZ, d) },
+				{ _mm_sub_ps(zero, nx), _mm_sub_ps(zero, ny), _mm_sub_ps(zero, nz), nDotl }
+			};
+
+			Matrix4f* matrices = shadowMatrices + plane * numLights + light;
+			for (int row = 0; row < 4; ++row)
+			{
+				// Entries of one row for four lights to that row of four matrices
+				_MM_TRANSPOSE4_PS(rows[row][0], rows[row][1], rows[row][2], rows[row][3]);
+				for (int lane = 0; lane < numValid; ++lane)
+					_mm_storeu_ps(matrices[lane].m[row], rows[row][lane]);
+			}
+		}
+	}
+}
+
 void MakeScaleMatrix( float sX, float sY, float sZ, Matrix4f& matrix )
 {
 	matrix.m[0][0] = sX;
@@ -199,3 +254,188 @@ void MakeScaleMatrix( float sX, float sY, float sZ, Matrix4f& matrix )
 	matrix.m[3][2] = 0;
 	matrix.m[3][3] = 1;
 }
+
+namespace {
+
+// 2x2 matrices packed row major in one register: a * b
+inline __m128 Mat2Mul(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, SHUFFLE_MASK(0, 3, 0, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_MASK(1, 0, 3, 2)), _mm_shuffle_ps(b, b, SHUFFLE_MASK(2, 1, 2, 1))));
+}
+
+// adjugate(a) * b
+inline __m128 Mat2AdjMul(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_MASK(3, 3, 0, 0)), b),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_MASK(1, 1, 2, 2)), _mm_shuffle_ps(b, b, SHUFFLE_MASK(2, 3, 0, 1))));
+}
+
+// a * adjugate(b)
+inline __m128 Mat2MulAdj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, SHUFFLE_MASK(3, 0, 3, 0))),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, SHUFFLE_MASK(1, 0, 3, 2)), _mm_shuffle_ps(b, b, SHUFFLE_MASK(2, 1, 2, 1))));
+}
+
+inline __m128 Splat(__m128 v, int lane)
+{
+	switch (lane)
+	{
+	case 0: return _mm_shuffle_ps(v, v, SHUFFLE_MASK(0, 0, 0, 0));
+	case 1: return _mm_shuffle_ps(v, v, SHUFFLE_MASK(1, 1, 1, 1));
+	case 2: return _mm_shuffle_ps(v, v, SHUFFLE_MASK(2, 2, 2, 2));
+	default: return _mm_shuffle_ps(v, v, SHUFFLE_MASK(3, 3, 3, 3));
+	}
+}
+
+}
+
+/**
+ * Block inverse on the four 2x2 sub matrices
+ *
+ *     M = | A B |     M^-1 = 1/|M| | X Y |
+ *         | C D |                  | Z W |
+ *
+ * with |M| = |A||D| + |B||C| - tr(A#B D#C), where # is the adjugate. Each 2x2 block is one register.
+ */
+bool InvertMatrix( const Matrix4f& matrix, Matrix4f& result )
+{
+	const __m128 r0 = _mm_loadu_ps(matrix.m[0]);
+	const __m128 r1 = _mm_loadu_ps(matrix.m[1]);
+	const __m128 r2 = _mm_loadu_ps(matrix.m[2]);
+	const __m128 r3 = _mm_loadu_ps(matrix.m[3]);
+
+	const __m128 A = _mm_movelh_ps(r0, r1);
+	const __m128 B = _mm_movehl_ps(r1, r0);
+	const __m128 C = _mm_movelh_ps(r2, r3);
+	const __m128 D = _mm_movehl_ps(r3, r2);
+
+	// (|A|, |B|, |C|, |D|)
+	const __m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, SHUFFLE_MASK(0, 2, 0, 2)), _mm_shuffle_ps(r1, r3, SHUFFLE_MASK(1, 3, 1, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, SHUFFLE_MASK(1, 3, 1, 3)), _mm_shuffle_ps(r1, r3, SHUFFLE_MASK(0, 2, 0, 2))));
+	const __m128 detA = Splat(detSub, 0);
+	const __m128 detB = Splat(detSub, 1);
+	const __m128 detC = Splat(detSub, 2);
+	const __m128 detD = Splat(detSub, 3);
+
+	const __m128 D_C = Mat2AdjMul(D, C);
+	const __m128 A_B = Mat2AdjMul(A, B);
+
+	// Adjugates of the result blocks
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, D_C));
+
+	// tr(A#B D#C), horizontal sum without SSE3
+	__m128 tr = _mm_mul_ps(A_B, _mm_shuffle_ps(D_C, D_C, SHUFFLE_MASK(0, 2, 1, 3)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, SHUFFLE_MASK(2, 3, 0, 1)));
+	tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, SHUFFLE_MASK(1, 0, 3, 2)));
+
+	const __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+	if (_mm_cvtss_f32(detM) == 0.0f)
+		return false;
+
+	// Signs of the adjugate folded into the scale
+	const __m128 rDetM = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+	X_ = _mm_mul_ps(X_, rDetM);
+	Y_ = _mm_mul_ps(Y_, rDetM);
+	Z_ = _mm_mul_ps(Z_, rDetM);
+	W_ = _mm_mul_ps(W_, rDetM);
+
+	// Adjugate swizzle and block layout in one shuffle per row
+	_mm_storeu_ps(result.m[0], _mm_shuffle_ps(X_, Y_, SHUFFLE_MASK(3, 1, 3, 1)));
+	_mm_storeu_ps(result.m[1], _mm_shuffle_ps(X_, Y_, SHUFFLE_MASK(2, 0, 2, 0)));
+	_mm_storeu_ps(result.m[2], _mm_shuffle_ps(Z_, W_, SHUFFLE_MASK(3, 1, 3, 1)));
+	_mm_storeu_ps(result.m[3], _mm_shuffle_ps(Z_, W_, SHUFFLE_MASK(2, 0, 2, 0)));
+
+	return true;
+}
+
+namespace {
+
+// Four packed Vector3 (12 floats) to x, y, z registers
+inline void LoadPoints4(const Vector3* in, __m128& x, __m128& y, __m128& z)
+{
+	const float* p = &in[0].x;
+	const __m128 v0 = _mm_loadu_ps(p);      // x0 y0 z0 x1
+	const __m128 v1 = _mm_loadu_ps(p + 4);  // y1 z1 x2 y2
+	const __m128 v2 = _mm_loadu_ps(p + 8);  // z2 x3 y3 z3
+
+	x = _mm_shuffle_ps(v0, _mm_shuffle_ps(v1, v2, SHUFFLE_MASK(2, 2, 1, 1)), SHUFFLE_MASK(0, 3, 0, 2));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, SHUFFLE_MASK(1, 1, 0, 0)), _mm_shuffle_ps(v1, v2, SHUFFLE_MASK(3, 3, 2, 2)), SHUFFLE_MASK(0, 2, 0, 2));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(v0, v1, SHUFFLE_MASK(2, 2, 1, 1)), v2, SHUFFLE_MASK(0, 2, 0, 3));
+}
+
+inline void StorePoints4(__m128 x, __m128 y, __m128 z, Vector3* out)
+{
+	float* p = &out[0].x;
+	_mm_storeu_ps(p, _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, SHUFFLE_MASK(0, 0, 1, 1)), SHUFFLE_MASK(0, 1, 0, 2)));
+	_mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, SHUFFLE_MASK(1, 1, 1, 1)), _mm_shuffle_ps(x, y, SHUFFLE_MASK(2, 2, 2, 2)), SHUFFLE_MASK(0, 2, 0, 2)));
+	_mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, SHUFFLE_MASK(2, 2, 3, 3)), _mm_shuffle_ps(y, z, SHUFFLE_MASK(3, 3, 3, 3)), SHUFFLE_MASK(0, 2, 0, 2)));
+}
+
+}
+
+void Matrix4f::TransformPoints( const Vector3* in, Vector3* out, size_t count ) const
+{
+	size_t i = 0;
+
+#ifdef __AVX__
+	__m256 c[4][4];
+	for (int row = 0; row < 4; ++row)
+		for (int col = 0; col < 4; ++col)
+			c[row][col] = _mm256_set1_ps(m[row][col]);
+
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128 x0, y0, z0, x1, y1, z1;
+		LoadPoints4(in + i, x0, y0, z0);
+		LoadPoints4(in + i + 4, x1, y1, z1);
+
+		const __m256 x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+		const __m256 y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+		const __m256 z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+
+		__m256 result[4];
+		for (int row = 0; row < 4; ++row)
+		{
+			result[row] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c[row][0], x), _mm256_mul_ps(c[row][1], y)),
+				_mm256_mul_ps(c[row][2], z)), c[row][3]);
+		}
+
+		const __m256 invW = _mm256_div_ps(_mm256_set1_ps(1.0f), result[3]);
+		for (int row = 0; row < 3; ++row)
+			result[row] = _mm256_mul_ps(result[row], invW);
+
+		StorePoints4(_mm256_castps256_ps128(result[0]), _mm256_castps256_ps128(result[1]), _mm256_castps256_ps128(result[2]), out + i);
+		StorePoints4(_mm256_extractf128_ps(result[0], 1), _mm256_extractf128_ps(result[1], 1), _mm256_extractf128_ps(result[2], 1), out + i + 4);
+	}
+#endif
+
+	__m128 c4[4][4];
+	for (int row = 0; row < 4; ++row)
+		for (int col = 0; col < 4; ++col)
+			c4[row][col] = _mm_set1_ps(m[row][col]);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x, y, z;
+		LoadPoints4(in + i, x, y, z);
+
+		__m128 result[4];
+		for (int row = 0; row < 4; ++row)
+		{
+			result[row] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c4[row][0], x), _mm_mul_ps(c4[row][1], y)),
+				_mm_mul_ps(c4[row][2], z)), c4[row][3]);
+		}
+
+		const __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), result[3]);
+		StorePoints4(_mm_mul_ps(result[0], invW), _mm_mul_ps(result[1], invW), _mm_mul_ps(result[2], invW), out + i);
+	}
+
+	for (; i < count; ++i)
+		out[i] = TransformPoint(in[i]);
+}
@@ -2,6 +2,12 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <iosfwd>
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 
 const float PI = 3.1415926f;
@@ -21,6 +27,20 @@ void BuildLookAtMatrix(float eyex, float eyey, float eyez, float centerx, float
 void MakePlanarShadowMatrix(float planeNormalX,  float planeNormalY, float planeNormalZ, float planeDist, 
 	float lightX, float lightY, float lightZ, Matrix4f& shadowMatrix);
 
+/**
+ * MakePlanarShadowMatrix for every pair of numLights lights and numPlanes planes (normal, dist), four lights
+ * per SSE register. shadowMatrices[plane * numLights + light] receives the matrix of that pair.
+ */
+void MakePlanarShadowMatrices(const Vector3* lights, int numLights, const Vector3* planeNormals, const float* planeDists,
+	int numPlanes, Matrix4f* shadowMatrices);
+
+void TransposeMatrix(const Matrix4f& matrix, Matrix4f& result);
+
+/**
+ * Returns false and leaves result untouched when the matrix is singular.
+ */
+bool InvertMatrix(const Matrix4f& matrix, Matrix4f& result);
+
 
 
 /**
@@ -423,20 +443,75 @@ public:
 		m[3][0] = 0.0f; m[3][1] = 0.0f; m[3][2] = 0.0f; m[3][3] = 1.0f;
 	}
 
+	/**
+	 * Row i of the product is the rows of Right weighted by row i of this matrix, one SIMD register per row.
+	 * With AVX two rows go through one register.
+	 */
 	inline Matrix4f operator*(const Matrix4f& Right) const
 	{
 		Matrix4f Ret;
 
+#ifdef __AVX__
+		const __m256 r0 = _mm256_broadcast_ps((const __m128*)Right.m[0]);
+		const __m256 r1 = _mm256_broadcast_ps((const __m128*)Right.m[1]);
+		const __m256 r2 = _mm256_broadcast_ps((const __m128*)Right.m[2]);
+		const __m256 r3 = _mm256_broadcast_ps((const __m128*)Right.m[3]);
+
+		for (unsigned int i = 0 ; i < 4 ; i += 2) {
+			const __m256 left = _mm256_loadu_ps(m[i]);
+			__m256 row = _mm256_mul_ps(_mm256_permute_ps(left, 0x00), r0);
+			row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(left, 0x55), r1));
+			row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(left, 0xAA), r2));
+			row = _mm256_add_ps(row, _mm256_mul_ps(_mm256_permute_ps(left, 0xFF), r3));
+			_mm256_storeu_ps(Ret.m[i], row);
+		}
+#else
+		const __m128 r0 = _mm_loadu_ps(Right.m[0]);
+		const __m128 r1 = _mm_loadu_ps(Right.m[1]);
+		const __m128 r2 = _mm_loadu_ps(Right.m[2]);
+		const __m128 r3 = _mm_loadu_ps(Right.m[3]);
+
 		for (unsigned int i = 0 ; i < 4 ; i++) {
-			for (unsigned int j = 0 ; j < 4 ; j++) {
-				Ret.m[i][j] = m[i][0] * Right.m[0][j] +
-					m[i][1] * Right.m[1][j] +
-					m[i][2] * Right.m[2][j] +
-					m[i][3] * Right.m[3][j];
-			}
+			__m128 row = _mm_mul_ps(_mm_set1_ps(m[i][0]), r0);
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m[i][1]), r1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m[i][2]), r2));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(m[i][3]), r3));
+			_mm_storeu_ps(Ret.m[i], row);
 		}
+#endif
 
 		return Ret;
 	}
 
+	/**
+	 * The point (x, y, z, 1) through this matrix, divided by w.
+	 */
+	inline Vector3 TransformPoint(const Vector3& p) const
+	{
+		float invW = 1.0f / (m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3]);
+		return Vector3(
+			(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3]) * invW,
+			(m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3]) * invW,
+			(m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]) * invW);
+	}
+
+	/**
+	 * TransformPoint on count points, four at a time (eight with AVX). in and out may be the same array.
+	 */
+	void TransformPoints(const Vector3* in, Vector3* out, size_t count) const;
 };
+
+inline void TransposeMatrix(const Matrix4f& matrix, Matrix4f& result)
+{
+	__m128 r0 = _mm_loadu_ps(matrix.m[0]);
+	__m128 r1 = _mm_loadu_ps(matrix.m[1]);
+	__m128 r2 = _mm_loadu_ps(matrix.m[2]);
+	__m128 r3 = _mm_loadu_ps(matrix.m[3]);
+
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	_mm_storeu_ps(result.m[0], r0);
+	_mm_storeu_ps(result.m[1], r1);
+	_mm_storeu_ps(result.m[2], r2);
+	_mm_storeu_ps(result.m[3], r3);
+}
@@ -0,0 +1,84 @@
+#include "SceneGeometry.h"
+
+const SimpleVertex CubeVertices[NumCubeVertices] = 
+{
+	// Top
+	{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 0.0f ) },
+	{ Vector3(  1.0f,  1.0f, -1.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 0.0f ) },
+	{ Vector3(  1.0f,  1.0f,  1.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 1.0f ) },
+	{ Vector3( -1.0f,  1.0f,  1.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 1.0f ) },
+
+	// Botton
+	{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(0, -1, 0), Vector2( 0.0f, 0.0f ) },
+	{ Vector3(  1.0f, -1.0f, -1.0f ), Vector3(0, -1, 0), Vector2( 1.0f, 0.0f ) },
+	{ Vector3(  1.0f, -1.0f,  1.0f ), Vector3(0, -1, 0), Vector2( 1.0f, 1.0f ) },
+	{ Vector3( -1.0f, -1.0f,  1.0f ), Vector3(0, -1, 0), Vector2( 0.0f, 1.0f ) },
+
+	// Left
+	{ Vector3( -1.0f, -1.0f,  1.0f ), Vector3(-1, 0, 0), Vector2( 1.0f, 0.0f ) },
+	{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(-1, 0, 0), Vector2( 0.0f, 0.0f ) },
+	{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(-1, 0, 0), Vector2( 0.0f, 1.0f ) },
+	{ Vector3( -1.0f,  1.0f,  1.0f ), Vector3(-1, 0, 0), Vector2( 1.0f, 1.0f ) },
+
+	// Right
+	{ Vector3( 1.0f, -1.0f,  1.0f ), Vector3(1, 0, 0), Vector2( 0.0f, 0.0f ) },
+	{ Vector3( 1.0f, -1.0f, -1.0f ), Vector3(1, 0, 0), Vector2( 1.0f, 0.0f ) },
+	{ Vector3( 1.0f,  1.0f, -1.0f ), Vector3(1, 0, 0), Vector2( 1.0f, 1.0f ) },
+	{ Vector3( 1.0f,  1.0f,  1.0f ), Vector3(1, 0, 0), Vector2( 0.0f, 1.0f ) },
+
+	// Back
+	{ Vector3( -1.0f, -1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 1.0f, 0.0f ) },
+	{ Vector3(  1.0f, -1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 0.0f, 0.0f ) },
+	{ Vector3(  1.0f,  1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 0.0f, 1.0f ) },
+	{ Vector3( -1.0f,  1.0f, -1.0f ), Vector3(0, 0, -1), Vector2( 1.0f, 1.0f ) },
+
+	// Front 
+	{ Vector3( -1.0f, -1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 0.0f, 0.0f ) },
+	{ Vector3(  1.0f, -1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 1.0f, 0.0f ) },
+	{ Vector3(  1.0f,  1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 1.0f, 1.0f ) },
+	{ Vector3( -1.0f,  1.0f, 1.0f ), Vector3(0, 0, 1), Vector2( 0.0f, 1.0f ) },
+};
+
+const unsigned char CubeIndices[NumCubeIndices] =
+{
+	3,1,0,
+	2,1,3,
+
+	6,4,5,
+	7,4,6,
+
+	11,9,8,
+	10,9,11,
+
+	14,12,13,
+	15,12,14,
+
+	19,17,16,
+	18,17,19,
+
+	22,20,21,
+	23,20,22
+};
+
+const SimpleVertex PlaneVertices[NumPlaneVertices] = 
+{
+	{ Vector3( -50.0f, 0.0f, -50.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 1.0f ) },
+	{ Vector3( -50.0f, 0.0f,  50.0f ), Vector3(0, 1, 0), Vector2( 0.0f, 0.0f ) },
+	{ Vector3(  50.0f, 0.0f,  50.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 0.0f ) },
+	{ Vector3(  50.0f, 0.0f, -50.0f ), Vector3(0, 1, 0), Vector2( 1.0f, 1.0f ) },
+};
+
+// The GL_QUADS order split in two triangles
+const unsigned char PlaneIndices[NumPlaneIndices] =
+{
+	0,1,2,
+	0,2,3
+};
+
+void BuildCubeWorldMatrix( Matrix4f& world )
+{
+	Matrix4f scale, translate;
+	MakeTranslateMatrix(0, 5, 0, translate);
+	MakeScaleMatrix(5, 5, 5, scale);
+	world = translate * scale;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "Math.h"
+
+/**
+ * Geometry of the demo scene, shared by the OpenGL path in Main.cpp and the software rasterizer.
+ */
+struct SimpleVertex
+{
+	Vector3 Positon;
+	Vector3 Normal;
+	Vector2 Tex;
+};
+
+const int NumCubeVertices = 24;
+const int NumCubeIndices = 6 * 2 * 3;
+
+extern const SimpleVertex CubeVertices[NumCubeVertices];
+extern const unsigned char CubeIndices[NumCubeIndices];
+
+// Ground plane y = 0 as one quad, -50..50 on x and z
+const int NumPlaneVertices = 4;
+const int NumPlaneIndices = 6;
+
+extern const SimpleVertex PlaneVertices[NumPlaneVertices];
+extern const unsigned char PlaneIndices[NumPlaneIndices];
+
+/**
+ * The cube sits on the plane: scaled by 5 and lifted by 5.
+ */
+void BuildCubeWorldMatrix(Matrix4f& world);
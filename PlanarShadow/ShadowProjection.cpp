@@ -0,0 +1,226 @@
+#include "ShadowProjection.h"
+#include <cfloat>
+
+namespace {
+
+// Pieces thinner than this are dropped, they come from cuts along nearly shared edges
+const float MinPieceArea = 1e-6f;
+
+inline float Cross(const Vector2& o, const Vector2& a, const Vector2& b)
+{
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+inline bool LessXY(const Vector2& a, const Vector2& b)
+{
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+float Area(const std::vector<Vector2>& polygon)
+{
+	float area = 0;
+	for (size_t i = 0; i < polygon.size(); ++i)
+	{
+		const Vector2& a = polygon[i];
+		const Vector2& b = polygon[(i + 1) % polygon.size()];
+		area += a.x * b.y - a.y * b.x;
+	}
+	return area * 0.5f;
+}
+
+void Bounds(const std::vector<Vector2>& polygon, Vector2& minPoint, Vector2& maxPoint)
+{
+	minPoint = maxPoint = polygon[0];
+	for (size_t i = 1; i < polygon.size(); ++i)
+	{
+		minPoint.x = std::min(minPoint.x, polygon[i].x);
+		minPoint.y = std::min(minPoint.y, polygon[i].y);
+		maxPoint.x = std::max(maxPoint.x, polygon[i].x);
+		maxPoint.y = std::max(maxPoint.y, polygon[i].y);
+	}
+}
+
+}
+
+PlanarShadowProjector::PlanarShadowProjector()
+{
+
+}
+
+void PlanarShadowProjector::SetReceivers( const Vector3* normals, const float* dists, int numPlanes )
+{
+	mPlaneNormals.assign(normals, normals + numPlanes);
+	mPlaneDists.assign(dists, dists + numPlanes);
+}
+
+void PlanarShadowProjector::SetLights( const Vector3* positions, int numLights )
+{
+	mLights.assign(positions, positions + numLights);
+}
+
+void PlanarShadowProjector::Project( const Vector3* casterPoints, int numPoints )
+{
+	const int numPlanes = GetNumReceivers();
+	const int numLights = GetNumLights();
+
+	mShadowMatrices.resize(numPlanes * numLights);
+	if (numPlanes && numLights)
+		MakePlanarShadowMatrices(&mLights[0], numLights, &mPlaneNormals[0], &mPlaneDists[0], numPlanes, &mShadowMatrices[0]);
+
+	mShadowTriangles.resize(numPlanes);
+	mNumPieces.resize(numPlanes);
+	for (int plane = 0; plane < numPlanes; ++plane)
+		MergeReceiver(plane, casterPoints, numPoints);
+}
+
+void PlanarShadowProjector::MergeReceiver( int receiver, const Vector3* casterPoints, int numPoints )
+{
+	const Vector3& normal = mPlaneNormals[receiver];
+	const float dist = mPlaneDists[receiver];
+
+	// Plane coordinates, U x V = normal so counter clockwise is seen from the lit side
+	const Vector3 helper = fabsf(normal.x) < 0.9f ? Vector3::UnitX : Vector3::UnitY;
+	const Vector3 axisU = normalize(cross(helper, normal));
+	const Vector3 axisV = cross(normal, axisU);
+	const Vector3 origin = normal * -dist;
+
+	float casterDist = -FLT_MAX;
+	for (int i = 0; i < numPoints; ++i)
+		casterDist = std::max(casterDist, dot(normal, casterPoints[i]) + dist);
+
+	mHulls.clear();
+	mProjected.resize(numPoints);
+
+	for (int light = 0; light < GetNumLights(); ++light)
+	{
+		if (dot(normal, mLights[light]) + dist <= casterDist)
+			continue;
+
+		mShadowMatrices[receiver * GetNumLights() + light].TransformPoints(casterPoints, &mProjected[0], numPoints);
+
+		mPlanePoints.resize(numPoints);
+		for (int i = 0; i < numPoints; ++i)
+		{
+			const Vector3 offset = mProjected[i] - origin;
+			mPlanePoints[i] = Vector2(dot(offset, axisU), dot(offset, axisV));
+		}
+
+		mHulls.push_back(Polygon());
+		ConvexHull(mPlanePoints, mHulls.back());
+		if (mHulls.back().size() < 3)
+			mHulls.pop_back();
+	}
+
+	// Each hull minus the hulls before it, the pieces cover the union once
+	std::vector<Polygon> pieces, fragments, remaining;
+	for (size_t i = 0; i < mHulls.size(); ++i)
+	{
+		fragments.assign(1, mHulls[i]);
+		for (size_t j = 0; j < i && !fragments.empty(); ++j)
+		{
+			remaining.clear();
+			for (size_t f = 0; f < fragments.size(); ++f)
+				Subtract(fragments[f], mHulls[j], remaining);
+			fragments.swap(remaining);
+		}
+		pieces.insert(pieces.end(), fragments.begin(), fragments.end());
+	}
+
+	std::vector<Vector3>& triangles = mShadowTriangles[receiver];
+	triangles.clear();
+	for (size_t p = 0; p < pieces.size(); ++p)
+	{
+		const Polygon& piece = pieces[p];
+		for (size_t k = 1; k + 1 < piece.size(); ++k)
+		{
+			triangles.push_back(origin + axisU * piece[0].x + axisV * piece[0].y);
+			triangles.push_back(origin + axisU * piece[k].x + axisV * piece[k].y);
+			triangles.push_back(origin + axisU * piece[k + 1].x + axisV * piece[k + 1].y);
+		}
+	}
+	mNumPieces[receiver] = int(pieces.size());
+}
+
+/**
+ * Monotone chain, counter clockwise without collinear points. Sorts points.
+ */
+void PlanarShadowProjector::ConvexHull( std::vector<Vector2>& points, Polygon& hull )
+{
+	std::sort(points.begin(), points.end(), LessXY);
+
+	const int n = int(points.size());
+	hull.resize(2 * n);
+
+	int k = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		while (k >= 2 && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+			--k;
+		hull[k++] = points[i];
+	}
+
+	for (int i = n - 2, lower = k + 1; i >= 0; --i)
+	{
+		while (k >= lower && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0)
+			--k;
+		hull[k++] = points[i];
+	}
+
+	hull.resize(std::max(k - 1, 0));
+}
+
+/**
+ * Sutherland-Hodgman against the line a->b, keeping the left or the right side. Points on the line are kept
+ * on both sides so neighboring pieces share their cut.
+ */
+void PlanarShadowProjector::ClipHalfPlane( const Polygon& polygon, const Vector2& a, const Vector2& b, bool keepLeft, Polygon& result )
+{
+	result.clear();
+
+	const float sign = keepLeft ? 1.0f : -1.0f;
+	for (size_t i = 0; i < polygon.size(); ++i)
+	{
+		const Vector2& p = polygon[i];
+		const Vector2& q = polygon[(i + 1) % polygon.size()];
+		const float dp = sign * Cross(a, b, p);
+		const float dq = sign * Cross(a, b, q);
+
+		if (dp >= 0)
+			result.push_back(p);
+
+		if ((dp > 0 && dq < 0) || (dp < 0 && dq > 0))
+			result.push_back(p + (q - p) * (dp / (dp - dq)));
+	}
+}
+
+/**
+ * Convex polygon minus a convex polygon, as convex pieces: walking the subtrahend's edges, the part outside
+ * an edge is a piece, the part inside goes on to the next edge. What is left at the end lies inside.
+ */
+void PlanarShadowProjector::Subtract( const Polygon& polygon, const Polygon& subtrahend, std::vector<Polygon>& pieces )
+{
+	Vector2 minA, maxA, minB, maxB;
+	Bounds(polygon, minA, maxA);
+	Bounds(subtrahend, minB, maxB);
+	if (maxA.x <= minB.x || maxB.x <= minA.x || maxA.y <= minB.y || maxB.y <= minA.y)
+	{
+		pieces.push_back(polygon);
+		return;
+	}
+
+	Polygon remaining = polygon, outside, inside;
+	for (size_t i = 0; i < subtrahend.size(); ++i)
+	{
+		const Vector2& a = subtrahend[i];
+		const Vector2& b = subtrahend[(i + 1) % subtrahend.size()];
+
+		ClipHalfPlane(remaining, a, b, false, outside);
+		if (outside.size() >= 3 && Area(outside) > MinPieceArea)
+			pieces.push_back(outside);
+
+		ClipHalfPlane(remaining, a, b, true, inside);
+		remaining.swap(inside);
+		if (remaining.size() < 3)
+			return;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "Math.h"
+#include <vector>
+
+/**
+ * Planar shadows of one convex caster from many lights on many receiver planes, merged on the CPU.
+ *
+ * The shadow matrices of all light/plane pairs come from MakePlanarShadowMatrices. Per pair the caster
+ * points are projected with Matrix4f::TransformPoints, the shadow is the convex hull of the projected
+ * points. Per plane the hulls are then cut into non overlapping convex pieces: each hull minus all the
+ * hulls before it. The pieces cover the union of the shadows exactly once, so all lights' shadows on a plane
+ * are drawn in one pass without stencil, where the matrix path needs a stencil tested pass per light.
+ *
+ * A light that is not farther from a plane than every caster point would cast an inverted shadow through
+ * the projection, such pairs are skipped. Receivers are infinite planes.
+ */
+class PlanarShadowProjector
+{
+public:
+	PlanarShadowProjector();
+
+	// Planes n.p + d = 0 with unit normals pointing to the lit side
+	void SetReceivers(const Vector3* normals, const float* dists, int numPlanes);
+	void SetLights(const Vector3* positions, int numLights);
+
+	/**
+	 * Project world space caster points and merge the shadows of each receiver.
+	 */
+	void Project(const Vector3* casterPoints, int numPoints);
+
+	int GetNumReceivers() const                                    { return int(mPlaneNormals.size()); }
+	int GetNumLights() const                                       { return int(mLights.size()); }
+
+	// [plane * numLights + light], valid after Project
+	const std::vector<Matrix4f>& GetShadowMatrices() const         { return mShadowMatrices; }
+
+	// Triangle list of the merged shadow on a receiver, world space points on the plane
+	const std::vector<Vector3>& GetShadowTriangles(int receiver) const   { return mShadowTriangles[receiver]; }
+
+	int GetNumPieces(int receiver) const                           { return mNumPieces[receiver]; }
+
+private:
+	typedef std::vector<Vector2> Polygon;
+
+	void MergeReceiver(int receiver, const Vector3* casterPoints, int numPoints);
+
+	static void ConvexHull(std::vector<Vector2>& points, Polygon& hull);
+	static void ClipHalfPlane(const Polygon& polygon, const Vector2& a, const Vector2& b, bool keepLeft, Polygon& result);
+	static void Subtract(const Polygon& polygon, const Polygon& subtrahend, std::vector<Polygon>& pieces);
+
+private:
+	std::vector<Vector3> mPlaneNormals;
+	std::vector<float> mPlaneDists;
+	std::vector<Vector3> mLights;
+
+	std::vector<Matrix4f> mShadowMatrices;
+	std::vector<std::vector<Vector3> > mShadowTriangles;
+	std::vector<int> mNumPieces;
+
+	// Scratch
+	std::vector<Vector3> mProjected;
+	std::vector<Vector2> mPlanePoints;
+	std::vector<Polygon> mHulls;
+};
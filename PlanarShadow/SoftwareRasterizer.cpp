@@ -0,0 +1,466 @@
+#include "SoftwareRasterizer.h"
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <ppl.h>
+#else
+#include <atomic>
+#include <thread>
+#endif
+
+namespace {
+
+// Ambient term of SimpleEffect.cgfx
+const float AmbientLight = 0.2f;
+
+// Triangles are clipped to |x|, |y| <= GuardBand * w, keeps the fixed point window coordinates in range
+// while almost never clipping against the sides
+const float GuardBand = 16.0f;
+
+const int SubPixelBits = 8;
+const int SubPixelScale = 1 << SubPixelBits;
+
+const int MaxClipVertices = 16;
+
+template <typename Function>
+void ParallelFor(int count, const Function& function)
+{
+#ifdef _MSC_VER
+	Concurrency::parallel_for(0, count, function);
+#else
+	std::atomic<int> next(0);
+	std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()));
+	for (size_t t = 0; t < threads.size(); ++t)
+	{
+		threads[t] = std::thread([&]() {
+			for (int i = next++; i < count; i = next++)
+				function(i);
+		});
+	}
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+#endif
+}
+
+inline float Saturate(float v)
+{
+	return std::min(std::max(v, 0.0f), 1.0f);
+}
+
+inline unsigned int PackColor(const Vector3& color)
+{
+	return (unsigned int)(Saturate(color.x) * 255.0f + 0.5f) |
+		((unsigned int)(Saturate(color.y) * 255.0f + 0.5f) << 8) |
+		((unsigned int)(Saturate(color.z) * 255.0f + 0.5f) << 16) | 0xFF000000;
+}
+
+inline Vector3 UnpackColor(unsigned int color)
+{
+	return Vector3((color & 0xFF) / 255.0f, ((color >> 8) & 0xFF) / 255.0f, ((color >> 16) & 0xFF) / 255.0f);
+}
+
+// matrix * (p, 1)
+inline void TransformHomogeneous(const Matrix4f& matrix, const Vector3& p, float result[4])
+{
+	for (int i = 0; i < 4; ++i)
+		result[i] = matrix.m[i][0] * p.x + matrix.m[i][1] * p.y + matrix.m[i][2] * p.z + matrix.m[i][3];
+}
+
+// Signed distances to the clip planes, inside is >= 0
+inline float ClipDistance(const float position[4], int plane)
+{
+	switch (plane)
+	{
+	case 0: return position[2] + position[3];                 // Near
+	case 1: return GuardBand * position[3] - position[0];
+	case 2: return GuardBand * position[3] + position[0];
+	case 3: return GuardBand * position[3] - position[1];
+	default: return GuardBand * position[3] + position[1];
+	}
+}
+
+}
+
+void RasterTexture::CreateChecker( int size, int checks, const Vector3& color0, const Vector3& color1 )
+{
+	Width = Height = size;
+	Texels.resize(size * size);
+
+	const unsigned int packed0 = PackColor(color0), packed1 = PackColor(color1);
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+			Texels[y * size + x] = ((x * checks / size + y * checks / size) & 1) ? packed1 : packed0;
+	}
+}
+
+Vector3 RasterTexture::Sample( float u, float v ) const
+{
+	const float x = u * Width - 0.5f;
+	const float y = v * Height - 0.5f;
+	const float fx = floorf(x), fy = floorf(y);
+	const float tx = x - fx, ty = y - fy;
+
+	const int x0 = (int(fx) % Width + Width) % Width, x1 = (x0 + 1) % Width;
+	const int y0 = (int(fy) % Height + Height) % Height, y1 = (y0 + 1) % Height;
+
+	const Vector3 top = UnpackColor(Texels[y0 * Width + x0]) * (1 - tx) + UnpackColor(Texels[y0 * Width + x1]) * tx;
+	const Vector3 bottom = UnpackColor(Texels[y1 * Width + x0]) * (1 - tx) + UnpackColor(Texels[y1 * Width + x1]) * tx;
+	return top * (1 - ty) + bottom * ty;
+}
+
+RasterState::RasterState()
+	: DiffuseMap(NULL),
+	  Shadow(false),
+	  ShadowAttenuation(0.0f),
+	  DepthBias(0.0f),
+	  CullBackFace(true),
+	  StencilFunction(StencilFunc_Always),
+	  StencilRef(0),
+	  StencilPass(StencilOp_Keep)
+{
+	World.InitIdentity();
+}
+
+SoftwareRasterizer::SoftwareRasterizer( int width, int height )
+	: mWidth(width),
+	  mHeight(height),
+	  mTilesX((width + TileSize - 1) / TileSize),
+	  mTilesY((height + TileSize - 1) / TileSize),
+	  mLightPosition(Vector3::Zero),
+	  mLightColor(Vector3::Ones),
+	  mColor(width * height),
+	  mDepth(width * height),
+	  mStencil(width * height),
+	  mTileBins(mTilesX * mTilesY)
+{
+	mViewProjection.InitIdentity();
+}
+
+void SoftwareRasterizer::SetViewProjection( const Matrix4f& view, const Matrix4f& projection )
+{
+	mViewProjection = projection * view;
+}
+
+void SoftwareRasterizer::SetLight( const Vector3& position, const Vector3& color )
+{
+	mLightPosition = position;
+	mLightColor = color;
+}
+
+void SoftwareRasterizer::Clear( const Vector3& color, float depth, unsigned char stencil )
+{
+	std::fill(mColor.begin(), mColor.end(), PackColor(color));
+	std::fill(mDepth.begin(), mDepth.end(), depth);
+	std::fill(mStencil.begin(), mStencil.end(), stencil);
+}
+
+void SoftwareRasterizer::DrawIndexed( const SimpleVertex* vertices, const unsigned char* indices, int numIndices, const RasterState& state )
+{
+	const int stateIndex = int(mStates.size());
+	mStates.push_back(state);
+
+	const Matrix4f worldViewProj = mViewProjection * state.World;
+
+	for (int i = 0; i + 2 < numIndices; i += 3)
+		SubmitTriangle(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]], worldViewProj, stateIndex);
+}
+
+void SoftwareRasterizer::Draw( const SimpleVertex* vertices, int numVertices, const RasterState& state )
+{
+	const int stateIndex = int(mStates.size());
+	mStates.push_back(state);
+
+	const Matrix4f worldViewProj = mViewProjection * state.World;
+
+	for (int i = 0; i + 2 < numVertices; i += 3)
+		SubmitTriangle(vertices[i], vertices[i + 1], vertices[i + 2], worldViewProj, stateIndex);
+}
+
+void SoftwareRasterizer::SubmitTriangle( const SimpleVertex& v0, const SimpleVertex& v1, const SimpleVertex& v2, const Matrix4f& worldViewProj, int stateIndex )
+{
+	const Matrix4f& world = mStates[stateIndex].World;
+	const SimpleVertex* triangle[3] = { &v0, &v1, &v2 };
+
+	ClipVertex polygon[MaxClipVertices];
+	for (int k = 0; k < 3; ++k)
+	{
+		const SimpleVertex& vertex = *triangle[k];
+		ClipVertex& clip = polygon[k];
+
+		TransformHomogeneous(worldViewProj, vertex.Positon, clip.Position);
+
+		// As the vertex shader: world position without the divide, normal through the upper 3x3
+		float worldPos[4];
+		TransformHomogeneous(world, vertex.Positon, worldPos);
+
+		clip.Attributes[0] = vertex.Tex.x;
+		clip.Attributes[1] = vertex.Tex.y;
+		for (int r = 0; r < 3; ++r)
+		{
+			clip.Attributes[2 + r] = world.m[r][0] * vertex.Normal.x + world.m[r][1] * vertex.Normal.y + world.m[r][2] * vertex.Normal.z;
+			clip.Attributes[5 + r] = worldPos[r];
+		}
+	}
+
+	ClipAndSetup(polygon, 3, stateIndex);
+}
+
+void SoftwareRasterizer::ClipAndSetup( ClipVertex polygon[], int numVertices, int stateIndex )
+{
+	ClipVertex scratch[MaxClipVertices];
+	ClipVertex* input = polygon;
+	ClipVertex* output = scratch;
+
+	// Sutherland-Hodgman against the near plane and the guard band
+	for (int plane = 0; plane < 5 && numVertices >= 3; ++plane)
+	{
+		int numOutput = 0;
+		for (int i = 0; i < numVertices; ++i)
+		{
+			const ClipVertex& a = input[i];
+			const ClipVertex& b = input[(i + 1) % numVertices];
+			const float da = ClipDistance(a.Position, plane);
+			const float db = ClipDistance(b.Position, plane);
+
+			if (da >= 0)
+				output[numOutput++] = a;
+
+			if ((da >= 0) != (db >= 0))
+			{
+				const float t = da / (da - db);
+				ClipVertex& v = output[numOutput++];
+				for (int k = 0; k < 4; ++k)
+					v.Position[k] = a.Position[k] + (b.Position[k] - a.Position[k]) * t;
+				for (int k = 0; k < NumAttributes; ++k)
+					v.Attributes[k] = a.Attributes[k] + (b.Attributes[k] - a.Attributes[k]) * t;
+			}
+		}
+
+		numVertices = numOutput;
+		std::swap(input, output);
+	}
+
+	for (int i = 1; i + 1 < numVertices; ++i)
+		SetupTriangle(input[0], input[i], input[i + 1], stateIndex);
+}
+
+void SoftwareRasterizer::SetupTriangle( const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int stateIndex )
+{
+	const ClipVertex* v[3] = { &v0, &v1, &v2 };
+
+	Triangle tri;
+	for (int i = 0; i < 3; ++i)
+	{
+		const float invW = 1.0f / v[i]->Position[3];
+		const float windowX = (v[i]->Position[0] * invW * 0.5f + 0.5f) * mWidth;
+		const float windowY = (0.5f - v[i]->Position[1] * invW * 0.5f) * mHeight;
+
+		tri.X[i] = int(floorf(windowX * SubPixelScale + 0.5f));
+		tri.Y[i] = int(floorf(windowY * SubPixelScale + 0.5f));
+		tri.Depth[i] = v[i]->Position[2] * invW * 0.5f + 0.5f;
+		tri.InvW[i] = invW;
+		for (int k = 0; k < NumAttributes; ++k)
+			tri.Attributes[i][k] = v[i]->Attributes[k] * invW;
+	}
+
+	// Window y points down, so counter clockwise front faces have a negative area here
+	const long long area = (long long)(tri.X[1] - tri.X[0]) * (tri.Y[2] - tri.Y[0]) - (long long)(tri.Y[1] - tri.Y[0]) * (tri.X[2] - tri.X[0]);
+	if (area == 0 || (area > 0 && mStates[stateIndex].CullBackFace))
+		return;
+
+	// Rasterize with positive area
+	if (area < 0)
+	{
+		std::swap(tri.X[1], tri.X[2]);
+		std::swap(tri.Y[1], tri.Y[2]);
+		std::swap(tri.Depth[1], tri.Depth[2]);
+		std::swap(tri.InvW[1], tri.InvW[2]);
+		for (int k = 0; k < NumAttributes; ++k)
+			std::swap(tri.Attributes[1][k], tri.Attributes[2][k]);
+	}
+
+	// Pixels whose center lies within the fixed point bounds
+	const int half = SubPixelScale / 2;
+	tri.MinX = std::max((std::min(tri.X[0], std::min(tri.X[1], tri.X[2])) - half + SubPixelScale - 1) >> SubPixelBits, 0);
+	tri.MinY = std::max((std::min(tri.Y[0], std::min(tri.Y[1], tri.Y[2])) - half + SubPixelScale - 1) >> SubPixelBits, 0);
+	tri.MaxX = std::min((std::max(tri.X[0], std::max(tri.X[1], tri.X[2])) - half) >> SubPixelBits, mWidth - 1);
+	tri.MaxY = std::min((std::max(tri.Y[0], std::max(tri.Y[1], tri.Y[2])) - half) >> SubPixelBits, mHeight - 1);
+	if (tri.MinX > tri.MaxX || tri.MinY > tri.MaxY)
+		return;
+
+	tri.StateIndex = stateIndex;
+
+	const int triangleIndex = int(mTriangles.size());
+	mTriangles.push_back(tri);
+
+	for (int ty = tri.MinY / TileSize; ty <= tri.MaxY / TileSize; ++ty)
+	{
+		for (int tx = tri.MinX / TileSize; tx <= tri.MaxX / TileSize; ++tx)
+			mTileBins[ty * mTilesX + tx].push_back(triangleIndex);
+	}
+}
+
+void SoftwareRasterizer::Flush( bool multithreaded )
+{
+	const int numTiles = mTilesX * mTilesY;
+	if (multithreaded)
+		ParallelFor(numTiles, [this](int tileIndex) { RasterizeTile(tileIndex); });
+	else
+	{
+		for (int tileIndex = 0; tileIndex < numTiles; ++tileIndex)
+			RasterizeTile(tileIndex);
+	}
+
+	mTriangles.clear();
+	mStates.clear();
+	for (size_t i = 0; i < mTileBins.size(); ++i)
+		mTileBins[i].clear();
+}
+
+void SoftwareRasterizer::RasterizeTile( int tileIndex )
+{
+	const int tileMinX = (tileIndex % mTilesX) * TileSize;
+	const int tileMinY = (tileIndex / mTilesX) * TileSize;
+	const int tileMaxX = std::min(tileMinX + TileSize, mWidth) - 1;
+	const int tileMaxY = std::min(tileMinY + TileSize, mHeight) - 1;
+
+	const std::vector<int>& bin = mTileBins[tileIndex];
+	for (size_t i = 0; i < bin.size(); ++i)
+		RasterizeTriangle(mTriangles[bin[i]], tileMinX, tileMinY, tileMaxX, tileMaxY);
+}
+
+void SoftwareRasterizer::RasterizeTriangle( const Triangle& tri, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY )
+{
+	const RasterState& state = mStates[tri.StateIndex];
+
+	const int minX = std::max(tri.MinX, tileMinX), maxX = std::min(tri.MaxX, tileMaxX);
+	const int minY = std::max(tri.MinY, tileMinY), maxY = std::min(tri.MaxY, tileMaxY);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// Edge i is opposite vertex i, its value at a pixel is the unnormalized barycentric of vertex i
+	long long rowEdge[3], stepX[3], stepY[3];
+	int bias[3];
+
+	const long long sampleX = (long long)minX * SubPixelScale + SubPixelScale / 2;
+	const long long sampleY = (long long)minY * SubPixelScale + SubPixelScale / 2;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		const int a = (i + 1) % 3, b = (i + 2) % 3;
+		const long long dx = tri.X[b] - tri.X[a];
+		const long long dy = tri.Y[b] - tri.Y[a];
+
+		rowEdge[i] = dx * (sampleY - tri.Y[a]) - dy * (sampleX - tri.X[a]);
+		stepX[i] = -dy * SubPixelScale;
+		stepY[i] = dx * SubPixelScale;
+
+		// Top left rule: samples exactly on an edge belong to the triangle whose inside is to the right,
+		// or below for horizontal edges
+		const bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+		bias[i] = topLeft ? 0 : 1;
+	}
+
+	const float invArea = 1.0f / float(rowEdge[0] + rowEdge[1] + rowEdge[2]);
+
+	for (int y = minY; y <= maxY; ++y)
+	{
+		long long edge[3] = { rowEdge[0], rowEdge[1], rowEdge[2] };
+
+		for (int x = minX; x <= maxX; ++x, edge[0] += stepX[0], edge[1] += stepX[1], edge[2] += stepX[2])
+		{
+			if (((edge[0] - bias[0]) | (edge[1] - bias[1]) | (edge[2] - bias[2])) < 0)
+				continue;
+
+			const int pixel = y * mWidth + x;
+
+			if (state.StencilFunction == StencilFunc_Equal && mStencil[pixel] != state.StencilRef)
+				continue;
+
+			const float l0 = float(edge[0]) * invArea, l1 = float(edge[1]) * invArea, l2 = float(edge[2]) * invArea;
+
+			const float depth = l0 * tri.Depth[0] + l1 * tri.Depth[1] + l2 * tri.Depth[2] + state.DepthBias;
+			if (!(depth < mDepth[pixel]))
+				continue;
+
+			mDepth[pixel] = depth;
+			if (state.StencilPass == StencilOp_Increment)
+				mStencil[pixel]++;
+
+			if (state.Shadow)
+			{
+				mColor[pixel] = PackColor(UnpackColor(mColor[pixel]) * state.ShadowAttenuation);
+				continue;
+			}
+
+			const float w = 1.0f / (l0 * tri.InvW[0] + l1 * tri.InvW[1] + l2 * tri.InvW[2]);
+
+			float attributes[NumAttributes];
+			for (int k = 0; k < NumAttributes; ++k)
+				attributes[k] = (l0 * tri.Attributes[0][k] + l1 * tri.Attributes[1][k] + l2 * tri.Attributes[2][k]) * w;
+
+			mColor[pixel] = PackColor(ShadePixel(state, attributes));
+		}
+
+		for (int i = 0; i < 3; ++i)
+			rowEdge[i] += stepY[i];
+	}
+}
+
+Vector3 SoftwareRasterizer::ShadePixel( const RasterState& state, const float attributes[NumAttributes] ) const
+{
+	const Vector3 normal(attributes[2], attributes[3], attributes[4]);
+	const Vector3 worldPos(attributes[5], attributes[6], attributes[7]);
+
+	const Vector3 lightVec = normalize(worldPos - mLightPosition);
+	const float diffuseFactor = Saturate(dot(-lightVec, normal));
+	const Vector3 diffuseMaterial = state.DiffuseMap ? state.DiffuseMap->Sample(attributes[0], attributes[1]) : Vector3::Ones;
+
+	const Vector3 diffuseColor = diffuseMaterial * diffuseFactor;
+	return Vector3(diffuseColor.x * mLightColor.x, diffuseColor.y * mLightColor.y, diffuseColor.z * mLightColor.z) + diffuseMaterial * AmbientLight;
+}
+
+unsigned int SoftwareRasterizer::Checksum() const
+{
+	unsigned int hash = 2166136261u;
+	const unsigned char* bytes = (const unsigned char*)&mColor[0];
+	for (size_t i = 0; i < mColor.size() * sizeof(unsigned int); ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+bool SoftwareRasterizer::SaveTGA( const char* fileName ) const
+{
+	FILE* file = fopen(fileName, "wb");
+	if (!file)
+		return false;
+
+	// Uncompressed 32 bit true color, origin at the top left
+	unsigned char header[18] = { 0 };
+	header[2] = 2;
+	header[12] = (unsigned char)(mWidth & 0xFF);
+	header[13] = (unsigned char)(mWidth >> 8);
+	header[14] = (unsigned char)(mHeight & 0xFF);
+	header[15] = (unsigned char)(mHeight >> 8);
+	header[16] = 32;
+	header[17] = 0x28;
+	fwrite(header, 1, sizeof(header), file);
+
+	std::vector<unsigned char> row(mWidth * 4);
+	for (int y = 0; y < mHeight; ++y)
+	{
+		for (int x = 0; x < mWidth; ++x)
+		{
+			const unsigned int color = mColor[y * mWidth + x];
+			row[x * 4 + 0] = (unsigned char)(color >> 16);
+			row[x * 4 + 1] = (unsigned char)(color >> 8);
+			row[x * 4 + 2] = (unsigned char)(color);
+			row[x * 4 + 3] = (unsigned char)(color >> 24);
+		}
+		fwrite(&row[0], 1, row.size(), file);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include "Math.h"
+#include "SceneGeometry.h"
+#include <vector>
+
+/**
+ * RGBA8 texture sampled bilinearly with wrapping, like the DiffuseMap sampler of SimpleEffect.cgfx.
+ */
+struct RasterTexture
+{
+	int Width, Height;
+	std::vector<unsigned int> Texels;
+
+	RasterTexture() : Width(0), Height(0) {}
+
+	/**
+	 * Checkerboard of checks x checks squares, stands in for the dds textures when running headless.
+	 */
+	void CreateChecker(int size, int checks, const Vector3& color0, const Vector3& color1);
+
+	Vector3 Sample(float u, float v) const;
+};
+
+enum StencilFunc
+{
+	StencilFunc_Always,
+	StencilFunc_Equal
+};
+
+enum StencilOp
+{
+	StencilOp_Keep,
+	StencilOp_Increment
+};
+
+/**
+ * Per draw state, the software counterpart of the effect parameters and the GL state Display() sets.
+ */
+struct RasterState
+{
+	Matrix4f World;
+	const RasterTexture* DiffuseMap;
+
+	// Draw the shadow color instead of lighting, the Shadow parameter of the effect. The color below is
+	// scaled by ShadowAttenuation, 0 is the opaque black of the effect.
+	bool Shadow;
+	float ShadowAttenuation;
+
+	// Added to the window space depth, negative pulls towards the viewer like glPolygonOffset
+	float DepthBias;
+
+	bool CullBackFace;
+
+	// Stencil test against StencilRef, StencilPass applies where both stencil and depth test pass.
+	// Equal 0 with Increment draws each pixel once, overlapping shadow triangles can't darken twice.
+	StencilFunc StencilFunction;
+	unsigned char StencilRef;
+	StencilOp StencilPass;
+
+	RasterState();
+};
+
+/**
+ * Small tile based software rasterizer, enough to render the planar shadow demo without a GPU.
+ *
+ * DrawIndexed transforms, culls and clips triangles and bins them into TileSize x TileSize screen tiles.
+ * Flush rasterizes the tiles, in parallel when asked to. Each tile walks its triangles in submission order,
+ * so the result does not depend on the thread count. Edges are evaluated in 24.8 fixed point with a
+ * top left fill rule, triangles sharing an edge never both cover a pixel. Conventions follow the GL path:
+ * column vectors, clip space z in [-w, w], counter clockwise front faces, depth test less.
+ */
+class SoftwareRasterizer
+{
+public:
+	static const int TileSize = 64;
+
+	SoftwareRasterizer(int width, int height);
+
+	void SetViewProjection(const Matrix4f& view, const Matrix4f& projection);
+	void SetLight(const Vector3& position, const Vector3& color);
+
+	void Clear(const Vector3& color, float depth, unsigned char stencil);
+
+	void DrawIndexed(const SimpleVertex* vertices, const unsigned char* indices, int numIndices, const RasterState& state);
+
+	// Triangle list without indices, for generated geometry such as merged shadows
+	void Draw(const SimpleVertex* vertices, int numVertices, const RasterState& state);
+
+	void Flush(bool multithreaded = true);
+
+	int GetWidth() const                                        { return mWidth; }
+	int GetHeight() const                                       { return mHeight; }
+	int GetNumBinnedTriangles() const                           { return int(mTriangles.size()); }
+
+	// Row 0 is the top of the image, RGBA8 with red in the low byte
+	const std::vector<unsigned int>& GetColorBuffer() const     { return mColor; }
+	const std::vector<float>& GetDepthBuffer() const            { return mDepth; }
+	const std::vector<unsigned char>& GetStencilBuffer() const  { return mStencil; }
+
+	/**
+	 * FNV-1a of the color buffer, for regression checks on the rendered image.
+	 */
+	unsigned int Checksum() const;
+
+	bool SaveTGA(const char* fileName) const;
+
+private:
+	enum { NumAttributes = 8 };   // Tex.xy, Normal.xyz, WorldPos.xyz
+
+	struct ClipVertex
+	{
+		float Position[4];
+		float Attributes[NumAttributes];
+	};
+
+	struct Triangle
+	{
+		int X[3], Y[3];                              // 24.8 fixed point window coordinates
+		float Depth[3];
+		float InvW[3];
+		float Attributes[3][NumAttributes];          // Divided by w for perspective correct interpolation
+		int MinX, MinY, MaxX, MaxY;                  // Pixel bounds, inclusive
+		int StateIndex;
+	};
+
+	void SubmitTriangle(const SimpleVertex& v0, const SimpleVertex& v1, const SimpleVertex& v2, const Matrix4f& worldViewProj, int stateIndex);
+	void ClipAndSetup(ClipVertex polygon[], int numVertices, int stateIndex);
+	void SetupTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2, int stateIndex);
+
+	void RasterizeTile(int tileIndex);
+	void RasterizeTriangle(const Triangle& tri, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY);
+
+	Vector3 ShadePixel(const RasterState& state, const float attributes[NumAttributes]) const;
+
+private:
+	int mWidth, mHeight;
+	int mTilesX, mTilesY;
+
+	Matrix4f mViewProjection;
+	Vector3 mLightPosition, mLightColor;
+
+	std::vector<unsigned int> mColor;
+	std::vector<float> mDepth;
+	std::vector<unsigned char> mStencil;
+
+	std::vector<RasterState> mStates;
+	std::vector<Triangle> mTriangles;
+	std::vector<std::vector<int> > mTileBins;
+};
@@ -0,0 +1,797 @@
+#include "AmbientOcclusionCPU.h"
+#include <emmintrin.h>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <ppl.h>
+#else
+#include <atomic>
+#include <thread>
+#endif
+
+namespace {
+
+const float PI = 3.14159265f;
+
+// Same as the shader side RANDOM_TEXTURE_WIDTH
+const int RANDOM_TEXTURE_WIDTH = HBAORandomTextureWidth;
+
+// Rows in parallel, PPL on Windows and plain threads elsewhere
+template <typename Function>
+void ParallelFor(int count, const Function& function)
+{
+#ifdef _MSC_VER
+	Concurrency::parallel_for(0, count, function);
+#else
+	std::atomic<int> next(0);
+	std::vector<std::thread> threads((std::max)(1u, std::thread::hardware_concurrency()));
+	for (size_t t = 0; t < threads.size(); ++t)
+	{
+		threads[t] = std::thread([&]() {
+			for (int i = next++; i < count; i = next++)
+				function(i);
+		});
+	}
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// HLSL intrinsics, written out so the evaluation order matches the shader source
+//--------------------------------------------------------------------------------------
+inline float Dot(const D3DXVECTOR3& a, const D3DXVECTOR3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline D3DXVECTOR3 Cross(const D3DXVECTOR3& a, const D3DXVECTOR3& b)
+{
+	return D3DXVECTOR3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+inline D3DXVECTOR3 Normalize(const D3DXVECTOR3& v)
+{
+	return v * (1.0f / sqrtf(Dot(v, v)));
+}
+
+inline D3DXVECTOR3 Reflect(const D3DXVECTOR3& i, const D3DXVECTOR3& n)
+{
+	return i - n * (2.0f * Dot(n, i));
+}
+
+inline float Saturate(float v)
+{
+	return (std::min)((std::max)(v, 0.0f), 1.0f);
+}
+
+inline float Lerp(float a, float b, float t)
+{
+	return a + (b - a) * t;
+}
+
+// HLSL round() is round-to-nearest-even
+inline float Round(float v)
+{
+	float r = floorf(v + 0.5f);
+	if (r - v == 0.5f && fmodf(r, 2.0f) != 0.0f)
+		r -= 1.0f;
+	return r;
+}
+
+inline D3DXVECTOR2 RotateDirection(const D3DXVECTOR2& dir, const D3DXVECTOR2& cosSin)
+{
+	return D3DXVECTOR2(dir.x*cosSin.x - dir.y*cosSin.y, dir.x*cosSin.y + dir.y*cosSin.x);
+}
+
+/**
+ * Point clamp fetch from the linearized depth.
+ */
+inline float FetchViewDepth(const float* viewDepth, int width, int height, float u, float v)
+{
+	float fx = (std::min)((std::max)(u * width, 0.0f), float(width - 1));
+	float fy = (std::min)((std::max)(v * height, 0.0f), float(height - 1));
+	return viewDepth[int(fy) * width + int(fx)];
+}
+
+/**
+ * FetchEyePos in HBAO.hlsl, AlchemyAO.hlsl and Unreal4AO.hlsl.
+ */
+inline D3DXVECTOR3 FetchEyePos(const float* viewDepth, int width, int height, const HBAOParams& params, float u, float v)
+{
+	float eyeZ = FetchViewDepth(viewDepth, width, height, u, v);
+
+	// Convet UV to Clip Space
+	float csX = u * 2.0f - 1.0f;
+	float csY = v * -2.0f + 1.0f;
+
+	return D3DXVECTOR3(csX / params.FocalLen.x * eyeZ, csY / params.FocalLen.y * eyeZ, eyeZ);
+}
+
+/**
+ * Eye position at the center of pixel (x, y), used to emulate ddx/ddy over a 2x2 quad.
+ */
+inline D3DXVECTOR3 PixelEyePos(const float* viewDepth, int width, int height, const HBAOParams& params, int x, int y)
+{
+	return FetchEyePos(viewDepth, width, height, params, (x + 0.5f) * params.InvAOResolution.x, (y + 0.5f) * params.InvAOResolution.y);
+}
+
+/**
+ * normalize(cross(ddx(C), ddy(C))) with fine derivatives, helper pixels outside the viewport
+ * fetch clamped depth just like the rasterizer does.
+ */
+D3DXVECTOR3 QuadNormal(const float* viewDepth, int width, int height, const HBAOParams& params, int x, int y)
+{
+	int quadX = x & ~1;
+	int quadY = y & ~1;
+
+	D3DXVECTOR3 ddx = PixelEyePos(viewDepth, width, height, params, quadX + 1, y) - PixelEyePos(viewDepth, width, height, params, quadX, y);
+	D3DXVECTOR3 ddy = PixelEyePos(viewDepth, width, height, params, x, quadY + 1) - PixelEyePos(viewDepth, width, height, params, x, quadY);
+
+	return Normalize(Cross(ddx, ddy));
+}
+
+//--------------------------------------------------------------------------------------
+// HBAO.hlsl
+//--------------------------------------------------------------------------------------
+const int HBAO_NUM_DIRECTIONS = 8;
+const int HBAO_NUM_STEPS = 6;
+
+struct HBAOContext
+{
+	const float* ViewDepth;
+	int Width, Height;
+	const HBAOParams* Params;
+
+	D3DXVECTOR3 P, dPdu, dPdv;
+};
+
+inline float Tangent(const D3DXVECTOR3& T)
+{
+	return -T.z * (1.0f / sqrtf(T.x*T.x + T.y*T.y));
+}
+
+inline float BiasedTangent(const D3DXVECTOR3& T, const HBAOParams& params)
+{
+	return Tangent(T) + params.TanAngleBias;
+}
+
+inline float Tan2Sin(float t)
+{
+	return t * (1.0f / sqrtf(1.0f + t*t));
+}
+
+inline D3DXVECTOR3 MinDiff(const D3DXVECTOR3& P, const D3DXVECTOR3& Pr, const D3DXVECTOR3& Pl)
+{
+	D3DXVECTOR3 V1 = Pr - P;
+	D3DXVECTOR3 V2 = P - Pl;
+	return (Dot(V1, V1) < Dot(V2, V2)) ? V1 : V2;
+}
+
+inline D3DXVECTOR2 SnapUVOffset(const D3DXVECTOR2& uv, const HBAOParams& params)
+{
+	return D3DXVECTOR2(Round(uv.x * params.AOResolution.x) * params.InvAOResolution.x,
+		               Round(uv.y * params.AOResolution.y) * params.InvAOResolution.y);
+}
+
+inline D3DXVECTOR3 TangentVector(const D3DXVECTOR2& duv, const HBAOContext& ctx)
+{
+	return ctx.dPdu * duv.x + ctx.dPdv * duv.y;
+}
+
+void ComputeSteps(float pixelRadius, float rand, const HBAOParams& params, float& numSteps, D3DXVECTOR2& uvStepSize)
+{
+	// Avoid oversampling if NUM_STEPS is greater than the kernel radius in pixels
+	numSteps = (std::min)(float(HBAO_NUM_STEPS), pixelRadius);
+
+	// Divide by Ns+1 so that the farthest samples are not fully attenuated
+	float pixelStepSize = pixelRadius / (numSteps + 1);
+
+	// Clamp numSteps if it is greater than the max kernel footprint
+	float maxNumSteps = params.MaxRadiusPixels / pixelStepSize;
+	if (maxNumSteps < numSteps)
+	{
+		// Use dithering to avoid AO discontinuities
+		numSteps = floorf(maxNumSteps + rand);
+		numSteps = (std::max)(numSteps, 1.0f);
+		pixelStepSize = params.MaxRadiusPixels / numSteps;
+	}
+
+	// Step size in uv space
+	uvStepSize = D3DXVECTOR2(pixelStepSize * params.InvAOResolution.x, pixelStepSize * params.InvAOResolution.y);
+}
+
+float IntegerateOcclusion(const HBAOContext& ctx, const D3DXVECTOR2& uv0, const D3DXVECTOR2& snappedDuv, float& tanH)
+{
+	const HBAOParams& params = *ctx.Params;
+
+	float ao = 0;
+
+	// Compute a tangent vector for snapped_duv
+	D3DXVECTOR3 T1 = TangentVector(snappedDuv, ctx);
+
+	float tanT = BiasedTangent(T1, params);
+	float sinT = Tan2Sin(tanT);
+
+	D3DXVECTOR3 S = FetchEyePos(ctx.ViewDepth, ctx.Width, ctx.Height, params, uv0.x + snappedDuv.x, uv0.y + snappedDuv.y);
+
+	float tanS = Tangent(S - ctx.P);
+	float sinS = Tan2Sin(tanS);
+
+	D3DXVECTOR3 SP = S - ctx.P;
+	float d2 = Dot(SP, SP);
+
+	if ( (d2 < params.RadiusSquared) && (tanS > tanH) )
+	{
+		ao = (1.0f - d2 * params.InvRadiusSquared) * (sinS - sinT);
+
+		// Update the horizon angle
+		tanH = (std::max)(tanH, tanS);
+	}
+
+	return ao;
+}
+
+float HorizonOcclusion(const HBAOContext& ctx, D3DXVECTOR2 deltaUV, const D3DXVECTOR2& texelDeltaUV, const D3DXVECTOR2& uv0, float numSteps, float randstep)
+{
+	const HBAOParams& params = *ctx.Params;
+
+	float ao = 0;
+
+	// Randomize starting point within the first sample distance
+	D3DXVECTOR2 uv = uv0 + SnapUVOffset(deltaUV * randstep, params);
+
+	deltaUV = SnapUVOffset(deltaUV, params);
+
+	// Compute tangent vector using the tangent plane
+	D3DXVECTOR3 T = TangentVector(deltaUV, ctx);
+
+	float tanH = BiasedTangent(T, params);
+
+	// Take a first sample between uv0 and uv0 + deltaUV (SAMPLE_FIRST_STEP)
+	D3DXVECTOR2 snappedDuv = SnapUVOffset(deltaUV * randstep + texelDeltaUV, params);
+	ao = IntegerateOcclusion(ctx, uv0, snappedDuv, tanH);
+	--numSteps;
+
+	// sinH is never assigned before the loop in the shader, which compiles to zero
+	float sinH = 0;
+
+	for (float i = 1; i <= numSteps; ++i)
+	{
+		uv += deltaUV;
+
+		D3DXVECTOR3 S = FetchEyePos(ctx.ViewDepth, ctx.Width, ctx.Height, params, uv.x, uv.y);
+		D3DXVECTOR3 SP = S - ctx.P;
+
+		float tanS = Tangent(SP);
+		float d2 = Dot(SP, SP);
+
+		if ( (d2 < params.RadiusSquared) && (tanS > tanH) )
+		{
+			// Accumulate AO between the horizon and the sample
+			float sinS = Tan2Sin(tanS);
+			ao += (1.0f - d2 * params.InvRadiusSquared) * (sinS - sinH);
+
+			// Update the current horizon angle
+			tanH = tanS;
+			sinH = sinS;
+		}
+	}
+
+	return ao;
+}
+
+//--------------------------------------------------------------------------------------
+// Unreal4AO.hlsl
+//--------------------------------------------------------------------------------------
+const int UNREAL4_NUM_SAMPLES = 6;
+const float UNREAL4_BIAS = 0.008f;
+
+inline float AcosApproximation(float x)
+{
+	return (-0.69813170079773212f * x * x - 0.87266462599716477f) * x + 1.5707963267948966f;
+}
+
+float CalcAngle(const float* viewDepth, int width, int height, const HBAOParams& params, const D3DXVECTOR2& sampleDir,
+	const D3DXVECTOR2& texC, float uvDiskRadius, const D3DXVECTOR3& C, const D3DXVECTOR3& nC)
+{
+	D3DXVECTOR2 texS = texC + sampleDir * uvDiskRadius;
+
+	D3DXVECTOR3 S = FetchEyePos(viewDepth, width, height, params, texS.x, texS.y);
+
+	D3DXVECTOR3 V = Normalize(-C);     // View
+	D3DXVECTOR3 D = Normalize(S - C);
+
+	float VdotS = Dot(V, D);
+	float NdotS = Dot(nC, D);
+
+	D3DXVECTOR3 T = Normalize(S - nC * NdotS);  // Tangent
+
+	float cosAngle = (NdotS >= 0) ? VdotS : Dot(V, T);
+
+	return (std::max)(AcosApproximation(cosAngle - UNREAL4_BIAS), 0.0f);
+}
+
+//--------------------------------------------------------------------------------------
+// AlchemyAO.hlsl
+//--------------------------------------------------------------------------------------
+const int ALCHEMY_NUM_SAMPLES = 9;
+const int ALCHEMY_NUM_SPIRAL_TURNS = 7;
+const float ALCHEMY_BIAS = 0.002f;
+
+//--------------------------------------------------------------------------------------
+// DDS reading for the noise texture
+//--------------------------------------------------------------------------------------
+#pragma pack(push, 1)
+struct DDSPixelFormat
+{
+	uint32_t Size, Flags, FourCC, RGBBitCount;
+	uint32_t RBitMask, GBitMask, BBitMask, ABitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t Magic;
+	uint32_t Size, Flags, Height, Width, PitchOrLinearSize, Depth, MipMapCount;
+	uint32_t Reserved1[11];
+	DDSPixelFormat PixelFormat;
+	uint32_t Caps, Caps2, Caps3, Caps4, Reserved2;
+};
+#pragma pack(pop)
+
+const uint32_t DDS_MAGIC = 0x20534444;  // "DDS "
+const uint32_t DDS_FOURCC = 0x00000004;
+
+// Extract one 8 bit channel with mask and convert to UNORM
+inline float UnpackChannel(uint32_t texel, uint32_t mask)
+{
+	if (mask == 0)
+		return 0.0f;
+
+	int shift = 0;
+	while (((mask >> shift) & 1) == 0) ++shift;
+
+	return float((texel & mask) >> shift) / 255.0f;
+}
+
+}
+
+AmbientOcclusionCPU::AmbientOcclusionCPU()
+	: mWidth(0), mHeight(0), mCryteckNoiseSize(0)
+{
+	uint16_t texels[HBAORandomTextureWidth*HBAORandomTextureWidth*4];
+	GenerateHBAORandomTexels(texels);
+
+	// Decode R16G16B16A16_SNORM
+	for (int i = 0; i < HBAORandomTextureWidth*HBAORandomTextureWidth; ++i)
+	{
+		float v[3];
+		for (int c = 0; c < 3; ++c)
+			v[c] = (std::max)(int16_t(texels[i*4+c]) / 32767.0f, -1.0f);
+
+		mHBAORandom[i] = D3DXVECTOR3(v);
+	}
+}
+
+AmbientOcclusionCPU::~AmbientOcclusionCPU()
+{
+
+}
+
+bool AmbientOcclusionCPU::LoadNoiseTexture( const char* filename )
+{
+	std::ifstream stream(filename, std::ios::binary);
+	if (!stream)
+		return false;
+
+	DDSHeader header;
+	stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!stream || header.Magic != DDS_MAGIC || header.Width != header.Height ||
+		(header.PixelFormat.Flags & DDS_FOURCC) || header.PixelFormat.RGBBitCount != 32)
+		return false;
+
+	// Sample(PointWrapSampler, iPos.xy / RANDOM_TEXTURE_WIDTH) has a screen space derivative of
+	// Size/RANDOM_TEXTURE_WIDTH texels per pixel, so the point mip filter picks the level which
+	// is RANDOM_TEXTURE_WIDTH wide when the chain has it.
+	int mipCount = (std::max)(int(header.MipMapCount), 1);
+	int lod = 0;
+	while (lod + 1 < mipCount && int(header.Width >> lod) > RANDOM_TEXTURE_WIDTH)
+		lod++;
+
+	std::streamoff offset = 0;
+	for (int i = 0; i < lod; ++i)
+	{
+		std::streamoff size = (std::max)(header.Width >> i, 1u);
+		offset += size * size * 4;
+	}
+
+	int size = (std::max)(int(header.Width >> lod), 1);
+	std::vector<uint32_t> data(size * size);
+
+	stream.seekg(sizeof(header) + offset, std::ios::beg);
+	stream.read(reinterpret_cast<char*>(&data[0]), data.size() * sizeof(uint32_t));
+	if (!stream)
+		return false;
+
+	const DDSPixelFormat& format = header.PixelFormat;
+
+	mCryteckNoiseSize = size;
+	mCryteckNoise.resize(data.size());
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		mCryteckNoise[i] = D3DXVECTOR3(
+			2.0f * UnpackChannel(data[i], format.RBitMask) - 1.0f,
+			2.0f * UnpackChannel(data[i], format.GBitMask) - 1.0f,
+			2.0f * UnpackChannel(data[i], format.BBitMask) - 1.0f);
+	}
+
+	return true;
+}
+
+void AmbientOcclusionCPU::LinearizeDepth( const float* depthBuffer, const HBAOParams& params )
+{
+	const int numPixels = mWidth * mHeight;
+	const int numRows = mHeight;
+
+	mViewDepth.resize(numPixels);
+	float* viewDepth = &mViewDepth[0];
+
+	const float clipX = params.ClipInfo.x;
+	const float clipY = params.ClipInfo.y;
+
+	ParallelFor(numRows, [&](int y)
+	{
+		const float* src = depthBuffer + y * mWidth;
+		float* dst = viewDepth + y * mWidth;
+
+		const __m128 clipX4 = _mm_set1_ps(clipX);
+		const __m128 clipY4 = _mm_set1_ps(clipY);
+
+		int x = 0;
+		for (; x + 4 <= mWidth; x += 4)
+			_mm_storeu_ps(dst + x, _mm_div_ps(clipY4, _mm_sub_ps(_mm_loadu_ps(src + x), clipX4)));
+
+		for (; x < mWidth; ++x)
+			dst[x] = clipY / (src[x] - clipX);
+	});
+}
+
+void AmbientOcclusionCPU::Compute( AmbientOcclusionTechnique technique, const float* depthBuffer, int width, int height, const HBAOParams& params, float* aoBuffer )
+{
+	mWidth = width;
+	mHeight = height;
+
+	LinearizeDepth(depthBuffer, params);
+
+	ParallelFor(height, [&](int y)
+	{
+		float* aoRow = aoBuffer + y * width;
+
+		switch(technique)
+		{
+		case AO_Cryteck:
+			ComputeCryteckRow(y, params, aoRow);
+			break;
+		case AO_HBAO:
+			ComputeHBAORow(y, params, aoRow);
+			break;
+		case AO_Unreal4:
+			ComputeUnreal4Row(y, params, aoRow);
+			break;
+		case AO_Alchemy:
+			ComputeAlchemyRow(y, params, aoRow);
+			break;
+		}
+	});
+}
+
+void AmbientOcclusionCPU::ComputeCryteckRow( int y, const HBAOParams& params, float* aoRow ) const
+{
+	// Parameters affecting offset points numbers and distribution
+	const int NumSamples = 16;
+
+	// The offset table doesn't depend on the pixel, build it the same way as the shader loop does
+	alignas(16) float offsets[NumSamples][3];
+	{
+		float offsetScale = 0.002f;
+		float offsetScaleStep = 1 + 2.4f / NumSamples;
+
+		int n = 0;
+		for (int i = 0; i < (NumSamples/8); ++i)
+		for (int ox = -1; ox <= 1; ox +=2)
+		for (int oy = -1; oy <= 1; oy +=2)
+		for (int oz = -1; oz <= 1; oz +=2)
+		{
+			D3DXVECTOR3 vOffset = Normalize(D3DXVECTOR3(float(ox), float(oy), float(oz))) * (offsetScale *= offsetScaleStep);
+			offsets[n][0] = vOffset.x;
+			offsets[n][1] = vOffset.y;
+			offsets[n][2] = vOffset.z;
+			n++;
+		}
+	}
+
+	const float* viewDepth = &mViewDepth[0];
+	const float v = (y + 0.5f) * params.InvAOResolution.y;
+	const float pixelY = y + 0.5f;
+
+	// Noise texel lookup, frac(iPos.xy / RANDOM_TEXTURE_WIDTH) * size
+	const D3DXVECTOR3 zero(0.0f, 0.0f, 0.0f);
+	auto noise = [&](int x) -> const D3DXVECTOR3&
+	{
+		if (mCryteckNoise.empty())
+			return zero;
+
+		float fu = (x + 0.5f) / RANDOM_TEXTURE_WIDTH;
+		float fv = pixelY / RANDOM_TEXTURE_WIDTH;
+		int tx = int((fu - floorf(fu)) * mCryteckNoiseSize);
+		int ty = int((fv - floorf(fv)) * mCryteckNoiseSize);
+		return mCryteckNoise[ty * mCryteckNoiseSize + tx];
+	};
+
+	const __m128 zero4 = _mm_setzero_ps();
+	const __m128 one4 = _mm_set1_ps(1.0f);
+	const __m128 half4 = _mm_set1_ps(0.5f);
+	const __m128 two4 = _mm_set1_ps(2.0f);
+	const __m128 width4 = _mm_set1_ps(float(mWidth));
+	const __m128 maxX4 = _mm_set1_ps(float(mWidth - 1));
+	const __m128 maxY4 = _mm_set1_ps(float(mHeight - 1));
+	const __m128 height4 = _mm_set1_ps(float(mHeight));
+
+	int x = 0;
+
+	// Four pixels of the row at a time
+	for (; x + 4 <= mWidth; x += 4)
+	{
+		alignas(16) float u[4], depthP[4], rx[4], ry[4], rz[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			u[i] = (x + i + 0.5f) * params.InvAOResolution.x;
+			depthP[i] = FetchViewDepth(viewDepth, mWidth, mHeight, u[i], v);
+
+			const D3DXVECTOR3& random = noise(x + i);
+			rx[i] = random.x;
+			ry[i] = random.y;
+			rz[i] = random.z;
+		}
+
+		const __m128 u4 = _mm_load_ps(u);
+		const __m128 v4 = _mm_set1_ps(v);
+		const __m128 P4 = _mm_load_ps(depthP);
+		const __m128 rx4 = _mm_load_ps(rx);
+		const __m128 ry4 = _mm_load_ps(ry);
+		const __m128 rz4 = _mm_load_ps(rz);
+
+		__m128 accessibility = zero4;
+		for (int s = 0; s < NumSamples; ++s)
+		{
+			const __m128 ox = _mm_set1_ps(offsets[s][0]);
+			const __m128 oy = _mm_set1_ps(offsets[s][1]);
+			const __m128 oz = _mm_set1_ps(offsets[s][2]);
+
+			// rotate offset vector, reflect(vOffset, random)
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx4, ox), _mm_mul_ps(ry4, oy)), _mm_mul_ps(rz4, oz));
+			d = _mm_mul_ps(two4, d);
+			__m128 rotX = _mm_sub_ps(ox, _mm_mul_ps(rx4, d));
+			__m128 rotY = _mm_sub_ps(oy, _mm_mul_ps(ry4, d));
+			__m128 rotZ = _mm_sub_ps(oz, _mm_mul_ps(rz4, d));
+
+			// shift coordinates by offset vector (range convert and width depth value)
+			__m128 sampleU = _mm_add_ps(u4, rotX);
+			__m128 sampleV = _mm_add_ps(v4, rotY);
+			__m128 sampleZ = _mm_add_ps(P4, _mm_mul_ps(_mm_mul_ps(rotZ, P4), two4));
+
+			// Point clamp texel
+			__m128 fx = _mm_min_ps(_mm_max_ps(_mm_mul_ps(sampleU, width4), zero4), maxX4);
+			__m128 fy = _mm_min_ps(_mm_max_ps(_mm_mul_ps(sampleV, height4), zero4), maxY4);
+			alignas(16) int ix[4], iy[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(ix), _mm_cvttps_epi32(fx));
+			_mm_store_si128(reinterpret_cast<__m128i*>(iy), _mm_cvttps_epi32(fy));
+
+			__m128 S4 = _mm_setr_ps(viewDepth[iy[0] * mWidth + ix[0]], viewDepth[iy[1] * mWidth + ix[1]],
+				                    viewDepth[iy[2] * mWidth + ix[2]], viewDepth[iy[3] * mWidth + ix[3]]);
+
+			// check if depth of both pixels are close enough and sampling point should affect out center pixel
+			__m128 rangeIsValid = _mm_div_ps(_mm_sub_ps(P4, S4), S4);
+			rangeIsValid = _mm_min_ps(_mm_max_ps(rangeIsValid, zero4), one4);
+
+			__m128 behind = _mm_and_ps(_mm_cmpgt_ps(S4, sampleZ), one4);
+			accessibility = _mm_add_ps(accessibility, _mm_add_ps(behind, _mm_mul_ps(_mm_sub_ps(half4, behind), rangeIsValid)));
+		}
+
+		accessibility = _mm_div_ps(accessibility, _mm_set1_ps(float(NumSamples)));
+		__m128 result = _mm_add_ps(_mm_mul_ps(accessibility, accessibility), accessibility);
+		_mm_storeu_ps(aoRow + x, _mm_min_ps(_mm_max_ps(result, zero4), one4));
+	}
+
+	// Remaining pixels
+	for (; x < mWidth; ++x)
+	{
+		const D3DXVECTOR3& random = noise(x);
+
+		const float u = (x + 0.5f) * params.InvAOResolution.x;
+		const float fSceneDepthP = FetchViewDepth(viewDepth, mWidth, mHeight, u, v);
+
+		float accessibility = 0;
+		for (int s = 0; s < NumSamples; ++s)
+		{
+			D3DXVECTOR3 vRotatedOffset = Reflect(D3DXVECTOR3(offsets[s]), random);
+			D3DXVECTOR3 vSamplePos(u + vRotatedOffset.x, v + vRotatedOffset.y, fSceneDepthP + vRotatedOffset.z * fSceneDepthP * 2);
+
+			float fSceneDepthS = FetchViewDepth(viewDepth, mWidth, mHeight, vSamplePos.x, vSamplePos.y);
+			float fRangeIsValid = Saturate( (fSceneDepthP - fSceneDepthS) / fSceneDepthS );
+
+			accessibility += Lerp( fSceneDepthS > vSamplePos.z ? 1.0f : 0.0f, 0.5f, fRangeIsValid);
+		}
+
+		accessibility = accessibility / NumSamples;
+		aoRow[x] = Saturate(accessibility*accessibility + accessibility);
+	}
+}
+
+void AmbientOcclusionCPU::ComputeHBAORow( int y, const HBAOParams& params, float* aoRow ) const
+{
+	const float alpha = 2.0f * PI / HBAO_NUM_DIRECTIONS;
+
+	// Direction table, same for every pixel before random rotation
+	D3DXVECTOR2 directions[HBAO_NUM_DIRECTIONS];
+	for (int d = 0; d < HBAO_NUM_DIRECTIONS; ++d)
+	{
+		float angle = alpha * d;
+		directions[d] = D3DXVECTOR2(cosf(angle), sinf(angle));
+	}
+
+	HBAOContext ctx;
+	ctx.ViewDepth = &mViewDepth[0];
+	ctx.Width = mWidth;
+	ctx.Height = mHeight;
+	ctx.Params = &params;
+
+	const D3DXVECTOR2 invRes = params.InvAOResolution;
+
+	for (int x = 0; x < mWidth; ++x)
+	{
+		const D3DXVECTOR2 uv((x + 0.5f) * invRes.x, (y + 0.5f) * invRes.y);
+
+		ctx.P = FetchEyePos(ctx.ViewDepth, mWidth, mHeight, params, uv.x, uv.y);
+
+		// (cos(alpha),sin(alpha),jitter)
+		const D3DXVECTOR3& rand = mHBAORandom[(y % RANDOM_TEXTURE_WIDTH) * RANDOM_TEXTURE_WIDTH + (x % RANDOM_TEXTURE_WIDTH)];
+
+		float uvRadiusX = 0.5f * params.Radius * params.FocalLen.x / ctx.P.z;
+		float pixelRadius = uvRadiusX * params.AOResolution.x;
+		if (pixelRadius < 1)
+		{
+			aoRow[x] = 1.0f;
+			continue;
+		}
+
+		float numSteps;
+		D3DXVECTOR2 uvStepSize;
+		ComputeSteps(pixelRadius, rand.z, params, numSteps, uvStepSize);
+
+		// Nearest neighbor pixels on the tangent plane
+		D3DXVECTOR3 Pl = FetchEyePos(ctx.ViewDepth, mWidth, mHeight, params, uv.x - invRes.x, uv.y);
+		D3DXVECTOR3 Pr = FetchEyePos(ctx.ViewDepth, mWidth, mHeight, params, uv.x + invRes.x, uv.y);
+		D3DXVECTOR3 Pb = FetchEyePos(ctx.ViewDepth, mWidth, mHeight, params, uv.x, uv.y - invRes.y);
+		D3DXVECTOR3 Pt = FetchEyePos(ctx.ViewDepth, mWidth, mHeight, params, uv.x, uv.y + invRes.y);
+
+		ctx.dPdu = MinDiff(ctx.P, Pr, Pl);
+		ctx.dPdv = MinDiff(ctx.P, Pt, Pb) * (params.AOResolution.y * invRes.x);
+
+		float ao = 0;
+		for (int d = 0; d < HBAO_NUM_DIRECTIONS; ++d)
+		{
+			D3DXVECTOR2 dir = RotateDirection(directions[d], D3DXVECTOR2(rand.x, rand.y));
+			D3DXVECTOR2 deltaUV(dir.x * uvStepSize.x, dir.y * uvStepSize.y);
+			D3DXVECTOR2 texelDeltaUV(dir.x * invRes.x, dir.y * invRes.y);
+
+			ao += HorizonOcclusion(ctx, deltaUV, texelDeltaUV, uv, numSteps, rand.z);
+		}
+
+		aoRow[x] = 1.0f - ao / HBAO_NUM_DIRECTIONS * params.Strength;
+	}
+}
+
+void AmbientOcclusionCPU::ComputeUnreal4Row( int y, const HBAOParams& params, float* aoRow ) const
+{
+	const float alpha = PI / UNREAL4_NUM_SAMPLES;
+
+	D3DXVECTOR2 directions[UNREAL4_NUM_SAMPLES];
+	for (int i = 0; i < UNREAL4_NUM_SAMPLES; ++i)
+	{
+		float angle = alpha * i;
+		directions[i] = D3DXVECTOR2(cosf(angle), sinf(angle));
+	}
+
+	const float* viewDepth = &mViewDepth[0];
+
+	for (int x = 0; x < mWidth; ++x)
+	{
+		const D3DXVECTOR2 uv((x + 0.5f) * params.InvAOResolution.x, (y + 0.5f) * params.InvAOResolution.y);
+
+		D3DXVECTOR3 C = FetchEyePos(viewDepth, mWidth, mHeight, params, uv.x, uv.y);
+		D3DXVECTOR3 nC = QuadNormal(viewDepth, mWidth, mHeight, params, x, y);
+
+		// (cos(alpha),sin(alpha),jitter)
+		const D3DXVECTOR3& rand = mHBAORandom[(y % RANDOM_TEXTURE_WIDTH) * RANDOM_TEXTURE_WIDTH + (x % RANDOM_TEXTURE_WIDTH)];
+
+		// Compute projection of disk of radius Radius into uv space
+		// Multiply by 0.5 to scale from [-1,1]^2 to [0,1]^2
+		float uvDiskRadius = 0.5f * params.FocalLen.y * params.Radius / C.z;
+
+		float occlusion = 0;
+		float weightSum = 0;
+		for (int i = 0; i < UNREAL4_NUM_SAMPLES; ++i)
+		{
+			D3DXVECTOR2 dir = RotateDirection(directions[i], D3DXVECTOR2(rand.x, rand.y));
+			float offset = float(i + rand.z) / UNREAL4_NUM_SAMPLES;
+
+			float pairWeight = 1.0f;
+			float angleSum = CalcAngle(viewDepth, mWidth, mHeight, params, dir, uv, uvDiskRadius * offset, C, nC) +
+				             CalcAngle(viewDepth, mWidth, mHeight, params, -dir, uv, uvDiskRadius * offset, C, nC);
+
+			occlusion += angleSum * pairWeight;
+			weightSum += pairWeight;
+		}
+
+		aoRow[x] = occlusion / (weightSum * PI);
+	}
+}
+
+void AmbientOcclusionCPU::ComputeAlchemyRow( int y, const HBAOParams& params, float* aoRow ) const
+{
+	const float* viewDepth = &mViewDepth[0];
+	const float epsilon = 0.01f;
+
+	const float temp = params.RadiusSquared * params.Radius;
+	const float invTempSq = 1.0f / (temp * temp);
+
+	for (int x = 0; x < mWidth; ++x)
+	{
+		const D3DXVECTOR2 uv((x + 0.5f) * params.InvAOResolution.x, (y + 0.5f) * params.InvAOResolution.y);
+
+		D3DXVECTOR3 C = FetchEyePos(viewDepth, mWidth, mHeight, params, uv.x, uv.y);
+		D3DXVECTOR3 nC = QuadNormal(viewDepth, mWidth, mHeight, params, x, y);
+
+		// Compute projection of disk of radius Radius into uv space
+		// Multiply by 0.5 to scale from [-1,1]^2 to [0,1]^2
+		float uvDiskRadius = 0.5f * params.FocalLen.y * params.Radius / C.z;
+
+		// Hash function used in the HPG12 AlchemyAO paper
+		float randomPatternRotationAngle = float((3 * x ^ y + x * y) * 10);
+
+		float sum = 0;
+		for (int i = 0; i < ALCHEMY_NUM_SAMPLES; ++i)
+		{
+			// Offset on the unit disk, spun for this pixel
+			float alpha = float(i + 0.5f) * (1.0f / ALCHEMY_NUM_SAMPLES);
+			float angle = alpha * (ALCHEMY_NUM_SPIRAL_TURNS * 6.28f) + randomPatternRotationAngle;
+
+			float ssR = alpha * uvDiskRadius;
+			D3DXVECTOR3 Q = FetchEyePos(viewDepth, mWidth, mHeight, params, uv.x + ssR * cosf(angle), uv.y + ssR * sinf(angle));
+
+			D3DXVECTOR3 v = Q - C;
+
+			float vv = Dot(v, v);
+			float vn = Dot(v, nC);
+
+			float f = (std::max)(params.RadiusSquared - vv, 0.0f);
+			sum += f * f * f * (std::max)((vn - ALCHEMY_BIAS) / (epsilon + vv), 0.0f);
+		}
+
+		sum *= invTempSq;
+
+		aoRow[x] = (std::max)(0.0f, 1.0f - sum * (5.0f / ALCHEMY_NUM_SAMPLES));
+	}
+}
+
+float AmbientOcclusionCPU::MaxDifference( const float* aoBuffer0, const float* aoBuffer1, int width, int height )
+{
+	float maxDiff = 0.0f;
+	for (int i = 0; i < width * height; ++i)
+		maxDiff = (std::max)(maxDiff, fabsf(aoBuffer0[i] - aoBuffer1[i]));
+	return maxDiff;
+}
@@ -0,0 +1,66 @@
+#ifndef AmbientOcclusionCPU_h__
+#define AmbientOcclusionCPU_h__
+
+#include "AmbientOcclusionParams.h"
+#include "Utility.h"
+#include <vector>
+
+/**
+ * CPU reference implementation of the four screen space AO pixel shaders.
+ *
+ * Each technique follows its HLSL source (CryteckSSAO.hlsl, HBAO.hlsl, Unreal4AO.hlsl, AlchemyAO.hlsl)
+ * operation for operation, including point-clamp depth fetches, the tiled random textures and 2x2 quad
+ * derivatives, so the output can be diffed against the un-blurred GPU AO buffer. Rows are processed in
+ * parallel, depth linearization and the Crytek kernel are SSE vectorized four pixels at a time.
+ */
+class AmbientOcclusionCPU
+{
+public:
+	AmbientOcclusionCPU();
+	~AmbientOcclusionCPU();
+
+	/**
+	 * Load the rotation noise used by CryteckSSAO.hlsl. Only uncompressed 32 bpp DDS is supported,
+	 * which is what Media\Textures\vector_noise.dds is.
+	 */
+	bool LoadNoiseTexture(const char* filename);
+
+	/**
+	 * Compute raw AO (before the cross bilateral blur) for a non-linear ZBuffer.
+	 *
+	 * @param depthBuffer  width * height post projection depth, row 0 at the top like the GPU texture
+	 * @param params       filled by UpdateHBAOParams with the same width and height
+	 * @param aoBuffer     width * height output
+	 */
+	void Compute(AmbientOcclusionTechnique technique, const float* depthBuffer, int width, int height,
+		const HBAOParams& params, float* aoBuffer);
+
+	/**
+	 * Return max absolute difference between two AO buffers, used to check shader output against the reference.
+	 */
+	static float MaxDifference(const float* aoBuffer0, const float* aoBuffer1, int width, int height);
+
+private:
+	void LinearizeDepth(const float* depthBuffer, const HBAOParams& params);
+
+	void ComputeCryteckRow(int y, const HBAOParams& params, float* aoRow) const;
+	void ComputeHBAORow(int y, const HBAOParams& params, float* aoRow) const;
+	void ComputeUnreal4Row(int y, const HBAOParams& params, float* aoRow) const;
+	void ComputeAlchemyRow(int y, const HBAOParams& params, float* aoRow) const;
+
+private:
+	int mWidth, mHeight;
+
+	// View space depth, ClipInfo.y / (z - ClipInfo.x) evaluated once per texel
+	std::vector<float> mViewDepth;
+
+	// Decoded HBAO random texture, (cos(alpha), sin(alpha), jitter) per texel
+	D3DXVECTOR3 mHBAORandom[HBAORandomTextureWidth*HBAORandomTextureWidth];
+
+	// Crytek noise mip level which is hit by iPos.xy / RANDOM_TEXTURE_WIDTH, already expanded to [-1, 1]
+	std::vector<D3DXVECTOR3> mCryteckNoise;
+	int mCryteckNoiseSize;
+};
+
+
+#endif // AmbientOcclusionCPU_h__
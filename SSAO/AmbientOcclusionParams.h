@@ -0,0 +1,36 @@
+#ifndef AmbientOcclusionParams_h__
+#define AmbientOcclusionParams_h__
+
+#include "VectorMath.h"
+
+// What the AO passes and AmbientOcclusionCPU share, kept out of Renderer.h so the CPU reference builds without D3D11
+
+enum AmbientOcclusionTechnique
+{
+	AO_Cryteck = 0,
+	AO_HBAO,
+	AO_Unreal4,
+	AO_Alchemy
+};
+
+// NOTE: Must match layout of the AO shader constant buffer
+struct HBAOParams
+{
+	D3DXVECTOR2 AOResolution;
+	D3DXVECTOR2 InvAOResolution;
+
+	D3DXVECTOR2 FocalLen;
+	D3DXVECTOR2 ClipInfo; //(M33, M43)
+
+	float Radius;
+	float RadiusSquared;
+	float InvRadiusSquared;
+	float MaxRadiusPixels;
+
+	float TanAngleBias;
+	float Strength;
+
+	float pad[2];
+};
+
+#endif // AmbientOcclusionParams_h__
@@ -0,0 +1,3211 @@
+﻿#include "DXUT.h"
+#include "Benchmark.h"
+#include "AmbientOcclusionCPU.h"
+#include "BoundingVolume.h"
+#include "FrameCapture.h"
+#include "ClusteredLightCulling.h"
+#include "ConstantRing.h"
+#include "CpuFeatures.h"
+#include "CrossBilateralFilterCPU.h"
+#include "DrawQueue.h"
+#include "LightAnimation.h"
+#include "LightBVH.h"
+#include "LightVolumeBatch.h"
+#include "MeshOptimizer.h"
+#include "PortableBenchmark.h"
+#include "SDKMeshFile.h"
+#include "SceneCulling.h"
+#include "SceneLoader.h"
+#include "ShaderCache.h"
+#include "TiledLightCulling.h"
+#include "Utility.h"
+#include "VertexCompression.h"
+#include "VectorMath.h"
+#include <ppl.h>
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+FILE* gBenchmarkLog = NULL;
+
+void Log(const char* format, ...)
+{
+	char buffer[1024];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	OutputDebugStringA(buffer);
+	if (gBenchmarkLog)
+	{
+		fputs(buffer, gBenchmarkLog);
+		fflush(gBenchmarkLog);
+	}
+}
+
+// Lines of the portable benchmarks
+void LogLine(const char* line)
+{
+	Log("%s", line);
+}
+
+double Now()
+{
+	static CDXUTTimer timer;
+	return timer.GetAbsoluteTime();
+}
+
+// Written by F6, replayed by the benchmarks when present
+const char* CaptureFile = "Frame.gbc";
+
+// Same camera setup as Main.cpp
+const float CameraNear = 0.5f;
+const float CameraFar = 300.0f;
+
+void BuildProjection(int width, int height, D3DXMATRIX& proj)
+{
+	D3DXMatrixPerspectiveFovLH(&proj, D3DX_PI / 4, float(width) / float(height), CameraNear, CameraFar);
+}
+
+// Looks over the ring LightAnimation::RandonPointLight spreads lights on
+void BuildView(D3DXMATRIX& view)
+{
+	D3DXVECTOR3 eye(0.0f, 30.0f, -120.0f);
+	D3DXVECTOR3 lookAt(0.0f, 0.0f, 0.0f);
+	D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
+	D3DXMatrixLookAtLH(&view, &eye, &lookAt, &up);
+}
+
+/**
+ * Ray cast a ground plane with a few spheres on it, and output post projection depth like the ZBuffer.
+ * The ground slopes slightly, a plane of constant view space y degenerates HBAO tangents to NaN.
+ */
+void GenerateSyntheticDepth(int width, int height, const D3DXMATRIX& proj, std::vector<float>& depth)
+{
+	const float GroundY = -2.0f;
+	const float GroundSlope = 0.05f;
+	const D3DXVECTOR4 Spheres[] = 
+	{
+		D3DXVECTOR4(0.0f, -0.5f, 8.0f, 1.5f),
+		D3DXVECTOR4(-3.0f, -1.0f, 12.0f, 1.0f),
+		D3DXVECTOR4(2.5f, -1.2f, 6.0f, 0.8f),
+		D3DXVECTOR4(5.0f, 1.0f, 20.0f, 3.0f),
+		D3DXVECTOR4(-6.0f, 0.0f, 30.0f, 2.0f),
+	};
+	const int NumSpheres = sizeof(Spheres) / sizeof(Spheres[0]);
+
+	depth.resize(width * height);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			// View ray with z = 1, so hit distance t equals view depth
+			float csX = (x + 0.5f) / width * 2.0f - 1.0f;
+			float csY = (y + 0.5f) / height * -2.0f + 1.0f;
+			D3DXVECTOR3 dir(csX / proj._11, csY / proj._22, 1.0f);
+
+			float viewZ = CameraFar;
+			if (dir.y < GroundSlope)
+				viewZ = (std::min)(viewZ, GroundY / (dir.y - GroundSlope));
+
+			float a = D3DXVec3Dot(&dir, &dir);
+			for (int i = 0; i < NumSpheres; ++i)
+			{
+				D3DXVECTOR3 center(Spheres[i].x, Spheres[i].y, Spheres[i].z);
+				float b = D3DXVec3Dot(&dir, &center);
+				float c = D3DXVec3Dot(&center, &center) - Spheres[i].w * Spheres[i].w;
+				float disc = b * b - a * c;
+				if (disc >= 0)
+				{
+					float t = (b - sqrtf(disc)) / a;
+					if (t > CameraNear)
+						viewZ = (std::min)(viewZ, t);
+				}
+			}
+
+			depth[y * width + x] = proj._33 + proj._43 / viewZ;
+		}
+	}
+}
+
+void BenchmarkAmbientOcclusion(AmbientOcclusionCPU& ao, const char* name, const float* depth, int width, int height, const HBAOParams& params)
+{
+	const char* TechniqueNames[] = { "Cryteck", "HBAO", "Unreal4", "Alchemy" };
+	const int NumIterations = 4;
+
+	std::vector<float> aoBuffer(width * height);
+
+	for (int technique = AO_Cryteck; technique <= AO_Alchemy; ++technique)
+	{
+		// Warm up
+		ao.Compute(AmbientOcclusionTechnique(technique), depth, width, height, params, &aoBuffer[0]);
+
+		double start = Now();
+		for (int i = 0; i < NumIterations; ++i)
+			ao.Compute(AmbientOcclusionTechnique(technique), depth, width, height, params, &aoBuffer[0]);
+		double elapsed = (Now() - start) / NumIterations;
+
+		// Mean AO is the golden value, it must not move unless the technique changes
+		double sum = 0;
+		for (size_t i = 0; i < aoBuffer.size(); ++i)
+			sum += aoBuffer[i];
+
+		Log("AO %-8s %s %dx%d: %8.2f ms, %7.2f MPixels/s, mean %.6f\n", TechniqueNames[technique], name, width, height,
+			elapsed * 1000.0, width * height / elapsed / 1e6, sum / aoBuffer.size());
+	}
+}
+
+void BenchmarkAmbientOcclusion()
+{
+	const int Resolutions[][2] = { { 1280, 720 }, { 1920, 1080 } };
+
+	AmbientOcclusionCPU ao;
+	if (!ao.LoadNoiseTexture(".\\Media\\Textures\\vector_noise.dds"))
+		Log("AO: vector_noise.dds not found, Cryteck runs without rotation\n");
+
+	for (int r = 0; r < 2; ++r)
+	{
+		const int width = Resolutions[r][0];
+		const int height = Resolutions[r][1];
+
+		D3DXMATRIX proj;
+		BuildProjection(width, height, proj);
+
+		HBAOParams params;
+		params.Radius = 1.0f;
+		params.TanAngleBias = tanf(D3DXToRadian(10.0f));
+		UpdateHBAOParams(params, proj, float(width), float(height));
+
+		std::vector<float> depth;
+		GenerateSyntheticDepth(width, height, proj, depth);
+
+		BenchmarkAmbientOcclusion(ao, "synthetic", &depth[0], width, height, params);
+	}
+
+	// Replay straight from the mapped capture
+	FrameCapture capture;
+	if (capture.Open(CaptureFile) && capture.GetDepth())
+		BenchmarkAmbientOcclusion(ao, "captured", capture.GetDepth(), capture.GetWidth(), capture.GetHeight(), capture.GetHeader().AOParams);
+}
+
+void BenchmarkCrossBilateralFilter()
+{
+	const int Resolutions[][2] = { { 1920, 1080 }, { 3840, 2160 } };
+	const int MaxBlurRadius = 16;
+	const int NumIterations = 4;
+
+	CrossBilateralFilterCPU filter;
+
+	for (int r = 0; r < 2; ++r)
+	{
+		const int width = Resolutions[r][0];
+		const int height = Resolutions[r][1];
+
+		D3DXMATRIX proj;
+		BuildProjection(width, height, proj);
+
+		std::vector<float> depth;
+		GenerateSyntheticDepth(width, height, proj, depth);
+
+		// Blur the checkerboard, so every radius has edges to preserve
+		std::vector<float> source(width * height);
+		for (int y = 0; y < height; ++y)
+			for (int x = 0; x < width; ++x)
+				source[y * width + x] = float(((x >> 3) ^ (y >> 3)) & 1);
+
+		std::vector<float> aoBuffer(width * height), sseBuffer(width * height);
+
+		for (int radius = 1; radius <= MaxBlurRadius; ++radius)
+		{
+			BlurParams params;
+			params.BlurRadius = float(radius);
+			UpdateBlurParams(params, CameraNear, CameraFar, float(width), float(height));
+
+			// SSE2 first, the AVX2 result is compared against it
+			double elapsed[2] = { 0, 0 };
+			float maxDifference = 0;
+			for (int level = Simd_SSE2; level <= (std::min)(GetSimdLevel(), Simd_AVX2); ++level)
+			{
+				filter.SetSimdLevel(SimdLevel(level));
+
+				for (int i = 0; i < NumIterations; ++i)
+				{
+					aoBuffer = source;
+
+					double start = Now();
+					filter.Filter(&depth[0], width, height, params, &aoBuffer[0]);
+					elapsed[level] += Now() - start;
+				}
+				elapsed[level] /= NumIterations;
+
+				if (level == Simd_SSE2)
+					sseBuffer = aoBuffer;
+
+				for (int i = 0; i < width * height; ++i)
+					maxDifference = (std::max)(maxDifference, fabsf(aoBuffer[i] - sseBuffer[i]));
+			}
+
+			if (GetSimdLevel() >= Simd_AVX2)
+			{
+				Log("Blur %dx%d radius %2d: SSE2 %8.2f ms, AVX2 %8.2f ms, max difference %g\n", width, height, radius, 
+					elapsed[Simd_SSE2] * 1000.0, elapsed[Simd_AVX2] * 1000.0, maxDifference);
+			}
+			else
+				Log("Blur %dx%d radius %2d: SSE2 %8.2f ms, no AVX2\n", width, height, radius, elapsed[Simd_SSE2] * 1000.0);
+		}
+	}
+}
+
+void BenchmarkLightBounds()
+{
+	const int NumLights[] = { 1024, 16384, 131072 };
+	const int LightsPerRun = 1 << 22;
+
+	D3DXMATRIX view, proj;
+	BuildView(view);
+	BuildProjection(1920, 1080, proj);
+
+	for (int n = 0; n < 3; ++n)
+	{
+		const int numLights = NumLights[n];
+		const int numIterations = (std::max)(LightsPerRun / numLights, 1);
+
+		LightAnimation lights;
+		lights.RandonPointLight(numLights);
+
+		// Split view space spheres into arrays
+		std::vector<float> x(numLights), y(numLights), z(numLights), radius(numLights);
+		for (int i = 0; i < numLights; ++i)
+		{
+			D3DXVECTOR3 lightPosView;
+			const LightAnimation::Light light = lights.GetLight(i);
+			D3DXVec3TransformCoord(&lightPosView, &light.LightPosition, &view);
+
+			x[i] = lightPosView.x;
+			y[i] = lightPosView.y;
+			z[i] = lightPosView.z;
+			radius[i] = light.LightAttenuation.y;
+		}
+
+		std::vector<D3DXVECTOR4> scalarBounds(numLights), batchBounds(numLights);
+
+		double start = Now();
+		for (int iter = 0; iter < numIterations; ++iter)
+		{
+			for (int i = 0; i < numLights; ++i)
+				scalarBounds[i] = CalculateLightBound(D3DXVECTOR3(x[i], y[i], z[i]), radius[i], CameraNear, proj._11, proj._22);
+		}
+		double scalarTime = Now() - start;
+
+		const double totalLights = double(numLights) * numIterations;
+		Log("LightBound %6d lights: scalar %7.2f MLights/s\n", numLights, totalLights / scalarTime / 1e6);
+
+		// Every width the CPU runs, each against the scalar rectangles
+		for (int level = Simd_SSE2; level <= GetSimdLevel(); ++level)
+		{
+			std::fill(batchBounds.begin(), batchBounds.end(), D3DXVECTOR4(0, 0, 0, 0));
+
+			start = Now();
+			for (int iter = 0; iter < numIterations; ++iter)
+			{
+				CalculateLightBounds(&x[0], &y[0], &z[0], &radius[0], numLights, CameraNear, proj._11, proj._22, &batchBounds[0], 
+					SimdLevel(level));
+			}
+			double batchTime = Now() - start;
+
+			int mismatches = 0;
+			for (int i = 0; i < numLights; ++i)
+				mismatches += memcmp(&scalarBounds[i], &batchBounds[i], sizeof(D3DXVECTOR4)) != 0;
+
+			Log("LightBound %6d lights: %-7s %2d wide %7.2f MLights/s, %d mismatches\n", numLights, GetSimdLevelName(SimdLevel(level)), 
+				GetSimdWidth(SimdLevel(level)), totalLights / batchTime / 1e6, mismatches);
+		}
+	}
+}
+
+void BenchmarkTiledLightCulling(const char* name, const float* depth, int width, int height,
+	const D3DXMATRIX& view, const D3DXMATRIX& proj)
+{
+	const int NumLights[] = { 1024, 10000, 50000 };
+	const int NumIterations = 8;
+
+	TiledLightCulling culling;
+
+	double start = Now();
+	for (int iter = 0; iter < NumIterations; ++iter)
+		culling.ComputeTileDepthBounds(depth, width, height, proj);
+	double depthTime = (Now() - start) / NumIterations;
+
+	Log("TiledCulling %s %dx%d: depth bounds %.3f ms, %dx%d tiles\n", name, width, height,
+		depthTime * 1000.0, culling.GetNumTilesX(), culling.GetNumTilesY());
+
+	for (int n = 0; n < 3; ++n)
+	{
+		LightAnimation lights;
+		lights.RandonPointLight(NumLights[n]);
+
+		start = Now();
+		for (int iter = 0; iter < NumIterations; ++iter)
+			culling.CullLights(lights, view, proj);
+		double cullTime = (Now() - start) / NumIterations;
+
+		const std::vector<uint32_t>& offsets = culling.GetTileOffsets();
+		const int numTiles = culling.GetNumTilesX() * culling.GetNumTilesY();
+
+		uint32_t maxLights = 0;
+		for (int t = 0; t < numTiles; ++t)
+			maxLights = (std::max)(maxLights, offsets[t + 1] - offsets[t]);
+
+		Log("TiledCulling %s %6d lights: cull %7.3f ms, %8u indices, %.1f avg / %u max lights per tile\n", name,
+			NumLights[n], cullTime * 1000.0, offsets[numTiles], double(offsets[numTiles]) / numTiles, maxLights);
+	}
+}
+
+void BenchmarkTiledLightCulling()
+{
+	const int width = 1920;
+	const int height = 1080;
+
+	D3DXMATRIX view, proj;
+	BuildView(view);
+	BuildProjection(width, height, proj);
+
+	std::vector<float> depth;
+	GenerateSyntheticDepth(width, height, proj, depth);
+
+	BenchmarkTiledLightCulling("synthetic", &depth[0], width, height, view, proj);
+
+	FrameCapture capture;
+	if (capture.Open(CaptureFile) && capture.GetDepth())
+	{
+		BenchmarkTiledLightCulling("captured", capture.GetDepth(), capture.GetWidth(), capture.GetHeight(),
+			capture.GetHeader().View, capture.GetHeader().Proj);
+	}
+}
+
+/**
+ * Clustered against tiled assignment on the same lights, a quarter of them spot lights. Besides the cost,
+ * report how many lights the shading pass would loop over per pixel with either list.
+ */
+void BenchmarkClusteredLightCulling()
+{
+	const int width = 1920;
+	const int height = 1080;
+	const int NumLights[] = { 1024, 10000, 50000 };
+	const int NumIterations = 8;
+
+	D3DXMATRIX view, proj;
+	BuildView(view);
+	BuildProjection(width, height, proj);
+
+	std::vector<float> depth;
+	GenerateSyntheticDepth(width, height, proj, depth);
+
+	TiledLightCulling tiled;
+	ClusteredLightCulling clustered;
+	clustered.SetupGrid(width, height, proj);
+
+	for (int n = 0; n < 3; ++n)
+	{
+		LightAnimation lights;
+		lights.RandonPointLight(NumLights[n] - NumLights[n] / 4);
+		lights.RandonSpotLight(NumLights[n] / 4);
+
+		double start = Now();
+		for (int iter = 0; iter < NumIterations; ++iter)
+		{
+			tiled.ComputeTileDepthBounds(&depth[0], width, height, proj);
+			tiled.CullLights(lights, view, proj);
+		}
+		double tiledTime = (Now() - start) / NumIterations;
+
+		start = Now();
+		for (int iter = 0; iter < NumIterations; ++iter)
+			clustered.CullLights(lights, view);
+		double clusteredTime = (Now() - start) / NumIterations;
+
+		// Lights per shaded pixel, sky pixels aren't lit
+		double tiledLightsPerPixel = 0, clusteredLightsPerPixel = 0;
+		int numPixels = 0;
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				const float z = depth[y * width + x];
+				if (z >= 1.0f)
+					continue;
+
+				const float viewZ = proj._43 / (z - proj._33);
+
+				uint32_t count;
+				tiled.GetTileLights(x / tiled.GetTileSize(), y / tiled.GetTileSize(), count);
+				tiledLightsPerPixel += count;
+
+				clustered.GetClusterLights(x / clustered.GetTileSize(), y / clustered.GetTileSize(), clustered.GetSlice(viewZ), count);
+				clusteredLightsPerPixel += count;
+
+				numPixels++;
+			}
+		}
+
+		const ClusteredLightCulling::ClusterStats stats = clustered.GetStats();
+
+		Log("Clustered %6d lights: tiled %7.3f ms %8u indices %7.1f lights/pixel, clustered %7.3f ms %8u indices %7.1f lights/pixel\n",
+			NumLights[n], tiledTime * 1000.0, tiled.GetTileOffsets().back(), tiledLightsPerPixel / numPixels,
+			clusteredTime * 1000.0, stats.NumIndices, clusteredLightsPerPixel / numPixels);
+		Log("Clustered %6d lights: %u/%u clusters occupied, %.1f avg / %u max lights, histogram 1:%u 2:%u 4:%u 8:%u 16:%u 32:%u 64:%u 128+:%u\n",
+			NumLights[n], stats.NumOccupied, stats.NumClusters, stats.AvgLights, stats.MaxLights,
+			stats.Histogram[0], stats.Histogram[1], stats.Histogram[2], stats.Histogram[3],
+			stats.Histogram[4], stats.Histogram[5], stats.Histogram[6], stats.Histogram[7]);
+	}
+}
+
+/**
+ * LightAnimation::Move on the light arrays against the original per light loop over an array of lights.
+ */
+void BenchmarkLightAnimation()
+{
+	const int NumLights[] = { 1024, 10000, 100000 };
+	const int NumFrames = 256;
+	const float FrameTime = 1.0f / 60.0f;
+
+	for (int n = 0; n < 3; ++n)
+	{
+		LightAnimation lights;
+		lights.RandonPointLight(NumLights[n]);
+
+		std::vector<LightAnimation::Light> reference(lights.GetNumLights());
+		for (size_t i = 0; i < reference.size(); ++i)
+			reference[i] = lights.GetLight(i);
+
+		double start = Now();
+		float totalTime = 0;
+		for (int frame = 0; frame < NumFrames; ++frame)
+		{
+			totalTime += FrameTime;
+			for (size_t i = 0; i < reference.size(); ++i)
+			{
+				if (reference[i].LightType == LT_PointLight)
+				{
+					float angle = reference[i].Angle + totalTime * reference[i].AnimationSpeed;
+					reference[i].LightPosition = D3DXVECTOR3(
+						reference[i].Radius * cosf(angle),
+						reference[i].Height,
+						reference[i].Radius * sinf(angle));
+				}
+			}
+		}
+		double scalarTime = (Now() - start) / NumFrames;
+
+		start = Now();
+		for (int frame = 0; frame < NumFrames; ++frame)
+			lights.Move(FrameTime);
+		double simdTime = (Now() - start) / NumFrames;
+
+		float maxError = 0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			D3DXVECTOR3 diff = reference[i].LightPosition - lights.GetLight(i).LightPosition;
+			maxError = (std::max)(maxError, D3DXVec3Length(&diff));
+		}
+
+		Log("LightAnimation %6d lights: scalar %.3f ms, SIMD %.3f ms, max position error %g\n", NumLights[n],
+			scalarTime * 1000.0, simdTime * 1000.0, maxError);
+	}
+}
+
+/**
+ * Load time of the text light file against the binary light set. Text is skipped at 1M lights, parsing
+ * a hundred megabytes with iostream takes too long to wait for.
+ */
+void BenchmarkLightSetLoad()
+{
+	const int NumLights[] = { 1000, 10000, 100000, 1000000 };
+	const int MaxTextLights = 100000;
+	const char* TextFile = "LightBenchmark.txt";
+	const char* LightSetFile = "LightBenchmark.lts";
+
+	for (int n = 0; n < 4; ++n)
+	{
+		LightAnimation source;
+		source.RandonPointLight(NumLights[n] - NumLights[n] / 4);
+		source.RandonSpotLight(NumLights[n] / 4);
+
+		double textTime = 0;
+		if (NumLights[n] <= MaxTextLights && source.SaveLights(TextFile))
+		{
+			LightAnimation lights;
+
+			double start = Now();
+			lights.LoadLights(TextFile);
+			textTime = Now() - start;
+		}
+
+		if (!source.SaveLights(LightSetFile))
+		{
+			Log("LightSet %7d lights: failed to write %s\n", NumLights[n], LightSetFile);
+			continue;
+		}
+
+		LightAnimation lights;
+
+		double start = Now();
+		bool loaded = lights.LoadLights(LightSetFile);
+		double binaryTime = Now() - start;
+
+		// The light set is exact, compare every array bit for bit
+		typedef std::vector<float> LightAnimation::LightArrays::* Field;
+		const Field Fields[] = 
+		{
+			&LightAnimation::LightArrays::PositionX, &LightAnimation::LightArrays::PositionY, &LightAnimation::LightArrays::PositionZ,
+			&LightAnimation::LightArrays::DirectionX, &LightAnimation::LightArrays::DirectionY, &LightAnimation::LightArrays::DirectionZ,
+			&LightAnimation::LightArrays::ColorR, &LightAnimation::LightArrays::ColorG, &LightAnimation::LightArrays::ColorB,
+			&LightAnimation::LightArrays::AttenuationBegin, &LightAnimation::LightArrays::AttenuationEnd,
+			&LightAnimation::LightArrays::SpotCosInner, &LightAnimation::LightArrays::SpotCosOuter, &LightAnimation::LightArrays::SpotDropoff,
+			&LightAnimation::LightArrays::Radius, &LightAnimation::LightArrays::Angle, &LightAnimation::LightArrays::Height, 
+			&LightAnimation::LightArrays::AnimationSpeed,
+		};
+		const int NumFields = sizeof(Fields) / sizeof(Fields[0]);
+
+		int mismatches = loaded ? 0 : -1;
+		for (int type = 0; type < LT_Count && loaded; ++type)
+		{
+			const LightAnimation::LightArrays& expected = source.GetLightArrays(LightType(type));
+			const LightAnimation::LightArrays& actual = lights.GetLightArrays(LightType(type));
+
+			if (expected.Begin != actual.Begin || expected.Count != actual.Count)
+			{
+				mismatches += NumFields;
+				continue;
+			}
+
+			for (int f = 0; f < NumFields; ++f)
+			{
+				const std::vector<float>& a = expected.*Fields[f];
+				const std::vector<float>& b = actual.*Fields[f];
+				if (a.size() != b.size() || (!a.empty() && memcmp(&a[0], &b[0], a.size() * sizeof(float)) != 0))
+					mismatches++;
+			}
+		}
+
+		if (textTime > 0)
+		{
+			Log("LightSet %7d lights: text %8.2f ms, binary %7.2f ms, %d mismatching fields\n", NumLights[n],
+				textTime * 1000.0, binaryTime * 1000.0, mismatches);
+		}
+		else
+		{
+			Log("LightSet %7d lights: binary %7.2f ms, %d mismatching fields\n", NumLights[n], binaryTime * 1000.0, mismatches);
+		}
+	}
+
+	// Damaged light sets must be rejected: header is Magic, Version, NumFields, Padding, then per type a
+	// 64 bit Offset, Count and PaddedCount. The point lights are the second group
+	struct Corruption
+	{
+		const char* Name;
+		size_t Offset;
+		uint64_t Value;
+		size_t Size;
+	};
+	const Corruption Corruptions[] = 
+	{
+		{ "padding", 12, 4, 4 },
+		{ "unaligned offset", 32, 66, 8 },
+		{ "offset past end", 32, 0xFFFFFFFFFFFFFFC0ULL, 8 },
+		{ "arrays past end", 44, 0xFFFFFFF0, 4 },
+	};
+
+	LightAnimation source;
+	source.RandonPointLight(1000);
+	if (source.SaveLights(LightSetFile))
+	{
+		FILE* file;
+		fopen_s(&file, LightSetFile, "rb");
+		std::vector<char> contents;
+		if (file)
+		{
+			fseek(file, 0, SEEK_END);
+			contents.resize(ftell(file));
+			fseek(file, 0, SEEK_SET);
+			fread(&contents[0], 1, contents.size(), file);
+			fclose(file);
+		}
+
+		for (int c = 0; c < sizeof(Corruptions) / sizeof(Corruptions[0]) && !contents.empty(); ++c)
+		{
+			std::vector<char> damaged = contents;
+			memcpy(&damaged[Corruptions[c].Offset], &Corruptions[c].Value, Corruptions[c].Size);
+
+			fopen_s(&file, LightSetFile, "wb");
+			if (!file)
+				break;
+			fwrite(&damaged[0], 1, damaged.size(), file);
+			fclose(file);
+
+			LightAnimation lights;
+			const bool loaded = lights.LoadLights(LightSetFile);
+			Log("LightSet %s: %s\n", Corruptions[c].Name, loaded ? "loaded, NOT REJECTED" : "rejected");
+		}
+	}
+
+	remove(TextFile);
+	remove(LightSetFile);
+}
+
+/**
+ * Light generation throughput, and a check that the lights don't depend on how many threads made them
+ * or how the generation was split into calls.
+ */
+void BenchmarkLightGeneration()
+{
+	const int NumLights = 1000000;
+	const int NumCalls = 10;
+
+	double start = Now();
+	LightAnimation lights;
+	lights.RandonPointLight(NumLights);
+	lights.RandonSpotLight(NumLights);
+	double parallelTime = Now() - start;
+
+	// Same lights on one thread, in several smaller calls
+	Concurrency::SchedulerPolicy policy(2, Concurrency::MinConcurrency, 1, Concurrency::MaxConcurrency, 1);
+	Concurrency::CurrentScheduler::Create(policy);
+
+	start = Now();
+	LightAnimation serialLights;
+	for (int call = 0; call < NumCalls; ++call)
+		serialLights.RandonPointLight(NumLights / NumCalls);
+	for (int call = 0; call < NumCalls; ++call)
+		serialLights.RandonSpotLight(NumLights / NumCalls);
+	double serialTime = Now() - start;
+
+	Concurrency::CurrentScheduler::Detach();
+
+	int mismatches = 0;
+	for (size_t i = 0; i < lights.GetNumLights(); ++i)
+	{
+		const LightAnimation::Light a = lights.GetLight(i);
+		const LightAnimation::Light b = serialLights.GetLight(i);
+
+		if (a.LightType != b.LightType ||
+			memcmp(&a.LightColor, &b.LightColor, sizeof(D3DXVECTOR3)) ||
+			memcmp(&a.LightPosition, &b.LightPosition, sizeof(D3DXVECTOR3)) ||
+			memcmp(&a.LightAttenuation, &b.LightAttenuation, sizeof(D3DXVECTOR2)))
+		{
+			mismatches++;
+		}
+	}
+
+	Log("LightGeneration %d point + %d spot lights: all cores %.1f ms, one thread %.1f ms, %d mismatches\n",
+		NumLights, NumLights, parallelTime * 1000.0, serialTime * 1000.0, mismatches);
+}
+
+/**
+ * Light BVH build, refit and query cost against testing every light sphere. Queries are the camera
+ * frustum, the 64 pixel tile frustums of a 1080p frame and random points around the light ring, each
+ * checked to return the same lights as the linear scan. Refit follows a second of animation.
+ */
+void BenchmarkLightBVH()
+{
+	const int width = 1920;
+	const int height = 1080;
+	const int TileSize = 64;
+	const int NumLights[] = { 10000, 100000 };
+	const int NumPoints = 10000;
+	const int NumMoveFrames = 60;
+	const float FrameTime = 1.0f / 60.0f;
+
+	D3DXMATRIX view, proj;
+	BuildView(view);
+	BuildProjection(width, height, proj);
+	const D3DXMATRIX viewProj = view * proj;
+
+	// Camera frustum first, then the tile frustums
+	std::vector<D3DXPLANE> frustums(6);
+	ExtractFrustumPlanes(viewProj, D3DXVECTOR4(-1, -1, 1, 1), 0.0f, 1.0f, &frustums[0]);
+	for (int tileY = 0; tileY < height; tileY += TileSize)
+	{
+		for (int tileX = 0; tileX < width; tileX += TileSize)
+		{
+			const D3DXVECTOR4 clipRect(
+				2.0f * tileX / width - 1.0f,
+				1.0f - 2.0f * (std::min)(tileY + TileSize, height) / height,
+				2.0f * (std::min)(tileX + TileSize, width) / width - 1.0f,
+				1.0f - 2.0f * tileY / height);
+
+			frustums.resize(frustums.size() + 6);
+			ExtractFrustumPlanes(viewProj, clipRect, 0.0f, 1.0f, &frustums[frustums.size() - 6]);
+		}
+	}
+	const int numFrustums = static_cast<int>(frustums.size() / 6);
+
+	std::mt19937 rng(7);
+	std::uniform_real<float> pointDist(-100.0f, 100.0f);
+	std::vector<D3DXVECTOR3> points(NumPoints);
+	for (int i = 0; i < NumPoints; ++i)
+		points[i] = D3DXVECTOR3(pointDist(rng), pointDist(rng) * 0.1f + 10.0f, pointDist(rng));
+
+	for (int n = 0; n < 2; ++n)
+	{
+		LightAnimation lights;
+		lights.RandonPointLight(NumLights[n] - NumLights[n] / 4);
+		lights.RandonSpotLight(NumLights[n] / 4);
+
+		LightBVH bvh;
+		double start = Now();
+		bvh.Build(lights);
+		double buildTime = Now() - start;
+
+		for (int frame = 0; frame < NumMoveFrames; ++frame)
+			lights.Move(FrameTime);
+
+		start = Now();
+		bvh.Refit(lights);
+		double refitTime = Now() - start;
+
+		// Reference spheres of the moved lights
+		std::vector<uint32_t> ids;
+		std::vector<D3DXVECTOR4> spheres;
+		for (size_t i = 0; i < lights.GetNumLights(); ++i)
+		{
+			D3DXVECTOR3 center;
+			float radius;
+			if (lights.GetBoundingSphere(i, center, radius))
+			{
+				ids.push_back(uint32_t(i));
+				spheres.push_back(D3DXVECTOR4(center, radius));
+			}
+		}
+
+		std::vector<uint32_t> bvhResult, linearResult;
+		size_t numMismatches = 0, frustumHits = 0, tileHits = 0, pointHits = 0;
+
+		auto compare = [&]()
+		{
+			std::sort(bvhResult.begin(), bvhResult.end());
+			std::sort(linearResult.begin(), linearResult.end());
+			if (bvhResult != linearResult)
+				numMismatches++;
+		};
+
+		double bvhFrustumTime = 0, linearFrustumTime = 0, bvhTileTime = 0, linearTileTime = 0;
+		for (int f = 0; f < numFrustums; ++f)
+		{
+			const D3DXPLANE* planes = &frustums[f * 6];
+
+			bvhResult.clear();
+			start = Now();
+			bvh.QueryFrustum(planes, bvhResult);
+			(f ? bvhTileTime : bvhFrustumTime) += Now() - start;
+
+			linearResult.clear();
+			start = Now();
+			for (size_t i = 0; i < spheres.size(); ++i)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; ++p)
+					inside = planes[p].a * spheres[i].x + planes[p].b * spheres[i].y + planes[p].c * spheres[i].z + planes[p].d >= -spheres[i].w;
+				if (inside)
+					linearResult.push_back(ids[i]);
+			}
+			(f ? linearTileTime : linearFrustumTime) += Now() - start;
+
+			(f ? tileHits : frustumHits) += linearResult.size();
+			compare();
+		}
+
+		double bvhPointTime = 0, linearPointTime = 0;
+		for (int i = 0; i < NumPoints; ++i)
+		{
+			bvhResult.clear();
+			start = Now();
+			bvh.QueryPoint(points[i], bvhResult);
+			bvhPointTime += Now() - start;
+
+			linearResult.clear();
+			start = Now();
+			for (size_t s = 0; s < spheres.size(); ++s)
+			{
+				const D3DXVECTOR3 delta = points[i] - D3DXVECTOR3(spheres[s].x, spheres[s].y, spheres[s].z);
+				if (D3DXVec3LengthSq(&delta) <= spheres[s].w * spheres[s].w)
+					linearResult.push_back(ids[s]);
+			}
+			linearPointTime += Now() - start;
+
+			pointHits += linearResult.size();
+			compare();
+		}
+
+		// Query cost of the refit tree against a fresh build on the moved lights
+		LightBVH rebuilt;
+		start = Now();
+		rebuilt.Build(lights);
+		double rebuildTime = Now() - start;
+
+		double rebuiltTileTime = 0;
+		for (int f = 1; f < numFrustums; ++f)
+		{
+			bvhResult.clear();
+			start = Now();
+			rebuilt.QueryFrustum(&frustums[f * 6], bvhResult);
+			rebuiltTileTime += Now() - start;
+		}
+
+		Log("LightBVH %6d lights: %u nodes, build %.3f ms, refit %.3f ms, rebuild after move %.3f ms\n",
+			NumLights[n], uint32_t(bvh.GetNodes().size()), buildTime * 1000.0, refitTime * 1000.0, rebuildTime * 1000.0);
+		Log("LightBVH %6d lights: frustum %.3f/%.3f ms (%u lights), %d tiles %.3f/%.3f ms (%u lights), %d points %.3f/%.3f ms (%u lights), bvh/linear\n",
+			NumLights[n], bvhFrustumTime * 1000.0, linearFrustumTime * 1000.0, uint32_t(frustumHits),
+			numFrustums - 1, bvhTileTime * 1000.0, linearTileTime * 1000.0, uint32_t(tileHits),
+			NumPoints, bvhPointTime * 1000.0, linearPointTime * 1000.0, uint32_t(pointHits));
+		Log("LightBVH %6d lights: tiles on rebuilt tree %.3f ms, %u queries differ from linear scan\n",
+			NumLights[n], rebuiltTileTime * 1000.0, uint32_t(numMismatches));
+	}
+}
+/**
+ * Frustum culling of synthetic scenes from one Sponza (about 400 subsets) up to a hundred times that.
+ * Boxes of varied size fill a Sponza sized hall, the camera turns around in it. The BVH and the linear SIMD
+ * pass are checked against a scalar per box plane test.
+ */
+void BenchmarkSceneCulling()
+{
+	const int NumObjects[] = { 400, 4000, 40000 };
+	const int NumViews = 64;
+
+	D3DXMATRIX proj;
+	BuildProjection(1920, 1080, proj);
+
+	std::vector<D3DXPLANE> frustums(NumViews * 6);
+	for (int v = 0; v < NumViews; ++v)
+	{
+		const float angle = 2.0f * D3DX_PI * v / NumViews;
+		D3DXVECTOR3 eye(20.0f * cosf(angle), 5.0f, 8.0f * sinf(angle));
+		D3DXVECTOR3 lookAt(eye.x - 10.0f * sinf(angle), 4.0f, eye.z + 10.0f * cosf(angle));
+		D3DXVECTOR3 up(0.0f, 1.0f, 0.0f);
+
+		D3DXMATRIX view;
+		D3DXMatrixLookAtLH(&view, &eye, &lookAt, &up);
+		ExtractFrustumPlanes(view * proj, D3DXVECTOR4(-1, -1, 1, 1), 0.0f, 1.0f, &frustums[v * 6]);
+	}
+
+	for (int n = 0; n < 3; ++n)
+	{
+		std::mt19937 rng(11);
+		std::uniform_real<float> positionX(-60.0f, 60.0f), positionY(0.0f, 30.0f), positionZ(-25.0f, 25.0f);
+		std::uniform_real<float> sizeDist(0.2f, 4.0f);
+
+		std::vector<BoundingBox> bounds(NumObjects[n]);
+		for (int i = 0; i < NumObjects[n]; ++i)
+		{
+			const D3DXVECTOR3 center(positionX(rng), positionY(rng), positionZ(rng));
+			const D3DXVECTOR3 extent(sizeDist(rng), sizeDist(rng), sizeDist(rng));
+			bounds[i] = BoundingBox(center - extent, center + extent);
+		}
+
+		SceneCulling culling;
+		double start = Now();
+		culling.Build(bounds);
+		double buildTime = Now() - start;
+
+		std::vector<uint32_t> bvhVisible, linearVisible, scalarVisible;
+		double bvhTime = 0, linearTime = 0, scalarTime = 0;
+		size_t numVisible = 0;
+		int numMismatches = 0;
+
+		for (int v = 0; v < NumViews; ++v)
+		{
+			const D3DXPLANE* planes = &frustums[v * 6];
+
+			bvhVisible.clear();
+			start = Now();
+			culling.CullFrustum(planes, bvhVisible);
+			bvhTime += Now() - start;
+
+			linearVisible.clear();
+			start = Now();
+			culling.CullFrustumLinear(planes, linearVisible);
+			linearTime += Now() - start;
+
+			scalarVisible.clear();
+			start = Now();
+			for (int i = 0; i < NumObjects[n]; ++i)
+			{
+				bool inside = true;
+				for (int p = 0; p < 6 && inside; ++p)
+				{
+					const D3DXVECTOR3 corner(
+						planes[p].a >= 0 ? bounds[i].Max.x : bounds[i].Min.x,
+						planes[p].b >= 0 ? bounds[i].Max.y : bounds[i].Min.y,
+						planes[p].c >= 0 ? bounds[i].Max.z : bounds[i].Min.z);
+					inside = planes[p].a * corner.x + planes[p].b * corner.y + planes[p].c * corner.z + planes[p].d >= 0;
+				}
+				if (inside)
+					scalarVisible.push_back(uint32_t(i));
+			}
+			scalarTime += Now() - start;
+
+			std::sort(bvhVisible.begin(), bvhVisible.end());
+			std::sort(linearVisible.begin(), linearVisible.end());
+			if (bvhVisible != scalarVisible || linearVisible != scalarVisible)
+				numMismatches++;
+
+			numVisible += scalarVisible.size();
+		}
+
+		const double objectsPerView = double(NumObjects[n]) * NumViews;
+		Log("SceneCulling %5d objects: build %.3f ms, %.1f%% visible, BVH %.2f us %.0f M objects/s, SIMD linear %.2f us %.0f M objects/s, scalar %.2f us %.0f M objects/s, %d mismatches\n",
+			NumObjects[n], buildTime * 1000.0, 100.0 * numVisible / objectsPerView,
+			bvhTime * 1e6 / NumViews, objectsPerView / bvhTime * 1e-6,
+			linearTime * 1e6 / NumViews, objectsPerView / linearTime * 1e-6,
+			scalarTime * 1e6 / NumViews, objectsPerView / scalarTime * 1e-6, numMismatches);
+	}
+}
+/**
+ * BoundingBoxBatch kernels against the BoundingBox member they vectorize, on random boxes. Every query
+ * result is compared, a mismatch means the kernels disagree with the scalar class.
+ */
+void BenchmarkBoundingBoxBatch()
+{
+	const int NumBoxes = 100000;
+	const int NumQueries = 256;
+
+	std::mt19937 rng(3);
+	std::uniform_real<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real<float> sizeDist(0.1f, 5.0f);
+
+	std::vector<BoundingBox> boxes(NumBoxes);
+	BoundingBoxBatch batch;
+	for (int i = 0; i < NumBoxes; ++i)
+	{
+		const D3DXVECTOR3 center(positionDist(rng), positionDist(rng), positionDist(rng));
+		const D3DXVECTOR3 extent(sizeDist(rng), sizeDist(rng), sizeDist(rng));
+		boxes[i] = BoundingBox(center - extent, center + extent);
+		batch.Add(boxes[i]);
+	}
+
+	D3DXMATRIX view, proj;
+	BuildView(view);
+	BuildProjection(1920, 1080, proj);
+
+	std::vector<uint32_t> scalarHits, batchHits;
+	double scalarTime[4] = { 0 }, batchTime[4] = { 0 };
+	int mismatches[4] = { 0 };
+
+	for (int q = 0; q < NumQueries; ++q)
+	{
+		// Odd ranges exercise the partial registers at both ends
+		const size_t first = rng() % 64;
+		const size_t count = NumBoxes - first - rng() % 64;
+
+		double start = Now();
+		BoundingBox scalarMerge;
+		for (size_t i = first; i < first + count; ++i)
+			scalarMerge.Merge(boxes[i]);
+		scalarTime[0] += Now() - start;
+
+		start = Now();
+		const BoundingBox batchMerge = batch.Merge(first, count);
+		batchTime[0] += Now() - start;
+
+		if (!(scalarMerge == batchMerge))
+			mismatches[0]++;
+
+		const D3DXVECTOR3 center(positionDist(rng), positionDist(rng), positionDist(rng));
+		const D3DXVECTOR3 extent(20.0f, 20.0f, 20.0f);
+		const BoundingBox queryBox(center - extent, center + extent);
+
+		D3DXPLANE planes[6];
+		const float tileX = positionDist(rng) * 0.009f, tileY = positionDist(rng) * 0.009f;
+		ExtractFrustumPlanes(view * proj, D3DXVECTOR4(tileX, tileY, tileX + 0.1f, tileY + 0.1f), 0.0f, 1.0f, planes);
+
+		for (int test = 1; test < 4; ++test)
+		{
+			scalarHits.clear();
+			start = Now();
+			for (size_t i = first; i < first + count; ++i)
+			{
+				const bool hit = test == 1 ? boxes[i].Intersects(queryBox) : 
+					(test == 2 ? boxes[i].Intersects(planes, 6) : boxes[i].Intersects(center, 20.0f));
+				if (hit)
+					scalarHits.push_back(uint32_t(i));
+			}
+			scalarTime[test] += Now() - start;
+
+			batchHits.clear();
+			start = Now();
+			if (test == 1)
+				batch.Intersects(queryBox, first, count, batchHits);
+			else if (test == 2)
+				batch.Intersects(planes, 6, first, count, batchHits);
+			else
+				batch.Intersects(center, 20.0f, first, count, batchHits);
+			batchTime[test] += Now() - start;
+
+			if (scalarHits != batchHits)
+				mismatches[test]++;
+		}
+	}
+
+	const char* names[4] = { "merge", "box", "planes", "sphere" };
+	for (int test = 0; test < 4; ++test)
+	{
+		Log("BoundingBoxBatch %-6s %d boxes: scalar %.3f ms, SIMD %.3f ms, %d mismatches\n", names[test], NumBoxes,
+			scalarTime[test] * 1000.0 / NumQueries, batchTime[test] * 1000.0 / NumQueries, mismatches[test]);
+	}
+}
+/**
+ * Bounds of every mesh from the positions its subsets index, as CDXUTSDKMesh::CreateFromMemory computes them.
+ * A mesh without subsets, like the spot light proxy, is drawn whole and gets the bounds of all its vertices.
+ */
+void ComputeMeshBounds(const SDKMeshFile& file, std::vector<BoundingBox>& bounds)
+{
+	const ArrayView<SDKMeshMesh> meshes = file.GetMeshes();
+	const ArrayView<SDKMeshSubset> subsets = file.GetSubsets();
+
+	bounds.assign(meshes.Size, BoundingBox());
+	for (uint32_t m = 0; m < meshes.Size; ++m)
+	{
+		const uint32_t vertexBuffer = meshes[m].VertexBuffers[0];
+		const int positionOffset = file.GetPositionOffset(vertexBuffer);
+		if (positionOffset < 0)
+			continue;
+
+		const ArrayView<uint8_t> vertices = file.GetVertexData(vertexBuffer);
+		const size_t stride = size_t(file.GetVertexBuffers()[vertexBuffer].StrideBytes);
+
+		const ArrayView<uint16_t> indices16 = file.GetIndices16(meshes[m].IndexBuffer);
+		const ArrayView<uint32_t> indices32 = file.GetIndices32(meshes[m].IndexBuffer);
+
+		const ArrayView<uint32_t> meshSubsets = file.GetMeshSubsets(m);
+		if (meshSubsets.empty())
+		{
+			for (size_t offset = positionOffset; offset + sizeof(D3DXVECTOR3) <= vertices.Size; offset += stride)
+			{
+				D3DXVECTOR3 position;
+				memcpy(&position, vertices.Data + offset, sizeof(position));
+				bounds[m].Merge(position);
+			}
+		}
+
+		for (size_t s = 0; s < meshSubsets.Size; ++s)
+		{
+			const SDKMeshSubset& subset = subsets[meshSubsets[s]];
+			for (uint64_t i = subset.IndexStart; i < subset.IndexStart + subset.IndexCount; ++i)
+			{
+				const uint64_t vertex = subset.VertexStart + (indices16.empty() ? indices32[size_t(i)] : indices16[size_t(i)]);
+				if (vertex * stride + positionOffset + sizeof(D3DXVECTOR3) > vertices.Size)
+					continue;
+
+				D3DXVECTOR3 position;
+				memcpy(&position, vertices.Data + vertex * stride + positionOffset, sizeof(position));
+				bounds[m].Merge(position);
+			}
+		}
+	}
+}
+
+/**
+ * A gridSize x gridSize vertex grid as one mesh with one subset and 32 bit indices, laid out like the DXUT
+ * exporter does: header, tables, then the buffer data. With numMeshes > 1 the file holds that many grids side
+ * by side along x, each with its own buffers, like a whole scene exported into one file.
+ */
+void BuildGridSDKMesh(int gridSize, std::vector<uint8_t>& data, int numMeshes = 1)
+{
+	struct GridVertex
+	{
+		D3DXVECTOR3 Position;
+		D3DXVECTOR3 Normal;
+		float Tex[2];
+	};
+
+	const uint64_t numVertices = uint64_t(gridSize) * gridSize;
+	const uint64_t numIndices = uint64_t(gridSize - 1) * (gridSize - 1) * 6;
+
+	// Mesh subset tables are 8 bytes apart, one index each
+	const uint64_t vertexBufferOffset = sizeof(SDKMeshHeader);
+	const uint64_t indexBufferOffset = vertexBufferOffset + numMeshes * sizeof(SDKMeshVertexBuffer);
+	const uint64_t meshOffset = indexBufferOffset + numMeshes * sizeof(SDKMeshIndexBuffer);
+	const uint64_t meshSubsetsOffset = meshOffset + numMeshes * sizeof(SDKMeshMesh);
+	const uint64_t subsetOffset = meshSubsetsOffset + numMeshes * 8;
+	const uint64_t materialOffset = subsetOffset + numMeshes * sizeof(SDKMeshSubset);
+	const uint64_t vertexDataOffset = materialOffset + sizeof(SDKMeshMaterial);
+	const uint64_t indexDataOffset = vertexDataOffset + numMeshes * numVertices * sizeof(GridVertex);
+
+	data.assign(size_t(indexDataOffset + numMeshes * numIndices * sizeof(uint32_t)), 0);
+
+	SDKMeshHeader& header = *reinterpret_cast<SDKMeshHeader*>(&data[0]);
+	header.Version = SDKMeshFileVersion;
+	header.HeaderSize = sizeof(SDKMeshHeader);
+	header.NonBufferDataSize = vertexDataOffset - sizeof(SDKMeshHeader);
+	header.BufferDataSize = data.size() - vertexDataOffset;
+	header.NumVertexBuffers = header.NumIndexBuffers = header.NumMeshes = header.NumTotalSubsets = numMeshes;
+	header.NumMaterials = 1;
+	header.VertexStreamHeadersOffset = vertexBufferOffset;
+	header.IndexStreamHeadersOffset = indexBufferOffset;
+	header.MeshDataOffset = meshOffset;
+	header.SubsetDataOffset = subsetOffset;
+	header.FrameDataOffset = materialOffset;
+	header.MaterialDataOffset = materialOffset;
+
+	SDKMeshMaterial& material = *reinterpret_cast<SDKMeshMaterial*>(&data[size_t(materialOffset)]);
+	strcpy(material.Name, "Grid");
+
+	const float halfSize = (gridSize - 1) * 0.5f;
+
+	for (int m = 0; m < numMeshes; ++m)
+	{
+		const uint64_t meshVertexDataOffset = vertexDataOffset + m * numVertices * sizeof(GridVertex);
+		const uint64_t meshIndexDataOffset = indexDataOffset + m * numIndices * sizeof(uint32_t);
+
+		// POSITION, NORMAL, TEXCOORD0, then end markers
+		SDKMeshVertexBuffer& vertexBuffer = *reinterpret_cast<SDKMeshVertexBuffer*>(&data[size_t(vertexBufferOffset + m * sizeof(SDKMeshVertexBuffer))]);
+		const SDKMeshVertexElement elements[] = { { 0, 0, 2, 0, 0, 0 }, { 0, 12, 2, 0, 3, 0 }, { 0, 24, 1, 0, 5, 0 } };
+		const SDKMeshVertexElement end = { 0xFF, 0, 17, 0, 0, 0 };
+		for (int i = 0; i < SDKMeshMaxVertexElements; ++i)
+			vertexBuffer.Decl[i] = i < 3 ? elements[i] : end;
+		vertexBuffer.NumVertices = numVertices;
+		vertexBuffer.StrideBytes = sizeof(GridVertex);
+		vertexBuffer.SizeBytes = numVertices * sizeof(GridVertex);
+		vertexBuffer.DataOffset = meshVertexDataOffset;
+
+		SDKMeshIndexBuffer& indexBuffer = *reinterpret_cast<SDKMeshIndexBuffer*>(&data[size_t(indexBufferOffset + m * sizeof(SDKMeshIndexBuffer))]);
+		indexBuffer.NumIndices = numIndices;
+		indexBuffer.SizeBytes = numIndices * sizeof(uint32_t);
+		indexBuffer.IndexType = SDKMeshIndex_32Bit;
+		indexBuffer.DataOffset = meshIndexDataOffset;
+
+		const float offsetX = m * float(gridSize);
+
+		SDKMeshMesh& mesh = *reinterpret_cast<SDKMeshMesh*>(&data[size_t(meshOffset + m * sizeof(SDKMeshMesh))]);
+		strcpy(mesh.Name, "Grid");
+		mesh.NumVertexBuffers = 1;
+		mesh.VertexBuffers[0] = m;
+		mesh.IndexBuffer = m;
+		mesh.NumSubsets = 1;
+		mesh.BoundingBoxCenter[0] = offsetX;
+		mesh.BoundingBoxExtents[0] = mesh.BoundingBoxExtents[2] = halfSize;
+		mesh.SubsetOffset = meshSubsetsOffset + m * 8;
+		mesh.FrameInfluenceOffset = meshSubsetsOffset + m * 8;
+
+		*reinterpret_cast<uint32_t*>(&data[size_t(mesh.SubsetOffset)]) = m;
+
+		SDKMeshSubset& subset = *reinterpret_cast<SDKMeshSubset*>(&data[size_t(subsetOffset + m * sizeof(SDKMeshSubset))]);
+		strcpy(subset.Name, "Grid");
+		subset.IndexCount = numIndices;
+		subset.VertexCount = numVertices;
+
+		GridVertex* vertices = reinterpret_cast<GridVertex*>(&data[size_t(meshVertexDataOffset)]);
+		uint32_t* indices = reinterpret_cast<uint32_t*>(&data[size_t(meshIndexDataOffset)]);
+		for (int z = 0; z < gridSize; ++z)
+		{
+			for (int x = 0; x < gridSize; ++x)
+			{
+				GridVertex& vertex = vertices[z * gridSize + x];
+				vertex.Position = D3DXVECTOR3(offsetX + x - halfSize, 0, z - halfSize);
+				vertex.Normal = D3DXVECTOR3(0, 1, 0);
+				vertex.Tex[0] = x / float(gridSize - 1);
+				vertex.Tex[1] = z / float(gridSize - 1);
+
+				if (x + 1 < gridSize && z + 1 < gridSize)
+				{
+					const uint32_t i = z * gridSize + x;
+					const uint32_t quad[6] = { i, i + gridSize, i + 1, i + 1, i + gridSize, i + gridSize + 1 };
+					indices = std::copy(quad, quad + 6, indices);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Number of corrupted copies of a valid file that SDKMeshFile still accepts, should be 0.
+ */
+int CountAcceptedCorruptions(const std::vector<uint8_t>& valid)
+{
+	std::vector<uint8_t> data;
+	SDKMeshFile file;
+	int accepted = 0;
+
+	const SDKMeshHeader& header = *reinterpret_cast<const SDKMeshHeader*>(&valid[0]);
+	const size_t vertexBuffer = size_t(header.VertexStreamHeadersOffset);
+	const size_t indexBuffer = size_t(header.IndexStreamHeadersOffset);
+	const size_t mesh = size_t(header.MeshDataOffset);
+	const size_t subset = size_t(header.SubsetDataOffset);
+
+	// Offset and value of a 32 or 64 bit field to overwrite
+	const struct { size_t Offset; uint64_t Value; bool Is64; } corruptions[] = 
+	{
+		{ offsetof(SDKMeshHeader, Version), 100, false },
+		{ offsetof(SDKMeshHeader, NumMeshes), 1000, false },
+		{ offsetof(SDKMeshHeader, MaterialDataOffset), valid.size() - 8, true },
+		{ vertexBuffer + offsetof(SDKMeshVertexBuffer, NumVertices), ~uint64_t(0) / 2, true },
+		{ vertexBuffer + offsetof(SDKMeshVertexBuffer, StrideBytes), 0, true },
+		{ vertexBuffer + offsetof(SDKMeshVertexBuffer, DataOffset), valid.size() - 16, true },
+		{ indexBuffer + offsetof(SDKMeshIndexBuffer, IndexType), 7, false },
+		{ indexBuffer + offsetof(SDKMeshIndexBuffer, SizeBytes), ~uint64_t(0), true },
+		{ mesh + offsetof(SDKMeshMesh, IndexBuffer), 5, false },
+		{ mesh + offsetof(SDKMeshMesh, VertexBuffers), 3, false },
+		{ mesh + offsetof(SDKMeshMesh, SubsetOffset), ~uint64_t(0) - 2, true },
+		{ subset + offsetof(SDKMeshSubset, MaterialID), 9, false },
+		{ subset + offsetof(SDKMeshSubset, IndexCount), ~uint64_t(0), true },
+		{ subset + offsetof(SDKMeshSubset, VertexStart), 1, true },
+	};
+
+	for (int c = 0; c < sizeof(corruptions) / sizeof(corruptions[0]); ++c)
+	{
+		data = valid;
+		if (corruptions[c].Is64)
+			memcpy(&data[corruptions[c].Offset], &corruptions[c].Value, sizeof(uint64_t));
+		else
+		{
+			const uint32_t value = uint32_t(corruptions[c].Value);
+			memcpy(&data[corruptions[c].Offset], &value, sizeof(uint32_t));
+		}
+		accepted += file.OpenMemory(&data[0], data.size());
+	}
+
+	// Truncated
+	accepted += file.OpenMemory(&valid[0], valid.size() - 1);
+	accepted += file.OpenMemory(&valid[0], sizeof(SDKMeshHeader) - 1);
+
+	return accepted;
+}
+
+/**
+ * SDKMeshFile memory mapping a mesh against reading it into the heap first like CDXUTSDKMesh::CreateFromFile,
+ * both followed by a pass over the positions so the mapped pages really get touched.
+ */
+void BenchmarkSDKMeshLoad()
+{
+	const char* GridFile = "SDKMeshGrid.sdkmesh";
+	const char* MeshFiles[] = 
+	{
+		".\\Media\\PointLightProxy.sdkmesh",
+		".\\Media\\SpotLightProxy.sdkmesh",
+		".\\Media\\Sponza\\sponza_dds.sdkmesh",
+		"..\\media\\powerplant\\powerplant.sdkmesh",
+		GridFile
+	};
+
+	// A large mesh that is always there, 1M vertices and 6M indices
+	std::vector<uint8_t> grid;
+	BuildGridSDKMesh(1024, grid);
+	Log("SDKMesh %s: %d of 16 corrupted copies accepted\n", GridFile, CountAcceptedCorruptions(grid));
+
+	FILE* gridFile = NULL;
+	if (fopen_s(&gridFile, GridFile, "wb") == 0)
+	{
+		fwrite(&grid[0], 1, grid.size(), gridFile);
+		fclose(gridFile);
+	}
+	grid.clear();
+
+	for (int f = 0; f < sizeof(MeshFiles) / sizeof(MeshFiles[0]); ++f)
+	{
+		SDKMeshFile mapped;
+		if (!mapped.Open(MeshFiles[f]))
+		{
+			Log("SDKMesh %s: not found or not a valid sdkmesh\n", MeshFiles[f]);
+			continue;
+		}
+
+		// Small files are loaded many times to get measurable times. A copy, the loops remap the file.
+		const SDKMeshHeader header = mapped.GetHeader();
+		const uint64_t fileSize = header.HeaderSize + header.NonBufferDataSize + header.BufferDataSize;
+		const int numIterations = int((std::max)(uint64_t(4), (uint64_t(256) << 20) / (std::max)(fileSize, uint64_t(1))));
+
+		std::vector<BoundingBox> mappedBounds, heapBounds;
+
+		double start = Now();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			mapped.Open(MeshFiles[f]);
+			ComputeMeshBounds(mapped, mappedBounds);
+		}
+		const double mappedTime = (Now() - start) / numIterations;
+
+		std::vector<uint8_t> data;
+		SDKMeshFile heap;
+
+		start = Now();
+		for (int i = 0; i < numIterations; ++i)
+		{
+			FILE* file = NULL;
+			if (fopen_s(&file, MeshFiles[f], "rb") == 0)
+			{
+				fseek(file, 0, SEEK_END);
+				data.resize(size_t(ftell(file)));
+				fseek(file, 0, SEEK_SET);
+				data.resize(fread(&data[0], 1, data.size(), file));
+				fclose(file);
+			}
+
+			heap.OpenMemory(data.empty() ? NULL : &data[0], data.size());
+			ComputeMeshBounds(heap, heapBounds);
+		}
+		const double heapTime = (Now() - start) / numIterations;
+
+		// Both paths have to agree, and with the bounds the exporter stored
+		int mismatches = heap.IsOpen() ? 0 : -1;
+		int storedMismatches = 0;
+		uint64_t numIndices = 0;
+		for (size_t m = 0; m < mappedBounds.size() && heap.IsOpen(); ++m)
+		{
+			mismatches += !(mappedBounds[m] == heapBounds[m]);
+
+			const SDKMeshMesh& mesh = mapped.GetMeshes()[m];
+			const D3DXVECTOR3 center(mesh.BoundingBoxCenter), extents(mesh.BoundingBoxExtents);
+			const D3DXVECTOR3 centerError = mappedBounds[m].Center() - center;
+			const D3DXVECTOR3 extentsError = (mappedBounds[m].Max - mappedBounds[m].Min) * 0.5f - extents;
+			storedMismatches += (std::max)(D3DXVec3Length(&centerError), D3DXVec3Length(&extentsError)) > 1e-3f * (std::max)(1.0f, D3DXVec3Length(&extents));
+		}
+
+		for (size_t i = 0; i < mapped.GetIndexBuffers().Size; ++i)
+			numIndices += mapped.GetIndexBuffers()[i].NumIndices;
+
+		Log("SDKMesh %s: %u meshes, %u subsets, %u materials, %llu indices, %.1f KB\n", MeshFiles[f], header.NumMeshes,
+			header.NumTotalSubsets, header.NumMaterials, (unsigned long long)numIndices, fileSize / 1024.0);
+		Log("SDKMesh %s: mapped %.3f ms, read to heap %.3f ms, %d mismatching bounds, %d differ from the stored bounds\n", MeshFiles[f],
+			mappedTime * 1000.0, heapTime * 1000.0, mismatches, storedMismatches);
+	}
+
+	remove(GridFile);
+}
+
+/**
+ * Scene startup through SceneLoader with 1 to 2x the cores worker threads, up to the point where the device
+ * thread could create the buffers; creating them and loading the textures needs the device and isn't timed.
+ * Power Plant and Sponza when they are there, and two scenes of generated grids that always are: one file
+ * per grid, and all grids in a single file like Power Plant and Sponza, which only scales with the work
+ * split inside a file. The subset boxes have to come out the same for every number of workers.
+ */
+void BenchmarkSceneLoad()
+{
+	const int NumGrids = 16;
+	const char* PowerPlantFiles[] = { "..\\media\\powerplant\\powerplant.sdkmesh" };
+	const char* SponzaFiles[] = { ".\\Media\\Sponza\\sponza_dds.sdkmesh" };
+
+	std::vector<std::string> gridFiles, gridSceneFiles;
+	for (int i = 0; i <= NumGrids; ++i)
+	{
+		char filename[64];
+		sprintf_s(filename, "SceneLoadGrid%d.sdkmesh", i);
+
+		// The last one holds NumGrids meshes
+		std::vector<uint8_t> grid;
+		if (i < NumGrids)
+			BuildGridSDKMesh(256 + 32 * i, grid);
+		else
+			BuildGridSDKMesh(480, grid, NumGrids);
+
+		FILE* file = NULL;
+		if (fopen_s(&file, filename, "wb") == 0)
+		{
+			fwrite(&grid[0], 1, grid.size(), file);
+			fclose(file);
+			(i < NumGrids ? gridFiles : gridSceneFiles).push_back(filename);
+		}
+	}
+
+	struct SceneFiles
+	{
+		const char* Name;
+		std::vector<std::string> Files;
+	} scenes[] = 
+	{
+		{ "PowerPlant", std::vector<std::string>(PowerPlantFiles, PowerPlantFiles + 1) },
+		{ "Sponza", std::vector<std::string>(SponzaFiles, SponzaFiles + 1) },
+		{ "Grids", gridFiles },
+		{ "GridScene", gridSceneFiles },
+	};
+
+	const int maxWorkers = 2 * (std::max)(1, int(Concurrency::GetProcessorCount()));
+
+	for (int s = 0; s < sizeof(scenes) / sizeof(scenes[0]); ++s)
+	{
+		const SceneFiles& scene = scenes[s];
+
+		FILE* file = NULL;
+		if (scene.Files.empty() || fopen_s(&file, scene.Files[0].c_str(), "rb") != 0)
+		{
+			Log("SceneLoad %s: not found\n", scene.Name);
+			continue;
+		}
+		fclose(file);
+
+		std::vector<BoundingBox> reference;
+		for (int workers = 1; workers <= maxWorkers; workers *= 2)
+		{
+			Concurrency::SchedulerPolicy policy(2, Concurrency::MinConcurrency, 1, Concurrency::MaxConcurrency, workers);
+			Concurrency::CurrentScheduler::Create(policy);
+
+			std::vector<BoundingBox> bounds;
+			int failed = 0;
+
+			double start = Now();
+			{
+				SceneLoader loader;
+				for (size_t f = 0; f < scene.Files.size(); ++f)
+					loader.Add(scene.Files[f], D3DXMATRIX(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1));
+				loader.Start();
+
+				// The device thread would render frames meanwhile and then create the buffers of each mesh
+				loader.Wait();
+				while (SceneLoader::LoadedMesh* mesh = loader.PopNext())
+				{
+					failed += mesh->Data == NULL;
+					bounds.insert(bounds.end(), mesh->SubsetBounds.begin(), mesh->SubsetBounds.end());
+					delete mesh;
+				}
+			}
+			const double loadTime = Now() - start;
+
+			Concurrency::CurrentScheduler::Detach();
+
+			if (reference.empty())
+				reference = bounds;
+
+			int mismatches = bounds.size() == reference.size() ? 0 : -1;
+			for (size_t i = 0; i < bounds.size() && mismatches >= 0; ++i)
+				mismatches += !(bounds[i] == reference[i]);
+
+			Log("SceneLoad %-9s %2d workers: %8.2f ms, %d files, %d failed, %u subsets, %d mismatches\n", scene.Name, workers,
+				loadTime * 1000.0, int(scene.Files.size()), failed, unsigned(bounds.size()), mismatches);
+		}
+	}
+
+	for (size_t i = 0; i < gridFiles.size(); ++i)
+		remove(gridFiles[i].c_str());
+	for (size_t i = 0; i < gridSceneFiles.size(); ++i)
+		remove(gridSceneFiles[i].c_str());
+}
+
+// False if the file isn't there or is empty
+bool ReadWholeFile(const char* filename, std::vector<uint8_t>& data)
+{
+	FILE* file = NULL;
+	if (fopen_s(&file, filename, "rb") != 0)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	data.resize(size_t(ftell(file)));
+	fseek(file, 0, SEEK_SET);
+	data.resize(data.empty() ? 0 : fread(&data[0], 1, data.size(), file));
+	fclose(file);
+
+	return !data.empty();
+}
+
+/**
+ * The triangle list subsets of a mesh file as 32 bit indices relative to VertexStart.
+ */
+struct SubsetTriangles
+{
+	std::vector<uint32_t> Indices;
+	uint32_t NumVertices;
+	uint32_t VertexBuffer;
+	const uint8_t* Vertices;    // Stream 0 at VertexStart
+	size_t Stride;
+	int PositionOffset;
+};
+
+void ExtractSubsetTriangles(const SDKMeshFile& file, std::vector<SubsetTriangles>& result)
+{
+	const ArrayView<SDKMeshMesh> meshes = file.GetMeshes();
+	const ArrayView<SDKMeshSubset> subsets = file.GetSubsets();
+
+	result.clear();
+	for (uint32_t m = 0; m < meshes.Size; ++m)
+	{
+		const uint32_t vertexBuffer = meshes[m].VertexBuffers[0];
+		const SDKMeshVertexBuffer& vertexBufferHeader = file.GetVertexBuffers()[vertexBuffer];
+		const ArrayView<uint16_t> indices16 = file.GetIndices16(meshes[m].IndexBuffer);
+		const ArrayView<uint32_t> indices32 = file.GetIndices32(meshes[m].IndexBuffer);
+
+		const ArrayView<uint32_t> meshSubsets = file.GetMeshSubsets(m);
+		for (size_t s = 0; s < meshSubsets.Size; ++s)
+		{
+			// D3DPT_TRIANGLELIST
+			const SDKMeshSubset& subset = subsets[meshSubsets[s]];
+			if (subset.PrimitiveType != 0 || subset.IndexCount == 0 || subset.IndexCount % 3 != 0)
+				continue;
+
+			SubsetTriangles triangles;
+			for (uint64_t i = subset.IndexStart; i < subset.IndexStart + subset.IndexCount; ++i)
+				triangles.Indices.push_back(indices16.empty() ? indices32[size_t(i)] : indices16[size_t(i)]);
+
+			triangles.NumVertices = *std::max_element(triangles.Indices.begin(), triangles.Indices.end()) + 1;
+			if (subset.VertexStart + triangles.NumVertices > vertexBufferHeader.NumVertices)
+				continue;
+
+			triangles.VertexBuffer = vertexBuffer;
+			triangles.Stride = size_t(vertexBufferHeader.StrideBytes);
+			triangles.Vertices = file.GetVertexData(vertexBuffer).Data + subset.VertexStart * triangles.Stride;
+			triangles.PositionOffset = file.GetPositionOffset(vertexBuffer);
+
+			result.push_back(triangles);
+		}
+	}
+}
+
+/**
+ * Triangles of a list rotated to start at their smallest index, in sorted order. Lists with the same
+ * triangles and windings give the same.
+ */
+void CanonicalTriangles(const std::vector<uint32_t>& indices, std::vector<std::array<uint32_t, 3> >& triangles)
+{
+	triangles.resize(indices.size() / 3);
+	for (size_t t = 0; t < triangles.size(); ++t)
+	{
+		const uint32_t* triangle = &indices[t * 3];
+		const int first = int(std::min_element(triangle, triangle + 3) - triangle);
+		for (int c = 0; c < 3; ++c)
+			triangles[t][c] = triangle[(first + c) % 3];
+	}
+	std::sort(triangles.begin(), triangles.end());
+}
+
+// Triangles of the reference missing from the other list
+int CountTriangleMismatches(const std::vector<uint32_t>& reference, const std::vector<uint32_t>& indices)
+{
+	std::vector<std::array<uint32_t, 3> > a, b, missing;
+	CanonicalTriangles(reference, a);
+	CanonicalTriangles(indices, b);
+	std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(missing));
+	return int(missing.size() + (a.size() > b.size() ? 0 : b.size() - a.size()));
+}
+
+/**
+ * Triangles of the reference file missing from the other, compared by the bytes of their vertices so
+ * renumbered vertices still match. Both files need the same subsets.
+ */
+int CountVertexTriangleMismatches(const SDKMeshFile& reference, const SDKMeshFile& file)
+{
+	std::vector<SubsetTriangles> a, b;
+	ExtractSubsetTriangles(reference, a);
+	ExtractSubsetTriangles(file, b);
+	if (a.size() != b.size())
+		return -1;
+
+	int mismatches = 0;
+	std::vector<std::string> keysA, keysB, missing;
+	for (size_t s = 0; s < a.size(); ++s)
+	{
+		const SubsetTriangles* lists[2] = { &a[s], &b[s] };
+		std::vector<std::string>* keys[2] = { &keysA, &keysB };
+		for (int l = 0; l < 2; ++l)
+		{
+			const SubsetTriangles& triangles = *lists[l];
+			keys[l]->resize(triangles.Indices.size() / 3);
+			for (size_t t = 0; t < keys[l]->size(); ++t)
+			{
+				std::string corners[3];
+				for (int c = 0; c < 3; ++c)
+				{
+					const uint8_t* vertex = triangles.Vertices + triangles.Indices[t * 3 + c] * triangles.Stride;
+					corners[c].assign(vertex, vertex + triangles.Stride);
+				}
+
+				const int first = int(std::min_element(corners, corners + 3) - corners);
+				(*keys[l])[t] = corners[first] + corners[(first + 1) % 3] + corners[(first + 2) % 3];
+			}
+			std::sort(keys[l]->begin(), keys[l]->end());
+		}
+
+		missing.clear();
+		std::set_difference(keysA.begin(), keysA.end(), keysB.begin(), keysB.end(), std::back_inserter(missing));
+		mismatches += int(missing.size());
+	}
+
+	return mismatches;
+}
+
+/**
+ * ACMR and ATVR through a FIFO cache of DefaultVertexCacheSize entries for the meshes as authored, after
+ * Forsyth, after Tipsify and after Tipsify with the overdraw cluster sort, subset by subset. Then the whole
+ * OptimizeSDKMesh pass the scene loader runs, checked to keep every triangle, winding and subset box.
+ * A generated grid is always there, once in row order and once with its triangles shuffled.
+ */
+void BenchmarkMeshOptimizer()
+{
+	const char* MeshFiles[] = 
+	{
+		".\\Media\\PointLightProxy.sdkmesh",
+		".\\Media\\SpotLightProxy.sdkmesh",
+		".\\Media\\Sponza\\sponza_dds.sdkmesh",
+		"..\\media\\powerplant\\powerplant.sdkmesh",
+	};
+
+	struct MeshSource
+	{
+		std::string Name;
+		std::vector<uint8_t> Data;
+	};
+
+	std::vector<MeshSource> sources;
+	for (int f = 0; f < sizeof(MeshFiles) / sizeof(MeshFiles[0]); ++f)
+	{
+		MeshSource source;
+		source.Name = MeshFiles[f];
+		if (!ReadWholeFile(MeshFiles[f], source.Data))
+		{
+			Log("MeshOptimizer %s: not found\n", MeshFiles[f]);
+			continue;
+		}
+		sources.push_back(source);
+	}
+
+	MeshSource grid;
+	grid.Name = "Grid256";
+	BuildGridSDKMesh(256, grid.Data);
+	sources.push_back(grid);
+
+	// Same grid, triangles in random order like a careless exporter would leave them
+	grid.Name = "Grid256Shuffled";
+	{
+		const SDKMeshHeader& header = *reinterpret_cast<const SDKMeshHeader*>(&grid.Data[0]);
+		const SDKMeshIndexBuffer& indexBuffer = *reinterpret_cast<const SDKMeshIndexBuffer*>(&grid.Data[size_t(header.IndexStreamHeadersOffset)]);
+		std::array<uint32_t, 3>* triangles = reinterpret_cast<std::array<uint32_t, 3>*>(&grid.Data[size_t(indexBuffer.DataOffset)]);
+
+		std::mt19937 rng(13);
+		std::shuffle(triangles, triangles + indexBuffer.NumIndices / 3, rng);
+	}
+	sources.push_back(grid);
+
+	const char* MethodNames[] = { "as authored", "Forsyth", "Tipsify", "Tipsify + overdraw" };
+	const int NumMethods = sizeof(MethodNames) / sizeof(MethodNames[0]);
+
+	for (size_t m = 0; m < sources.size(); ++m)
+	{
+		const MeshSource& source = sources[m];
+
+		SDKMeshFile file;
+		std::vector<SubsetTriangles> subsets;
+		if (file.OpenMemory(&source.Data[0], source.Data.size()))
+			ExtractSubsetTriangles(file, subsets);
+
+		if (subsets.empty())
+		{
+			Log("MeshOptimizer %s: no triangle list subsets\n", source.Name.c_str());
+			continue;
+		}
+
+		VertexCacheStatistics statistics[NumMethods];
+		memset(statistics, 0, sizeof(statistics));
+		double times[NumMethods] = { 0 };
+		int mismatches[NumMethods] = { 0 };
+
+		std::vector<uint32_t> results[NumMethods];
+		for (size_t s = 0; s < subsets.size(); ++s)
+		{
+			const SubsetTriangles& subset = subsets[s];
+			const size_t numIndices = subset.Indices.size();
+			for (int method = 1; method < NumMethods; ++method)
+				results[method].resize(numIndices);
+			results[0] = subset.Indices;
+
+			double start = Now();
+			OptimizeVertexCacheForsyth(&results[1][0], &subset.Indices[0], numIndices, subset.NumVertices);
+			times[1] += Now() - start;
+
+			start = Now();
+			OptimizeVertexCacheTipsify(&results[2][0], &subset.Indices[0], numIndices, subset.NumVertices);
+			times[2] += Now() - start;
+
+			if (subset.PositionOffset >= 0)
+			{
+				start = Now();
+				OptimizeOverdraw(&results[3][0], &results[2][0], numIndices, subset.Vertices + subset.PositionOffset, subset.Stride, subset.NumVertices);
+				times[3] += Now() - start;
+			}
+			else
+				results[3] = results[2];
+
+			for (int method = 0; method < NumMethods; ++method)
+			{
+				const VertexCacheStatistics result = AnalyzeVertexCache(&results[method][0], numIndices, subset.NumVertices, DefaultVertexCacheSize);
+				statistics[method].NumTriangles += result.NumTriangles;
+				statistics[method].NumVertices += result.NumVertices;
+				statistics[method].NumMisses += result.NumMisses;
+				mismatches[method] += CountTriangleMismatches(subset.Indices, results[method]);
+			}
+		}
+
+		// The overdraw sort runs on the Tipsify order
+		times[3] += times[2];
+
+		for (int method = 0; method < NumMethods; ++method)
+		{
+			Log("MeshOptimizer %s %-18s: ACMR %.3f, ATVR %.3f, %8.2f ms, %d mismatching triangles\n", source.Name.c_str(), MethodNames[method],
+				statistics[method].ACMR(), statistics[method].ATVR(), times[method] * 1000.0, mismatches[method]);
+		}
+
+		// The whole file in place, as SceneLoader does it
+		std::vector<uint8_t> optimized = source.Data;
+		SDKMeshOptimizeStatistics fileStatistics;
+
+		const double start = Now();
+		OptimizeSDKMesh(&optimized[0], optimized.size(), DefaultVertexCacheSize, &fileStatistics);
+		const double optimizeTime = Now() - start;
+
+		SDKMeshFile optimizedFile;
+		optimizedFile.OpenMemory(&optimized[0], optimized.size());
+
+		std::vector<BoundingBox> bounds, optimizedBounds;
+		ComputeMeshBounds(file, bounds);
+		ComputeMeshBounds(optimizedFile, optimizedBounds);
+
+		int boundMismatches = 0;
+		for (size_t b = 0; b < bounds.size(); ++b)
+			boundMismatches += !(bounds[b] == optimizedBounds[b]);
+
+		Log("MeshOptimizer %s OptimizeSDKMesh: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u subsets (%u skipped), %u vertex buffers renumbered (%u skipped), "
+			"%.2f ms, %d mismatching triangles, %d mismatching bounds\n", source.Name.c_str(), fileStatistics.Before.ACMR(), fileStatistics.After.ACMR(),
+			fileStatistics.Before.ATVR(), fileStatistics.After.ATVR(), fileStatistics.NumSubsets, fileStatistics.NumSkippedSubsets,
+			fileStatistics.NumVertexBuffers, fileStatistics.NumSkippedVertexBuffers, optimizeTime * 1000.0,
+			CountVertexTriangleMismatches(file, optimizedFile), boundMismatches);
+
+		// The first vertex buffer's data moved onto the first index buffer's, has to be left as it is
+		std::vector<uint8_t> overlapping = source.Data;
+		{
+			const SDKMeshHeader& header = *reinterpret_cast<const SDKMeshHeader*>(&overlapping[0]);
+			SDKMeshVertexBuffer& vertexBuffer = *reinterpret_cast<SDKMeshVertexBuffer*>(&overlapping[size_t(header.VertexStreamHeadersOffset)]);
+			const SDKMeshIndexBuffer& indexBuffer = *reinterpret_cast<const SDKMeshIndexBuffer*>(&overlapping[size_t(header.IndexStreamHeadersOffset)]);
+			vertexBuffer.DataOffset = indexBuffer.DataOffset;
+		}
+
+		const std::vector<uint8_t> damaged = overlapping;
+		const bool optimizedOverlapping = OptimizeSDKMesh(&overlapping[0], overlapping.size());
+
+		Log("MeshOptimizer %s overlapping buffers: %s, %s\n", source.Name.c_str(), optimizedOverlapping ? "NOT REJECTED" : "rejected",
+			overlapping == damaged ? "unchanged" : "CHANGED");
+	}
+}
+
+/**
+ * Vertices whose decoded form is further off than the formats allow: half a unorm step of the box per position
+ * axis (plus float rounding), half an ulp of the half texture coordinates and 0.01 degrees for the 16 bit
+ * octahedral normals.
+ */
+int CountVerticesOutOfBounds(const MeshVertex* original, const MeshVertex* decoded, size_t numVertices, const VertexQuantization& quantization)
+{
+	int count = 0;
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		bool outOfBounds = false;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float scale = (&quantization.Scale.x)[axis];
+			const float value = (&original[i].Position.x)[axis];
+			const float tolerance = scale * (0.5f / 65535.0f) + (fabsf(value) + scale) * 1e-6f;
+			outOfBounds |= fabsf((&decoded[i].Position.x)[axis] - value) > tolerance;
+		}
+
+		for (int c = 0; c < 2; ++c)
+		{
+			const float value = (&original[i].Tex.x)[c];
+			outOfBounds |= fabsf((&decoded[i].Tex.x)[c] - value) > fabsf(value) * (1.0f / 2048.0f) + (1.0f / (1 << 25));
+		}
+
+		if (D3DXVec3LengthSq(&original[i].Normal) > 0)
+		{
+			const VertexCompressionError error = MeasureCompressionError(original + i, decoded + i, 1);
+			outOfBounds |= error.MaxNormalDegrees > 0.01f;
+		}
+
+		count += outOfBounds;
+	}
+	return count;
+}
+
+/**
+ * PackedVertex encoding of the scene meshes after OptimizeSDKMesh, as the loader would leave them: encode and
+ * decode times, the largest errors, vertex memory and the vertex bytes fetched by one draw of every subset
+ * (misses of a DefaultVertexCacheSize FIFO times the stride). Buffers with 16 bytes or less per vertex, like
+ * the position only spot light proxy, are left as they are. Every decoded vertex has to be within the
+ * precision of the formats.
+ */
+void BenchmarkVertexCompression()
+{
+	const char* GridName = "Grid256";
+	const char* MeshFiles[] = 
+	{
+		".\\Media\\PointLightProxy.sdkmesh",
+		".\\Media\\SpotLightProxy.sdkmesh",
+		".\\Media\\Sponza\\sponza_dds.sdkmesh",
+		"..\\media\\powerplant\\powerplant.sdkmesh",
+		GridName
+	};
+
+	for (int f = 0; f < sizeof(MeshFiles) / sizeof(MeshFiles[0]); ++f)
+	{
+		std::vector<uint8_t> data;
+		if (MeshFiles[f] == GridName)
+			BuildGridSDKMesh(256, data);
+		else if (!ReadWholeFile(MeshFiles[f], data))
+		{
+			Log("VertexCompression %s: not found\n", MeshFiles[f]);
+			continue;
+		}
+
+		SDKMeshFile file;
+		if (!OptimizeSDKMesh(&data[0], data.size()) || !file.OpenMemory(&data[0], data.size()))
+		{
+			Log("VertexCompression %s: not a valid sdkmesh\n", MeshFiles[f]);
+			continue;
+		}
+
+		const ArrayView<SDKMeshVertexBuffer> vertexBuffers = file.GetVertexBuffers();
+		std::vector<bool> packedBuffers(vertexBuffers.Size, false);
+
+		VertexCompressionError maxError = { 0, 0, 0, 0, 0 };
+		double sumNormalDegrees = 0, encodeTime = 0, decodeTime = 0;
+		uint64_t bytes = 0, packedBytes = 0, numPackedVertices = 0;
+		int numPackedBuffers = 0, outOfBounds = 0;
+
+		std::vector<MeshVertex> vertices, decoded;
+		std::vector<PackedVertex> packed;
+		for (uint32_t vb = 0; vb < vertexBuffers.Size; ++vb)
+		{
+			const uint64_t numVertices = vertexBuffers[vb].NumVertices;
+			bytes += numVertices * vertexBuffers[vb].StrideBytes;
+
+			if (vertexBuffers[vb].StrideBytes <= sizeof(PackedVertex) || !ReadMeshVertices(file, vb, vertices) || vertices.empty())
+			{
+				packedBytes += numVertices * vertexBuffers[vb].StrideBytes;
+				continue;
+			}
+
+			const VertexQuantization quantization = ComputeVertexQuantization(&vertices[0], vertices.size());
+			packed.resize(vertices.size());
+			decoded.resize(vertices.size());
+
+			double start = Now();
+			EncodeVertices(&vertices[0], vertices.size(), quantization, &packed[0]);
+			encodeTime += Now() - start;
+
+			start = Now();
+			DecodeVertices(&packed[0], packed.size(), quantization, &decoded[0]);
+			decodeTime += Now() - start;
+
+			outOfBounds += CountVerticesOutOfBounds(&vertices[0], &decoded[0], vertices.size(), quantization);
+
+			const VertexCompressionError error = MeasureCompressionError(&vertices[0], &decoded[0], vertices.size());
+			maxError.MaxPosition = (std::max)(maxError.MaxPosition, error.MaxPosition);
+			maxError.MaxPositionRelative = (std::max)(maxError.MaxPositionRelative, error.MaxPositionRelative);
+			maxError.MaxNormalDegrees = (std::max)(maxError.MaxNormalDegrees, error.MaxNormalDegrees);
+			maxError.MaxTex = (std::max)(maxError.MaxTex, error.MaxTex);
+			sumNormalDegrees += error.MeanNormalDegrees * vertices.size();
+
+			packedBuffers[vb] = true;
+			packedBytes += vertices.size() * sizeof(PackedVertex);
+			numPackedVertices += vertices.size();
+			++numPackedBuffers;
+		}
+
+		std::vector<SubsetTriangles> subsets;
+		ExtractSubsetTriangles(file, subsets);
+
+		uint64_t fetchBytes = 0, packedFetchBytes = 0;
+		for (size_t s = 0; s < subsets.size(); ++s)
+		{
+			const SubsetTriangles& subset = subsets[s];
+			const uint64_t misses = AnalyzeVertexCache(&subset.Indices[0], subset.Indices.size(), subset.NumVertices, DefaultVertexCacheSize).NumMisses;
+			fetchBytes += misses * subset.Stride;
+			packedFetchBytes += misses * (packedBuffers[subset.VertexBuffer] ? sizeof(PackedVertex) : subset.Stride);
+		}
+
+		Log("VertexCompression %s: %d of %u vertex buffers packed, %.1f KB -> %.1f KB of vertices, %.1f KB -> %.1f KB fetched per draw of all subsets\n",
+			MeshFiles[f], numPackedBuffers, unsigned(vertexBuffers.Size), bytes / 1024.0, packedBytes / 1024.0, fetchBytes / 1024.0, packedFetchBytes / 1024.0);
+
+		if (numPackedBuffers)
+		{
+			Log("VertexCompression %s: encode %.2f ms, decode %.2f ms, position error %.3g (%.2g of the diagonal), normal error max %.4f mean %.4f degrees, "
+				"texcoord error %.3g, %d vertices out of the format's bounds\n", MeshFiles[f], encodeTime * 1000.0, decodeTime * 1000.0,
+				maxError.MaxPosition, maxError.MaxPositionRelative, maxError.MaxNormalDegrees, sumNormalDegrees / numPackedVertices,
+				maxError.MaxTex, outOfBounds);
+		}
+	}
+}
+
+/**
+ * Stands in for ID3D11DeviceContext in the light volume submit templates. Buffers are plain memory and the
+ * handle is the memory itself, so Map hands it back. Every call is counted, and each draw records the
+ * lights it would shade: the Light cbuffer for single draws, the instance range for instanced draws.
+ */
+class LightVolumeRecorder
+{
+public:
+	struct Counters
+	{
+		int Calls;
+		int Maps;
+		size_t MappedBytes;
+		int Draws;
+		int StateChanges;           // Depth stencil and rasterizer state sets
+	};
+
+public:
+	LightVolumeRecorder(const LightVolumePass& pass)
+		: mPass(pass), mInstanceBufferSize(0), mDepthState(NULL)
+	{
+		Reset();
+	}
+
+	// Storage that is both the handle and the contents of a buffer
+	static ID3D11Buffer* AddBuffer(std::vector<std::vector<uint8_t> >& storage, size_t size)
+	{
+		storage.push_back(std::vector<uint8_t>(size));
+		return reinterpret_cast<ID3D11Buffer*>(&storage.back()[0]);
+	}
+
+	void Reset()
+	{
+		memset(&mCounters, 0, sizeof(mCounters));
+		memset(mVertexBuffers, 0, sizeof(mVertexBuffers));
+		mDrawn.clear();
+	}
+
+	HRESULT Map(ID3D11Resource* resource, UINT, D3D11_MAP, UINT, D3D11_MAPPED_SUBRESOURCE* mapped)
+	{
+		mCounters.Calls++;
+		mCounters.Maps++;
+
+		mapped->pData = resource;
+		mapped->RowPitch = mapped->DepthPitch = 0;
+
+		if (resource == mPass.InstanceBuffer)
+			mCounters.MappedBytes += mInstanceBufferSize;
+		else if (resource == mPass.PerObjectConstants)
+			mCounters.MappedBytes += sizeof(PerObjectConstants);
+		else if (resource == mPass.LightConstants)
+			mCounters.MappedBytes += sizeof(LightCBuffer);
+		return S_OK;
+	}
+
+	void Unmap(ID3D11Resource*, UINT)                                  { mCounters.Calls++; }
+	void RSSetState(ID3D11RasterizerState*)                            { mCounters.Calls++; mCounters.StateChanges++; }
+	void IASetIndexBuffer(ID3D11Buffer*, DXGI_FORMAT, UINT)            { mCounters.Calls++; }
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY)              { mCounters.Calls++; }
+
+	void OMSetDepthStencilState(ID3D11DepthStencilState* state, UINT)
+	{
+		mCounters.Calls++;
+		mCounters.StateChanges++;
+		mDepthState = state;
+	}
+
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT*, const UINT*)
+	{
+		mCounters.Calls++;
+		for (UINT i = 0; i < numBuffers && startSlot + i < 2; ++i)
+			mVertexBuffers[startSlot + i] = buffers[i];
+	}
+
+	void DrawIndexed(UINT, UINT, INT)
+	{
+		mCounters.Calls++;
+		mCounters.Draws++;
+
+		const LightCBuffer* light = reinterpret_cast<const LightCBuffer*>(mPass.LightConstants);
+
+		LightVolumeInstance instance;
+		instance.PositionVS = light->LightPosition;
+		instance.Radius = light->LightAttenuation.y;
+		instance.Color = light->LightColor;
+		instance.AttenuationBegin = light->LightAttenuation.x;
+		Record(instance);
+	}
+
+	void DrawIndexedInstanced(UINT, UINT instanceCount, UINT, INT, UINT startInstance)
+	{
+		mCounters.Calls++;
+		mCounters.Draws++;
+
+		const LightVolumeInstance* instances = reinterpret_cast<const LightVolumeInstance*>(mVertexBuffers[1]);
+		for (UINT i = 0; i < instanceCount; ++i)
+			Record(instances[startInstance + i]);
+	}
+
+	void SetInstanceBufferSize(size_t size)              { mInstanceBufferSize = size; }
+
+	const Counters& GetCounters() const                  { return mCounters; }
+
+	// Drawn lights as (group, instance) sorted, to compare the two paths
+	std::vector<std::pair<int, std::array<float, 8> > >& GetDrawn()
+	{
+		std::sort(mDrawn.begin(), mDrawn.end());
+		return mDrawn;
+	}
+
+private:
+	void Record(const LightVolumeInstance& instance)
+	{
+		std::array<float, 8> values;
+		memcpy(&values[0], &instance, sizeof(instance));
+		mDrawn.push_back(std::make_pair(mDepthState == mPass.DepthState[LVG_CameraInside] ? int(LVG_CameraInside) : int(LVG_CameraOutside), values));
+	}
+
+private:
+	const LightVolumePass& mPass;
+	size_t mInstanceBufferSize;
+
+	Counters mCounters;
+	ID3D11DepthStencilState* mDepthState;
+	ID3D11Buffer* mVertexBuffers[2];
+
+	std::vector<std::pair<int, std::array<float, 8> > > mDrawn;
+};
+
+/**
+ * Driver calls of the point light volumes, one draw per light against one instanced draw per group, on
+ * the recording context. Both paths must shade the same lights with the same depth and cull state, apart
+ * from the lights the batch culls, which have to be outside the frustum.
+ */
+void BenchmarkLightVolumeBatch()
+{
+	const int width = 1920;
+	const int height = 1080;
+	const int NumFrames = 60;
+	const float FrameTime = 1.0f / 60.0f;
+
+	static_assert(sizeof(LightVolumeInstance) == 32, "LightVolumeInstance layout");
+
+	D3DXMATRIX proj;
+	BuildProjection(width, height, proj);
+
+	// The proxy draw arguments, only the recorder reads the buffers
+	SDKMeshFile proxy;
+	UINT proxyIndexCount = 0;
+	if (proxy.Open(".\\Media\\PointLightProxy.sdkmesh"))
+		proxyIndexCount = UINT(proxy.GetSubsets()[0].IndexCount);
+
+	for (int scene = 0; scene < 2; ++scene)
+	{
+		// The lights of the Sponza scene when present, then a synthetic ring of lights
+		LightAnimation lights;
+		D3DXVECTOR3 eye, lookAt(0.0f, 0.0f, 0.0f), up(0.0f, 1.0f, 0.0f);
+		const char* name;
+		if (scene == 0)
+		{
+			if (!lights.LoadLights(".\\Media\\Animation.txt"))
+				continue;
+
+			name = "Animation.txt";
+			eye = 0.05f * D3DXVECTOR3(1200.0f, 200.0f, 100.0f);
+		}
+		else
+		{
+			lights.RandonPointLight(10000);
+
+			name = "10000 random";
+			eye = D3DXVECTOR3(0.0f, 30.0f, -120.0f);
+		}
+
+		const LightAnimation::LightArrays& points = lights.GetLightArrays(LT_PointLight);
+		if (points.Count == 0)
+			continue;
+
+		std::vector<std::vector<uint8_t> > storage;
+		storage.reserve(8);
+
+		LightVolumePass pass;
+		pass.VertexBuffer = LightVolumeRecorder::AddBuffer(storage, 16);
+		pass.VertexStride = sizeof(D3DXVECTOR3);
+		pass.IndexBuffer = LightVolumeRecorder::AddBuffer(storage, 16);
+		pass.IndexFormat = DXGI_FORMAT_R16_UINT;
+		pass.IndexCount = proxyIndexCount;
+		pass.StartIndex = 0;
+		pass.BaseVertex = 0;
+		pass.PerObjectConstants = LightVolumeRecorder::AddBuffer(storage, sizeof(PerObjectConstants));
+		pass.LightConstants = LightVolumeRecorder::AddBuffer(storage, sizeof(LightCBuffer));
+		pass.InstanceBuffer = LightVolumeRecorder::AddBuffer(storage, points.Count * sizeof(LightVolumeInstance));
+
+		// Distinct handles are all the recorder needs
+		char stateHandles[4];
+		pass.DepthState[LVG_CameraOutside] = reinterpret_cast<ID3D11DepthStencilState*>(&stateHandles[0]);
+		pass.DepthState[LVG_CameraInside] = reinterpret_cast<ID3D11DepthStencilState*>(&stateHandles[1]);
+		pass.RasterizerState[LVG_CameraOutside] = reinterpret_cast<ID3D11RasterizerState*>(&stateHandles[2]);
+		pass.RasterizerState[LVG_CameraInside] = reinterpret_cast<ID3D11RasterizerState*>(&stateHandles[3]);
+
+		// Looking over the scene, then from inside the first light's volume
+		for (int view = 0; view < 2; ++view)
+		{
+			LightAnimation frameLights = lights;
+			if (view == 1)
+			{
+				eye = lights.GetLight(points.Begin).LightPosition + D3DXVECTOR3(0.1f, 0.1f, 0.1f);
+				lookAt = eye + D3DXVECTOR3(1.0f, -0.2f, 0.5f);
+			}
+
+			D3DXMATRIX viewMatrix;
+			D3DXMatrixLookAtLH(&viewMatrix, &eye, &lookAt, &up);
+
+			D3DXPLANE planes[6];
+			ExtractFrustumPlanes(viewMatrix * proj, D3DXVECTOR4(-1, -1, 1, 1), 0.0f, 1.0f, planes);
+
+			LightVolumeRecorder perLight(pass), instanced(pass);
+			LightVolumeBatch batch;
+
+			double perLightTime = 0, buildTime = 0, instancedTime = 0;
+			int numMismatches = 0, numFrameCulled = 0;
+			LightVolumeRecorder::Counters perLightCounters, instancedCounters;
+			int groupCounts[LVG_Count] = { 0, 0 };
+
+			for (int frame = 0; frame < NumFrames; ++frame)
+			{
+				frameLights.Move(FrameTime);
+
+				perLight.Reset();
+				double start = Now();
+				SubmitLightVolumesPerLight(&perLight, pass, frameLights, viewMatrix, proj, eye);
+				perLightTime += Now() - start;
+
+				instanced.Reset();
+				start = Now();
+				batch.Build(frameLights, viewMatrix, proj, eye);
+				buildTime += Now() - start;
+
+				instanced.SetInstanceBufferSize(batch.GetInstances().size() * sizeof(LightVolumeInstance));
+				start = Now();
+				SubmitLightVolumesInstanced(&instanced, pass, batch);
+				instancedTime += Now() - start;
+
+				perLightCounters = perLight.GetCounters();
+				instancedCounters = instanced.GetCounters();
+				groupCounts[LVG_CameraOutside] = batch.GetGroupCount(LVG_CameraOutside);
+				groupCounts[LVG_CameraInside] = batch.GetGroupCount(LVG_CameraInside);
+
+				// Every instanced light must be drawn by the per light path, every light it leaves out must
+				// be culled, outside one of the planes
+				std::vector<std::pair<int, std::array<float, 8> > >& reference = perLight.GetDrawn();
+				std::vector<std::pair<int, std::array<float, 8> > >& result = instanced.GetDrawn();
+
+				std::vector<std::pair<int, std::array<float, 8> > > missing, extra;
+				std::set_difference(result.begin(), result.end(), reference.begin(), reference.end(), std::back_inserter(extra));
+				std::set_difference(reference.begin(), reference.end(), result.begin(), result.end(), std::back_inserter(missing));
+				numMismatches += int(extra.size());
+
+				D3DXMATRIX invView;
+				D3DXMatrixInverse(&invView, NULL, &viewMatrix);
+				for (size_t i = 0; i < missing.size(); ++i)
+				{
+					const D3DXVECTOR3 positionVS(&missing[i].second[0]);
+					const float radius = missing[i].second[3];
+
+					D3DXVECTOR3 position;
+					D3DXVec3TransformCoord(&position, &positionVS, &invView);
+
+					// Back from view space isn't exact, allow for the rounding
+					bool outside = false;
+					for (int p = 0; p < 6 && !outside; ++p)
+						outside = planes[p].a * position.x + planes[p].b * position.y + planes[p].c * position.z + planes[p].d < -radius + 1e-3f;
+					if (!outside)
+						numMismatches++;
+				}
+
+				numFrameCulled += int(missing.size()) - int(batch.GetNumCulled());
+			}
+
+			// numFrameCulled checks the batch's cull count against what went missing
+			numMismatches += abs(numFrameCulled);
+
+			Log("LightVolumeBatch %s %s: %u point lights, %d visible (%d camera outside, %d inside)\n",
+				name, view ? "inside" : "overview", unsigned(points.Count), groupCounts[0] + groupCounts[1], groupCounts[0], groupCounts[1]);
+			Log("LightVolumeBatch %s %s: per light %d calls, %d maps %.1f KB, %d draws, %d state sets, %.3f ms\n",
+				name, view ? "inside" : "overview", perLightCounters.Calls, perLightCounters.Maps, perLightCounters.MappedBytes / 1024.0,
+				perLightCounters.Draws, perLightCounters.StateChanges, perLightTime * 1000.0 / NumFrames);
+			Log("LightVolumeBatch %s %s: instanced %d calls, %d maps %.1f KB, %d draws, %d state sets, build %.3f ms, submit %.3f ms, %d mismatches\n",
+				name, view ? "inside" : "overview", instancedCounters.Calls, instancedCounters.Maps, instancedCounters.MappedBytes / 1024.0,
+				instancedCounters.Draws, instancedCounters.StateChanges, buildTime * 1000.0 / NumFrames, instancedTime * 1000.0 / NumFrames,
+				numMismatches);
+		}
+	}
+}
+
+/**
+ * Mock context of the per object constant paths. Map hands out the storage behind the buffer handle, a
+ * draw reads the PerObjectConstants the vertex shader would see: the constant buffer for DrawIndexed, the
+ * instance in the ring stream for DrawIndexedInstanced.
+ */
+class ObjectConstantRecorder
+{
+public:
+	struct Counters
+	{
+		int Calls;
+		int Maps;
+		int Discards;
+		size_t MappedBytes;
+		int Draws;
+	};
+
+public:
+	ObjectConstantRecorder(ID3D11Buffer* constants, UINT objectSlot)
+		: mConstants(constants), mObjectSlot(objectSlot), mObjectStream(NULL), mRecord(false)
+	{
+		Reset();
+	}
+
+	void Reset()
+	{
+		memset(&mCounters, 0, sizeof(mCounters));
+		mDrawn.clear();
+	}
+
+	// Keep the constants of every draw, off while timing
+	void SetRecord(bool record)                          { mRecord = record; }
+
+	HRESULT Map(ID3D11Resource* resource, UINT, D3D11_MAP mapType, UINT, D3D11_MAPPED_SUBRESOURCE* mapped)
+	{
+		mCounters.Calls++;
+		mCounters.Maps++;
+		mCounters.Discards += mapType == D3D11_MAP_WRITE_DISCARD;
+
+		mapped->pData = resource;
+		mapped->RowPitch = mapped->DepthPitch = 0;
+		return S_OK;
+	}
+
+	void Unmap(ID3D11Resource*, UINT)                    { mCounters.Calls++; }
+
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT*, const UINT*)
+	{
+		mCounters.Calls++;
+		if (startSlot <= mObjectSlot && mObjectSlot < startSlot + numBuffers)
+			mObjectStream = buffers[mObjectSlot - startSlot];
+	}
+
+	void DrawIndexed(UINT, UINT, INT)
+	{
+		mCounters.Calls++;
+		mCounters.Draws++;
+		if (mRecord)
+			mDrawn.push_back(*reinterpret_cast<const PerObjectConstants*>(mConstants));
+	}
+
+	void DrawIndexedInstanced(UINT, UINT, UINT, INT, UINT startInstance)
+	{
+		mCounters.Calls++;
+		mCounters.Draws++;
+		if (mRecord)
+			mDrawn.push_back(reinterpret_cast<const PerObjectConstants*>(mObjectStream)[startInstance]);
+	}
+
+	const Counters& GetCounters() const                  { return mCounters; }
+	const std::vector<PerObjectConstants>& GetDrawn() const { return mDrawn; }
+
+private:
+	ID3D11Buffer* mConstants;
+	UINT mObjectSlot;
+	ID3D11Buffer* mObjectStream;
+	bool mRecord;
+
+	Counters mCounters;
+	std::vector<PerObjectConstants> mDrawn;
+};
+
+// What Renderer::RenderVisibleOpaque does without the ring, one WRITE_DISCARD map per object
+template<typename Context>
+void SubmitObjectsPerDraw(Context* context, ID3D11Buffer* constants, const std::vector<D3DXMATRIX>& worlds,
+	                      const D3DXMATRIX& view, const D3DXMATRIX& proj)
+{
+	for (size_t i = 0; i < worlds.size(); ++i)
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		context->Map(constants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		PerObjectConstants* objectConstants = static_cast<PerObjectConstants *>(mappedResource.pData);
+
+		objectConstants->WorldView = worlds[i] * view;
+		objectConstants->WorldViewProj = objectConstants->WorldView * proj;
+
+		context->Unmap(constants, 0);
+
+		context->DrawIndexed(36, 0, 0);
+	}
+}
+
+// And with it, Renderer::UploadObjectConstants then one instanced draw per object
+template<typename Context>
+void SubmitObjectsRing(Context* context, ID3D11Buffer* ringBuffer, ConstantRing& ring, UINT objectSlot, const std::vector<D3DXMATRIX>& worlds,
+	                   const D3DXMATRIX& view, const D3DXMATRIX& proj)
+{
+	UINT offset;
+	PerObjectConstants* objectConstants = static_cast<PerObjectConstants*>(
+		MapRing(context, ringBuffer, ring, UINT(worlds.size() * sizeof(PerObjectConstants)), sizeof(PerObjectConstants), &offset));
+
+	for (size_t i = 0; i < worlds.size(); ++i)
+	{
+		objectConstants[i].WorldView = worlds[i] * view;
+		objectConstants[i].WorldViewProj = objectConstants[i].WorldView * proj;
+	}
+
+	context->Unmap(ringBuffer, 0);
+
+	const UINT stride = sizeof(PerObjectConstants), streamOffset = 0;
+	context->IASetVertexBuffers(objectSlot, 1, &ringBuffer, &stride, &streamOffset);
+
+	const UINT firstInstance = offset / sizeof(PerObjectConstants);
+	for (size_t i = 0; i < worlds.size(); ++i)
+		context->DrawIndexedInstanced(36, 1, 0, 0, firstInstance + UINT(i));
+}
+
+/**
+ * Constant ring: random allocations against a GPU that lags a random number of frames behind, every block
+ * must be aligned, inside the buffer and clear of the blocks of the frames still in flight. Then the CPU
+ * time of 10000 draws with their own constants, one WRITE_DISCARD map per draw against one ring upload per
+ * pass, on the mock context. A driver renames the buffer on every discard, that cost is only seen on the
+ * device, F7 records the frame with either path (F8 toggles).
+ */
+void BenchmarkConstantRing()
+{
+	{
+		const UINT Capacity = 64 * 1024;
+		const int NumFrames = 20000;
+
+		struct Block
+		{
+			UINT64 Frame;
+			UINT Offset;
+			UINT Size;
+		};
+
+		ConstantRing ring(Capacity);
+		std::vector<Block> live;
+
+		std::mt19937 rng(17);
+		std::uniform_int<UINT> allocationsDist(0, 12), sizeDist(1, 4096), alignmentDist(0, 3), lagDist(0, 3);
+		const UINT alignments[4] = { 16, 32, 128, 256 };
+
+		int numMismatches = 0, numAllocations = 0;
+		UINT64 completed = 0, allocatedBytes = 0;
+		UINT maxFramesInFlight = 0;
+		double time = 0;
+
+		for (UINT64 frame = 1; frame <= NumFrames; ++frame)
+		{
+			// The GPU finishes up to frame - lag, never going back
+			const UINT64 lag = lagDist(rng);
+			if (frame > lag + 1 && frame - lag - 1 > completed)
+				completed = frame - lag - 1;
+
+			double start = Now();
+			ring.Retire(completed);
+			time += Now() - start;
+
+			for (size_t i = 0; i < live.size(); )
+			{
+				if (live[i].Frame <= completed)
+				{
+					live[i] = live.back();
+					live.pop_back();
+				}
+				else
+					++i;
+			}
+
+			const UINT frameAllocations = allocationsDist(rng);
+			for (UINT a = 0; a < frameAllocations; ++a)
+			{
+				const UINT size = sizeDist(rng);
+				const UINT alignment = alignments[alignmentDist(rng)];
+
+				start = Now();
+				UINT offset = ring.Allocate(size, alignment);
+				if (offset == ConstantRing::InvalidOffset)
+				{
+					// What UploadToRing does, the buffer is discarded and nothing in flight is overwritten
+					ring.Reset();
+					offset = ring.Allocate(size, alignment);
+					live.clear();
+				}
+				time += Now() - start;
+
+				if (offset == ConstantRing::InvalidOffset || offset % alignment != 0 || offset + size > Capacity)
+				{
+					numMismatches++;
+					continue;
+				}
+
+				for (size_t i = 0; i < live.size(); ++i)
+					if (offset < live[i].Offset + live[i].Size && live[i].Offset < offset + size)
+						numMismatches++;
+
+				Block block = { frame, offset, size };
+				live.push_back(block);
+				allocatedBytes += size;
+			}
+			numAllocations += frameAllocations;
+
+			ring.EndFrame(frame);
+			maxFramesInFlight = (std::max)(maxFramesInFlight, ring.GetFramesInFlight());
+		}
+
+		Log("ConstantRing fences: %d frames, %d allocations %.1f MB into %u KB, %u resets, %.1f KB wrapped tails, at most %u frames in flight, %.3f us per allocation, %d mismatches\n",
+			NumFrames, numAllocations, allocatedBytes / (1024.0 * 1024.0), Capacity / 1024, ring.GetNumResets(), ring.GetWastedBytes() / 1024.0,
+			maxFramesInFlight, time * 1e6 / (std::max)(numAllocations, 1), numMismatches);
+	}
+
+	{
+		const int NumDraws = 10000;
+		const int NumFrames = 100;
+		const UINT ObjectSlot = 15;
+
+		D3DXMATRIX view, proj;
+		BuildView(view);
+		BuildProjection(1920, 1080, proj);
+
+		std::mt19937 rng(19);
+		std::uniform_real<float> positionDist(-100.0f, 100.0f), scaleDist(0.5f, 2.0f);
+
+		std::vector<D3DXMATRIX> worlds(NumDraws);
+		for (int i = 0; i < NumDraws; ++i)
+		{
+			D3DXMatrixScaling(&worlds[i], scaleDist(rng), scaleDist(rng), scaleDist(rng));
+			worlds[i]._41 = positionDist(rng);
+			worlds[i]._42 = positionDist(rng);
+			worlds[i]._43 = positionDist(rng);
+		}
+
+		// Storage that is both the handle and the contents of a buffer, the ring holds three frames
+		std::vector<PerObjectConstants> constantStorage(1);
+		std::vector<PerObjectConstants> ringStorage(NumDraws * 3 + 1);
+		ID3D11Buffer* constants = reinterpret_cast<ID3D11Buffer*>(&constantStorage[0]);
+		ID3D11Buffer* ringBuffer = reinterpret_cast<ID3D11Buffer*>(&ringStorage[0]);
+
+		ConstantRing ring(UINT(ringStorage.size() * sizeof(PerObjectConstants)));
+
+		ObjectConstantRecorder perDraw(constants, ObjectSlot), ringed(constants, ObjectSlot);
+
+		// Both paths must feed every draw the same constants
+		perDraw.SetRecord(true);
+		ringed.SetRecord(true);
+		SubmitObjectsPerDraw(&perDraw, constants, worlds, view, proj);
+		SubmitObjectsRing(&ringed, ringBuffer, ring, ObjectSlot, worlds, view, proj);
+		ring.EndFrame(0);
+
+		int numMismatches = 0;
+		if (perDraw.GetDrawn().size() != ringed.GetDrawn().size())
+			numMismatches = NumDraws;
+		else
+		{
+			for (size_t i = 0; i < perDraw.GetDrawn().size(); ++i)
+				numMismatches += memcmp(&perDraw.GetDrawn()[i], &ringed.GetDrawn()[i], sizeof(PerObjectConstants)) != 0;
+		}
+
+		perDraw.SetRecord(false);
+		ringed.SetRecord(false);
+
+		double perDrawTime = 0, ringTime = 0;
+		for (int frame = 1; frame <= NumFrames; ++frame)
+		{
+			perDraw.Reset();
+			double start = Now();
+			SubmitObjectsPerDraw(&perDraw, constants, worlds, view, proj);
+			perDrawTime += Now() - start;
+
+			// Two frames in flight
+			ring.Retire(frame > 2 ? frame - 2 : 0);
+
+			ringed.Reset();
+			start = Now();
+			SubmitObjectsRing(&ringed, ringBuffer, ring, ObjectSlot, worlds, view, proj);
+			ringTime += Now() - start;
+
+			ring.EndFrame(frame);
+		}
+
+		const ObjectConstantRecorder::Counters& perDrawCounters = perDraw.GetCounters();
+		const ObjectConstantRecorder::Counters& ringCounters = ringed.GetCounters();
+		const double scale = 1000.0 / NumFrames * 10000.0 / NumDraws;
+
+		Log("ConstantRing %d draws: per draw %d calls, %d maps (%d discards) %.1f KB, %.3f ms per 10k draws\n",
+			NumDraws, perDrawCounters.Calls, perDrawCounters.Maps, perDrawCounters.Discards, NumDraws * sizeof(PerObjectConstants) / 1024.0, perDrawTime * scale);
+		Log("ConstantRing %d draws: ring %d calls, %d maps (%d discards) %.1f KB, %.3f ms per 10k draws, %u resets, %d mismatches\n",
+			NumDraws, ringCounters.Calls, ringCounters.Maps, ringCounters.Discards, NumDraws * sizeof(PerObjectConstants) / 1024.0, ringTime * scale,
+			ring.GetNumResets(), numMismatches);
+	}
+}
+
+/**
+ * Mock context of the opaque passes. Counts the state sets and the ones that bind what is already bound,
+ * and keeps the state every draw sees.
+ */
+class DrawStateRecorder
+{
+public:
+	struct DrawState
+	{
+		ID3D11InputLayout* Layout;
+		ID3D11VertexShader* VertexShader;
+		ID3D11PixelShader* PixelShader;
+		ID3D11Buffer* VertexBuffer;
+		ID3D11Buffer* IndexBuffer;
+		ID3D11ShaderResourceView* Material;
+		D3D11_PRIMITIVE_TOPOLOGY Topology;
+		UINT IndexCount;
+		UINT StartIndex;
+		INT BaseVertex;
+		UINT Instance;
+	};
+
+	struct Counters
+	{
+		int Calls;
+		int StateSets;
+		int Redundant;
+		int Draws;
+	};
+
+public:
+	explicit DrawStateRecorder(UINT materialSlot)
+		: mMaterialSlot(materialSlot), mRecord(false)
+	{
+		Reset();
+	}
+
+	// Forget the bound state too, each pass starts from nothing bound
+	void Reset()
+	{
+		memset(&mCounters, 0, sizeof(mCounters));
+		memset(&mBound, 0, sizeof(mBound));
+		mDrawn.clear();
+	}
+
+	void SetRecord(bool record)                          { mRecord = record; }
+
+	void IASetInputLayout(ID3D11InputLayout* layout)     { Set(mBound.Layout, layout); }
+	void VSSetShader(ID3D11VertexShader* shader, ID3D11ClassInstance* const*, UINT)   { Set(mBound.VertexShader, shader); }
+	void PSSetShader(ID3D11PixelShader* shader, ID3D11ClassInstance* const*, UINT)    { Set(mBound.PixelShader, shader); }
+	void IASetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT, UINT)                   { Set(mBound.IndexBuffer, buffer); }
+	void IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)                    { Set(mBound.Topology, topology); }
+
+	// The meshes here have one vertex buffer
+	void IASetVertexBuffers(UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers, const UINT*, const UINT*)
+	{
+		if (startSlot == 0 && numBuffers > 0)
+			Set(mBound.VertexBuffer, buffers[0]);
+	}
+
+	void PSSetShaderResources(UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views)
+	{
+		if (startSlot <= mMaterialSlot && mMaterialSlot < startSlot + numViews)
+			Set(mBound.Material, views[mMaterialSlot - startSlot]);
+	}
+
+	void DrawIndexedInstanced(UINT indexCount, UINT, UINT startIndex, INT baseVertex, UINT startInstance)
+	{
+		mCounters.Calls++;
+		mCounters.Draws++;
+		if (mRecord)
+		{
+			DrawState state = mBound;
+			state.IndexCount = indexCount;
+			state.StartIndex = startIndex;
+			state.BaseVertex = baseVertex;
+			state.Instance = startInstance;
+			mDrawn.push_back(state);
+		}
+	}
+
+	const Counters& GetCounters() const                  { return mCounters; }
+	const std::vector<DrawState>& GetDrawn() const       { return mDrawn; }
+
+private:
+	template<typename T>
+	void Set(T& bound, T value)
+	{
+		mCounters.Calls++;
+		mCounters.StateSets++;
+		mCounters.Redundant += bound == value;
+		bound = value;
+	}
+
+private:
+	UINT mMaterialSlot;
+	bool mRecord;
+
+	DrawState mBound;
+	Counters mCounters;
+	std::vector<DrawState> mDrawn;
+};
+
+// Renderer::RenderVisibleOpaque with the constant ring over the items of an unsorted queue: shaders once per
+// pass, buffers when the mesh changes, topology and texture for every subset
+template<typename Context>
+void SubmitDrawsInOrder(Context* context, const DrawQueue& queue, UINT materialSlot)
+{
+	const std::vector<DrawItem>& items = queue.GetItems();
+	if (items.empty())
+		return;
+
+	const DrawShader& shader = queue.GetShaders()[items[0].Shader];
+	context->IASetInputLayout(shader.Layout);
+	context->VSSetShader(shader.VertexShader, 0, 0);
+	context->PSSetShader(shader.PixelShader, 0, 0);
+
+	uint32_t boundGeometry = UINT_MAX;
+	for (size_t i = 0; i < items.size(); ++i)
+	{
+		const DrawItem& item = items[i];
+
+		if (item.Geometry != boundGeometry)
+		{
+			const DrawGeometry& geometry = queue.GetGeometries()[item.Geometry];
+			const UINT offsets[DrawGeometry::MaxVertexBuffers] = { 0 };
+			context->IASetVertexBuffers(0, geometry.NumVertexBuffers, geometry.VertexBuffers, geometry.Strides, offsets);
+			context->IASetIndexBuffer(geometry.IndexBuffer, geometry.IndexFormat, 0);
+			boundGeometry = item.Geometry;
+		}
+
+		context->IASetPrimitiveTopology(item.Topology);
+		if (item.Material)
+			context->PSSetShaderResources(materialSlot, 1, &item.Material);
+
+		context->DrawIndexedInstanced(item.IndexCount, 1, item.StartIndex, item.BaseVertex, item.Instance);
+	}
+}
+
+bool DrawStateLess(const DrawStateRecorder::DrawState& a, const DrawStateRecorder::DrawState& b)
+{
+	return memcmp(&a, &b, sizeof(DrawStateRecorder::DrawState)) < 0;
+}
+
+bool DrawPacketKeyLess(const DrawPacket& a, const DrawPacket& b)
+{
+	return a.Key < b.Key;
+}
+
+/**
+ * Draw queue: a Sponza like scene of 10000 subsets, 40 objects placed from 8 meshes, textures picked from 64,
+ * drawn in scene order the way RenderVisibleOpaque does and through the sorted queue. Both must draw the same
+ * subsets with the same state, the log has the state sets and the redundant ones of each on the mock context.
+ * Then the radix sort against std::stable_sort, which it must match exactly, at 10k to 1M packets.
+ */
+void BenchmarkDrawQueue()
+{
+	{
+		const int NumObjects = 40;
+		const int NumAssets = 8;
+		const int MeshesPerAsset = 2;
+		const int SubsetsPerMesh = 125;
+		const int NumMaterials = 64;
+		const int NumFrames = 100;
+		const UINT MaterialSlot = 1;
+
+		// Handles only, never dereferenced
+		const DrawShader shader = { reinterpret_cast<ID3D11InputLayout*>(0x10), reinterpret_cast<ID3D11VertexShader*>(0x20),
+			                        reinterpret_cast<ID3D11PixelShader*>(0x30) };
+
+		std::mt19937 rng(23);
+		std::uniform_int<int> materialDist(0, NumMaterials - 1), topologyDist(0, 19), indexDist(3, 3000);
+		std::uniform_real<float> depthDist(0.0f, 1.0f);
+
+		struct Subset
+		{
+			uint32_t Material;
+			D3D11_PRIMITIVE_TOPOLOGY Topology;
+			UINT IndexCount;
+			UINT StartIndex;
+		};
+
+		// The subsets of each asset mesh, shared by the objects placing it
+		std::vector<Subset> assetSubsets(NumAssets * MeshesPerAsset * SubsetsPerMesh);
+		for (size_t i = 0; i < assetSubsets.size(); ++i)
+		{
+			assetSubsets[i].Material = materialDist(rng);
+			assetSubsets[i].Topology = topologyDist(rng) == 0 ? D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP : D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			assetSubsets[i].IndexCount = indexDist(rng);
+			assetSubsets[i].StartIndex = UINT(i % SubsetsPerMesh) * 3000;
+		}
+
+		// Scene order, as Renderer::BuildOpaqueQueue walks Scene::mSceneObjectsOpaque
+		DrawQueue queue;
+		std::vector<float> depths;
+		// The subsets of an object lie close to its center
+		for (int object = 0; object < NumObjects; ++object)
+		{
+			const float center = depthDist(rng);
+			for (int i = 0; i < MeshesPerAsset * SubsetsPerMesh; ++i)
+				depths.push_back((std::min)(center + depthDist(rng) * 0.01f, 1.0f));
+		}
+
+		std::vector<DrawPacket> sceneOrder;
+		double buildTime = 0;
+		for (int frame = 0; frame <= NumFrames; ++frame)
+		{
+			const double start = Now();
+
+			queue.Clear();
+			const uint32_t shaderIndex = queue.AddShader(shader);
+
+			size_t draw = 0;
+			for (int object = 0; object < NumObjects; ++object)
+			{
+				const int asset = object % NumAssets;
+				for (int mesh = 0; mesh < MeshesPerAsset; ++mesh)
+				{
+					const int assetMesh = asset * MeshesPerAsset + mesh;
+
+					DrawGeometry geometry;
+					geometry.NumVertexBuffers = 1;
+					geometry.VertexBuffers[0] = reinterpret_cast<ID3D11Buffer*>(uintptr_t(0x1000 + assetMesh * 16));
+					geometry.Strides[0] = 32;
+					geometry.IndexBuffer = reinterpret_cast<ID3D11Buffer*>(uintptr_t(0x2000 + assetMesh * 16));
+					geometry.IndexFormat = DXGI_FORMAT_R16_UINT;
+					const uint32_t geometryIndex = queue.AddGeometry(geometry);
+
+					for (int subset = 0; subset < SubsetsPerMesh; ++subset, ++draw)
+					{
+						const Subset& source = assetSubsets[assetMesh * SubsetsPerMesh + subset];
+
+						DrawItem item;
+						item.Shader = shaderIndex;
+						item.Geometry = geometryIndex;
+						item.Material = reinterpret_cast<ID3D11ShaderResourceView*>(uintptr_t(0x3000 + source.Material * 16));
+						item.Topology = source.Topology;
+						item.IndexCount = source.IndexCount;
+						item.StartIndex = source.StartIndex;
+						item.BaseVertex = 0;
+						item.Instance = object;
+
+						queue.Add(DrawQueue::MakeKey(0, shaderIndex, source.Material, depths[draw]), item);
+					}
+				}
+			}
+
+			// The first frame warms up and keeps the unsorted queue for the scene order path
+			if (frame == 0)
+				sceneOrder = queue.GetPackets();
+
+			queue.Sort();
+
+			if (frame > 0)
+				buildTime += Now() - start;
+		}
+
+		DrawStateRecorder inOrder(MaterialSlot), sorted(MaterialSlot);
+
+		// Same draws with the same state, in whatever order
+		inOrder.SetRecord(true);
+		sorted.SetRecord(true);
+		SubmitDrawsInOrder(&inOrder, queue, MaterialSlot);
+		const DrawQueueStats stats = queue.Submit(&sorted, MaterialSlot);
+
+		std::vector<DrawStateRecorder::DrawState> inOrderDrawn = inOrder.GetDrawn(), sortedDrawn = sorted.GetDrawn();
+		std::sort(inOrderDrawn.begin(), inOrderDrawn.end(), DrawStateLess);
+		std::sort(sortedDrawn.begin(), sortedDrawn.end(), DrawStateLess);
+
+		int numMismatches = 0;
+		if (inOrderDrawn.size() != sortedDrawn.size() || int(stats.Draws) != inOrder.GetCounters().Draws)
+			numMismatches = int(depths.size());
+		else
+		{
+			for (size_t i = 0; i < inOrderDrawn.size(); ++i)
+				numMismatches += memcmp(&inOrderDrawn[i], &sortedDrawn[i], sizeof(DrawStateRecorder::DrawState)) != 0;
+		}
+
+		// Sorted by material, then front to back
+		for (size_t i = 1; i < queue.GetPackets().size(); ++i)
+			numMismatches += queue.GetPackets()[i - 1].Key > queue.GetPackets()[i].Key;
+
+		inOrder.SetRecord(false);
+		sorted.SetRecord(false);
+
+		double inOrderTime = 0, sortedTime = 0;
+		for (int frame = 0; frame < NumFrames; ++frame)
+		{
+			inOrder.Reset();
+			double start = Now();
+			SubmitDrawsInOrder(&inOrder, queue, MaterialSlot);
+			inOrderTime += Now() - start;
+
+			sorted.Reset();
+			start = Now();
+			queue.Submit(&sorted, MaterialSlot);
+			sortedTime += Now() - start;
+		}
+
+		const DrawStateRecorder::Counters& inOrderCounters = inOrder.GetCounters();
+		const DrawStateRecorder::Counters& sortedCounters = sorted.GetCounters();
+
+		Log("DrawQueue %d draws, %d objects, %d textures: scene order %d calls, %d state sets (%d redundant), %.3f ms\n",
+			inOrderCounters.Draws, NumObjects, NumMaterials, inOrderCounters.Calls, inOrderCounters.StateSets, inOrderCounters.Redundant,
+			inOrderTime * 1000.0 / NumFrames);
+		Log("DrawQueue %d draws, %d objects, %d textures: sorted %d calls, %d state sets (%d redundant), %u filtered, build and sort %.3f ms, submit %.3f ms, %d mismatches\n",
+			sortedCounters.Draws, NumObjects, NumMaterials, sortedCounters.Calls, sortedCounters.StateSets, sortedCounters.Redundant, stats.Filtered,
+			buildTime * 1000.0 / NumFrames, sortedTime * 1000.0 / NumFrames, numMismatches);
+	}
+
+	const int numPackets[] = { 10000, 100000, 1000000 };
+	for (int test = 0; test < 3; ++test)
+	{
+		const int NumRuns = 10;
+		const int count = numPackets[test];
+
+		std::mt19937 rng(29);
+		std::uniform_int<uint32_t> passDist(0, 3), shaderDist(0, 15), materialDist(0, 1023);
+		std::uniform_real<float> depthDist(0.0f, 1.0f);
+
+		std::vector<DrawPacket> packets(count);
+		for (int i = 0; i < count; ++i)
+		{
+			packets[i].Key = DrawQueue::MakeKey(passDist(rng), shaderDist(rng), materialDist(rng), depthDist(rng));
+			packets[i].Item = i;
+		}
+
+		std::vector<DrawPacket> radixSorted, stableSorted, scratch;
+		double radixTime = 0, stableTime = 0;
+		for (int run = 0; run < NumRuns; ++run)
+		{
+			radixSorted = packets;
+			double start = Now();
+			RadixSortDrawPackets(radixSorted, scratch);
+			radixTime += Now() - start;
+
+			stableSorted = packets;
+			start = Now();
+			std::stable_sort(stableSorted.begin(), stableSorted.end(), DrawPacketKeyLess);
+			stableTime += Now() - start;
+		}
+
+		int numMismatches = 0;
+		for (int i = 0; i < count; ++i)
+			numMismatches += radixSorted[i].Key != stableSorted[i].Key || radixSorted[i].Item != stableSorted[i].Item;
+
+		Log("DrawQueue sort %d packets: radix %.3f ms, std::stable_sort %.3f ms, %d mismatches\n",
+			count, radixTime * 1000.0 / NumRuns, stableTime * 1000.0 / NumRuns, numMismatches);
+	}
+}
+
+/**
+ * Stand in for D3DX11CompileFromFile: a few milliseconds of work, then bytecode that depends on the source
+ * text, the entry point, the profile, the defines and the flags. Thread safe like the real one.
+ */
+bool CompileBytecodeStub(const ShaderCompileRequest& request, std::vector<uint8_t>* bytecode, std::string* errors)
+{
+	std::string filename(request.Filename.begin(), request.Filename.end());
+
+	std::vector<uint8_t> source;
+	FILE* file = NULL;
+	if (fopen_s(&file, filename.c_str(), "rb") != 0)
+	{
+		*errors = filename + ": file not found\n";
+		return false;
+	}
+
+	uint8_t buffer[4096];
+	for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+		source.insert(source.end(), buffer, buffer + read);
+	fclose(file);
+
+	uint64_t hash = HashBytes(request.EntryPoint.data(), request.EntryPoint.size());
+	hash = HashBytes(request.Profile.data(), request.Profile.size(), hash);
+	hash = HashBytes(&request.Flags, sizeof(request.Flags), hash);
+	for (size_t i = 0; i < request.Defines.size(); ++i)
+	{
+		hash = HashBytes(request.Defines[i].first.data(), request.Defines[i].first.size(), hash);
+		hash = HashBytes(request.Defines[i].second.data(), request.Defines[i].second.size(), hash);
+	}
+
+	for (int pass = 0; pass < 2000; ++pass)
+		hash = HashBytes(&source[0], source.size(), hash);
+
+	bytecode->resize(2048 + size_t(hash % 2048));
+	for (size_t i = 0; i < bytecode->size(); ++i)
+	{
+		hash ^= hash << 13;
+		hash ^= hash >> 7;
+		hash ^= hash << 17;
+		(*bytecode)[i] = uint8_t(hash);
+	}
+
+	return true;
+}
+
+struct ShaderCacheRun
+{
+	ShaderCacheStats Stats;
+	double Time;
+	int Mismatches;
+};
+
+// Everything through a new cache, as Renderer::CreateShaderEffect does. The bytecode must match reference
+ShaderCacheRun RunShaderCache(const std::vector<ShaderCompileRequest>& requests, const std::vector<std::vector<uint8_t> >& reference)
+{
+	ShaderCacheRun run;
+
+	const double start = Now();
+	ShaderCache cache(L".", CompileBytecodeStub);
+	std::vector<uint32_t> indices(requests.size());
+	for (size_t i = 0; i < requests.size(); ++i)
+	{
+		indices[i] = cache.Add(requests[i]);
+		cache.Start();
+	}
+	cache.Wait();
+	run.Time = Now() - start;
+
+	run.Stats = cache.GetStats();
+	run.Mismatches = 0;
+	for (size_t i = 0; i < requests.size(); ++i)
+		run.Mismatches += cache.GetBytecode(indices[i]) != reference[i];
+
+	return run;
+}
+
+// Deletes the entries of requests under the keys their sources have now
+void RemoveShaderCacheEntries(const std::vector<ShaderCompileRequest>& requests)
+{
+	ShaderCache cache(L".", CompileBytecodeStub);
+	for (size_t i = 0; i < requests.size(); ++i)
+		cache.Add(requests[i]);
+	cache.RemoveEntries();
+}
+
+bool WriteText(const char* filename, const std::string& text)
+{
+	FILE* file = NULL;
+	if (fopen_s(&file, filename, "wb") != 0)
+		return false;
+
+	fwrite(text.data(), 1, text.size(), file);
+	fclose(file);
+	return true;
+}
+
+/**
+ * Shader cache with the compiler stubbed: 30 permutations over 5 sources sharing 2 includes, laid out like
+ * CreateShaderEffect. Serially from source as before, then a cold cache compiling the misses in parallel,
+ * a warm one, one after an include changed and one with two damaged entries. Every run must hand out the
+ * bytecode of the serial compile, the log has the loaded and compiled counts against the expected ones.
+ */
+void BenchmarkShaderCache()
+{
+	struct SourceFile
+	{
+		const char* Name;
+		const char* Includes;
+	};
+
+	const SourceFile Sources[] = {
+		{ "ShaderCacheCommon.hlsl",     "" },
+		{ "ShaderCacheUtility.hlsl",    "#include \"ShaderCacheCommon.hlsl\"\n" },
+		{ "ShaderCacheGBuffer.hlsl",    "#include \"ShaderCacheCommon.hlsl\"\n" },
+		{ "ShaderCacheLighting.hlsl",   "#include \"ShaderCacheCommon.hlsl\"\n#include \"ShaderCacheUtility.hlsl\"\n" },
+		{ "ShaderCacheAO.hlsl",         "#include \"ShaderCacheCommon.hlsl\"\n" },
+		{ "ShaderCacheFullScreen.hlsl", "" },
+		{ "ShaderCacheForward.hlsl",    "#include \"ShaderCacheUtility.hlsl\"\n" },
+	};
+	const int NumSources = sizeof(Sources) / sizeof(Sources[0]);
+
+	// Some kilobytes of text each, like the real ones
+	for (int i = 0; i < NumSources; ++i)
+	{
+		std::string text = Sources[i].Includes;
+		for (int line = 0; line < 200; ++line)
+		{
+			char buffer[96];
+			sprintf_s(buffer, "float4 Function%d_%d(float4 x) { return x * %d.0f + %d.0f; }\n", i, line, line, i);
+			text += buffer;
+		}
+		WriteText(Sources[i].Name, text);
+	}
+
+	struct Permutation
+	{
+		const char* File;
+		const char* EntryPoint;
+		const char* Profile;
+		const char* Defines;    // Space separated names
+	};
+
+	// The vertex shaders of the layouts come twice, the cache compiles them once
+	const Permutation Permutations[] = {
+		{ "ShaderCacheGBuffer.hlsl",    "GBufferVS",       "vs_4_0", "" },
+		{ "ShaderCacheGBuffer.hlsl",    "GBufferPS",       "ps_4_0", "" },
+		{ "ShaderCacheGBuffer.hlsl",    "GBufferVS",       "vs_4_0", "ObjectConstantStream" },
+		{ "ShaderCacheGBuffer.hlsl",    "GBufferVS",       "vs_4_0", "" },
+		{ "ShaderCacheGBuffer.hlsl",    "GBufferVS",       "vs_4_0", "ObjectConstantStream" },
+		{ "ShaderCacheForward.hlsl",    "ForwardVS",       "vs_4_0", "" },
+		{ "ShaderCacheForward.hlsl",    "ForwardPS",       "ps_4_0", "" },
+		{ "ShaderCacheForward.hlsl",    "ForwardVS",       "vs_4_0", "ObjectConstantStream" },
+		{ "ShaderCacheFullScreen.hlsl", "FullScreenVS",    "vs_4_0", "" },
+		{ "ShaderCacheFullScreen.hlsl", "SpritePS",        "ps_4_0", "" },
+		{ "ShaderCacheFullScreen.hlsl", "SpriteAOPS",      "ps_4_0", "" },
+		{ "ShaderCacheFullScreen.hlsl", "EdgeAAPS",        "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "CryteckSSAO",     "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "HBAO",            "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "AlchemyAO",       "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "Unreal4AO",       "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "BlurX",           "ps_4_0", "" },
+		{ "ShaderCacheAO.hlsl",         "BlurY",           "ps_4_0", "" },
+		{ "ShaderCacheLighting.hlsl",   "LightVS",         "vs_4_0", "PointLight" },
+		{ "ShaderCacheLighting.hlsl",   "ShadingPS",       "ps_4_0", "PointLight" },
+		{ "ShaderCacheLighting.hlsl",   "LightingPS",      "ps_4_0", "PointLight" },
+		{ "ShaderCacheLighting.hlsl",   "LightVS",         "vs_4_0", "PointLight InstancedLightVolume" },
+		{ "ShaderCacheLighting.hlsl",   "ShadingPS",       "ps_4_0", "PointLight InstancedLightVolume" },
+		{ "ShaderCacheLighting.hlsl",   "LightingPS",      "ps_4_0", "PointLight InstancedLightVolume" },
+		{ "ShaderCacheLighting.hlsl",   "LightingPS",      "ps_4_0", "SpotLight" },
+		{ "ShaderCacheLighting.hlsl",   "LightVS",         "vs_4_0", "DirectionalLight" },
+		{ "ShaderCacheLighting.hlsl",   "ShadingPS",       "ps_4_0", "DirectionalLight" },
+		{ "ShaderCacheLighting.hlsl",   "LightingPS",      "ps_4_0", "DirectionalLight" },
+		{ "ShaderCacheLighting.hlsl",   "ShadingPassPS",   "ps_4_0", "" },
+		{ "ShaderCacheLighting.hlsl",   "LightVS",         "vs_4_0", "PointLight SpotLight" },
+		{ "ShaderCacheFullScreen.hlsl", "DebugVS",         "vs_4_0", "" },
+		{ "ShaderCacheFullScreen.hlsl", "DebugPS",         "ps_4_0", "" },
+	};
+	const int NumPermutations = sizeof(Permutations) / sizeof(Permutations[0]);
+
+	std::vector<ShaderCompileRequest> requests(NumPermutations);
+	for (int i = 0; i < NumPermutations; ++i)
+	{
+		const std::string file = Permutations[i].File;
+		requests[i].Filename.assign(file.begin(), file.end());
+		requests[i].EntryPoint = Permutations[i].EntryPoint;
+		requests[i].Profile = Permutations[i].Profile;
+		requests[i].Flags = 0;
+
+		std::string defines = Permutations[i].Defines;
+		for (size_t begin = 0; begin < defines.size(); )
+		{
+			size_t end = defines.find(' ', begin);
+			if (end == std::string::npos)
+				end = defines.size();
+			requests[i].Defines.push_back(std::make_pair(defines.substr(begin, end - begin), std::string()));
+			begin = end + 1;
+		}
+	}
+
+	// No entries of these keys left from an earlier run
+	RemoveShaderCacheEntries(requests);
+
+	// What CreateShaderEffect did before, one compile after the other, including the repeated ones
+	std::vector<std::vector<uint8_t> > reference(NumPermutations);
+	double start = Now();
+	int numFailed = 0;
+	for (int i = 0; i < NumPermutations; ++i)
+	{
+		std::string errors;
+		numFailed += !CompileBytecodeStub(requests[i], &reference[i], &errors);
+	}
+	const double serialTime = Now() - start;
+
+	const ShaderCacheRun cold = RunShaderCache(requests, reference);
+	const ShaderCacheRun warm = RunShaderCache(requests, reference);
+
+	Log("ShaderCache %d permutations: from source serially %.1f ms, %d failed\n", NumPermutations, serialTime * 1000.0, numFailed);
+	Log("ShaderCache cold: %.1f ms, %u requests, %u compiled, %u loaded, %d mismatches\n",
+		cold.Time * 1000.0, cold.Stats.Requests, cold.Stats.Compiled, cold.Stats.Loaded, cold.Mismatches);
+	Log("ShaderCache warm: %.1f ms, %u requests, %u compiled, %u loaded, %d mismatches\n",
+		warm.Time * 1000.0, warm.Stats.Requests, warm.Stats.Compiled, warm.Stats.Loaded, warm.Mismatches);
+
+	// Change the include of Lighting and Forward, only their permutations may compile again
+	{
+		std::vector<ShaderCompileRequest> affected;
+		for (int i = 0; i < NumPermutations; ++i)
+		{
+			const std::string file = Permutations[i].File;
+			if (file == "ShaderCacheLighting.hlsl" || file == "ShaderCacheForward.hlsl")
+				affected.push_back(requests[i]);
+		}
+		const uint32_t expected = uint32_t(affected.size());
+
+		// Their keys change with the include, the entries under the current ones would stay behind
+		RemoveShaderCacheEntries(affected);
+
+		std::string text = std::string(Sources[1].Includes) + "float4 Changed(float4 x) { return x; }\n";
+		WriteText(Sources[1].Name, text);
+
+		// The stub only reads the file itself, the bytecode stays that of the reference
+		const ShaderCacheRun changed = RunShaderCache(requests, reference);
+		Log("ShaderCache include changed: %.1f ms, %u compiled (%u expected), %u loaded, %d mismatches\n",
+			changed.Time * 1000.0, changed.Stats.Compiled, expected, changed.Stats.Loaded, changed.Mismatches);
+	}
+
+	// A flipped byte and a write cut short must both be rejected and compiled again
+	{
+		ShaderCache cache(L".", CompileBytecodeStub);
+		const uint32_t flipped = cache.Add(requests[0]);
+		const uint32_t truncated = cache.Add(requests[NumPermutations - 1]);
+
+		const std::wstring flippedName = cache.GetEntryFilename(cache.GetKey(flipped));
+		const std::wstring truncatedName = cache.GetEntryFilename(cache.GetKey(truncated));
+
+		FILE* file = NULL;
+		if (_wfopen_s(&file, flippedName.c_str(), L"r+b") == 0)
+		{
+			fseek(file, 100, SEEK_SET);
+			const int value = fgetc(file);
+			fseek(file, 100, SEEK_SET);
+			fputc(value ^ 0x40, file);
+			fclose(file);
+		}
+
+		std::vector<uint8_t> contents;
+		if (_wfopen_s(&file, truncatedName.c_str(), L"rb") == 0)
+		{
+			uint8_t buffer[4096];
+			for (size_t read; (read = fread(buffer, 1, sizeof(buffer), file)) > 0; )
+				contents.insert(contents.end(), buffer, buffer + read);
+			fclose(file);
+		}
+		if (_wfopen_s(&file, truncatedName.c_str(), L"wb") == 0)
+		{
+			fwrite(&contents[0], 1, contents.size() / 2, file);
+			fclose(file);
+		}
+
+		const ShaderCacheRun damaged = RunShaderCache(requests, reference);
+		Log("ShaderCache damaged entries: %.1f ms, %u rejected (2 expected), %u compiled, %u loaded, %d mismatches\n",
+			damaged.Time * 1000.0, damaged.Stats.Rejected, damaged.Stats.Compiled, damaged.Stats.Loaded, damaged.Mismatches);
+	}
+
+	// Leave nothing behind
+	RemoveShaderCacheEntries(requests);
+
+	for (int i = 0; i < NumSources; ++i)
+		remove(Sources[i].Name);
+}
+}
+
+void RunCPUBenchmarks()
+{
+	gBenchmarkLog = fopen("Benchmark.log", "w");
+
+	BenchmarkAmbientOcclusion();
+	BenchmarkCrossBilateralFilter();
+	BenchmarkLightGeneration();
+	BenchmarkLightAnimation();
+	BenchmarkLightSetLoad();
+	BenchmarkLightBounds();
+	BenchmarkTiledLightCulling();
+	BenchmarkClusteredLightCulling();
+	BenchmarkLightBVH();
+	BenchmarkSceneCulling();
+	BenchmarkBoundingBoxBatch();
+	BenchmarkMatrixChain(LogLine);
+	BenchmarkSDKMeshLoad();
+	BenchmarkSceneLoad();
+	BenchmarkMeshOptimizer();
+	BenchmarkVertexCompression();
+	BenchmarkLightVolumeBatch();
+	BenchmarkConstantRing();
+	BenchmarkDrawQueue();
+	BenchmarkShaderCache();
+
+	if (gBenchmarkLog)
+	{
+		fclose(gBenchmarkLog);
+		gBenchmarkLog = NULL;
+	}
+}
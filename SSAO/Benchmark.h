@@ -0,0 +1,8 @@
+#ifndef Benchmark_h__
+#define Benchmark_h__
+
+// CPU side benchmarks. None of them touch the D3D device, results are written to Benchmark.log
+// and the debugger output.
+void RunCPUBenchmarks();
+
+#endif // Benchmark_h__
@@ -1,6 +1,11 @@
 #pragma once
 
-#include <D3dx9math.h>
+#include "VectorMath.h"
+#include "SimdMath.h"
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cfloat>
 
 enum ContainmentType 
 {
@@ -32,7 +37,7 @@ public:
 		return *this;
 	}
 
-	bool operator == ( const BoundingBox& rhs)
+	bool operator == ( const BoundingBox& rhs) const
 	{
 		return (Defined == rhs.Defined) && (Min == rhs.Min) && (Max == rhs.Max);
 	}
@@ -42,6 +47,11 @@ public:
 	 */
 	void SetNull()	{ Defined = false; }
 
+	/**
+	 * False until something is merged.
+	 */
+	bool IsDefined() const	{ return Defined; }
+
 	/**
 	 * Return center of box.
 	 */
@@ -102,7 +112,7 @@ public:
 	/**
 	 * Determines whether contains the specified box.
 	 */
-	ContainmentType Contains( const BoundingBox& box )
+	ContainmentType Contains( const BoundingBox& box ) const
 	{
 		if( Max.x < box.Min.x || Min.x > box.Max.x )
 			return CT_Disjoint;
@@ -124,7 +134,7 @@ public:
 	/**
 	 * Determines whether contains the specified point.
 	 */
-	ContainmentType Contains( const D3DXVECTOR3& point )
+	ContainmentType Contains( const D3DXVECTOR3& point ) const
 	{
 		if( Min.x <= point.x && point.x <= Max.x && Min.y <= point.y && 
 			point.y <= Max.y && Min.z <= point.z && point.z <= Max.z )
@@ -134,9 +144,9 @@ public:
 	}
 
 	/**
-	 * Determines whether a sphere intersects the specified object.
+	 * Determines whether a box intersects the specified object.
 	 */
-	bool Intersects( const BoundingBox& box )
+	bool Intersects( const BoundingBox& box ) const
 	{
 		if ( Max.x < box.Min.x || Min.x > box.Max.x )
 			return false;
@@ -147,6 +157,40 @@ public:
 		return ( Max.z >= box.Min.z && Min.z <= box.Max.z );
 	}
 
+	/**
+	 * Determines whether a sphere intersects the box.
+	 */
+	bool Intersects( const D3DXVECTOR3& center, float radius ) const
+	{
+		// Squared distance from the center to the closest point in the box
+		float distSq = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float d = (std::max)((std::max)(Min[axis] - center[axis], center[axis] - Max[axis]), 0.0f);
+			distSq += d * d;
+		}
+		return distSq <= radius * radius;
+	}
+
+	/**
+	 * Determines whether the box is inside or crossing every plane, normals point inside. Conservative for
+	 * frustums, a box outside near a corner passes.
+	 */
+	bool Intersects( const D3DXPLANE* planes, int numPlanes ) const
+	{
+		for (int i = 0; i < numPlanes; ++i)
+		{
+			// Corner furthest along the plane normal
+			const float x = planes[i].a >= 0 ? Max.x : Min.x;
+			const float y = planes[i].b >= 0 ? Max.y : Min.y;
+			const float z = planes[i].c >= 0 ? Max.z : Min.z;
+
+			if (planes[i].a * x + planes[i].b * y + planes[i].c * z + planes[i].d < 0)
+				return false;
+		}
+		return true;
+	}
+
 	/**
 	 * Return which axis has maximum extent, 0-x, 1-y, 2-z
 	 */
@@ -181,9 +225,309 @@ public:
 
 
 public:
-	D3DXVECTOR3 Max, Min;
+	D3DXVECTOR3 Min, Max;
 
 private:
 	bool Defined;
 };
 
+/**
+ * Many boxes stored as arrays of min and max per axis, so kernels test a SIMD register of boxes with
+ * each instruction. Arrays are padded to whole registers with empty boxes (min FLT_MAX, max -FLT_MAX),
+ * which merge to nothing. Queries append the indices of the boxes that pass to a list.
+ */
+class BoundingBoxBatch
+{
+public:
+	typedef SimdNative S;
+
+	BoundingBoxBatch() : mSize(0) { }
+
+	size_t Size() const	{ return mSize; }
+
+	void Clear()
+	{
+		mSize = 0;
+		for (int i = 0; i < 6; ++i)
+			mBounds[i].clear();
+	}
+
+	void Add( const BoundingBox& box )
+	{
+		if (mSize % S::Width == 0)
+		{
+			for (int i = 0; i < 6; ++i)
+				mBounds[i].resize(mSize + S::Width, i < 3 ? FLT_MAX : -FLT_MAX);
+		}
+
+		mBounds[0][mSize] = box.Min.x; mBounds[1][mSize] = box.Min.y; mBounds[2][mSize] = box.Min.z;
+		mBounds[3][mSize] = box.Max.x; mBounds[4][mSize] = box.Max.y; mBounds[5][mSize] = box.Max.z;
+		mSize++;
+	}
+
+	BoundingBox Get( size_t i ) const
+	{
+		return BoundingBox(D3DXVECTOR3(mBounds[0][i], mBounds[1][i], mBounds[2][i]), D3DXVECTOR3(mBounds[3][i], mBounds[4][i], mBounds[5][i]));
+	}
+
+	const float* MinX() const	{ return mSize ? &mBounds[0][0] : NULL; }
+	const float* MinY() const	{ return mSize ? &mBounds[1][0] : NULL; }
+	const float* MinZ() const	{ return mSize ? &mBounds[2][0] : NULL; }
+	const float* MaxX() const	{ return mSize ? &mBounds[3][0] : NULL; }
+	const float* MaxY() const	{ return mSize ? &mBounds[4][0] : NULL; }
+	const float* MaxZ() const	{ return mSize ? &mBounds[5][0] : NULL; }
+
+	/**
+	 * Merge of boxes [first, first + count), undefined when count is zero.
+	 */
+	BoundingBox Merge( size_t first, size_t count ) const
+	{
+		BoundingBox result;
+		if (!count)
+			return result;
+
+		S::Float bounds[6];
+		for (int i = 0; i < 6; ++i)
+			bounds[i] = S::Set(i < 3 ? FLT_MAX : -FLT_MAX);
+
+		size_t i = first;
+		for (; i + S::Width <= first + count; i += S::Width)
+		{
+			for (int b = 0; b < 3; ++b)
+			{
+				bounds[b] = S::Min(bounds[b], S::Load(&mBounds[b][i]));
+				bounds[b + 3] = S::Max(bounds[b + 3], S::Load(&mBounds[b + 3][i]));
+			}
+		}
+
+		alignas(64) float lanes[6][S::Width];
+		for (int b = 0; b < 6; ++b)
+			S::Store(lanes[b], bounds[b]);
+
+		D3DXVECTOR3 boxMin(FLT_MAX, FLT_MAX, FLT_MAX), boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int lane = 0; lane < S::Width; ++lane)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boxMin[axis] = (std::min)(boxMin[axis], lanes[axis][lane]);
+				boxMax[axis] = (std::max)(boxMax[axis], lanes[axis + 3][lane]);
+			}
+		}
+
+		// Remainder which doesn't fill a register
+		for (; i < first + count; ++i)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boxMin[axis] = (std::min)(boxMin[axis], mBounds[axis][i]);
+				boxMax[axis] = (std::max)(boxMax[axis], mBounds[axis + 3][i]);
+			}
+		}
+
+		result.Merge(boxMin);
+		result.Merge(boxMax);
+		return result;
+	}
+
+	BoundingBox Merge() const	{ return Merge(0, mSize); }
+
+	/**
+	 * Boxes of [first, first + count) overlapping box.
+	 */
+	void Intersects( const BoundingBox& box, size_t first, size_t count, std::vector<uint32_t>& hits ) const
+	{
+		const S::Float boxMin[3] = { S::Set(box.Min.x), S::Set(box.Min.y), S::Set(box.Min.z) };
+		const S::Float boxMax[3] = { S::Set(box.Max.x), S::Set(box.Max.y), S::Set(box.Max.z) };
+
+		for (size_t i = first & ~size_t(S::Width - 1); i < first + count; i += S::Width)
+		{
+			S::Mask overlap = S::And(S::CmpLe(S::Load(&mBounds[0][i]), boxMax[0]), S::CmpGe(S::Load(&mBounds[3][i]), boxMin[0]));
+			for (int axis = 1; axis < 3; ++axis)
+			{
+				overlap = S::And(overlap, S::And(S::CmpLe(S::Load(&mBounds[axis][i]), boxMax[axis]), 
+					S::CmpGe(S::Load(&mBounds[axis + 3][i]), boxMin[axis])));
+			}
+			AppendHits(S::Bits(overlap), i, first, count, hits);
+		}
+	}
+
+	/**
+	 * Boxes of [first, first + count) inside or crossing every plane, see BoundingBox::Intersects.
+	 */
+	void Intersects( const D3DXPLANE* planes, int numPlanes, size_t first, size_t count, std::vector<uint32_t>& hits ) const
+	{
+		for (size_t i = first & ~size_t(S::Width - 1); i < first + count; i += S::Width)
+		{
+			int inside = (1 << S::Width) - 1;
+			for (int p = 0; p < numPlanes && inside; ++p)
+			{
+				// The corner furthest along the normal decides, picked per plane for all lanes
+				const float* x = planes[p].a >= 0 ? &mBounds[3][i] : &mBounds[0][i];
+				const float* y = planes[p].b >= 0 ? &mBounds[4][i] : &mBounds[1][i];
+				const float* z = planes[p].c >= 0 ? &mBounds[5][i] : &mBounds[2][i];
+
+				S::Float dist = S::Add(S::Mul(S::Set(planes[p].a), S::Load(x)), S::Mul(S::Set(planes[p].b), S::Load(y)));
+				dist = S::Add(dist, S::Add(S::Mul(S::Set(planes[p].c), S::Load(z)), S::Set(planes[p].d)));
+
+				inside &= S::Bits(S::CmpGe(dist, S::Zero()));
+			}
+			AppendHits(inside, i, first, count, hits);
+		}
+	}
+
+	/**
+	 * Boxes of [first, first + count) touched by the sphere.
+	 */
+	void Intersects( const D3DXVECTOR3& center, float radius, size_t first, size_t count, std::vector<uint32_t>& hits ) const
+	{
+		const S::Float c[3] = { S::Set(center.x), S::Set(center.y), S::Set(center.z) };
+		const S::Float radiusSq = S::Set(radius * radius);
+
+		for (size_t i = first & ~size_t(S::Width - 1); i < first + count; i += S::Width)
+		{
+			S::Float distSq = S::Zero();
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				// Distance to the slab, zero inside
+				S::Float d = S::Max(S::Max(S::Sub(S::Load(&mBounds[axis][i]), c[axis]), S::Sub(c[axis], S::Load(&mBounds[axis + 3][i]))), S::Zero());
+				distSq = S::Add(distSq, S::Mul(d, d));
+			}
+			AppendHits(S::Bits(S::CmpLe(distSq, radiusSq)), i, first, count, hits);
+		}
+	}
+
+private:
+	// Lanes of the register at i that passed and lie in [first, first + count)
+	static void AppendHits( int bits, size_t i, size_t first, size_t count, std::vector<uint32_t>& hits )
+	{
+		for (int lane = 0; bits; ++lane, bits >>= 1)
+		{
+			if ((bits & 1) && i + lane >= first && i + lane < first + count)
+				hits.push_back(uint32_t(i + lane));
+		}
+	}
+
+private:
+	size_t mSize;
+
+	// Min x, y, z then max x, y, z
+	std::vector<float> mBounds[6];
+};
+
+/**
+ * Box against the planes in planeMask. Returns false when the box is outside one of them, otherwise clears
+ * the planes the box is entirely inside of, which also hold for everything the box contains.
+ */
+inline bool BoxInsidePlanes( const BoundingBox& box, const D3DXPLANE planes[6], uint32_t& planeMask )
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if (!(planeMask & (1 << i)))
+			continue;
+
+		// Corners furthest along and against the plane normal
+		const bool positiveX = planes[i].a >= 0, positiveY = planes[i].b >= 0, positiveZ = planes[i].c >= 0;
+
+		const float farthest = planes[i].a * (positiveX ? box.Max.x : box.Min.x) + planes[i].b * (positiveY ? box.Max.y : box.Min.y) +
+			planes[i].c * (positiveZ ? box.Max.z : box.Min.z) + planes[i].d;
+		if (farthest < 0)
+			return false;
+
+		const float nearest = planes[i].a * (positiveX ? box.Min.x : box.Max.x) + planes[i].b * (positiveY ? box.Min.y : box.Max.y) +
+			planes[i].c * (positiveZ ? box.Min.z : box.Max.z) + planes[i].d;
+		if (nearest >= 0)
+			planeMask &= ~(1 << i);
+	}
+	return true;
+}
+
+// Past this depth the BVH builds split at the median, keeps the trees within BVHTraversalStackSize
+const uint32_t MaxSAHDepth = 32;
+const int BVHTraversalStackSize = 64;
+
+/**
+ * Binned surface area heuristic along one axis, shared by the top down BVH builds (LightBVH, SceneCulling).
+ * Centroids in [axisMin, axisMin + axisExtent] go into NumBins bins with their bounds, FindSplit evaluates
+ * every bin boundary. The cost of a side is countCost(primitives on it) times its surface area, so a build
+ * can count primitives or the leaves they make.
+ */
+class SAHBinning
+{
+public:
+	static const int NumBins = 16;
+
+	SAHBinning( float axisMin, float axisExtent )
+		: mAxisMin(axisMin), mBinScale(NumBins / axisExtent)
+	{
+		for (int i = 0; i < NumBins; ++i)
+			mCounts[i] = 0;
+	}
+
+	int Bin( float centroid ) const
+	{
+		return (std::min)(int((centroid - mAxisMin) * mBinScale), NumBins - 1);
+	}
+
+	void Add( float centroid, const BoundingBox& bound )
+	{
+		const int bin = Bin(centroid);
+		mCounts[bin]++;
+		mBounds[bin].Merge(bound);
+	}
+
+	/**
+	 * Boundary with the lowest cost, bins up to and including it go to the first child. cost gets the sum
+	 * over both sides, not yet divided by the area of the parent.
+	 */
+	template <typename CountCost>
+	int FindSplit( CountCost countCost, float* cost ) const
+	{
+		float costs[NumBins - 1];
+
+		BoundingBox sweep;
+		uint32_t sweepCount = 0;
+		for (int split = 0; split < NumBins - 1; ++split)
+		{
+			sweep.Merge(mBounds[split]);
+			sweepCount += mCounts[split];
+			costs[split] = sweepCount ? countCost(sweepCount) * sweep.SurfaceArea() : 0.0f;
+		}
+
+		sweep.SetNull();
+		sweepCount = 0;
+		for (int split = NumBins - 2; split >= 0; --split)
+		{
+			sweep.Merge(mBounds[split + 1]);
+			sweepCount += mCounts[split + 1];
+			costs[split] += sweepCount ? countCost(sweepCount) * sweep.SurfaceArea() : 0.0f;
+		}
+
+		int bestSplit = 0;
+		for (int split = 1; split < NumBins - 1; ++split)
+		{
+			if (costs[split] < costs[bestSplit])
+				bestSplit = split;
+		}
+
+		if (cost)
+			*cost = costs[bestSplit];
+		return bestSplit;
+	}
+
+private:
+	float mAxisMin, mBinScale;
+	uint32_t mCounts[NumBins];
+	BoundingBox mBounds[NumBins];
+};
+
+/**
+ * Fallback of the BVH builds when the SAH puts everything on one side or the tree is too deep: half of
+ * [first, last) on each side, by less.
+ */
+template <typename Iterator, typename Less>
+Iterator SplitAtMedian( Iterator first, Iterator last, Less less )
+{
+	Iterator middle = first + (last - first) / 2;
+	std::nth_element(first, middle, last, less);
+	return middle;
+}
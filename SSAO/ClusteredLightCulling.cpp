@@ -0,0 +1,262 @@
+#include "DXUT.h"
+#include "ClusteredLightCulling.h"
+#include "Utility.h"
+#include <ppl.h>
+#include <algorithm>
+#include <cfloat>
+
+ClusteredLightCulling::ClusteredLightCulling( int tileSize, int numSlices )
+	: mTileSize(tileSize), mNumSlices(numSlices), mWidth(0), mHeight(0), mNumTilesX(0), mNumTilesY(0),
+	  mCameraNear(0), mCameraFar(0), mSliceScale(0)
+{
+
+}
+
+ClusteredLightCulling::~ClusteredLightCulling()
+{
+
+}
+
+void ClusteredLightCulling::SetupGrid( int width, int height, const D3DXMATRIX& cameraProj )
+{
+	mWidth = width;
+	mHeight = height;
+	mNumTilesX = (width + mTileSize - 1) / mTileSize;
+	mNumTilesY = (height + mTileSize - 1) / mTileSize;
+	mCameraProj = cameraProj;
+
+	// Near and far plane back from the projection
+	mCameraNear = -cameraProj._43 / cameraProj._33;
+	mCameraFar = cameraProj._43 / (1.0f - cameraProj._33);
+	mSliceScale = mNumSlices / logf(mCameraFar / mCameraNear);
+
+	const int numClusters = mNumTilesX * mNumTilesY * mNumSlices;
+	mClusterMin.resize(numClusters);
+	mClusterMax.resize(numClusters);
+
+	for (int slice = 0; slice < mNumSlices; ++slice)
+	{
+		const float sliceNear = mCameraNear * powf(mCameraFar / mCameraNear, float(slice) / mNumSlices);
+		const float sliceFar = mCameraNear * powf(mCameraFar / mCameraNear, float(slice + 1) / mNumSlices);
+
+		for (int tileY = 0; tileY < mNumTilesY; ++tileY)
+		{
+			// Clip y points up, tile y down
+			const float clipTop = 1.0f - 2.0f * float(tileY * mTileSize) / mHeight;
+			const float clipBottom = 1.0f - 2.0f * float((std::min)((tileY + 1) * mTileSize, mHeight)) / mHeight;
+
+			for (int tileX = 0; tileX < mNumTilesX; ++tileX)
+			{
+				const float clipLeft = 2.0f * float(tileX * mTileSize) / mWidth - 1.0f;
+				const float clipRight = 2.0f * float((std::min)((tileX + 1) * mTileSize, mWidth)) / mWidth - 1.0f;
+
+				// View x = clip x * z / _11, extremes are on the near or far face
+				const int cluster = GetClusterIndex(tileX, tileY, slice);
+				mClusterMin[cluster] = D3DXVECTOR3(
+					(std::min)(clipLeft * sliceNear, clipLeft * sliceFar) / cameraProj._11,
+					(std::min)(clipBottom * sliceNear, clipBottom * sliceFar) / cameraProj._22,
+					sliceNear);
+				mClusterMax[cluster] = D3DXVECTOR3(
+					(std::max)(clipRight * sliceNear, clipRight * sliceFar) / cameraProj._11,
+					(std::max)(clipTop * sliceNear, clipTop * sliceFar) / cameraProj._22,
+					sliceFar);
+			}
+		}
+	}
+}
+
+int ClusteredLightCulling::GetSlice( float viewZ ) const
+{
+	if (viewZ <= mCameraNear)
+		return 0;
+
+	return (std::min)(int(logf(viewZ / mCameraNear) * mSliceScale), mNumSlices - 1);
+}
+
+void ClusteredLightCulling::CullLights( const LightAnimation& lights, const D3DXMATRIX& cameraView )
+{
+	// Gather bounding spheres in view space
+	mLightIds.clear();
+	mLightX.clear();
+	mLightY.clear();
+	mLightZ.clear();
+	mLightRadius.clear();
+
+	for (size_t i = 0; i < lights.GetNumLights(); ++i)
+	{
+		D3DXVECTOR3 center;
+		float radius;
+		if (!lights.GetBoundingSphere(i, center, radius))
+			continue;
+
+		D3DXVECTOR3 centerView;
+		D3DXVec3TransformCoord(&centerView, &center, &cameraView);
+
+		// Entirely in front of near or behind far plane
+		if (centerView.z + radius < mCameraNear || centerView.z - radius > mCameraFar)
+			continue;
+
+		mLightIds.push_back(uint32_t(i));
+		mLightX.push_back(centerView.x);
+		mLightY.push_back(centerView.y);
+		mLightZ.push_back(centerView.z);
+		mLightRadius.push_back(radius);
+	}
+
+	const int numLights = static_cast<int>(mLightIds.size());
+
+	mLightClipRegions.resize(numLights);
+	mLightClusterRanges.resize(numLights * 6);
+	if (numLights)
+	{
+		CalculateLightBounds(&mLightX[0], &mLightY[0], &mLightZ[0], &mLightRadius[0], numLights,
+			mCameraNear, mCameraProj._11, mCameraProj._22, &mLightClipRegions[0]);
+	}
+
+	for (int i = 0; i < numLights; ++i)
+	{
+		const D3DXVECTOR4& clip = mLightClipRegions[i];
+		int* range = &mLightClusterRanges[i * 6];
+
+		if (clip.x >= clip.z || clip.y >= clip.w)
+		{
+			range[0] = range[1] = range[2] = 0;
+			range[3] = range[4] = range[5] = -1;
+			continue;
+		}
+
+		float minX = (clip.x * 0.5f + 0.5f) * mWidth;
+		float maxX = (clip.z * 0.5f + 0.5f) * mWidth;
+		float minY = (0.5f - clip.w * 0.5f) * mHeight;
+		float maxY = (0.5f - clip.y * 0.5f) * mHeight;
+
+		range[0] = (std::max)(int(minX) / mTileSize, 0);
+		range[1] = (std::max)(int(minY) / mTileSize, 0);
+		range[2] = GetSlice(mLightZ[i] - mLightRadius[i]);
+		range[3] = (std::min)(int(maxX) / mTileSize, mNumTilesX - 1);
+		range[4] = (std::min)(int(maxY) / mTileSize, mNumTilesY - 1);
+		range[5] = GetSlice(mLightZ[i] + mLightRadius[i]);
+	}
+
+	// Each depth slice fills its own lists, slices run in parallel
+	const int numCellsPerSlice = mNumTilesX * mNumTilesY;
+
+	mSliceLightIndices.resize(mNumSlices);
+	mSliceCellEnds.resize(mNumSlices);
+	mSliceHits.resize(mNumSlices);
+
+	Concurrency::parallel_for(0, mNumSlices, [&](int slice)
+	{
+		std::vector<uint32_t>& sliceIndices = mSliceLightIndices[slice];
+		std::vector<uint32_t>& cellEnds = mSliceCellEnds[slice];
+		std::vector<uint32_t>& hits = mSliceHits[slice];
+		cellEnds.assign(numCellsPerSlice, 0);
+		hits.clear();
+
+		const D3DXVECTOR3* clusterMin = &mClusterMin[slice * numCellsPerSlice];
+		const D3DXVECTOR3* clusterMax = &mClusterMax[slice * numCellsPerSlice];
+
+		for (int i = 0; i < numLights; ++i)
+		{
+			const int* range = &mLightClusterRanges[i * 6];
+			if (slice < range[2] || slice > range[5])
+				continue;
+
+			const D3DXVECTOR3 center(mLightX[i], mLightY[i], mLightZ[i]);
+			const float radiusSq = mLightRadius[i] * mLightRadius[i];
+
+			for (int tileY = range[1]; tileY <= range[4]; ++tileY)
+			{
+				for (int tileX = range[0]; tileX <= range[3]; ++tileX)
+				{
+					const int cell = tileY * mNumTilesX + tileX;
+
+					// Sphere against cluster box, squared distance to the closest point
+					float distSq = 0;
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						const float d = (std::max)((std::max)(clusterMin[cell][axis] - center[axis], center[axis] - clusterMax[cell][axis]), 0.0f);
+						distSq += d * d;
+					}
+					if (distSq > radiusSq)
+						continue;
+
+					cellEnds[cell]++;
+					hits.push_back(uint32_t(cell));
+					hits.push_back(uint32_t(i));
+				}
+			}
+		}
+
+		uint32_t offset = 0;
+		for (int cell = 0; cell < numCellsPerSlice; ++cell)
+		{
+			const uint32_t count = cellEnds[cell];
+			cellEnds[cell] = offset;
+			offset += count;
+		}
+
+		sliceIndices.resize(offset);
+		for (size_t h = 0; h < hits.size(); h += 2)
+			sliceIndices[cellEnds[hits[h]]++] = mLightIds[hits[h + 1]];
+	});
+
+	// Pack the slices into the flat buffer
+	mLightGrid.resize(numCellsPerSlice * mNumSlices);
+
+	uint32_t offset = 0;
+	for (int slice = 0; slice < mNumSlices; ++slice)
+	{
+		const std::vector<uint32_t>& cellEnds = mSliceCellEnds[slice];
+		for (int cell = 0; cell < numCellsPerSlice; ++cell)
+		{
+			LightGridCell& gridCell = mLightGrid[slice * numCellsPerSlice + cell];
+			gridCell.Offset = offset + (cell ? cellEnds[cell - 1] : 0);
+			gridCell.Count = cellEnds[cell] - (cell ? cellEnds[cell - 1] : 0);
+		}
+		offset += static_cast<uint32_t>(mSliceLightIndices[slice].size());
+	}
+
+	mLightIndices.resize(offset);
+	Concurrency::parallel_for(0, mNumSlices, [&](int slice)
+	{
+		const std::vector<uint32_t>& sliceIndices = mSliceLightIndices[slice];
+		if (!sliceIndices.empty())
+			std::copy(sliceIndices.begin(), sliceIndices.end(), mLightIndices.begin() + mLightGrid[slice * numCellsPerSlice].Offset);
+	});
+}
+
+const uint32_t* ClusteredLightCulling::GetClusterLights( int tileX, int tileY, int slice, uint32_t& numLights ) const
+{
+	const LightGridCell& cell = mLightGrid[GetClusterIndex(tileX, tileY, slice)];
+
+	numLights = cell.Count;
+	return numLights ? &mLightIndices[cell.Offset] : NULL;
+}
+
+ClusteredLightCulling::ClusterStats ClusteredLightCulling::GetStats() const
+{
+	ClusterStats stats;
+	memset(&stats, 0, sizeof(stats));
+
+	stats.NumClusters = static_cast<uint32_t>(mLightGrid.size());
+	stats.NumIndices = static_cast<uint32_t>(mLightIndices.size());
+
+	for (size_t i = 0; i < mLightGrid.size(); ++i)
+	{
+		const uint32_t count = mLightGrid[i].Count;
+		if (count == 0)
+			continue;
+
+		stats.NumOccupied++;
+		stats.MaxLights = (std::max)(stats.MaxLights, count);
+
+		int bucket = 0;
+		while (bucket < 7 && (2u << bucket) <= count)
+			bucket++;
+		stats.Histogram[bucket]++;
+	}
+
+	stats.AvgLights = stats.NumOccupied ? float(stats.NumIndices) / stats.NumOccupied : 0.0f;
+	return stats;
+}
@@ -0,0 +1,101 @@
+#ifndef ClusteredLightCulling_h__
+#define ClusteredLightCulling_h__
+
+#include "LightAnimation.h"
+#include <vector>
+#include <cstdint>
+
+/**
+ * Clustered light assignment, the 3D counterpart of TiledLightCulling.
+ *
+ * The view frustum is split in TileSize x TileSize pixel tiles and NumSlices depth slices whose thickness
+ * grows exponentially from near to far plane, so every cluster (froxel) has roughly the same aspect ratio.
+ * Clusters don't depend on the depth buffer, which keeps light lists tight where a tile covers both a
+ * close wall and the far background.
+ *
+ * Point lights are bound by their attenuation sphere, spot lights by the smallest sphere around their cone.
+ * Lights are binned through their CalculateLightBounds screen rectangle and depth range, then tested against
+ * the view space box of each candidate cluster.
+ */
+class ClusteredLightCulling
+{
+public:
+	struct ClusterStats
+	{
+		uint32_t NumClusters;
+		uint32_t NumOccupied;
+		uint32_t NumIndices;
+		uint32_t MaxLights;
+		float AvgLights;            // Over occupied clusters
+		uint32_t Histogram[8];      // Occupied clusters with 1, 2-3, 4-7, ... , 128+ lights
+	};
+
+	// Offset into the index list and number of lights of a cluster
+	struct LightGridCell
+	{
+		uint32_t Offset;
+		uint32_t Count;
+	};
+
+public:
+	ClusteredLightCulling(int tileSize = 64, int numSlices = 24);
+	~ClusteredLightCulling();
+
+	/**
+	 * Build the cluster grid for a viewport, only needed when resolution or projection changes.
+	 */
+	void SetupGrid(int width, int height, const D3DXMATRIX& cameraProj);
+
+	/**
+	 * Bin the point and spot lights, directional lights affect every cluster and are left out.
+	 */
+	void CullLights(const LightAnimation& lights, const D3DXMATRIX& cameraView);
+
+	int GetNumTilesX() const         { return mNumTilesX; }
+	int GetNumTilesY() const         { return mNumTilesY; }
+	int GetNumSlices() const         { return mNumSlices; }
+	int GetTileSize() const          { return mTileSize; }
+
+	// Depth slice of a view depth, clamped to the grid
+	int GetSlice(float viewZ) const;
+
+	int GetClusterIndex(int tileX, int tileY, int slice) const  { return (slice * mNumTilesY + tileY) * mNumTilesX + tileX; }
+
+	// Light indices (LightAnimation::GetLight) of a cluster
+	const uint32_t* GetClusterLights(int tileX, int tileY, int slice, uint32_t& numLights) const;
+
+	const std::vector<LightGridCell>& GetLightGrid() const  { return mLightGrid; }
+	const std::vector<uint32_t>& GetLightIndices() const    { return mLightIndices; }
+
+	ClusterStats GetStats() const;
+
+private:
+	int mTileSize;
+	int mNumSlices;
+	int mWidth, mHeight;
+	int mNumTilesX, mNumTilesY;
+
+	// Slice = log(z / near) * mSliceScale
+	float mCameraNear, mCameraFar;
+	float mSliceScale;
+	D3DXMATRIX mCameraProj;
+
+	// View space bounding box of every cluster, min and max corner
+	std::vector<D3DXVECTOR3> mClusterMin, mClusterMax;
+
+	std::vector<LightGridCell> mLightGrid;
+	std::vector<uint32_t> mLightIndices;
+
+	// View space bounding spheres and their cluster ranges (x0, y0, slice0, x1, y1, slice1)
+	std::vector<uint32_t> mLightIds;
+	std::vector<float> mLightX, mLightY, mLightZ, mLightRadius;
+	std::vector<D3DXVECTOR4> mLightClipRegions;
+	std::vector<int> mLightClusterRanges;
+
+	// Per slice lists before they are packed into mLightIndices
+	std::vector<std::vector<uint32_t>> mSliceLightIndices;
+	std::vector<std::vector<uint32_t>> mSliceCellEnds;
+	std::vector<std::vector<uint32_t>> mSliceHits;      // (cell, light) pairs
+};
+
+#endif // ClusteredLightCulling_h__
@@ -0,0 +1,66 @@
+#include "DXUT.h"
+#include "ConstantRing.h"
+
+ConstantRing::ConstantRing( UINT capacity )
+	: mCapacity(capacity), mHead(0), mUsed(0), mFrameBytes(0), mNeedsDiscard(true), mWastedBytes(0), mNumResets(0)
+{
+
+}
+
+UINT ConstantRing::Allocate( UINT size, UINT alignment )
+{
+	UINT offset = (mHead + alignment - 1) / alignment * alignment;
+	UINT consumed = offset - mHead + size;
+
+	// Doesn't fit before the end, skip the tail and start over at zero
+	UINT wasted = 0;
+	if (offset > mCapacity || size > mCapacity - offset)
+	{
+		wasted = mCapacity - mHead;
+		offset = 0;
+		consumed = wasted + size;
+	}
+
+	// The bytes from the head on belong to the oldest frame in flight once used reaches capacity
+	if (consumed > mCapacity - mUsed)
+		return InvalidOffset;
+
+	mHead = offset + size;
+	mUsed += consumed;
+	mFrameBytes += consumed;
+	mWastedBytes += wasted;
+	return offset;
+}
+
+void ConstantRing::EndFrame( UINT64 fence )
+{
+	Frame frame = { fence, mFrameBytes };
+	mFrames.push_back(frame);
+	mFrameBytes = 0;
+}
+
+void ConstantRing::Retire( UINT64 completedFence )
+{
+	while (!mFrames.empty() && mFrames.front().Fence <= completedFence)
+	{
+		mUsed -= mFrames.front().Bytes;
+		mFrames.pop_front();
+	}
+}
+
+void ConstantRing::Reset()
+{
+	mFrames.clear();
+	mHead = 0;
+	mUsed = 0;
+	mFrameBytes = 0;
+	mNeedsDiscard = true;
+	mNumResets++;
+}
+
+bool ConstantRing::TakeDiscard()
+{
+	const bool discard = mNeedsDiscard;
+	mNeedsDiscard = false;
+	return discard;
+}
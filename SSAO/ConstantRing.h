@@ -0,0 +1,113 @@
+#ifndef ConstantRing_h__
+#define ConstantRing_h__
+
+#include <d3d11.h>
+#include <deque>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Suballocator of one large dynamic buffer, shared by everything that changes per draw in a frame.
+ *
+ * The per draw path maps a small buffer with WRITE_DISCARD before every draw, and the driver has to rename
+ * it each time: a new piece of memory, its bookkeeping and often a flush of the command buffer. Here a pass
+ * writes the constants of all its draws in one go at the head of the ring with NO_OVERWRITE, and the draws
+ * point into it. The head wraps to the start when the next block doesn't fit before the end.
+ *
+ * The ring only tracks offsets, the buffer belongs to the caller. Each frame ends with a fence value, the
+ * caller retires the frames the GPU has finished and their bytes become free again. An allocation that
+ * would run into a frame still in flight fails, the caller then Resets, which discards the whole buffer once.
+ */
+class ConstantRing
+{
+public:
+	static const UINT InvalidOffset = UINT(-1);
+
+public:
+	explicit ConstantRing(UINT capacity);
+
+	// Offset of size bytes at a multiple of alignment, InvalidOffset when the frames in flight don't leave room
+	UINT Allocate(UINT size, UINT alignment);
+
+	// Close the allocations made since the last call, the GPU is done with them once fence completes
+	void EndFrame(UINT64 fence);
+
+	// Free the frames whose fence is less or equal to completedFence
+	void Retire(UINT64 completedFence);
+
+	// Forget the frames in flight and start over at offset zero, the next map must discard the buffer
+	void Reset();
+
+	// True once after Reset, the caller maps with WRITE_DISCARD instead of NO_OVERWRITE then
+	bool TakeDiscard();
+
+	UINT GetCapacity() const         { return mCapacity; }
+	UINT GetUsed() const             { return mUsed; }
+	UINT GetFramesInFlight() const   { return static_cast<UINT>(mFrames.size()); }
+
+	// Bytes skipped at the end of the buffer by wraps, and the number of Resets, since construction
+	UINT64 GetWastedBytes() const    { return mWastedBytes; }
+	UINT GetNumResets() const        { return mNumResets; }
+
+private:
+	struct Frame
+	{
+		UINT64 Fence;
+		UINT Bytes;    // Allocated in the frame, alignment padding and wrapped tail included
+	};
+
+	UINT mCapacity;
+	UINT mHead;
+	UINT mUsed;
+	UINT mFrameBytes;
+	bool mNeedsDiscard;
+
+	std::deque<Frame> mFrames;
+
+	UINT64 mWastedBytes;
+	UINT mNumResets;
+};
+
+/**
+ * Map size bytes of the ring buffer for writing, the caller fills them and Unmaps the buffer. A full ring is
+ * Reset and the block goes at the start of a discarded buffer, so size plus alignment must fit the capacity.
+ * Context is ID3D11DeviceContext or anything with the same calls. Returns NULL when the map fails.
+ */
+template<typename Context>
+void* MapRing(Context* context, ID3D11Buffer* buffer, ConstantRing& ring, UINT size, UINT alignment, UINT* offset)
+{
+	*offset = ring.Allocate(size, alignment);
+	if (*offset == ConstantRing::InvalidOffset)
+	{
+		ring.Reset();
+		*offset = ring.Allocate(size, alignment);
+	}
+
+	const D3D11_MAP mapType = ring.TakeDiscard() ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+
+	D3D11_MAPPED_SUBRESOURCE mappedResource;
+	if (FAILED(context->Map(buffer, 0, mapType, 0, &mappedResource)))
+	{
+		*offset = ConstantRing::InvalidOffset;
+		return NULL;
+	}
+
+	return static_cast<uint8_t*>(mappedResource.pData) + *offset;
+}
+
+// Copy size bytes into the ring buffer and return their offset, InvalidOffset when the map fails
+template<typename Context>
+UINT UploadToRing(Context* context, ID3D11Buffer* buffer, ConstantRing& ring, const void* data, UINT size, UINT alignment)
+{
+	UINT offset;
+	void* destination = MapRing(context, buffer, ring, size, alignment, &offset);
+	if (!destination)
+		return ConstantRing::InvalidOffset;
+
+	memcpy(destination, data, size);
+	context->Unmap(buffer, 0);
+
+	return offset;
+}
+
+#endif // ConstantRing_h__
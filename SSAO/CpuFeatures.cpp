@@ -0,0 +1,85 @@
+#include "DXUT.h"
+#include "CpuFeatures.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace {
+
+void Cpuid( int leaf, int subleaf, unsigned int regs[4] )
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, leaf, subleaf);
+	for (int i = 0; i < 4; ++i)
+		regs[i] = static_cast<unsigned int>(info[i]);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XCR0, which register states the OS saves on a context switch
+unsigned long long ReadXCR0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+
+SimdLevel DetectSimdLevel()
+{
+	unsigned int regs[4];
+
+	Cpuid(0, 0, regs);
+	const unsigned int maxLeaf = regs[0];
+	if (maxLeaf < 7)
+		return Simd_SSE2;
+
+	// OSXSAVE, AVX and FMA
+	Cpuid(1, 0, regs);
+	const unsigned int Leaf1Bits = (1u << 27) | (1u << 28) | (1u << 12);
+	if ((regs[2] & Leaf1Bits) != Leaf1Bits)
+		return Simd_SSE2;
+
+	// XMM and YMM state enabled
+	const unsigned long long xcr0 = ReadXCR0();
+	if ((xcr0 & 0x6) != 0x6)
+		return Simd_SSE2;
+
+	Cpuid(7, 0, regs);
+	if ((regs[1] & (1u << 5)) == 0)
+		return Simd_SSE2;
+
+	// AVX-512F, plus opmask and both halves of the ZMM state
+	if ((regs[1] & (1u << 16)) != 0 && (xcr0 & 0xE6) == 0xE6)
+		return Simd_AVX512;
+
+	return Simd_AVX2;
+}
+
+}
+
+SimdLevel GetSimdLevel()
+{
+	static const SimdLevel level = DetectSimdLevel();
+	return level;
+}
+
+const char* GetSimdLevelName( SimdLevel level )
+{
+	const char* Names[Simd_Count] = { "SSE2", "AVX2", "AVX-512" };
+	return Names[level];
+}
+
+int GetSimdWidth( SimdLevel level )
+{
+	const int Widths[Simd_Count] = { 4, 8, 16 };
+	return Widths[level];
+}
@@ -0,0 +1,27 @@
+#ifndef CpuFeatures_h__
+#define CpuFeatures_h__
+
+/**
+ * Instruction sets the CPU kernels are compiled for. The SSE2 kernels build with the project settings,
+ * the AVX2 and AVX-512 ones live in their own files built with /arch:AVX2 and /arch:AVX512, and are only
+ * called when GetSimdLevel says the machine runs them.
+ */
+enum SimdLevel
+{
+	Simd_SSE2,
+	Simd_AVX2,       // With FMA, Haswell and later
+	Simd_AVX512,     // AVX-512F, Skylake-X and later
+
+	Simd_Count
+};
+
+// Widest instruction set both the CPU and the OS (saving the YMM/ZMM registers) support, checked once
+SimdLevel GetSimdLevel();
+
+// "SSE2", "AVX2" or "AVX-512"
+const char* GetSimdLevelName(SimdLevel level);
+
+// Lanes of a float register
+int GetSimdWidth(SimdLevel level);
+
+#endif // CpuFeatures_h__
@@ -0,0 +1,18 @@
+// Built with /arch:AVX2 and without the precompiled header, only called when GetSimdLevel reports AVX2
+#include "CrossBilateralFilterKernels.h"
+
+#if defined(__AVX2__)
+
+void BlurTileXAVX2( const BlurTile& tile, const float* src, float* dst )
+{
+	BlurTileX<SimdAVX2>(tile, src, dst);
+}
+
+void BlurTileYAVX2( const BlurTile& tile, const float* src, float* dst )
+{
+	BlurTileY<SimdAVX2>(tile, src, dst);
+}
+
+#else
+#error CrossBilateralFilterAVX2.cpp must be compiled for AVX2 (/arch:AVX2, -mavx2 -mfma)
+#endif
@@ -0,0 +1,126 @@
+#include "DXUT.h"
+#include "CrossBilateralFilterCPU.h"
+#include "CrossBilateralFilterKernels.h"
+#include <ppl.h>
+
+namespace {
+
+// Tile size of the parallel passes, 64x64 floats of source and depth is 32KB
+const int TileSize = 64;
+
+}
+
+void BlurTileXSSE2( const BlurTile& tile, const float* src, float* dst )
+{
+	BlurTileX<SimdSSE>(tile, src, dst);
+}
+
+void BlurTileYSSE2( const BlurTile& tile, const float* src, float* dst )
+{
+	BlurTileY<SimdSSE>(tile, src, dst);
+}
+
+CrossBilateralFilterCPU::CrossBilateralFilterCPU()
+	: mSimdLevel(::GetSimdLevel()), mWidth(0), mHeight(0), mRadius(0), mSharpness(0)
+{
+
+}
+
+CrossBilateralFilterCPU::~CrossBilateralFilterCPU()
+{
+
+}
+
+void CrossBilateralFilterCPU::SetSimdLevel( SimdLevel level )
+{
+	mSimdLevel = (std::min)(level, ::GetSimdLevel());
+}
+
+void CrossBilateralFilterCPU::LinearizeDepth( const float* depthBuffer, const BlurParams& params )
+{
+	mLinearDepth.resize(mWidth * mHeight);
+
+	// CameraNear / (CameraFar - (CameraFar - CameraNear) * nonLinearDepth)
+	const float cameraNear = params.CameraNear;
+	const float cameraFar = params.CameraFar;
+	const float range = cameraFar - cameraNear;
+
+	float* linearDepth = &mLinearDepth[0];
+	const int numPixels = mWidth * mHeight;
+	const int numChunks = (numPixels + TileSize * TileSize - 1) / (TileSize * TileSize);
+
+	Concurrency::parallel_for(0, numChunks, [&](int chunk)
+	{
+		const int begin = chunk * TileSize * TileSize;
+		const int end = (std::min)(begin + TileSize * TileSize, numPixels);
+
+		// Bound by memory, SSE2 is as fast as anything wider here
+		int i = begin;
+		for (; i + SimdSSE::Width <= end; i += SimdSSE::Width)
+		{
+			SimdSSE::Float d = SimdSSE::Load(depthBuffer + i);
+			SimdSSE::Store(linearDepth + i, SimdSSE::Div(SimdSSE::Set(cameraNear), 
+				SimdSSE::Sub(SimdSSE::Set(cameraFar), SimdSSE::Mul(SimdSSE::Set(range), d))));
+		}
+
+		for (; i < end; ++i)
+			linearDepth[i] = cameraNear / (cameraFar - range * depthBuffer[i]);
+	});
+}
+
+void CrossBilateralFilterCPU::Filter( const float* depthBuffer, int width, int height, const BlurParams& params, float* aoBuffer )
+{
+	mWidth = width;
+	mHeight = height;
+
+	// BlurRadius is a whole number, the HUD slider is integral
+	mRadius = int(floorf(params.BlurRadius));
+	mSharpness = params.BlurSharpness;
+
+	mSpatialWeights.resize(2 * mRadius + 1);
+	for (int r = -mRadius; r <= mRadius; ++r)
+		mSpatialWeights[r + mRadius] = expf(-float(r * r) * params.BlurFalloff);
+
+	LinearizeDepth(depthBuffer, params);
+	mBlurX.resize(width * height);
+
+	const int numTilesX = (width + TileSize - 1) / TileSize;
+	const int numTilesY = (height + TileSize - 1) / TileSize;
+	const int numTiles = numTilesX * numTilesY;
+
+	float* blurX = &mBlurX[0];
+
+	// AVX-512 has no kernels of its own, its CPUs run the AVX2 ones
+	typedef void (*TileKernel)(const BlurTile&, const float*, float*);
+	const bool avx2 = mSimdLevel >= Simd_AVX2;
+	const TileKernel blurTileX = avx2 ? BlurTileXAVX2 : BlurTileXSSE2;
+	const TileKernel blurTileY = avx2 ? BlurTileYAVX2 : BlurTileYSSE2;
+
+	BlurTile tileParams;
+	tileParams.LinearDepth = &mLinearDepth[0];
+	tileParams.SpatialWeights = &mSpatialWeights[mRadius];
+	tileParams.Width = width;
+	tileParams.Height = height;
+	tileParams.Radius = mRadius;
+	tileParams.Sharpness = mSharpness;
+
+	auto getTile = [&](int tile) -> BlurTile
+	{
+		BlurTile t = tileParams;
+		t.X0 = (tile % numTilesX) * TileSize;
+		t.X1 = (std::min)(t.X0 + TileSize, width);
+		t.Y0 = (tile / numTilesX) * TileSize;
+		t.Y1 = (std::min)(t.Y0 + TileSize, height);
+		return t;
+	};
+
+	Concurrency::parallel_for(0, numTiles, [&](int tile)
+	{
+		blurTileX(getTile(tile), aoBuffer, blurX);
+	});
+
+	Concurrency::parallel_for(0, numTiles, [&](int tile)
+	{
+		blurTileY(getTile(tile), blurX, aoBuffer);
+	});
+}
@@ -0,0 +1,53 @@
+#ifndef CrossBilateralFilterCPU_h__
+#define CrossBilateralFilterCPU_h__
+
+#include "ShaderContanst.h"
+#include "CpuFeatures.h"
+#include <vector>
+
+/**
+ * CPU version of CrossBilateralFilter.hlsl, BlurX followed by BlurY.
+ *
+ * Depth is linearized once per frame instead of once per tap, the spatial term exp(-r*r*BlurFalloff)
+ * comes from a table built per call, and the image is processed in tiles small enough that the rows
+ * touched by the vertical pass stay in cache. Taps are evaluated 4 pixels at a time with SSE2, or 8 with
+ * the AVX2 kernels (CrossBilateralFilterKernels.h) when the CPU has it.
+ */
+class CrossBilateralFilterCPU
+{
+public:
+	CrossBilateralFilterCPU();
+	~CrossBilateralFilterCPU();
+
+	/**
+	 * Blur aoBuffer in place.
+	 *
+	 * @param depthBuffer  width * height post projection depth
+	 * @param params       filled by UpdateBlurParams
+	 */
+	void Filter(const float* depthBuffer, int width, int height, const BlurParams& params, float* aoBuffer);
+
+	// Kernels to use, GetSimdLevel by default and never wider than it. The benchmark compares them
+	void SetSimdLevel(SimdLevel level);
+
+private:
+	void LinearizeDepth(const float* depthBuffer, const BlurParams& params);
+
+private:
+	SimdLevel mSimdLevel;
+
+	int mWidth, mHeight;
+	int mRadius;
+	float mSharpness;
+
+	// FetchLinearDepth for every texel
+	std::vector<float> mLinearDepth;
+
+	// Result of the horizontal pass
+	std::vector<float> mBlurX;
+
+	// exp(-r*r*BlurFalloff), indexed by r + mRadius
+	std::vector<float> mSpatialWeights;
+};
+
+#endif // CrossBilateralFilterCPU_h__
@@ -0,0 +1,166 @@
+#ifndef CrossBilateralFilterKernels_h__
+#define CrossBilateralFilterKernels_h__
+
+#include "SimdMath.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Tile kernels of CrossBilateralFilterCPU, instantiated once per instruction set: CrossBilateralFilterCPU.cpp
+ * builds the SSE2 ones with the project settings, CrossBilateralFilterAVX2.cpp the AVX2 ones with /arch:AVX2.
+ * The filter picks a set per call from GetSimdLevel.
+ *
+ * The templates are in an anonymous namespace, every file gets its own copy. Shared inline code compiled
+ * with /arch:AVX2 could otherwise be the copy the linker keeps for the SSE2 callers too.
+ */
+
+// One tile of a blur pass, everything the kernels read besides the source and destination
+struct BlurTile
+{
+	const float* LinearDepth;
+	const float* SpatialWeights;   // exp(-r*r*BlurFalloff), points at r = 0 and is indexed [-Radius, Radius]
+	int Width, Height;
+	int Radius;
+	float Sharpness;
+	int X0, X1, Y0, Y1;
+};
+
+void BlurTileXSSE2(const BlurTile& tile, const float* src, float* dst);
+void BlurTileYSSE2(const BlurTile& tile, const float* src, float* dst);
+
+void BlurTileXAVX2(const BlurTile& tile, const float* src, float* dst);
+void BlurTileYAVX2(const BlurTile& tile, const float* src, float* dst);
+
+namespace {
+
+inline int ClampTap(int v, int lo, int hi)
+{
+	return (std::min)((std::max)(v, lo), hi);
+}
+
+template <typename S>
+void BlurTileX(const BlurTile& tile, const float* src, float* dst)
+{
+	typedef typename S::Float Float;
+
+	const int width = tile.Width;
+	const int radius = tile.Radius;
+	const float sharpness = tile.Sharpness;
+	const float* spatial = tile.SpatialWeights;
+	const Float negSharpness = S::Set(-sharpness);
+
+	// Pixels whose taps all lie inside the row don't need clamping
+	const int interiorBegin = (std::max)(tile.X0, radius);
+	const int interiorEnd = (std::min)(tile.X1, width - radius);
+
+	for (int y = tile.Y0; y < tile.Y1; ++y)
+	{
+		const float* srcRow = src + y * width;
+		const float* depthRow = tile.LinearDepth + y * width;
+		float* dstRow = dst + y * width;
+
+		auto blurPixel = [&](int x)
+		{
+			const float centerDepth = depthRow[x];
+
+			float totalWeight = 0, b = 0;
+			for (int r = -radius; r <= radius; ++r)
+			{
+				const int sx = ClampTap(x + r, 0, width - 1);
+				const float ddiff = depthRow[sx] - centerDepth;
+				const float w = spatial[r] * expf(-ddiff * ddiff * sharpness);
+
+				totalWeight += w;
+				b += w * srcRow[sx];
+			}
+
+			dstRow[x] = b / totalWeight;
+		};
+
+		int x = tile.X0;
+		for (; x < (std::min)(interiorBegin, tile.X1); ++x)
+			blurPixel(x);
+
+		for (; x + S::Width <= interiorEnd; x += S::Width)
+		{
+			const Float centerDepth = S::Load(depthRow + x);
+
+			Float totalWeight = S::Zero(), b = S::Zero();
+			for (int r = -radius; r <= radius; ++r)
+			{
+				Float ddiff = S::Sub(S::Load(depthRow + x + r), centerDepth);
+				Float w = S::Mul(S::Set(spatial[r]), Exp<S>(S::Mul(S::Mul(ddiff, ddiff), negSharpness)));
+
+				totalWeight = S::Add(totalWeight, w);
+				b = S::Add(b, S::Mul(w, S::Load(srcRow + x + r)));
+			}
+
+			S::Store(dstRow + x, S::Div(b, totalWeight));
+		}
+
+		for (; x < tile.X1; ++x)
+			blurPixel(x);
+	}
+}
+
+template <typename S>
+void BlurTileY(const BlurTile& tile, const float* src, float* dst)
+{
+	typedef typename S::Float Float;
+
+	const int width = tile.Width;
+	const int radius = tile.Radius;
+	const float sharpness = tile.Sharpness;
+	const float* spatial = tile.SpatialWeights;
+	const float* linearDepth = tile.LinearDepth;
+	const Float negSharpness = S::Set(-sharpness);
+
+	// Clamping is per row here, so only the last few columns of a tile are scalar
+	for (int y = tile.Y0; y < tile.Y1; ++y)
+	{
+		const float* depthRow = linearDepth + y * width;
+		float* dstRow = dst + y * width;
+
+		int x = tile.X0;
+		for (; x + S::Width <= tile.X1; x += S::Width)
+		{
+			const Float centerDepth = S::Load(depthRow + x);
+
+			Float totalWeight = S::Zero(), b = S::Zero();
+			for (int r = -radius; r <= radius; ++r)
+			{
+				const int offset = ClampTap(y + r, 0, tile.Height - 1) * width + x;
+
+				Float ddiff = S::Sub(S::Load(linearDepth + offset), centerDepth);
+				Float w = S::Mul(S::Set(spatial[r]), Exp<S>(S::Mul(S::Mul(ddiff, ddiff), negSharpness)));
+
+				totalWeight = S::Add(totalWeight, w);
+				b = S::Add(b, S::Mul(w, S::Load(src + offset)));
+			}
+
+			S::Store(dstRow + x, S::Div(b, totalWeight));
+		}
+
+		for (; x < tile.X1; ++x)
+		{
+			const float centerDepth = depthRow[x];
+
+			float totalWeight = 0, b = 0;
+			for (int r = -radius; r <= radius; ++r)
+			{
+				const int offset = ClampTap(y + r, 0, tile.Height - 1) * width + x;
+				const float ddiff = linearDepth[offset] - centerDepth;
+				const float w = spatial[r] * expf(-ddiff * ddiff * sharpness);
+
+				totalWeight += w;
+				b += w * src[offset];
+			}
+
+			dstRow[x] = b / totalWeight;
+		}
+	}
+}
+
+}
+
+#endif // CrossBilateralFilterKernels_h__
@@ -0,0 +1,164 @@
+#include "DXUT.h"
+#include "DrawQueue.h"
+#include <ppl.h>
+#include <algorithm>
+
+namespace {
+
+const int RadixBits = 8;
+const int RadixSize = 1 << RadixBits;
+
+// Packets a task histograms and scatters, below ParallelChunks of them one thread is faster
+const size_t SortChunkSize = 8192;
+const int ParallelChunks = 4;
+
+inline uint32_t Digit(uint64_t key, int shift)
+{
+	return uint32_t(key >> shift) & (RadixSize - 1);
+}
+
+void HistogramChunk( const DrawPacket* source, size_t count, int shift, int chunk, uint32_t* histogram )
+{
+	std::fill(histogram, histogram + RadixSize, 0);
+
+	const size_t end = (std::min)(chunk * SortChunkSize + SortChunkSize, count);
+	for (size_t i = chunk * SortChunkSize; i < end; ++i)
+		histogram[Digit(source[i].Key, shift)]++;
+}
+
+void ScatterChunk( const DrawPacket* source, DrawPacket* destination, size_t count, int shift, int chunk, uint32_t* next )
+{
+	const size_t end = (std::min)(chunk * SortChunkSize + SortChunkSize, count);
+	for (size_t i = chunk * SortChunkSize; i < end; ++i)
+		destination[next[Digit(source[i].Key, shift)]++] = source[i];
+}
+
+}
+
+uint64_t DrawQueue::MakeKey( uint32_t pass, uint32_t shader, uint32_t material, float depth )
+{
+	const uint32_t quantizedDepth = uint32_t((std::min)((std::max)(depth, 0.0f), 1.0f) * 65535.0f + 0.5f);
+
+	return (uint64_t(pass & (MaxPasses - 1)) << 60) |
+		   (uint64_t(shader & (MaxShaders - 1)) << 52) |
+		   (uint64_t(material & (MaxMaterials - 1)) << 32) |
+		   (uint64_t(quantizedDepth) << 16);
+}
+
+DrawQueue::DrawQueue()
+{
+
+}
+
+DrawQueue::~DrawQueue()
+{
+
+}
+
+void DrawQueue::Clear()
+{
+	mPackets.clear();
+	mItems.clear();
+	mShaders.clear();
+	mGeometries.clear();
+}
+
+uint32_t DrawQueue::AddShader( const DrawShader& shader )
+{
+	mShaders.push_back(shader);
+	return static_cast<uint32_t>(mShaders.size() - 1);
+}
+
+uint32_t DrawQueue::AddGeometry( const DrawGeometry& geometry )
+{
+	mGeometries.push_back(geometry);
+	return static_cast<uint32_t>(mGeometries.size() - 1);
+}
+
+void DrawQueue::Add( uint64_t key, const DrawItem& item )
+{
+	DrawPacket packet = { key, static_cast<uint32_t>(mItems.size()) };
+	mPackets.push_back(packet);
+	mItems.push_back(item);
+}
+
+void DrawQueue::Sort()
+{
+	RadixSortDrawPackets(mPackets, mScratch);
+}
+
+void RadixSortDrawPackets( std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch )
+{
+	const size_t count = packets.size();
+	if (count < 2)
+		return;
+
+	// Bytes equal in every key don't change the order
+	uint64_t allOr = 0, allAnd = ~uint64_t(0);
+	for (size_t i = 0; i < count; ++i)
+	{
+		allOr |= packets[i].Key;
+		allAnd &= packets[i].Key;
+	}
+	const uint64_t differing = allOr ^ allAnd;
+
+	scratch.resize(count);
+
+	const int numChunks = static_cast<int>((count + SortChunkSize - 1) / SortChunkSize);
+	const bool parallel = numChunks >= ParallelChunks;
+	std::vector<uint32_t> offsets(numChunks * RadixSize);
+
+	DrawPacket* source = &packets[0];
+	DrawPacket* destination = &scratch[0];
+
+	for (int shift = 0; shift < 64; shift += RadixBits)
+	{
+		if (Digit(differing, shift) == 0)
+			continue;
+
+		// Histogram of each chunk
+		if (parallel)
+		{
+			Concurrency::parallel_for(0, numChunks, [&](int chunk)
+			{
+				HistogramChunk(source, count, shift, chunk, &offsets[chunk * RadixSize]);
+			});
+		}
+		else
+		{
+			for (int chunk = 0; chunk < numChunks; ++chunk)
+				HistogramChunk(source, count, shift, chunk, &offsets[chunk * RadixSize]);
+		}
+
+		// Where each chunk starts writing each digit, digit major so the chunks keep their order
+		uint32_t sum = 0;
+		for (int digit = 0; digit < RadixSize; ++digit)
+		{
+			for (int chunk = 0; chunk < numChunks; ++chunk)
+			{
+				const uint32_t chunkCount = offsets[chunk * RadixSize + digit];
+				offsets[chunk * RadixSize + digit] = sum;
+				sum += chunkCount;
+			}
+		}
+
+		if (parallel)
+		{
+			Concurrency::parallel_for(0, numChunks, [&](int chunk)
+			{
+				ScatterChunk(source, destination, count, shift, chunk, &offsets[chunk * RadixSize]);
+			});
+		}
+		else
+		{
+			for (int chunk = 0; chunk < numChunks; ++chunk)
+				ScatterChunk(source, destination, count, shift, chunk, &offsets[chunk * RadixSize]);
+		}
+
+		std::swap(source, destination);
+	}
+
+	// An odd number of passes leaves the result in scratch
+	if (source != &packets[0])
+		packets.swap(scratch);
+}
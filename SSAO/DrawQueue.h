@@ -0,0 +1,211 @@
+#ifndef DrawQueue_h__
+#define DrawQueue_h__
+
+#include <d3d11.h>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Draw packets of a pass, sorted by a 64 bit key and submitted with the redundant state sets left out.
+ *
+ * A pass adds one DrawItem per draw, with what it binds, and a key built by MakeKey from pass, shader,
+ * material and depth, most significant first. Sort() orders the packets by key with a radix sort over the
+ * key bytes that differ, on all cores when there are enough of them. Equal keys keep the order they were
+ * added in. Submit() walks the sorted packets and only sets the shaders, geometry, topology and material
+ * that differ from the previous draw.
+ *
+ * Per object constants come from the constant ring, each item draws its own Instance of the object stream
+ * (see ConstantRing.h), so the order of the draws is free.
+ */
+
+// Vertex and pixel shader with their input layout, shared by the items of a pass
+struct DrawShader
+{
+	ID3D11InputLayout* Layout;
+	ID3D11VertexShader* VertexShader;
+	ID3D11PixelShader* PixelShader;
+};
+
+// Input assembler buffers of a mesh, shared by its subsets
+struct DrawGeometry
+{
+	static const UINT MaxVertexBuffers = D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT;
+
+	UINT NumVertexBuffers;
+	ID3D11Buffer* VertexBuffers[MaxVertexBuffers];
+	UINT Strides[MaxVertexBuffers];
+	ID3D11Buffer* IndexBuffer;
+	DXGI_FORMAT IndexFormat;
+};
+
+struct DrawItem
+{
+	uint32_t Shader;                      // Into the shaders of the queue
+	uint32_t Geometry;                    // Into the geometries of the queue
+	ID3D11ShaderResourceView* Material;   // Diffuse texture, NULL leaves the bound one
+	D3D11_PRIMITIVE_TOPOLOGY Topology;
+	UINT IndexCount;
+	UINT StartIndex;
+	INT BaseVertex;
+	UINT Instance;                        // Per object constants in the constant ring
+};
+
+struct DrawPacket
+{
+	uint64_t Key;
+	uint32_t Item;
+};
+
+// Calls of one Submit, StateSets issued and Filtered left out because the state was already bound
+struct DrawQueueStats
+{
+	UINT Draws;
+	UINT StateSets;
+	UINT Filtered;
+};
+
+class DrawQueue
+{
+public:
+	// Key bits, from the top: pass 4, shader 8, material 20, depth 16, the low 16 are zero
+	static const uint32_t MaxPasses = 1 << 4;
+	static const uint32_t MaxShaders = 1 << 8;
+	static const uint32_t MaxMaterials = 1 << 20;
+
+	// Depth in [0, 1], near to far, draws front to back within a material. Fields are masked to their bits
+	static uint64_t MakeKey(uint32_t pass, uint32_t shader, uint32_t material, float depth);
+
+public:
+	DrawQueue();
+	~DrawQueue();
+
+	void Clear();
+
+	uint32_t AddShader(const DrawShader& shader);
+	uint32_t AddGeometry(const DrawGeometry& geometry);
+	void Add(uint64_t key, const DrawItem& item);
+
+	// Stable radix sort of the packets by key
+	void Sort();
+
+	/**
+	 * Bind and draw the packets in order, every draw DrawIndexedInstanced of one instance. The first draw
+	 * sets everything, the material goes to PS slot materialSlot. Context is ID3D11DeviceContext or anything
+	 * with the same calls.
+	 */
+	template<typename Context>
+	DrawQueueStats Submit(Context* context, UINT materialSlot) const;
+
+	const std::vector<DrawPacket>& GetPackets() const        { return mPackets; }
+	const std::vector<DrawItem>& GetItems() const            { return mItems; }
+	const std::vector<DrawShader>& GetShaders() const        { return mShaders; }
+	const std::vector<DrawGeometry>& GetGeometries() const   { return mGeometries; }
+
+private:
+	std::vector<DrawPacket> mPackets;
+	std::vector<DrawPacket> mScratch;
+	std::vector<DrawItem> mItems;
+	std::vector<DrawShader> mShaders;
+	std::vector<DrawGeometry> mGeometries;
+};
+
+/**
+ * Radix sort of packets by key, least significant byte first and only over the bytes where the keys differ.
+ * From 32k packets on the histograms and the scatter of each byte run in chunks of 8k on all cores.
+ * scratch is resized to match.
+ */
+void RadixSortDrawPackets(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch);
+
+template<typename Context>
+DrawQueueStats DrawQueue::Submit(Context* context, UINT materialSlot) const
+{
+	DrawQueueStats stats = { 0, 0, 0 };
+
+	// What the last draw had bound, NULL before the first one
+	const DrawShader* boundShader = NULL;
+	const DrawGeometry* boundGeometry = NULL;
+	ID3D11ShaderResourceView* boundMaterial = NULL;
+	D3D11_PRIMITIVE_TOPOLOGY boundTopology = D3D11_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	for (size_t i = 0; i < mPackets.size(); ++i)
+	{
+		const DrawItem& item = mItems[mPackets[i].Item];
+		const DrawShader& shader = mShaders[item.Shader];
+		const DrawGeometry& geometry = mGeometries[item.Geometry];
+
+		if (!boundShader || shader.Layout != boundShader->Layout)
+		{
+			context->IASetInputLayout(shader.Layout);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		if (!boundShader || shader.VertexShader != boundShader->VertexShader)
+		{
+			context->VSSetShader(shader.VertexShader, 0, 0);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		if (!boundShader || shader.PixelShader != boundShader->PixelShader)
+		{
+			context->PSSetShader(shader.PixelShader, 0, 0);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		// Compared by contents, the same mesh may have been added twice
+		const bool sameVertexBuffers = boundGeometry && geometry.NumVertexBuffers == boundGeometry->NumVertexBuffers &&
+			memcmp(geometry.VertexBuffers, boundGeometry->VertexBuffers, geometry.NumVertexBuffers * sizeof(ID3D11Buffer*)) == 0 &&
+			memcmp(geometry.Strides, boundGeometry->Strides, geometry.NumVertexBuffers * sizeof(UINT)) == 0;
+
+		if (!sameVertexBuffers)
+		{
+			const UINT offsets[DrawGeometry::MaxVertexBuffers] = { 0 };
+			context->IASetVertexBuffers(0, geometry.NumVertexBuffers, geometry.VertexBuffers, geometry.Strides, offsets);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		if (!boundGeometry || geometry.IndexBuffer != boundGeometry->IndexBuffer || geometry.IndexFormat != boundGeometry->IndexFormat)
+		{
+			context->IASetIndexBuffer(geometry.IndexBuffer, geometry.IndexFormat, 0);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		if (item.Topology != boundTopology)
+		{
+			context->IASetPrimitiveTopology(item.Topology);
+			stats.StateSets++;
+		}
+		else
+			stats.Filtered++;
+
+		if (item.Material && item.Material != boundMaterial)
+		{
+			context->PSSetShaderResources(materialSlot, 1, &item.Material);
+			boundMaterial = item.Material;
+			stats.StateSets++;
+		}
+		else if (item.Material)
+			stats.Filtered++;
+
+		boundShader = &shader;
+		boundGeometry = &geometry;
+		boundTopology = item.Topology;
+
+		context->DrawIndexedInstanced(item.IndexCount, 1, item.StartIndex, item.BaseVertex, item.Instance);
+		stats.Draws++;
+	}
+
+	return stats;
+}
+
+#endif // DrawQueue_h__
@@ -0,0 +1,165 @@
+#include "DXUT.h"
+#include "FrameCapture.h"
+#include <cstdio>
+
+namespace {
+
+const uint32_t CaptureMagic = 0x46554247;  // "GBUF"
+const uint32_t CaptureVersion = 1;
+
+inline uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + CaptureAlignment - 1) & ~uint64_t(CaptureAlignment - 1);
+}
+
+}
+
+FrameCapture::FrameCapture()
+	: mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mView(NULL), mHeader(NULL), mSize(0)
+{
+
+}
+
+FrameCapture::~FrameCapture()
+{
+	Close();
+}
+
+bool FrameCapture::Open( const char* filename )
+{
+	Close();
+
+	mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart < LONGLONG(sizeof(FrameCaptureHeader)))
+	{
+		Close();
+		return false;
+	}
+	mSize = fileSize.QuadPart;
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mView = static_cast<const unsigned char*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mView == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mHeader = reinterpret_cast<const FrameCaptureHeader*>(mView);
+	if (mHeader->Magic != CaptureMagic || mHeader->Version != CaptureVersion)
+	{
+		Close();
+		return false;
+	}
+
+	// Validate channel ranges once, so GetChannel doesn't have to. Divided rather than multiplied, a corrupt
+	// header can't wrap the end of a channel around
+	const uint64_t numPixels = uint64_t(mHeader->Width) * mHeader->Height;
+	for (int i = 0; i < Capture_Count; ++i)
+	{
+		const FrameCaptureHeader::Channel& channel = mHeader->Channels[i];
+		if (channel.BytesPerPixel && (channel.Offset % CaptureAlignment || channel.Offset > mSize ||
+			numPixels > (mSize - channel.Offset) / channel.BytesPerPixel))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void FrameCapture::Close()
+{
+	if (mView)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+
+	if (mMapping)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	if (mFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+
+	mHeader = NULL;
+	mSize = 0;
+}
+
+const void* FrameCapture::GetChannel( CaptureChannel channel ) const
+{
+	assert(mView);
+
+	const FrameCaptureHeader::Channel& desc = mHeader->Channels[channel];
+	if (desc.BytesPerPixel == 0)
+		return NULL;
+
+	return mView + desc.Offset;
+}
+
+bool FrameCapture::Save( const char* filename, const FrameCaptureHeader& header, const void* const pixels[Capture_Count] )
+{
+	FrameCaptureHeader fileHeader = header;
+	fileHeader.Magic = CaptureMagic;
+	fileHeader.Version = CaptureVersion;
+
+	const uint64_t numPixels = uint64_t(header.Width) * header.Height;
+
+	uint64_t offset = AlignOffset(sizeof(FrameCaptureHeader));
+	for (int i = 0; i < Capture_Count; ++i)
+	{
+		FrameCaptureHeader::Channel& channel = fileHeader.Channels[i];
+		if (channel.BytesPerPixel == 0)
+		{
+			channel.Offset = 0;
+			continue;
+		}
+
+		channel.Offset = offset;
+		offset = AlignOffset(offset + numPixels * channel.BytesPerPixel);
+	}
+
+	FILE* f;
+	errno_t err = fopen_s(&f, filename, "wb");
+	if (err != 0)
+		return false;
+
+	const char padding[CaptureAlignment] = { 0 };
+
+	bool succeeded = fwrite(&fileHeader, sizeof(fileHeader), 1, f) == 1;
+
+	uint64_t written = sizeof(fileHeader);
+	for (int i = 0; i < Capture_Count && succeeded; ++i)
+	{
+		const FrameCaptureHeader::Channel& channel = fileHeader.Channels[i];
+		if (channel.BytesPerPixel == 0)
+			continue;
+
+		succeeded = fwrite(padding, 1, size_t(channel.Offset - written), f) == channel.Offset - written;
+
+		const size_t size = size_t(numPixels * channel.BytesPerPixel);
+		succeeded = succeeded && fwrite(pixels[i], 1, size, f) == size;
+
+		written = channel.Offset + size;
+	}
+
+	fclose(f);
+	return succeeded;
+}
@@ -0,0 +1,91 @@
+#ifndef FrameCapture_h__
+#define FrameCapture_h__
+
+#include "ShaderContanst.h"
+#include <cstdint>
+
+enum CaptureChannel
+{
+	Capture_Depth = 0,      // R32_FLOAT post projection depth
+	Capture_Normal,         // R8G8B8A8_UNORM best fit packed view space normal, GBuffer 0
+	Capture_Albedo,         // R8G8B8A8_UNORM, GBuffer 1
+	Capture_AO,             // R32_FLOAT blurred AO
+	Capture_Count
+};
+
+// Every channel starts at a multiple of this, so SIMD kernels can read them in place
+const uint32_t CaptureAlignment = 64;
+
+/**
+ * File layout: FrameCaptureHeader followed by the channels, each one stored in its native GPU format,
+ * tightly packed with the top row first (not flipped like PFM). A channel with BytesPerPixel of 0 was not captured.
+ */
+struct FrameCaptureHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t Width;
+	uint32_t Height;
+
+	D3DXMATRIX View;
+	D3DXMATRIX Proj;
+
+	PerFrameConstants FrameConstants;
+	HBAOParams AOParams;
+
+	struct Channel
+	{
+		uint32_t Format;          // DXGI_FORMAT
+		uint32_t BytesPerPixel;
+		uint64_t Offset;          // From start of file
+	} Channels[Capture_Count];
+};
+
+/**
+ * Read only memory mapped view of a frame capture. Channel pointers go straight into the mapping,
+ * nothing is copied, so they are valid until Close() or destruction.
+ */
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	bool Open(const char* filename);
+	void Close();
+
+	bool IsOpen() const                        { return mView != NULL; }
+
+	int GetWidth() const                       { return mHeader->Width; }
+	int GetHeight() const                      { return mHeader->Height; }
+	const FrameCaptureHeader& GetHeader() const { return *mHeader; }
+
+	// Return NULL if the channel is not in the file
+	const void* GetChannel(CaptureChannel channel) const;
+
+	const float* GetDepth() const              { return static_cast<const float*>(GetChannel(Capture_Depth)); }
+	const float* GetAO() const                 { return static_cast<const float*>(GetChannel(Capture_AO)); }
+	const uint32_t* GetNormal() const          { return static_cast<const uint32_t*>(GetChannel(Capture_Normal)); }
+	const uint32_t* GetAlbedo() const          { return static_cast<const uint32_t*>(GetChannel(Capture_Albedo)); }
+
+	/**
+	 * Write a capture. Offsets in the header are filled here, pixels[i] must hold Width * Height * BytesPerPixel
+	 * bytes of channel i, or be NULL if the channel's BytesPerPixel is 0.
+	 */
+	static bool Save(const char* filename, const FrameCaptureHeader& header, const void* const pixels[Capture_Count]);
+
+private:
+	// Not implemented
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+
+private:
+	HANDLE mFile;
+	HANDLE mMapping;
+
+	const unsigned char* mView;
+	const FrameCaptureHeader* mHeader;
+	uint64_t mSize;
+};
+
+#endif // FrameCapture_h__
@@ -1,13 +1,20 @@
 #include "DXUT.h"
 #include "DXUTcamera.h"
 #include "LightAnimation.h"
+#include "MappedFile.h"
+#include "Philox.h"
+#include "SimdMath.h"
+#include <ppl.h>
+#include <algorithm>
 #include <fstream>
+#include <cstdio>
 
 const float MaxRadius = 100.0f;
 const float AttenuationStartFactor = 0.8f;
 
-// Use a constant seed for consistency
-std::mt19937 rng(1337);
+// Use a constant seed for consistency, rng is for interactively recorded lights
+const uint32_t LightSeed = 1337;
+std::mt19937 rng(LightSeed);
 
 std::uniform_real<float> RadiusNormDist(0.0f, 1.0f);
 std::uniform_real<float> AngleDist(0.0f, 360.0f); 
@@ -41,13 +48,162 @@ D3DXVECTOR3 HueToRGB(float hue)
 	return D3DXVECTOR3(0.0f, 0.0f, 0.0f);
 }
 
+// Fields of LightAnimation::LightArrays, the order is the binary light set layout
+enum LightArrayField
+{
+	Field_PositionX, Field_PositionY, Field_PositionZ,
+	Field_DirectionX, Field_DirectionY, Field_DirectionZ,
+	Field_ColorR, Field_ColorG, Field_ColorB,
+	Field_AttenuationBegin, Field_AttenuationEnd,
+	Field_SpotCosInner, Field_SpotCosOuter, Field_SpotDropoff,
+	Field_Radius, Field_Angle, Field_Height, Field_AnimationSpeed,
+	Field_Count
+};
+
+typedef std::vector<float> LightAnimation::LightArrays::* LightArrayMember;
+
+const LightArrayMember LightArrayMembers[Field_Count] = 
+{
+	&LightAnimation::LightArrays::PositionX, &LightAnimation::LightArrays::PositionY, &LightAnimation::LightArrays::PositionZ,
+	&LightAnimation::LightArrays::DirectionX, &LightAnimation::LightArrays::DirectionY, &LightAnimation::LightArrays::DirectionZ,
+	&LightAnimation::LightArrays::ColorR, &LightAnimation::LightArrays::ColorG, &LightAnimation::LightArrays::ColorB,
+	&LightAnimation::LightArrays::AttenuationBegin, &LightAnimation::LightArrays::AttenuationEnd,
+	&LightAnimation::LightArrays::SpotCosInner, &LightAnimation::LightArrays::SpotCosOuter, &LightAnimation::LightArrays::SpotDropoff,
+	&LightAnimation::LightArrays::Radius, &LightAnimation::LightArrays::Angle, &LightAnimation::LightArrays::Height, &LightAnimation::LightArrays::AnimationSpeed,
+};
+
+void EncodeLight(const LightAnimation::Light& light, float* const fields[Field_Count], size_t i)
+{
+	fields[Field_PositionX][i] = light.LightPosition.x;
+	fields[Field_PositionY][i] = light.LightPosition.y;
+	fields[Field_PositionZ][i] = light.LightPosition.z;
+	fields[Field_DirectionX][i] = light.LightDirection.x;
+	fields[Field_DirectionY][i] = light.LightDirection.y;
+	fields[Field_DirectionZ][i] = light.LightDirection.z;
+	fields[Field_ColorR][i] = light.LightColor.x;
+	fields[Field_ColorG][i] = light.LightColor.y;
+	fields[Field_ColorB][i] = light.LightColor.z;
+	fields[Field_AttenuationBegin][i] = light.LightAttenuation.x;
+	fields[Field_AttenuationEnd][i] = light.LightAttenuation.y;
+
+	if (light.LightType == LT_SpotLight)
+	{
+		fields[Field_SpotCosInner][i] = light.SpotFalloff.x;
+		fields[Field_SpotCosOuter][i] = light.SpotFalloff.y;
+		fields[Field_SpotDropoff][i] = light.SpotFalloff.z;
+	}
+
+	if (light.LightType == LT_PointLight)
+	{
+		fields[Field_Radius][i] = light.Radius;
+		fields[Field_Angle][i] = light.Angle;
+		fields[Field_Height][i] = light.Height;
+		fields[Field_AnimationSpeed][i] = light.AnimationSpeed;
+
+		// Height is constant while animating
+		fields[Field_PositionY][i] = light.Height;
+	}
+}
+
+void DecodeLight(LightType type, const float* const fields[Field_Count], size_t i, LightAnimation::Light& light)
+{
+	light.LightType = type;
+	light.LightPosition = D3DXVECTOR3(fields[Field_PositionX][i], fields[Field_PositionY][i], fields[Field_PositionZ][i]);
+	light.LightDirection = D3DXVECTOR3(fields[Field_DirectionX][i], fields[Field_DirectionY][i], fields[Field_DirectionZ][i]);
+	light.LightColor = D3DXVECTOR3(fields[Field_ColorR][i], fields[Field_ColorG][i], fields[Field_ColorB][i]);
+	light.LightAttenuation = D3DXVECTOR2(fields[Field_AttenuationBegin][i], fields[Field_AttenuationEnd][i]);
+	light.SpotFalloff = D3DXVECTOR3(fields[Field_SpotCosInner][i], fields[Field_SpotCosOuter][i], fields[Field_SpotDropoff][i]);
+	light.Radius = fields[Field_Radius][i];
+	light.Angle = fields[Field_Angle][i];
+	light.Height = fields[Field_Height][i];
+	light.AnimationSpeed = fields[Field_AnimationSpeed][i];
+}
+
+// Value of a distribution from 32 random bits
+inline float Uniform(uint32_t bits, const std::uniform_real<float>& dist)
+{
+	return dist.min() + (dist.max() - dist.min()) * Philox4x32::ToFloat(bits);
+}
+
+// Run func(i) for i in [0, count) on all cores, in chunks large enough to hide the scheduling
+template <typename Func>
+void ForEachLightChunk(int count, const Func& func)
+{
+	const int ChunkSize = 4096;
+	const int numChunks = (count + ChunkSize - 1) / ChunkSize;
+
+	Concurrency::parallel_for(0, numChunks, [&](int chunk)
+	{
+		const int end = (std::min)(chunk * ChunkSize + ChunkSize, count);
+		for (int i = chunk * ChunkSize; i < end; ++i)
+			func(i);
+	});
+}
+
+inline size_t PaddedLightCount(size_t count)
+{
+	return (count + LightAnimation::LightArrayPadding - 1) / LightAnimation::LightArrayPadding * LightAnimation::LightArrayPadding;
+}
+
+//--------------------------------------------------------------------------------------
+// Binary light set: header, then per light type Field_Count arrays of PaddedCount floats
+//--------------------------------------------------------------------------------------
+const uint32_t LightSetMagic = 0x5445534C;  // "LSET"
+const uint32_t LightSetVersion = 1;
+const uint64_t LightSetAlignment = 64;
+
+struct LightSetHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t NumFields;
+	uint32_t Padding;
+
+	struct Group
+	{
+		uint64_t Offset;          // From start of file
+		uint32_t Count;
+		uint32_t PaddedCount;
+	} Groups[LT_Count];
+};
+
+inline uint64_t AlignLightSetOffset(uint64_t offset)
+{
+	return (offset + LightSetAlignment - 1) & ~(LightSetAlignment - 1);
+}
+
+// Group arrays must lie inside the file, at a float aligned offset. Checked without overflowing on a
+// corrupt Offset or PaddedCount
+bool IsValidLightSetGroup(const LightSetHeader::Group& group, uint64_t fileSize)
+{
+	if (group.Count > group.PaddedCount || group.PaddedCount % LightAnimation::LightArrayPadding != 0)
+		return false;
+
+	if (group.Offset % sizeof(float) != 0 || group.Offset < sizeof(LightSetHeader) || group.Offset > fileSize)
+		return false;
+
+	// PaddedCount is 32 bit, the size can't overflow 64 bits
+	const uint64_t size = uint64_t(group.PaddedCount) * Field_Count * sizeof(float);
+	return size <= fileSize - group.Offset;
+}
+
+// Light sets end in .lts, everything else is text
+bool IsLightSetFile(const std::string& filename)
+{
+	return filename.size() >= 4 && _stricmp(filename.c_str() + filename.size() - 4, ".lts") == 0;
+}
+
 }
 
 
 LightAnimation::LightAnimation()
 	: mTotalTime(0.0f)
 {
-
+	for (int type = 0; type < LT_Count; ++type)
+	{
+		mLightArrays[type].Begin = 0;
+		mLightArrays[type].Count = 0;
+	}
 }
 
 LightAnimation::~LightAnimation()
@@ -59,64 +215,241 @@ void LightAnimation::Move( float elapsedTime )
 {
 	mTotalTime += elapsedTime;
 
-	// Update positions of active lights
-	for (unsigned int i = 0; i < mLights.size(); ++i) 
+	// Only animate point light, a whole register of them at a time
+	typedef SimdNative S;
+
+	LightArrays& points = mLightArrays[LT_PointLight];
+	const S::Float totalTime = S::Set(mTotalTime);
+
+	// Chunks are a multiple of the padding, only the last one has padding lanes
+	const size_t ChunkSize = 4096;
+	const int numChunks = static_cast<int>((points.Radius.size() + ChunkSize - 1) / ChunkSize);
+
+	Concurrency::parallel_for(0, numChunks, [&](int chunk)
 	{
-		// Only animate point light
-		if (mLights[i].LightType == LT_PointLight)
+		const size_t begin = chunk * ChunkSize;
+		const size_t end = (std::min)(begin + ChunkSize, points.Radius.size());
+
+		for (size_t i = begin; i < end; i += S::Width)
 		{
-			float angle = mLights[i].Angle + mTotalTime * mLights[i].AnimationSpeed;
+			S::Float angle = S::Add(S::Load(&points.Angle[i]), S::Mul(totalTime, S::Load(&points.AnimationSpeed[i])));
+			S::Float radius = S::Load(&points.Radius[i]);
+
+			S::Float sinAngle, cosAngle;
+			SinCos<S>(angle, sinAngle, cosAngle);
+
+			S::Store(&points.PositionX[i], S::Mul(radius, cosAngle));
+			S::Store(&points.PositionZ[i], S::Mul(radius, sinAngle));
+		}
+	});
+}
+
+size_t LightAnimation::AppendLightArrays( LightType type, size_t numLights )
+{
+	LightArrays& arrays = mLightArrays[type];
+
+	// New lanes and padding are zero
+	const size_t first = arrays.Count;
+	for (int f = 0; f < Field_Count; ++f)
+		(arrays.*LightArrayMembers[f]).resize(PaddedLightCount(first + numLights), 0.0f);
+	arrays.Count += numLights;
+
+	size_t begin = 0;
+	for (int t = 0; t < LT_Count; ++t)
+	{
+		mLightArrays[t].Begin = begin;
+		begin += mLightArrays[t].Count;
+	}
 
-			mLights[i].LightPosition = D3DXVECTOR3(
-				mLights[i].Radius * cosf(angle),
-				mLights[i].Height,
-				mLights[i].Radius * sinf(angle));
-		}		
+	return first;
+}
+
+void LightAnimation::AddLights( const Light* lights, size_t numLights )
+{
+	for (int type = 0; type < LT_Count; ++type)
+	{
+		std::vector<const Light*> typeLights;
+		for (size_t i = 0; i < numLights; ++i)
+		{
+			if (lights[i].LightType == type)
+				typeLights.push_back(&lights[i]);
+		}
+
+		if (typeLights.empty())
+			continue;
+
+		const size_t first = AppendLightArrays(LightType(type), typeLights.size());
+
+		LightArrays& arrays = mLightArrays[type];
+		float* fields[Field_Count];
+		for (int f = 0; f < Field_Count; ++f)
+			fields[f] = &(arrays.*LightArrayMembers[f])[0];
+
+		ForEachLightChunk(static_cast<int>(typeLights.size()), [&](int i)
+		{
+			EncodeLight(*typeLights[i], fields, first + i);
+		});
 	}
+
+	// Positions of the new point lights
+	Move(0);
+}
+
+size_t LightAnimation::GetNumLights() const
+{
+	return mLightArrays[LT_Count - 1].Begin + mLightArrays[LT_Count - 1].Count;
+}
+
+LightType LightAnimation::FindLight( size_t index, size_t& arrayIndex ) const
+{
+	assert(index < GetNumLights());
+
+	int type = 0;
+	while (index >= mLightArrays[type].Begin + mLightArrays[type].Count)
+		type++;
+
+	arrayIndex = index - mLightArrays[type].Begin;
+	return LightType(type);
+}
+
+LightType LightAnimation::GetLightType( size_t index ) const
+{
+	size_t arrayIndex;
+	return FindLight(index, arrayIndex);
+}
+
+LightAnimation::Light LightAnimation::GetLight( size_t index ) const
+{
+	size_t arrayIndex;
+	const LightType type = FindLight(index, arrayIndex);
+
+	const float* fields[Field_Count];
+	for (int f = 0; f < Field_Count; ++f)
+		fields[f] = &(mLightArrays[type].*LightArrayMembers[f])[0];
+
+	Light light;
+	DecodeLight(type, fields, arrayIndex, light);
+	return light;
+}
+
+bool LightAnimation::GetBoundingSphere( size_t index, D3DXVECTOR3& center, float& radius ) const
+{
+	size_t i;
+	const LightType type = FindLight(index, i);
+	const LightArrays& arrays = mLightArrays[type];
+
+	Light light;
+	light.LightType = type;
+	light.LightPosition = D3DXVECTOR3(arrays.PositionX[i], arrays.PositionY[i], arrays.PositionZ[i]);
+	light.LightDirection = D3DXVECTOR3(arrays.DirectionX[i], arrays.DirectionY[i], arrays.DirectionZ[i]);
+	light.LightAttenuation = D3DXVECTOR2(arrays.AttenuationBegin[i], arrays.AttenuationEnd[i]);
+	light.SpotFalloff = D3DXVECTOR3(arrays.SpotCosInner[i], arrays.SpotCosOuter[i], arrays.SpotDropoff[i]);
+
+	return GetBoundingSphere(light, center, radius);
+}
+
+bool LightAnimation::GetBoundingSphere( const Light& light, D3DXVECTOR3& center, float& radius )
+{
+	const float range = light.LightAttenuation.y;
+
+	if (light.LightType == LT_PointLight)
+	{
+		center = light.LightPosition;
+		radius = range;
+		return true;
+	}
+
+	if (light.LightType != LT_SpotLight)
+		return false;
+
+	// Wide cones are bound by their base circle, narrow ones by the sphere through apex and rim
+	const float cosHalfAngle = light.SpotFalloff.y;
+	if (cosHalfAngle <= 0.0f)
+	{
+		center = light.LightPosition;
+		radius = range;
+	}
+	else if (cosHalfAngle < 0.70710678f)
+	{
+		center = light.LightPosition + light.LightDirection * (range * cosHalfAngle);
+		radius = range * sqrtf(1.0f - cosHalfAngle * cosHalfAngle);
+	}
+	else
+	{
+		radius = range / (2.0f * cosHalfAngle);
+		center = light.LightPosition + light.LightDirection * radius;
+	}
+
+	return true;
 }
 
 void LightAnimation::RandonPointLight( int numLight )
 {
-	for (int i = 0; i < numLight; ++i)
+	if (numLight <= 0)
+		return;
+
+	const size_t begin = GetNumLights();
+	std::vector<Light> lights(numLight);
+
+	const Philox4x32 philox(LightSeed);
+
+	ForEachLightChunk(numLight, [&](int i)
 	{
-		Light light;
+		// Counter is (light index, type, block), nothing depends on which thread generates the light
+		uint32_t bits[8];
+		philox.Generate(uint32_t(begin + i), LT_PointLight, 0, 0, bits);
+		philox.Generate(uint32_t(begin + i), LT_PointLight, 1, 0, bits + 4);
+
+		Light& light = lights[i];
 
 		light.LightType = LT_PointLight;
 
-		light.LightColor = IntensityDist(rng) * HueToRGB(HueDist(rng));
-		light.LightAttenuation.y = AttenuationDist(rng);
+		light.LightColor = Uniform(bits[0], IntensityDist) * HueToRGB(Uniform(bits[1], HueDist));
+		light.LightAttenuation.y = Uniform(bits[2], AttenuationDist);
 		light.LightAttenuation.x = AttenuationStartFactor * light.LightAttenuation.y;
 		
-		light.Radius = std::sqrt(RadiusNormDist(rng)) * MaxRadius;
-		light.Angle = AngleDist(rng) * D3DX_PI / 180.0f;
-		light.Height = HeightDist(rng);
+		// (0, 1] so the speed below stays finite
+		light.Radius = std::sqrt(1.0f - Philox4x32::ToFloat(bits[3])) * MaxRadius;
+		light.Angle = Uniform(bits[4], AngleDist) * D3DX_PI / 180.0f;
+		light.Height = Uniform(bits[5], HeightDist);
 		// Normalize by arc length
-		light.AnimationSpeed = (AnimationDirection(rng) * 2 - 1) * AnimationSpeedDist(rng) / light.Radius;
-
-		mLights.push_back(light);
-	}
+		light.AnimationSpeed = (int(bits[6] & 1) * 2 - 1) * Uniform(bits[7], AnimationSpeedDist) / light.Radius;
+	});
 
-	Move(0);
+	AddLights(&lights[0], lights.size());
 }
 
 void LightAnimation::RandonSpotLight( int numLight )
 {
-	for (int i = 0; i < numLight; ++i)
+	if (numLight <= 0)
+		return;
+
+	const size_t begin = GetNumLights();
+	std::vector<Light> lights(numLight);
+
+	const Philox4x32 philox(LightSeed);
+
+	ForEachLightChunk(numLight, [&](int i)
 	{
-		Light light;
+		uint32_t bits[12];
+		philox.Generate(uint32_t(begin + i), LT_SpotLight, 0, 0, bits);
+		philox.Generate(uint32_t(begin + i), LT_SpotLight, 1, 0, bits + 4);
+		philox.Generate(uint32_t(begin + i), LT_SpotLight, 2, 0, bits + 8);
 
-		light.LightType = LT_PointLight;
+		Light& light = lights[i];
+
+		light.LightType = LT_SpotLight;
 
-		light.LightColor = IntensityDist(rng) * HueToRGB(HueDist(rng));
-		light.LightAttenuation.y = AttenuationDist(rng);
+		light.LightColor = Uniform(bits[0], IntensityDist) * HueToRGB(Uniform(bits[1], HueDist));
+		light.LightAttenuation.y = Uniform(bits[2], AttenuationDist);
 		light.LightAttenuation.x = AttenuationStartFactor * light.LightAttenuation.y;
-		light.SpotFalloff.x =  SpotInnerAngleDist(rng) * D3DX_PI / 180.0f;
-		light.SpotFalloff.y =  light.SpotFalloff.x  + SpotOuterAngleDist(rng) * D3DX_PI / 180.0f;
-		light.SpotFalloff = D3DXVECTOR3(cosf(light.SpotFalloff.x), cosf(light.SpotFalloff.y), SpotDropoffDist(rng));
+		light.SpotFalloff.x =  Uniform(bits[3], SpotInnerAngleDist) * D3DX_PI / 180.0f;
+		light.SpotFalloff.y =  light.SpotFalloff.x  + Uniform(bits[4], SpotOuterAngleDist) * D3DX_PI / 180.0f;
+		light.SpotFalloff = D3DXVECTOR3(cosf(light.SpotFalloff.x), cosf(light.SpotFalloff.y), Uniform(bits[5], SpotDropoffDist));
 
-		float radius = std::sqrt(RadiusNormDist(rng)) * MaxRadius;
-		float angle = AngleDist(rng) * D3DX_PI / 180.0f;
-		float height = HeightDist(rng);
+		float radius = std::sqrt(1.0f - Philox4x32::ToFloat(bits[6])) * MaxRadius;
+		float angle = Uniform(bits[7], AngleDist) * D3DX_PI / 180.0f;
+		float height = Uniform(bits[8], HeightDist);
 
 		light.LightPosition = D3DXVECTOR3(
 			radius * std::cos(angle),
@@ -124,13 +457,12 @@ void LightAnimation::RandonSpotLight( int numLight )
 			radius * std::sin(angle));
 
 		D3DXVec3Normalize(&light.LightDirection, &light.LightPosition);
+	});
 
-		mLights.push_back(light);
-	}
-
-	Move(0);
+	AddLights(&lights[0], lights.size());
 }
 
+#ifdef _WIN32
 void LightAnimation::RecordLight( const CFirstPersonCamera& camera, UINT uMsg, WPARAM wParam, LPARAM lParam )
 {
 	switch(uMsg)
@@ -147,7 +479,7 @@ void LightAnimation::RecordLight( const CFirstPersonCamera& camera, UINT uMsg, W
 				light.LightType = LT_DirectionalLigt;
 				light.LightDirection = cameraDir;
 
-				mLights.push_back(light);
+				AddLights(&light, 1);
 			}
 			else if (wParam == '1' + LT_PointLight)
 			{
@@ -168,9 +500,7 @@ void LightAnimation::RecordLight( const CFirstPersonCamera& camera, UINT uMsg, W
 				// Normalize by arc length
 				light.AnimationSpeed = (AnimationDirection(rng) * 2 - 1) * AnimationSpeedDist(rng) / light.Radius;
 				
-				mLights.push_back(light);
-
-				Move(0);
+				AddLights(&light, 1);
 			}
 			else if (wParam == '1' + LT_SpotLight)
 			{
@@ -179,7 +509,7 @@ void LightAnimation::RecordLight( const CFirstPersonCamera& camera, UINT uMsg, W
 				D3DXVECTOR3 cameraDir = *camera.GetLookAtPt() - *camera.GetEyePt();
 				D3DXVec3Normalize(&cameraDir, &cameraDir);
 
-				light.LightType = LT_PointLight;
+				light.LightType = LT_SpotLight;
 
 				light.LightColor = IntensityDist(rng) * HueToRGB(HueDist(rng));
 				light.LightPosition = *camera.GetEyePt();
@@ -190,30 +520,58 @@ void LightAnimation::RecordLight( const CFirstPersonCamera& camera, UINT uMsg, W
 				light.SpotFalloff.y =  light.SpotFalloff.x  + SpotOuterAngleDist(rng) * D3DX_PI / 180.0f;
 				light.SpotFalloff = D3DXVECTOR3(cosf(light.SpotFalloff.x), cosf(light.SpotFalloff.y), SpotDropoffDist(rng));
 
-				mLights.push_back(light);
-
-				Move(0);
+				AddLights(&light, 1);
 			}
 		}
 		break;
 	}
 }
+#endif
+
+void LightAnimation::SaveLights()
+{
+	if (!mFilename.empty())
+		SaveLights(mFilename);
+}
+
+bool LightAnimation::SaveLights( const std::string& filename ) const
+{
+	return IsLightSetFile(filename) ? SaveLightSet(filename) : SaveLightsText(filename);
+}
+
+bool LightAnimation::LoadLights( const std::string& filename )
+{
+	if (!(IsLightSetFile(filename) ? LoadLightSet(filename) : LoadLightsText(filename)))
+		return false;
+
+	mFilename = filename;
+	return true;
+}
 
-void LightAnimation::SaveLights( )
+bool LightAnimation::ConvertLights( const std::string& srcFilename, const std::string& dstFilename )
+{
+	LightAnimation lights;
+	return lights.LoadLights(srcFilename) && lights.SaveLights(dstFilename);
+}
+
+bool LightAnimation::SaveLightsText( const std::string& filename ) const
 {
 #define OutputVector2(vec2) "(" << vec2.x << " " << vec2.y << ") "
 #define OutputVector3(vec3) "(" << vec3.x << " " << vec3.y << " " << vec3.z << ") "
 
-	if (mLights.empty())
-		return;
+	const size_t numLights = GetNumLights();
+	if (numLights == 0)
+		return false;
 
-	std::ofstream stream(mFilename);
+	std::ofstream stream(filename);
+	if (!stream)
+		return false;
 
-	stream << mLights.size() << std::endl;
+	stream << numLights << std::endl;
 
-	for (size_t i = 0; i < mLights.size(); ++i)
+	for (size_t i = 0; i < numLights; ++i)
 	{
-		const Light& light = mLights[i];
+		const Light light = GetLight(i);
 		switch(light.LightType)
 		{
 		case LT_DirectionalLigt:
@@ -234,9 +592,11 @@ void LightAnimation::SaveLights( )
 
 #undef OutputVector2
 #undef OutputVector3
+
+	return !stream.fail();
 }
 
-void LightAnimation::LoadLights( const std::string& filename )
+bool LightAnimation::LoadLightsText( const std::string& filename )
 {
 #define ReadVector2(vec2) dummy >> vec2.x >>  vec2.y >> dummy
 #define ReadVector3(vec3) dummy >> vec3.x >>  vec3.y >> vec3.z >> dummy
@@ -246,13 +606,13 @@ void LightAnimation::LoadLights( const std::string& filename )
 	
 	std::ifstream stream(filename);
 
-	mFilename = filename;
 	stream >> numLights;
 
-	if (stream.eof())
-		return;
+	if (stream.fail())
+		return false;
 
-	mLights.reserve(numLights);
+	std::vector<Light> lights;
+	lights.reserve(numLights);
 	for (size_t i = 0; i < numLights; ++i)
 	{
 		stream >> lightType; 
@@ -274,14 +634,106 @@ void LightAnimation::LoadLights( const std::string& filename )
 				   >> ReadVector3(light.SpotFalloff) >> ReadVector2(light.LightAttenuation);
 			break;
 		}
-		mLights.push_back(light);
+		lights.push_back(light);
 	}
 
-
-	Move(0);
+	if (!lights.empty())
+		AddLights(&lights[0], lights.size());
 
 #undef ReadVector2
 #undef ReadVector3
+
+	return true;
+}
+
+bool LightAnimation::SaveLightSet( const std::string& filename ) const
+{
+	LightSetHeader header;
+	memset(&header, 0, sizeof(header));
+	header.Magic = LightSetMagic;
+	header.Version = LightSetVersion;
+	header.NumFields = Field_Count;
+	header.Padding = LightArrayPadding;
+
+	uint64_t offset = AlignLightSetOffset(sizeof(LightSetHeader));
+	for (int type = 0; type < LT_Count; ++type)
+	{
+		header.Groups[type].Offset = offset;
+		header.Groups[type].Count = static_cast<uint32_t>(mLightArrays[type].Count);
+		header.Groups[type].PaddedCount = static_cast<uint32_t>(PaddedLightCount(mLightArrays[type].Count));
+		offset = AlignLightSetOffset(offset + uint64_t(header.Groups[type].PaddedCount) * Field_Count * sizeof(float));
+	}
+
+	FILE* f;
+	errno_t err = fopen_s(&f, filename.c_str(), "wb");
+	if (err != 0)
+		return false;
+
+	bool succeeded = fwrite(&header, sizeof(header), 1, f) == 1;
+
+	const char zeros[LightSetAlignment] = { 0 };
+	uint64_t written = sizeof(header);
+
+	for (int type = 0; type < LT_Count && succeeded; ++type)
+	{
+		const LightSetHeader::Group& group = header.Groups[type];
+
+		succeeded &= fwrite(zeros, 1, size_t(group.Offset - written), f) == group.Offset - written;
+		written = group.Offset;
+
+		for (int field = 0; field < Field_Count && succeeded && group.PaddedCount; ++field)
+		{
+			const std::vector<float>& data = mLightArrays[type].*LightArrayMembers[field];
+			succeeded &= fwrite(&data[0], sizeof(float), group.PaddedCount, f) == group.PaddedCount;
+			written += group.PaddedCount * sizeof(float);
+		}
+	}
+
+	fclose(f);
+	return succeeded;
+}
+
+bool LightAnimation::LoadLightSet( const std::string& filename )
+{
+	MappedFile file;
+	if (!file.Open(filename.c_str(), MappedFile::Access_Sequential) || file.GetSize() < sizeof(LightSetHeader))
+		return false;
+
+	const uint8_t* view = file.GetData();
+	const LightSetHeader& header = *reinterpret_cast<const LightSetHeader*>(view);
+
+	// Written with another padding the arrays don't line up with ours
+	if (header.Magic != LightSetMagic || header.Version != LightSetVersion || header.NumFields != Field_Count ||
+		header.Padding != LightArrayPadding)
+		return false;
+
+	for (int type = 0; type < LT_Count; ++type)
+	{
+		if (!IsValidLightSetGroup(header.Groups[type], file.GetSize()))
+			return false;
+	}
+
+	// Straight into the arrays, appended to any lights already there
+	for (int type = 0; type < LT_Count; ++type)
+	{
+		const LightSetHeader::Group& group = header.Groups[type];
+		if (group.Count == 0)
+			continue;
+
+		const float* data = reinterpret_cast<const float*>(view + group.Offset);
+		const size_t first = AppendLightArrays(LightType(type), group.Count);
+
+		LightArrays& arrays = mLightArrays[type];
+		for (int f = 0; f < Field_Count; ++f)
+		{
+			const float* field = data + size_t(f) * group.PaddedCount;
+			std::copy(field, field + group.Count, (arrays.*LightArrayMembers[f]).begin() + first);
+		}
+	}
+
+	Move(0);
+
+	return true;
 }
 
 
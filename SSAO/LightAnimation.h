@@ -1,8 +1,11 @@
 #ifndef LightAnimation_h__
 #define LightAnimation_h__
 
+#include "VectorMath.h"
 #include <vector>
+#include <string>
 #include <cmath>
+#include <cstddef>
 #include <random>
 
 class CFirstPersonCamera;
@@ -12,6 +15,7 @@ enum LightType
 	LT_DirectionalLigt = 0,
 	LT_PointLight,
 	LT_SpotLight,
+	LT_Count
 };
 
 class LightAnimation
@@ -19,7 +23,7 @@ class LightAnimation
 public:
 	struct Light
 	{
-		LightType   LightType;
+		::LightType LightType;
 		D3DXVECTOR3 LightColor;
 		D3DXVECTOR3 LightPosition;
 		D3DXVECTOR3 LightDirection;
@@ -49,6 +53,31 @@ public:
 		//	  SpotFalloff(cosf(innerAngle), cosf(outAngle), spotFalloff), LightAttenuation(attenuationBegin, attenuationEnd) {}
 	};
 
+	/**
+	 * Lights of one type in structure of arrays layout. These arrays are the only copy of the lights, Move
+	 * animates the point light positions in place and everything else reads them through GetLightArrays,
+	 * GetLight or GetBoundingSphere. Light index i counts the lights in type order (directional, point, spot),
+	 * the lights of a type are [Begin, Begin + Count). Arrays are padded with zeros to a multiple of
+	 * LightArrayPadding, which lets SIMD kernels run without a scalar tail.
+	 */
+	struct LightArrays
+	{
+		size_t Begin;
+		size_t Count;
+
+		std::vector<float> PositionX, PositionY, PositionZ;
+		std::vector<float> DirectionX, DirectionY, DirectionZ;
+		std::vector<float> ColorR, ColorG, ColorB;
+		std::vector<float> AttenuationBegin, AttenuationEnd;
+		std::vector<float> SpotCosInner, SpotCosOuter, SpotDropoff;
+
+		// For animation
+		std::vector<float> Radius, Angle, Height, AnimationSpeed;
+	};
+
+	// Widest SIMD register in floats
+	static const int LightArrayPadding = 16;
+
 public:
 	LightAnimation();
 	~LightAnimation();
@@ -58,17 +87,63 @@ public:
 	void RandonPointLight(int numLight);
 	void RandonSpotLight(int numLight);
 
+#ifdef _WIN32
+	// Window messages of the light recording mode
 	void RecordLight(const CFirstPersonCamera& camera, UINT uMsg, WPARAM wParam, LPARAM lParam);
+#endif
+
+	/**
+	 * Lights are stored as text, or as a binary light set when the file name ends in .lts. A light set holds
+	 * the light arrays as they are in memory, it is memory mapped and copied straight into them. Loading
+	 * appends to the current lights.
+	 */
+	bool LoadLights(const std::string& filename);
+	bool SaveLights(const std::string& filename) const;
 
+	// Save to the file the lights were loaded from
 	void SaveLights();
-	void LoadLights(const std::string& filename);
 
-public:
-	std::vector<Light> mLights;
+	// Rewrite a light file in the other format, e.g. Animation.txt to Animation.lts
+	static bool ConvertLights(const std::string& srcFilename, const std::string& dstFilename);
+
+	// Append lights of any type to the arrays of their type
+	void AddLights(const Light* lights, size_t numLights);
+
+	size_t GetNumLights() const;
+	LightType GetLightType(size_t index) const;
+
+	// Light index assembled from the arrays, a copy: changing it doesn't change the light
+	Light GetLight(size_t index) const;
+
+	/**
+	 * Sphere bounding the lit volume, the attenuation sphere for point lights and the smallest sphere around
+	 * the cone for spot lights. Directional lights have no bound and return false.
+	 */
+	static bool GetBoundingSphere(const Light& light, D3DXVECTOR3& center, float& radius);
+
+	// Same for light index, reading only the fields it needs
+	bool GetBoundingSphere(size_t index, D3DXVECTOR3& center, float& radius) const;
+
+	const LightArrays& GetLightArrays(LightType type) const { return mLightArrays[type]; }
+
+private:
+	// Grow the arrays of type by numLights zeroed lights, returns the array index of the first one
+	size_t AppendLightArrays(LightType type, size_t numLights);
+
+	// Type of light index and its index in the arrays of that type
+	LightType FindLight(size_t index, size_t& arrayIndex) const;
+
+	bool LoadLightsText(const std::string& filename);
+	bool SaveLightsText(const std::string& filename) const;
+
+	bool LoadLightSet(const std::string& filename);
+	bool SaveLightSet(const std::string& filename) const;
 
 private:
 	std::string mFilename;
 	float mTotalTime;
+
+	LightArrays mLightArrays[LT_Count];
 };
 
 
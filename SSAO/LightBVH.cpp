@@ -0,0 +1,252 @@
+#include "DXUT.h"
+#include "LightBVH.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+
+// Relative cost of visiting an interior node against testing one light
+const float TraversalCost = 0.125f;
+
+BoundingBox SphereBound(const D3DXVECTOR3& center, float radius)
+{
+	const D3DXVECTOR3 extent(radius, radius, radius);
+	return BoundingBox(center - extent, center + extent);
+}
+
+bool SphereOutsidePlanes(const D3DXVECTOR3& center, float radius, const D3DXPLANE planes[6], uint32_t planeMask)
+{
+	for (int i = 0; i < 6; ++i)
+	{
+		if ((planeMask & (1 << i)) && 
+			planes[i].a * center.x + planes[i].b * center.y + planes[i].c * center.z + planes[i].d < -radius)
+			return true;
+	}
+	return false;
+}
+
+bool BoxContainsPoint(const BoundingBox& box, const D3DXVECTOR3& point)
+{
+	return box.Min.x <= point.x && point.x <= box.Max.x &&
+		   box.Min.y <= point.y && point.y <= box.Max.y &&
+		   box.Min.z <= point.z && point.z <= box.Max.z;
+}
+
+}
+
+LightBVH::LightBVH()
+	: mMaxLeafLights(4)
+{
+
+}
+
+LightBVH::~LightBVH()
+{
+
+}
+
+void LightBVH::Build( const LightAnimation& lights, int maxLeafLights )
+{
+	mMaxLeafLights = (std::max)(maxLeafLights, 1);
+
+	mPrimitives.clear();
+	mPrimitives.reserve(lights.GetNumLights());
+	for (size_t i = 0; i < lights.GetNumLights(); ++i)
+	{
+		LightPrimitive prim;
+		if (!lights.GetBoundingSphere(i, prim.Center, prim.Radius))
+			continue;
+
+		prim.LightIndex = uint32_t(i);
+		mPrimitives.push_back(prim);
+	}
+
+	mNodes.clear();
+	if (mPrimitives.empty())
+		return;
+
+	mNodes.reserve(2 * mPrimitives.size() / mMaxLeafLights + 1);
+	BuildRecursive(0, static_cast<uint32_t>(mPrimitives.size()), 0);
+}
+
+uint32_t LightBVH::BuildRecursive( uint32_t begin, uint32_t end, uint32_t depth )
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size());
+	mNodes.push_back(Node());
+
+	BoundingBox bound, centroidBound;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		bound.Merge(SphereBound(mPrimitives[i].Center, mPrimitives[i].Radius));
+		centroidBound.Merge(mPrimitives[i].Center);
+	}
+
+	const uint32_t count = end - begin;
+	const int axis = centroidBound.MaximumExtent();
+	const float axisMin = centroidBound.Min[axis];
+	const float axisExtent = centroidBound.Max[axis] - axisMin;
+
+	// Small enough, or every centroid in the same spot so no split separates them
+	if (count <= uint32_t(mMaxLeafLights) || (axisExtent <= 0 && count <= 0xFFFF))
+	{
+		Node& leaf = mNodes[nodeIndex];
+		leaf.Bound = bound;
+		leaf.Offset = begin;
+		leaf.NumPrimitives = static_cast<uint16_t>(count);
+		leaf.Axis = 0;
+		return nodeIndex;
+	}
+
+	LightPrimitive* first = &mPrimitives[0] + begin;
+	LightPrimitive* last = &mPrimitives[0] + end;
+	LightPrimitive* middle = first;
+
+	if (axisExtent > 0 && depth < MaxSAHDepth)
+	{
+		// Bin centroids along the axis and evaluate the SAH at every bin boundary
+		SAHBinning binning(axisMin, axisExtent);
+		for (uint32_t i = begin; i < end; ++i)
+			binning.Add(mPrimitives[i].Center[axis], SphereBound(mPrimitives[i].Center, mPrimitives[i].Radius));
+
+		float bestCost;
+		const int bestSplit = binning.FindSplit([](uint32_t n) { return float(n); }, &bestCost);
+
+		const float area = bound.SurfaceArea();
+		const float splitCost = TraversalCost + (area > 0 ? bestCost / area : float(count));
+
+		// Keep a leaf when testing its lights is cheaper than splitting, leaves count is limited by uint16_t
+		if (splitCost >= float(count) && count <= 0xFFFF)
+		{
+			Node& leaf = mNodes[nodeIndex];
+			leaf.Bound = bound;
+			leaf.Offset = begin;
+			leaf.NumPrimitives = static_cast<uint16_t>(count);
+			leaf.Axis = 0;
+			return nodeIndex;
+		}
+
+		middle = std::partition(first, last, [&](const LightPrimitive& prim)
+		{
+			return binning.Bin(prim.Center[axis]) <= bestSplit;
+		});
+	}
+
+	// All on one side or too deep, fall back to the median
+	if (middle == first || middle == last)
+	{
+		middle = SplitAtMedian(first, last, [=](const LightPrimitive& a, const LightPrimitive& b)
+		{
+			return a.Center[axis] < b.Center[axis];
+		});
+	}
+
+	const uint32_t mid = begin + static_cast<uint32_t>(middle - first);
+
+	BuildRecursive(begin, mid, depth + 1);
+	const uint32_t secondChild = BuildRecursive(mid, end, depth + 1);
+
+	Node& interior = mNodes[nodeIndex];
+	interior.Bound = bound;
+	interior.Offset = secondChild;
+	interior.NumPrimitives = 0;
+	interior.Axis = static_cast<uint16_t>(axis);
+	return nodeIndex;
+}
+
+void LightBVH::Refit( const LightAnimation& lights )
+{
+	for (size_t i = 0; i < mPrimitives.size(); ++i)
+	{
+		LightPrimitive& prim = mPrimitives[i];
+		lights.GetBoundingSphere(prim.LightIndex, prim.Center, prim.Radius);
+	}
+
+	// Children always come after their parent
+	for (size_t i = mNodes.size(); i-- > 0; )
+	{
+		Node& node = mNodes[i];
+		node.Bound.SetNull();
+
+		if (node.NumPrimitives)
+		{
+			for (uint32_t p = node.Offset; p < node.Offset + node.NumPrimitives; ++p)
+				node.Bound.Merge(SphereBound(mPrimitives[p].Center, mPrimitives[p].Radius));
+		}
+		else
+		{
+			node.Bound.Merge(mNodes[i + 1].Bound);
+			node.Bound.Merge(mNodes[node.Offset].Bound);
+		}
+	}
+}
+
+void LightBVH::QueryFrustum( const D3DXPLANE planes[6], std::vector<uint32_t>& lightIndices ) const
+{
+	if (mNodes.empty())
+		return;
+
+	// Node and the planes it still has to be tested against
+	uint32_t stack[BVHTraversalStackSize][2];
+	int stackSize = 0;
+	stack[stackSize][0] = 0;
+	stack[stackSize++][1] = 0x3F;
+
+	while (stackSize)
+	{
+		--stackSize;
+		const uint32_t nodeIndex = stack[stackSize][0];
+		uint32_t planeMask = stack[stackSize][1];
+
+		const Node& node = mNodes[nodeIndex];
+		if (planeMask && !BoxInsidePlanes(node.Bound, planes, planeMask))
+			continue;
+
+		if (node.NumPrimitives)
+		{
+			for (uint32_t p = node.Offset; p < node.Offset + node.NumPrimitives; ++p)
+			{
+				if (!planeMask || !SphereOutsidePlanes(mPrimitives[p].Center, mPrimitives[p].Radius, planes, planeMask))
+					lightIndices.push_back(mPrimitives[p].LightIndex);
+			}
+		}
+		else
+		{
+			stack[stackSize][0] = node.Offset;
+			stack[stackSize++][1] = planeMask;
+			stack[stackSize][0] = nodeIndex + 1;
+			stack[stackSize++][1] = planeMask;
+		}
+	}
+}
+
+void LightBVH::QueryPoint( const D3DXVECTOR3& point, std::vector<uint32_t>& lightIndices ) const
+{
+	if (mNodes.empty())
+		return;
+
+	uint32_t stack[BVHTraversalStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const Node& node = mNodes[stack[--stackSize]];
+		if (!BoxContainsPoint(node.Bound, point))
+			continue;
+
+		if (node.NumPrimitives)
+		{
+			for (uint32_t p = node.Offset; p < node.Offset + node.NumPrimitives; ++p)
+			{
+				const D3DXVECTOR3 delta = point - mPrimitives[p].Center;
+				if (D3DXVec3LengthSq(&delta) <= mPrimitives[p].Radius * mPrimitives[p].Radius)
+					lightIndices.push_back(mPrimitives[p].LightIndex);
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.Offset;
+			stack[stackSize++] = static_cast<uint32_t>(&node - &mNodes[0]) + 1;
+		}
+	}
+}
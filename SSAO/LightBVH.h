@@ -0,0 +1,63 @@
+#ifndef LightBVH_h__
+#define LightBVH_h__
+
+#include "LightAnimation.h"
+#include "BoundingVolume.h"
+#include <vector>
+#include <cstdint>
+
+/**
+ * Bounding volume hierarchy over the bounding spheres of the point and spot lights.
+ *
+ * Built top down with the surface area heuristic, nodes are stored depth first in one array: the first
+ * child of an interior node follows it, the second sits at Offset. Animated lights keep their topology,
+ * Refit() only recomputes the node boxes bottom up, which is O(n) against a full rebuild. The tree gets
+ * looser the further the lights drift from where it was built, rebuild once in a while for a tight fit.
+ */
+class LightBVH
+{
+public:
+	struct LightPrimitive
+	{
+		D3DXVECTOR3 Center;
+		float Radius;
+		uint32_t LightIndex;    // LightAnimation::GetLight index
+	};
+
+	struct Node
+	{
+		BoundingBox Bound;
+		uint32_t Offset;        // First primitive of a leaf, second child of an interior node
+		uint16_t NumPrimitives; // Zero for interior nodes
+		uint16_t Axis;          // Split axis of interior nodes
+	};
+
+public:
+	LightBVH();
+	~LightBVH();
+
+	void Build(const LightAnimation& lights, int maxLeafLights = 4);
+
+	// Update the bounds after the lights moved, the light count and order must not have changed
+	void Refit(const LightAnimation& lights);
+
+	// Lights whose sphere intersects the convex volume of six inward facing planes, see ExtractFrustumPlanes
+	void QueryFrustum(const D3DXPLANE planes[6], std::vector<uint32_t>& lightIndices) const;
+
+	// Lights whose sphere contains the point
+	void QueryPoint(const D3DXVECTOR3& point, std::vector<uint32_t>& lightIndices) const;
+
+	const std::vector<Node>& GetNodes() const                    { return mNodes; }
+	const std::vector<LightPrimitive>& GetPrimitives() const     { return mPrimitives; }
+
+private:
+	uint32_t BuildRecursive(uint32_t begin, uint32_t end, uint32_t depth);
+
+private:
+	int mMaxLeafLights;
+
+	std::vector<Node> mNodes;
+	std::vector<LightPrimitive> mPrimitives;
+};
+
+#endif // LightBVH_h__
@@ -0,0 +1,15 @@
+// Built with /arch:AVX2 and without the precompiled header, only called when GetSimdLevel allows it
+#include "LightBoundsKernels.h"
+
+#if defined(__AVX2__)
+
+int CalculateLightBoundsAVX2( const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius, 
+	                        int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions )
+{
+	return CalculateLightBoundsBatch<SimdAVX2>(lightPosViewX, lightPosViewY, lightPosViewZ, lightRadius, numLights, 
+		cameraNear, cameraScaleX, cameraScaleY, clipRegions);
+}
+
+#else
+#error LightBoundsAVX2.cpp must be compiled for AVX2 (/arch:AVX2, -mavx2 -mfma)
+#endif
@@ -0,0 +1,15 @@
+// Built with /arch:AVX512 and without the precompiled header, only called when GetSimdLevel allows it
+#include "LightBoundsKernels.h"
+
+#if defined(__AVX512F__)
+
+int CalculateLightBoundsAVX512( const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius, 
+	                          int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions )
+{
+	return CalculateLightBoundsBatch<SimdAVX512>(lightPosViewX, lightPosViewY, lightPosViewZ, lightRadius, numLights, 
+		cameraNear, cameraScaleX, cameraScaleY, clipRegions);
+}
+
+#else
+#error LightBoundsAVX512.cpp must be compiled for AVX-512 (/arch:AVX512, -mavx512f)
+#endif
@@ -0,0 +1,118 @@
+#ifndef LightBoundsKernels_h__
+#define LightBoundsKernels_h__
+
+#include "SimdMath.h"
+
+/**
+ * Batch kernels of CalculateLightBounds, instantiated once per instruction set: Utility.cpp builds the SSE2
+ * one with the project settings, LightBoundsAVX2.cpp and LightBoundsAVX512.cpp are built with /arch:AVX2
+ * and /arch:AVX512. CalculateLightBounds calls the one GetSimdLevel allows.
+ *
+ * Each fills clipRegions (4 floats per light, [min.xy, max.xy]) for the lights that fill whole registers and
+ * returns how many that are, the caller does the rest with CalculateLightBound. The templates are in an
+ * anonymous namespace so no file shares inline code compiled for another instruction set.
+ */
+
+int CalculateLightBoundsSSE2(const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius,
+	                         int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions);
+
+int CalculateLightBoundsAVX2(const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius,
+	                         int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions);
+
+int CalculateLightBoundsAVX512(const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius,
+	                           int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions);
+
+namespace {
+
+// Same steps as UpdateClipRegionRoot, lanes failing a branch keep their old clip values
+template<typename S>
+void UpdateClipRegionRootBatch( typename S::Float nc, typename S::Float lc, typename S::Float lz, typename S::Float lightRadius,
+	                            typename S::Float cameraScale, typename S::Mask valid, 
+								typename S::Float& clipMin, typename S::Float& clipMax )
+{
+	typename S::Float nz = S::Div(S::Sub(lightRadius, S::Mul(nc, lc)), lz);
+	typename S::Float pz = S::Sub(lz, S::Mul(lightRadius, nz));
+
+	typename S::Mask update = S::And(valid, S::CmpGt(pz, S::Zero()));
+	typename S::Mask left = S::CmpGt(nc, S::Zero());
+
+	typename S::Float c = S::Div(S::Mul(S::Neg(nz), cameraScale), nc);
+
+	// (std::max)(clipMin, c) keeps clipMin unless c is greater, which is what max(c, clipMin) does
+	clipMin = S::Select(S::And(update, left), S::Max(c, clipMin), clipMin);
+	clipMax = S::Select(S::AndNot(left, update), S::Min(c, clipMax), clipMax);
+}
+
+template<typename S>
+void UpdateClipRegionBatch( typename S::Float lc, typename S::Float lz, typename S::Float lightRadius, typename S::Float cameraScale, 
+	                        typename S::Float& clipMin, typename S::Float& clipMax )
+{
+	typename S::Float rSq = S::Mul(lightRadius, lightRadius);
+	typename S::Float lcSqPluslzSq = S::Add(S::Mul(lc, lc), S::Mul(lz, lz));
+	typename S::Float d = S::Sub(S::Mul(S::Mul(rSq, lc), lc), S::Mul(lcSqPluslzSq, S::Sub(rSq, S::Mul(lz, lz))));
+
+	typename S::Mask valid = S::CmpGt(d, S::Zero());
+	if (!S::Any(valid))
+		return;
+
+	typename S::Float a = S::Mul(lightRadius, lc);
+	typename S::Float b = S::Sqrt(S::Max(d, S::Zero()));
+	typename S::Float nx0 = S::Div(S::Add(a, b), lcSqPluslzSq);
+	typename S::Float nx1 = S::Div(S::Sub(a, b), lcSqPluslzSq);
+
+	UpdateClipRegionRootBatch<S>(nx0, lc, lz, lightRadius, cameraScale, valid, clipMin, clipMax);
+	UpdateClipRegionRootBatch<S>(nx1, lc, lz, lightRadius, cameraScale, valid, clipMin, clipMax);
+}
+
+template<typename S>
+int CalculateLightBoundsBatch( const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius, 
+	                           int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, float* clipRegions )
+{
+	const typename S::Float nearPlane = S::Set(cameraNear);
+	const typename S::Float scaleX = S::Set(cameraScaleX);
+	const typename S::Float scaleY = S::Set(cameraScaleY);
+	const typename S::Float one = S::Set(1.0f);
+	const typename S::Float zero = S::Zero();
+
+	int i = 0;
+	for (; i + S::Width <= numLights; i += S::Width)
+	{
+		typename S::Float x = S::Load(lightPosViewX + i);
+		typename S::Float y = S::Load(lightPosViewY + i);
+		typename S::Float z = S::Load(lightPosViewZ + i);
+		typename S::Float r = S::Load(lightRadius + i);
+
+		typename S::Mask visible = S::CmpGe(S::Add(z, r), nearPlane);
+
+		typename S::Float clipMinX = S::Neg(one), clipMinY = S::Neg(one);
+		typename S::Float clipMaxX = one, clipMaxY = one;
+
+		if (S::Any(visible))
+		{
+			UpdateClipRegionBatch<S>(x, z, r, scaleX, clipMinX, clipMaxX);
+			UpdateClipRegionBatch<S>(y, z, r, scaleY, clipMinY, clipMaxY);
+		}
+
+		// Empty rectangle (1, 1, 0, 0) for the lights behind the near plane
+		alignas(64) float rect[4][S::Width];
+		S::Store(rect[0], S::Select(visible, clipMinX, one));
+		S::Store(rect[1], S::Select(visible, clipMinY, one));
+		S::Store(rect[2], S::Select(visible, clipMaxX, zero));
+		S::Store(rect[3], S::Select(visible, clipMaxY, zero));
+
+		for (int j = 0; j < S::Width; ++j)
+		{
+			float* clipRegion = clipRegions + (i + j) * 4;
+			clipRegion[0] = rect[0][j];
+			clipRegion[1] = rect[1][j];
+			clipRegion[2] = rect[2][j];
+			clipRegion[3] = rect[3][j];
+		}
+	}
+
+	return i;
+}
+
+}
+
+#endif // LightBoundsKernels_h__
@@ -0,0 +1,59 @@
+#include "DXUT.h"
+#include "LightVolumeBatch.h"
+#include "Utility.h"
+
+LightVolumeBatch::LightVolumeBatch()
+	: mNumCulled(0)
+{
+	memset(mGroupStart, 0, sizeof(mGroupStart));
+}
+
+LightVolumeBatch::~LightVolumeBatch()
+{
+
+}
+
+void LightVolumeBatch::Build( const LightAnimation& lights, const D3DXMATRIX& view, const D3DXMATRIX& proj, const D3DXVECTOR3& eye )
+{
+	D3DXPLANE planes[6];
+	ExtractFrustumPlanes(view * proj, D3DXVECTOR4(-1, -1, 1, 1), 0.0f, 1.0f, planes);
+
+	const LightAnimation::LightArrays& points = lights.GetLightArrays(LT_PointLight);
+
+	mInstances.clear();
+	mInside.clear();
+	mNumCulled = 0;
+
+	for (size_t i = 0; i < points.Count; ++i)
+	{
+		const D3DXVECTOR3 position(points.PositionX[i], points.PositionY[i], points.PositionZ[i]);
+		const float radius = points.AttenuationEnd[i];
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p)
+			outside = planes[p].a * position.x + planes[p].b * position.y + planes[p].c * position.z + planes[p].d < -radius;
+
+		if (outside)
+		{
+			mNumCulled++;
+			continue;
+		}
+
+		LightVolumeInstance instance;
+		D3DXVec3TransformCoord(&instance.PositionVS, &position, &view);
+		instance.Radius = radius;
+		instance.Color = D3DXVECTOR3(points.ColorR[i], points.ColorG[i], points.ColorB[i]);
+		instance.AttenuationBegin = points.AttenuationBegin[i];
+
+		const D3DXVECTOR3 cameraToLight = position - eye;
+		if (D3DXVec3Length(&cameraToLight) < radius)
+			mInside.push_back(instance);
+		else
+			mInstances.push_back(instance);
+	}
+
+	mGroupStart[LVG_CameraOutside] = 0;
+	mGroupStart[LVG_CameraInside] = static_cast<uint32_t>(mInstances.size());
+	mInstances.insert(mInstances.end(), mInside.begin(), mInside.end());
+	mGroupStart[LVG_Count] = static_cast<uint32_t>(mInstances.size());
+}
@@ -0,0 +1,203 @@
+#ifndef LightVolumeBatch_h__
+#define LightVolumeBatch_h__
+
+#include "LightAnimation.h"
+#include "ShaderContanst.h"
+#include <d3d11.h>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Point light volumes drawn as instances of the unit sphere proxy.
+ *
+ * The classic path draws the proxy once per light, with two constant buffer Map/Unmap round trips and a
+ * depth/rasterizer state switch in between, so the driver sees about ten calls per light. Here the lights
+ * inside the camera frustum are packed into one per frame instance buffer, grouped by which side of their
+ * volume the camera is on, and each group is one DrawIndexedInstanced: the camera outside draws front faces
+ * with LESS_EQUAL, the camera inside draws back faces with GREATER.
+ *
+ * The proxy is a sphere so its orientation doesn't matter, the instanced vertex shader scales it and adds
+ * the view space center, skipping the view rotation. Shaders are the InstancedLightVolume variants of
+ * DeferredShadingClassicVS/PS and DeferredLightingPassPS, which take the light from the instance instead
+ * of the Light cbuffer.
+ */
+
+// One instance, read by the input assembler as LIGHT_POSITION and LIGHT_COLOR, 32 bytes
+struct LightVolumeInstance
+{
+	D3DXVECTOR3 PositionVS;      // View space center
+	float Radius;                // Attenuation end, scales the proxy
+	D3DXVECTOR3 Color;
+	float AttenuationBegin;
+};
+
+enum LightVolumeGroup
+{
+	LVG_CameraOutside = 0,
+	LVG_CameraInside,
+	LVG_Count
+};
+
+class LightVolumeBatch
+{
+public:
+	LightVolumeBatch();
+	~LightVolumeBatch();
+
+	/**
+	 * Pack the point lights whose attenuation sphere touches the view frustum, camera outside group first.
+	 * The inside test is the one of the per light path, distance from eye to center below the radius.
+	 */
+	void Build(const LightAnimation& lights, const D3DXMATRIX& view, const D3DXMATRIX& proj, const D3DXVECTOR3& eye);
+
+	const std::vector<LightVolumeInstance>& GetInstances() const  { return mInstances; }
+
+	uint32_t GetGroupStart(LightVolumeGroup group) const          { return mGroupStart[group]; }
+	uint32_t GetGroupCount(LightVolumeGroup group) const          { return mGroupStart[group + 1] - mGroupStart[group]; }
+
+	// Point lights left out by the frustum test in the last Build
+	uint32_t GetNumCulled() const                                 { return mNumCulled; }
+
+private:
+	std::vector<LightVolumeInstance> mInstances;
+	std::vector<LightVolumeInstance> mInside;
+
+	uint32_t mGroupStart[LVG_Count + 1];
+	uint32_t mNumCulled;
+};
+
+/**
+ * Buffers and states of the light volume pass. Shaders, input layout and the PS constant buffers are bound
+ * by the caller, the submit functions below do what changes per light or per group.
+ */
+struct LightVolumePass
+{
+	// Proxy mesh, one indexed triangle list
+	ID3D11Buffer* VertexBuffer;
+	UINT VertexStride;
+	ID3D11Buffer* IndexBuffer;
+	DXGI_FORMAT IndexFormat;
+	UINT IndexCount;
+	UINT StartIndex;
+	INT BaseVertex;
+
+	// Per light path
+	ID3D11Buffer* PerObjectConstants;
+	ID3D11Buffer* LightConstants;
+
+	// Instanced path, dynamic vertex buffer with room for all instances of the batch
+	ID3D11Buffer* InstanceBuffer;
+
+	ID3D11DepthStencilState* DepthState[LVG_Count];
+	ID3D11RasterizerState* RasterizerState[LVG_Count];
+};
+
+/**
+ * The classic path, every point light, one draw each. Context is ID3D11DeviceContext or anything with the
+ * same calls, the benchmarks count them on a recording context.
+ */
+template<typename Context>
+void SubmitLightVolumesPerLight(Context* context, const LightVolumePass& pass, const LightAnimation& lights,
+	                            const D3DXMATRIX& view, const D3DXMATRIX& proj, const D3DXVECTOR3& eye)
+{
+	const LightAnimation::LightArrays& points = lights.GetLightArrays(LT_PointLight);
+
+	for (size_t idx = points.Begin; idx < points.Begin + points.Count; ++idx)
+	{
+		const LightAnimation::Light light = lights.GetLight(idx);
+
+		float lightRadius = light.LightAttenuation.y;  // Attenuation End
+		const D3DXVECTOR3& lightPosition = light.LightPosition;
+
+		D3DXMATRIX world;
+		D3DXMatrixScaling(&world, lightRadius, lightRadius, lightRadius);   // Scale
+		world._41 = lightPosition.x;
+		world._42 = lightPosition.y;
+		world._43 = lightPosition.z;         // translation
+
+		// Fill per object constants
+		{
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+			context->Map(pass.PerObjectConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+			PerObjectConstants* constants = static_cast<PerObjectConstants *>(mappedResource.pData);
+
+			// Only need those two
+			constants->WorldView = world * view;
+			constants->WorldViewProj = constants->WorldView * proj;
+
+			context->Unmap(pass.PerObjectConstants, 0);
+		}
+
+		// Fill PointLight constants
+		{
+			D3D11_MAPPED_SUBRESOURCE mappedResource;
+			context->Map(pass.LightConstants, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+			LightCBuffer* lightCBuffer = static_cast<LightCBuffer*>(mappedResource.pData);
+
+			D3DXVec3TransformCoord(&lightCBuffer->LightPosition, &lightPosition, &view);
+			lightCBuffer->LightColor = light.LightColor;
+			lightCBuffer->LightAttenuation = light.LightAttenuation;
+
+			context->Unmap(pass.LightConstants, 0);
+		}
+
+		// Camera inside light volume, draw backfaces, Cull front. Outside, draw front, Cull back
+		D3DXVECTOR3 cameraToLight = lightPosition - eye;
+		LightVolumeGroup group = D3DXVec3Length(&cameraToLight) < lightRadius ? LVG_CameraInside : LVG_CameraOutside;
+
+		context->OMSetDepthStencilState(pass.DepthState[group], 0);
+		context->RSSetState(pass.RasterizerState[group]);
+
+		// What CDXUTSDKMesh::Render does for the proxy
+		UINT offset = 0;
+		context->IASetVertexBuffers(0, 1, &pass.VertexBuffer, &pass.VertexStride, &offset);
+		context->IASetIndexBuffer(pass.IndexBuffer, pass.IndexFormat, 0);
+		context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+		context->DrawIndexed(pass.IndexCount, pass.StartIndex, pass.BaseVertex);
+	}
+}
+
+// At most one draw per group, the instances of the batch start at firstInstance of instanceBuffer
+template<typename Context>
+void DrawLightVolumesInstanced(Context* context, const LightVolumePass& pass, const LightVolumeBatch& batch,
+	                           ID3D11Buffer* instanceBuffer, UINT firstInstance)
+{
+	ID3D11Buffer* buffers[2] = { pass.VertexBuffer, instanceBuffer };
+	UINT strides[2] = { pass.VertexStride, sizeof(LightVolumeInstance) };
+	UINT offsets[2] = { 0, 0 };
+	context->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	context->IASetIndexBuffer(pass.IndexBuffer, pass.IndexFormat, 0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	for (int group = 0; group < LVG_Count; ++group)
+	{
+		const UINT count = batch.GetGroupCount(LightVolumeGroup(group));
+		if (count == 0)
+			continue;
+
+		context->OMSetDepthStencilState(pass.DepthState[group], 0);
+		context->RSSetState(pass.RasterizerState[group]);
+		context->DrawIndexedInstanced(pass.IndexCount, count, pass.StartIndex, pass.BaseVertex, firstInstance + batch.GetGroupStart(LightVolumeGroup(group)));
+	}
+}
+
+// One instance buffer upload and at most one draw per group
+template<typename Context>
+void SubmitLightVolumesInstanced(Context* context, const LightVolumePass& pass, const LightVolumeBatch& batch)
+{
+	const std::vector<LightVolumeInstance>& instances = batch.GetInstances();
+	if (instances.empty())
+		return;
+
+	{
+		D3D11_MAPPED_SUBRESOURCE mappedResource;
+		context->Map(pass.InstanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
+		memcpy(mappedResource.pData, &instances[0], instances.size() * sizeof(LightVolumeInstance));
+		context->Unmap(pass.InstanceBuffer, 0);
+	}
+
+	DrawLightVolumesInstanced(context, pass, batch, pass.InstanceBuffer, 0);
+}
+
+#endif // LightVolumeBatch_h__
@@ -16,8 +16,11 @@
 #include "Renderer.h"
 #include "Scene.h"
 #include "LightAnimation.h"
+#include "Benchmark.h"
+#include "RecordingDeviceContext.h"
 
 #include <sstream>
+#include <ppl.h>
 
 CDXUTDialogResourceManager  g_DialogResourceManager; // manager for shared resources of dialogs
 CDXUTDialog                 g_HUD;                  // manages the 3D   
@@ -31,6 +34,14 @@ CFirstPersonCamera          g_Camera;               // A FPS camera
 Renderer*                   g_Renderer;
 Scene*                      g_Scene;
 LightAnimation*             g_LightAnimation;
+RecordingDeviceContext*     g_Recorder;             // Renderer's context while F7 records
+
+// F5 runs the CPU benchmarks here, the window keeps rendering meanwhile
+Concurrency::task_group     g_BenchmarkTask;
+volatile LONG               g_BenchmarkRunning;
+
+// F7 records this many frames to Submission.log
+const UINT RecordFrames = 100;
 
 
 enum SceneSelection
@@ -67,6 +78,7 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
 void InitUI();
 void InitScene(ID3D11Device* d3dDevice);
 void DestroyScene();
+void FinishRecording();
 
 //--------------------------------------------------------------------------------------
 // Initialize the app 
@@ -294,12 +306,15 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 		return;
 	}
 
-	// Lazily load scene
+	// Lazily load scene, meshes are added as the loader finishes them
 	if (!g_Scene) 
 	{
 		InitScene(pd3dDevice);
 	}
 
+	if (g_Scene->IsLoading())
+		g_Scene->UpdateLoading(pd3dDevice);
+
     // Clear render target and the depth stencil 
     float ClearColor[4] = { 0.176f, 0.196f, 0.667f, 0.0f };
 
@@ -316,7 +331,21 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 	viewport.TopLeftX = 0.0f;
 	viewport.TopLeftY = 0.0f;
 
-	g_Renderer->Render(pd3dImmediateContext, pRTV, pDSV, *g_Scene, *g_LightAnimation, g_Camera, &viewport);
+	ID3D11DeviceContext* rendererContext = pd3dImmediateContext;
+	if (g_Recorder)
+	{
+		g_Recorder->BeginFrame();
+		rendererContext = g_Recorder;
+	}
+
+	g_Renderer->Render(rendererContext, pRTV, pDSV, *g_Scene, *g_LightAnimation, g_Camera, &viewport);
+
+	if (g_Recorder)
+	{
+		g_Recorder->EndFrame();
+		if (g_Recorder->GetNumFrames() == RecordFrames)
+			FinishRecording();
+	}
 
 	// reset render target
 	pd3dImmediateContext->RSSetViewports(1, &viewport);
@@ -345,6 +374,9 @@ void CALLBACK OnD3D11FrameRender( ID3D11Device* pd3dDevice, ID3D11DeviceContext*
 		g_TextHelper->DrawTextLine(oss.str().c_str());
 	}
 
+	if (g_BenchmarkRunning)
+		g_TextHelper->DrawTextLine(L"Running CPU benchmarks (F5), results in Benchmark.log");
+
 	g_TextHelper->End();
 }
 
@@ -371,6 +403,7 @@ void CALLBACK OnD3D11DestroyDevice( void* pUserContext )
 
 	SAFE_DELETE(g_TextHelper);
 	SAFE_DELETE(g_Renderer);
+	SAFE_DELETE(g_Recorder);
 }
 
 
@@ -415,6 +448,50 @@ LRESULT CALLBACK MsgProc( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam,
 //--------------------------------------------------------------------------------------
 void CALLBACK OnKeyboard( UINT nChar, bool bKeyDown, bool bAltDown, void* pUserContext )
 {
+	if (bKeyDown)
+	{
+		switch(nChar)
+		{
+		case VK_F5:
+			// One run at a time, the HUD shows it until Benchmark.log is complete
+			if (InterlockedCompareExchange(&g_BenchmarkRunning, 1, 0) == 0)
+			{
+				g_BenchmarkTask.run([]() {
+					RunCPUBenchmarks();
+					OutputDebugString(L"CPU benchmarks finished, results in Benchmark.log\n");
+					InterlockedExchange(&g_BenchmarkRunning, 0);
+				});
+			}
+			break;
+		case VK_F6:
+			if (g_Renderer)
+				g_Renderer->CaptureFrame(DXUTGetD3D11DeviceContext(), g_Camera, "Frame.gbc");
+			break;
+		case VK_F7:
+			// With shift nothing reaches the driver, the screen keeps the last frame meanwhile
+			if (!g_Recorder)
+			{
+				const bool nullContext = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
+				g_Recorder = new RecordingDeviceContext(nullContext ? NULL : DXUTGetD3D11DeviceContext(), DXUTGetD3D11Device());
+			}
+			break;
+		case VK_F8:
+			// Per draw WRITE_DISCARD maps or the constant ring, F7 records the driver time of either
+			if (g_Renderer)
+				g_Renderer->mUseConstantRing = !g_Renderer->mUseConstantRing;
+			break;
+		case VK_F9:
+			// Sorted draws without the redundant state sets or scene order, F7 counts the calls of either
+			if (g_Renderer)
+				g_Renderer->mSortDraws = !g_Renderer->mSortDraws;
+			break;
+		case VK_F11:
+			// Point light volumes drawn as instances or one by one, both light the same pixels
+			if (g_Renderer)
+				g_Renderer->mInstancedLightVolumes = !g_Renderer->mInstancedLightVolumes;
+			break;
+		}
+	}
 }
 
 
@@ -479,10 +556,24 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     DXUTMainLoop(); // Enter into the DXUT render loop
 
     // Perform any application-level cleanup here
+	g_BenchmarkTask.wait();
 
     return DXUTGetExitCode();
 }
 
+// Lights come from the binary light set, which is converted from the text version when missing
+void LoadAnimationLights()
+{
+	const char* LightSetFile = ".\\Media\\Animation.lts";
+	const char* LightTextFile = ".\\Media\\Animation.txt";
+
+	if (!g_LightAnimation->LoadLights(LightSetFile))
+	{
+		if (!LightAnimation::ConvertLights(LightTextFile, LightSetFile) || !g_LightAnimation->LoadLights(LightSetFile))
+			g_LightAnimation->LoadLights(LightTextFile);
+	}
+}
+
 void InitScene(ID3D11Device* d3dDevice)
 {
 	DestroyScene();
@@ -502,16 +593,13 @@ void InitScene(ID3D11Device* d3dDevice)
 	{
 	case Scene_Power_Plant: 
 		{
-			g_LightAnimation->LoadLights(".\\Media\\Animation.txt");
+			LoadAnimationLights();
 			g_LightAnimation->RandonPointLight(100);
 
 			sceneScaling = 1.0f;
 			D3DXMatrixScaling(&world, sceneScaling, sceneScaling, sceneScaling);
 			
-			g_Scene->LoadOpaqueMesh(d3dDevice, L"..\\media\\powerplant\\powerplant.sdkmesh", world);
-
-			D3DXVECTOR3 extent = g_Scene->mWorldBound.Extent();
-			D3DXVECTOR3 center = g_Scene->mWorldBound.Center();
+			g_Scene->AddOpaqueMesh(L"..\\media\\powerplant\\powerplant.sdkmesh", world);
 
 			cameraEye = sceneScaling * D3DXVECTOR3(100.0f, 5.0f, 5.0f);
 			cameraAt = sceneScaling * D3DXVECTOR3(0.0f, 0.0f, 0.0f);		
@@ -520,16 +608,13 @@ void InitScene(ID3D11Device* d3dDevice)
 
 	case Scene_Sponza: 
 		{
-			g_LightAnimation->LoadLights(".\\Media\\Animation.txt");
+			LoadAnimationLights();
 			//g_LightAnimation->RandonPointLight(100);
 
 			sceneScaling = 0.05f;
 			D3DXMatrixScaling(&world, sceneScaling, sceneScaling, sceneScaling);
 
-			g_Scene->LoadOpaqueMesh(d3dDevice, L".\\Media\\Sponza\\sponza_dds.sdkmesh", world);
-
-			D3DXVECTOR3 extent = g_Scene->mWorldBound.Extent();
-			D3DXVECTOR3 center = g_Scene->mWorldBound.Center();
+			g_Scene->AddOpaqueMesh(L".\\Media\\Sponza\\sponza_dds.sdkmesh", world);
 
 			cameraEye = sceneScaling * D3DXVECTOR3(1200.0f, 200.0f, 100.0f);
 			cameraAt = sceneScaling * D3DXVECTOR3(0.0f, 0.0f, 0.0f);
@@ -537,6 +622,9 @@ void InitScene(ID3D11Device* d3dDevice)
 		break;
 	};
 
+	// Meshes come in over the next frames, see OnD3D11FrameRender
+	g_Scene->StartLoading();
+
 	g_Camera.SetViewParams(&cameraEye, &cameraAt);
 	g_Camera.SetScalers(0.01f, 10.0f);
 	g_Camera.FrameMove(0.0f);
@@ -558,6 +646,19 @@ void DestroyScene()
 	}	
 }
 
+// Submission counts per pass of the recorded frames
+void FinishRecording()
+{
+	FILE* file;
+	if (fopen_s(&file, "Submission.log", "w") == 0)
+	{
+		g_Recorder->Report(file);
+		fclose(file);
+	}
+
+	SAFE_DELETE(g_Recorder);
+}
+
 void InitUI()
 {
 #define Default(v, min, max) int((v - min) / (max - min ) * 100.0f )
@@ -0,0 +1,131 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mView(NULL), mSize(0)
+{
+
+}
+
+#else
+
+MappedFile::MappedFile()
+	: mFile(-1), mView(NULL), mSize(0)
+{
+
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open( const char* filename, AccessPattern access )
+{
+	Close();
+
+#ifdef _WIN32
+	const DWORD flags = access == Access_Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+	mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mMapping == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mView = MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (mView == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	mSize = fileSize.QuadPart;
+#else
+	mFile = open(filename, O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(mFile, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* view = mmap(NULL, size_t(fileStat.st_size), PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	posix_madvise(view, size_t(fileStat.st_size), access == Access_Sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_RANDOM);
+
+	mView = view;
+	mSize = fileStat.st_size;
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (mView)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+
+	if (mMapping)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	if (mFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (mView)
+	{
+		munmap(const_cast<void*>(mView), size_t(mSize));
+		mView = NULL;
+	}
+
+	if (mFile >= 0)
+	{
+		close(mFile);
+		mFile = -1;
+	}
+#endif
+
+	mSize = 0;
+}
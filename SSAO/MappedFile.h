@@ -0,0 +1,50 @@
+#ifndef MappedFile_h__
+#define MappedFile_h__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Read only mapping of a whole file, CreateFileMapping on Windows and mmap elsewhere, so the binary formats
+ * (.sdkmesh, .lts) are read in place without DXUT or Windows. Empty files can't be mapped and fail to open.
+ * The data is valid until Close() or destruction.
+ */
+class MappedFile
+{
+public:
+	// How the file is going to be read, a hint for the read ahead
+	enum AccessPattern
+	{
+		Access_Random,
+		Access_Sequential
+	};
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* filename, AccessPattern access = Access_Random);
+	void Close();
+
+	bool IsOpen() const                 { return mView != NULL; }
+
+	const uint8_t* GetData() const      { return static_cast<const uint8_t*>(mView); }
+	uint64_t GetSize() const            { return mSize; }
+
+private:
+	// Not implemented
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+private:
+#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+	const void* mView;
+	uint64_t mSize;
+};
+
+#endif // MappedFile_h__
@@ -33,6 +33,14 @@ Texture2D DepthBuffer           : register(t1);           // Depth Buffer
 float4 DeferredLightingPS(
 #if defined(DirectionalLight)       
 	in float2 iTex : TEXCOORD0,
+#if defined(LightInstanceStream)
+	nointerpolation in float4 iLightDirection : TEXCOORD2,
+	nointerpolation in float4 iLightColor     : TEXCOORD3,
+#endif
+#elif defined(InstancedLightVolume)
+    in float3 iTex : TEXCOORD0,
+	nointerpolation in float4 iLightPositionRadius : TEXCOORD2,
+	nointerpolation in float4 iLightColorBegin     : TEXCOORD3,
 #elif defined(PointLight) || defined(SpotLight)   
     in float3 iTex : TEXCOORD0,
 #endif
@@ -53,21 +61,36 @@ float4 DeferredLightingPS(
 	// View space lit position
 	float3 positionVS = PositionVSFromDepth(iViewRay, linearDepth);
 
+	// Light of this pixel, from the instance stream or the Light cbuffer
+#if defined(InstancedLightVolume)
+	float3 lightColor = iLightColorBegin.rgb;
+	float3 lightPosition = iLightPositionRadius.xyz;
+	float2 lightAttenuation = float2(iLightColorBegin.w, iLightPositionRadius.w);
+#elif defined(LightInstanceStream)
+	float3 lightColor = iLightColor.rgb;
+	float3 lightDirection = iLightDirection.xyz;
+#else
+	float3 lightColor = LightColor;
+	float3 lightPosition = LightPosition;
+	float3 lightDirection = LightDirection;
+	float2 lightAttenuation = LightAttenuation;
+#endif
+
 	float3 L = 0;
 	float attenuation = 1.0f;
 
 #if defined(PointLight) || defined(SpotLight)
 	
-	L = LightPosition - positionVS;
+	L = lightPosition - positionVS;
 
 	float dist = length(L);
-	attenuation = CalculateAttenuation(dist, LightAttenuation.x, LightAttenuation.y);
+	attenuation = CalculateAttenuation(dist, lightAttenuation.x, lightAttenuation.y);
 
 	// Normailize
 	L /= dist;
 
 #elif defined(DirectionalLight)
-	L = -LightDirection;
+	L = -lightDirection;
 #endif
 
 #if defined(SpotLight)
@@ -86,13 +109,13 @@ float4 DeferredLightingPS(
 
 	if(nDotl > 0)
 	{
-		float3 diffuse = LightColor * nDotl * attenuation;
+		float3 diffuse = lightColor * nDotl * attenuation;
 
 		float3 V = normalize(-positionVS);
 		float3 H = normalize(L + V);
 
 		// Frensel in moved to calculate in shading pass
-		float3 specular = CalculateSpecular(N, H, shininess) * LightColor * nDotl * attenuation;
+		float3 specular = CalculateSpecular(N, H, shininess) * lightColor * nDotl * attenuation;
 
 		final = float4(diffuse, Luminance(specular));
 	}
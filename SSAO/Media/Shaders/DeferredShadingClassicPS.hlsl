@@ -23,6 +23,14 @@ Texture2D AOBuffer    : register(t3);
 float4 DeferredRenderingPS(
 #if defined(DirectionalLight)       
 							in float2 iTex : TEXCOORD0,
+#if defined(LightInstanceStream)
+							nointerpolation in float4 iLightDirection : TEXCOORD2,
+							nointerpolation in float4 iLightColor     : TEXCOORD3,
+#endif
+#elif defined(InstancedLightVolume)
+							in float3 iTex : TEXCOORD0,
+							nointerpolation in float4 iLightPositionRadius : TEXCOORD2,
+							nointerpolation in float4 iLightColorBegin     : TEXCOORD3,
 #elif defined(PointLight) || defined(SpotLight)   
 							in float3 iTex : TEXCOORD0,
 #endif
@@ -42,21 +50,36 @@ float4 DeferredRenderingPS(
 	// View space lit position
 	float3 positionVS = PositionVSFromDepth(iViewRay, linearDepth);
 
+	// Light of this pixel, from the instance stream or the Light cbuffer
+#if defined(InstancedLightVolume)
+	float3 lightColor = iLightColorBegin.rgb;
+	float3 lightPosition = iLightPositionRadius.xyz;
+	float2 lightAttenuation = float2(iLightColorBegin.w, iLightPositionRadius.w);
+#elif defined(LightInstanceStream)
+	float3 lightColor = iLightColor.rgb;
+	float3 lightDirection = iLightDirection.xyz;
+#else
+	float3 lightColor = LightColor;
+	float3 lightPosition = LightPosition;
+	float3 lightDirection = LightDirection;
+	float2 lightAttenuation = LightAttenuation;
+#endif
+
 	float3 L = 0;
 	float attenuation = 1.0f;
 
 #if defined(PointLight) || defined(SpotLight)
 	
-	L = LightPosition - positionVS;
+	L = lightPosition - positionVS;
 
 	float dist = length(L);
-	attenuation = CalculateAttenuation(dist, LightAttenuation.x, LightAttenuation.y);
+	attenuation = CalculateAttenuation(dist, lightAttenuation.x, lightAttenuation.y);
 
 	// Normailize
 	L /= dist;
 
 #elif defined(DirectionalLight)
-	L = -LightDirection;
+	L = -lightDirection;
 #endif
 
 #if defined(SpotLight)
@@ -85,7 +108,7 @@ float4 DeferredRenderingPS(
 		float3 H = normalize(L + V);
 
 		final = diffuseAlbedo + CalculateFresnel(specularAlbedo, L, H) * CalculateSpecularNormalized(N, H, shininess);
-		final *= LightColor * nDotl * attenuation;
+		final *= lightColor * nDotl * attenuation;
 
 		
 	}
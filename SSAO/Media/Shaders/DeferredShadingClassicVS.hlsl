@@ -1,12 +1,21 @@
 #ifndef DeferredRendering_HLSL
 #define DeferredRendering_HLSL
 
+#if defined(InstancedLightVolume)
+
+// The light comes with the instance, only the projection is needed
+#include "PerFrameConstant.hlsl"
+
+#else
+
 cbuffer PerOjectConstant : register(b0)
 {
 	float4x4 WorldView;
 	float4x4 WorldViewProj;
 };
 
+#endif
+
 #if defined(DirectionalLight)	
 	#define InvProj	WorldView // if directional light, WorldView store InvProjection
 #endif
@@ -14,7 +23,22 @@ cbuffer PerOjectConstant : register(b0)
 void DeferredRenderingVS(                   
 #if defined(DirectionalLight)
 						 in  uint vertexID   : SV_VertexID,
+#if defined(LightInstanceStream)
+						 in  float4 iLightDirection : LIGHT_DIRECTION,   // view space
+						 in  float4 iLightColor     : LIGHT_COLOR,
+#endif
 						 out float2 oTex     : TEXCOORD0,
+#if defined(LightInstanceStream)
+						 nointerpolation out float4 oLightDirection : TEXCOORD2,
+						 nointerpolation out float4 oLightColor     : TEXCOORD3,
+#endif
+#elif defined(InstancedLightVolume)
+						 in  float3 iPos     : POSITION,
+						 in  float4 iLightPositionRadius : LIGHT_POSITION,   // view space center, attenuation end
+						 in  float4 iLightColorBegin     : LIGHT_COLOR,      // color, attenuation begin
+						 out float3 oTex     : TEXCOORD0,
+						 nointerpolation out float4 oLightPositionRadius : TEXCOORD2,
+						 nointerpolation out float4 oLightColorBegin     : TEXCOORD3,
 #elif defined(PointLight) || defined(SpotLight)   
 						 in  float3 iPos     : POSITION,
 						 out float3 oTex     : TEXCOORD0, // divide by w is wrong, w may negative, So pass the clip space coord to pixel shader
@@ -33,6 +57,23 @@ void DeferredRenderingVS(
 	float4 posVS = mul(oPos, InvProj);
 	oViewRay = float3(posVS.xy / posVS.z, 1.0f);       // Proj to Z=1 plane
 
+#if defined(LightInstanceStream)
+	oLightDirection = iLightDirection;
+	oLightColor = iLightColor;
+#endif
+
+#elif defined(InstancedLightVolume)
+
+	// The proxy is a sphere, no need to rotate it into view space
+	float3 posVS = iPos * iLightPositionRadius.w + iLightPositionRadius.xyz;
+
+	oPos = mul(float4(posVS, 1.0f), Projection);
+	oTex = float3(oPos.xy, oPos.w);
+	oViewRay = posVS;
+
+	oLightPositionRadius = iLightPositionRadius;
+	oLightColorBegin = iLightColorBegin;
+
 #elif defined(PointLight) || defined(SpotLight)   
 	
 	oPos = mul(float4(iPos, 1.0f), WorldViewProj);
@@ -1,11 +1,13 @@
 #include "Utility.hlsl"
 
 // VS Constant
+#ifndef ObjectConstantStream
 cbuffer PerOjectConstant : register(b0)
 {
 	float4x4 WorldView;
 	float4x4 WorldViewProj;
 };
+#endif
 
 // PS Constant
 cbuffer Light : register(b0)
@@ -28,6 +30,16 @@ struct ForwardVSIn
     float3 iPos       : POSITION;
     float3 iNormal    : NORMAL;
     float2 iTex       : TEXCOORD0;
+#ifdef ObjectConstantStream
+	// Same instance stream as GBufferVS
+	float4 iWorldView[4]     : WORLDVIEW;
+	float4 iWorldViewProj[4] : WORLDVIEWPROJ;
+#endif
+#ifdef LightInstanceStream
+	// The light of the draw, a stream of stride 0 gives every instance the same one
+	float4 iLightDirection   : LIGHT_DIRECTION;   // view space
+	float4 iLightColor       : LIGHT_COLOR;
+#endif
 };
 
 struct ForwardVSOut
@@ -36,17 +48,31 @@ struct ForwardVSOut
     float3 oNormal    : TEXCOORD0;
     float2 oTex       : TEXCOORD1;
 	float3 oPosVS     : TEXCOORD2;
+#ifdef LightInstanceStream
+	nointerpolation float4 oLightDirection : TEXCOORD3;
+	nointerpolation float4 oLightColor     : TEXCOORD4;
+#endif
 };
 
 ForwardVSOut ForwardVS(ForwardVSIn input)
 {
 	ForwardVSOut output;
 
+#ifdef ObjectConstantStream
+	float4x4 WorldView = float4x4(input.iWorldView[0], input.iWorldView[1], input.iWorldView[2], input.iWorldView[3]);
+	float4x4 WorldViewProj = float4x4(input.iWorldViewProj[0], input.iWorldViewProj[1], input.iWorldViewProj[2], input.iWorldViewProj[3]);
+#endif
+
 	output.oPos     = mul(float4(input.iPos, 1.0f), WorldViewProj);
 	output.oPosVS   = mul(float4(input.iPos, 1.0f), WorldView).xyz;
     output.oNormal  = mul(float4(input.iNormal, 0.0f), WorldView).xyz;
     output.oTex     = input.iTex;
 
+#ifdef LightInstanceStream
+	output.oLightDirection = input.iLightDirection;
+	output.oLightColor     = input.iLightColor;
+#endif
+
 	return output;
 }
 
@@ -54,8 +80,16 @@ float4 ForwardPS( ForwardVSOut input ) : SV_Target0
 {
 	float3 final = 0;
 
+#ifdef LightInstanceStream
+	float3 lightDirection = input.oLightDirection.xyz;
+	float3 lightColor = input.oLightColor.rgb;
+#else
+	float3 lightDirection = LightDirection;
+	float3 lightColor = LightColor;
+#endif
+
 	float3 N = normalize(input.oNormal);
-	float3 L = normalize(-LightDirection);
+	float3 L = normalize(-lightDirection);
 	
 	float nDotl = dot(L, N);
 
@@ -67,7 +101,7 @@ float4 ForwardPS( ForwardVSOut input ) : SV_Target0
 		float3 H = normalize(L + V);
 		
 		final = diffuseAlbedo + CalculateFresnel(SpecularAlbedo, L, H) * CalculateSpecularNormalized(N, H, Shininess);
-		final *= LightColor * nDotl;
+		final *= lightColor * nDotl;
 	}
 
 	final += diffuseAlbedo * float3(0.2, 0.2, 0.2);
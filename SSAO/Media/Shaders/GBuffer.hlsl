@@ -1,11 +1,13 @@
 #ifndef GBuffer_HLSL
 #define GBuffer_HLSL
 
+#ifndef ObjectConstantStream
 cbuffer PerOjectConstant : register(b0)
 {
 	float4x4 WorldView;
 	float4x4 WorldViewProj;
 };
+#endif
 
 static const float Shininess = 100.0f;
 static const float Specular = 0.2f;
@@ -38,11 +40,23 @@ void CompressUnsignedNormalToNormalsBuffer(inout float3 vNormal)
   vNormal.rgb = vNormal.rgb * .5f + .5f;
 }
 
+// The 16 byte PackedVertex of VertexCompression.h with QuantizedVertices defined. Positions are in the
+// [0, 1] box of the mesh, WorldViewProj has to include the dequantization, WorldView must not.
 struct VSInput
 {
+#ifdef QuantizedVertices
+	float4 iPos       : POSITION;
+	float2 iNormal    : NORMAL;
+#else
 	float3 iPos       : POSITION;
 	float3 iNormal    : NORMAL;
+#endif
 	float2 iTex       : TEXCOORD0;
+#ifdef ObjectConstantStream
+	// PerObjectConstants rows, one instance per draw out of the constant ring, see ConstantRing.h
+	float4 iWorldView[4]     : WORLDVIEW;
+	float4 iWorldViewProj[4] : WORLDVIEWPROJ;
+#endif
 };
 
 struct VSOutput
@@ -52,12 +66,32 @@ struct VSOutput
 	float2 oTex      : TEXCOORD0;
 };
 
+// Same as DecodeOctahedralNormal in VertexCompression.cpp
+float3 DecodeOctahedralNormal(float2 encoded)
+{
+	float3 normal = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float t = saturate(-normal.z);
+	normal.xy += normal.xy >= 0.0f ? -t.xx : t.xx;
+	return normalize(normal);
+}
+
 VSOutput GBufferVS(VSInput input)
 {
 	VSOutput output;
 
-	output.oPosCS   = mul(float4(input.iPos, 1.0f), WorldViewProj);
-    output.oNormal  = mul(input.iNormal, (float3x3)WorldView);
+#ifdef ObjectConstantStream
+	float4x4 WorldView = float4x4(input.iWorldView[0], input.iWorldView[1], input.iWorldView[2], input.iWorldView[3]);
+	float4x4 WorldViewProj = float4x4(input.iWorldViewProj[0], input.iWorldViewProj[1], input.iWorldViewProj[2], input.iWorldViewProj[3]);
+#endif
+
+#ifdef QuantizedVertices
+	float3 normal = DecodeOctahedralNormal(input.iNormal);
+#else
+	float3 normal = input.iNormal;
+#endif
+
+	output.oPosCS   = mul(float4(input.iPos.xyz, 1.0f), WorldViewProj);
+    output.oNormal  = mul(normal, (float3x3)WorldView);
     output.oTex     = input.iTex;
 
 	return output;
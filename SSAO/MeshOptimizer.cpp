@@ -0,0 +1,747 @@
+#include "DXUT.h"
+#include "MeshOptimizer.h"
+#include "SDKMeshFile.h"
+#include <ppl.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+// SDKMESH_PRIMITIVE_TYPE
+const uint32_t PrimitiveTriangleList = 0;
+
+// Forsyth's tuning, from "Linear-Speed Vertex Cache Optimisation"
+const int ForsythCacheSize = 32;
+const float CacheDecayPower = 1.5f;
+const float LastTriangleScore = 0.75f;
+const float ValenceBoostScale = 2.0f;
+const float ValenceBoostPower = 0.5f;
+
+/**
+ * Triangles using each vertex, vertex v owns Triangles[Offsets[v], Offsets[v + 1]).
+ */
+struct VertexTriangles
+{
+	std::vector<uint32_t> Offsets;
+	std::vector<uint32_t> Triangles;
+
+	void Build(const uint32_t* indices, size_t numIndices, uint32_t numVertices)
+	{
+		Offsets.assign(numVertices + 1, 0);
+		for (size_t i = 0; i < numIndices; ++i)
+			++Offsets[indices[i] + 1];
+		for (uint32_t v = 0; v < numVertices; ++v)
+			Offsets[v + 1] += Offsets[v];
+
+		std::vector<uint32_t> fill(Offsets.begin(), Offsets.end() - 1);
+		Triangles.resize(numIndices);
+		for (size_t i = 0; i < numIndices; ++i)
+			Triangles[fill[indices[i]]++] = uint32_t(i / 3);
+	}
+
+	uint32_t Count(uint32_t vertex) const           { return Offsets[vertex + 1] - Offsets[vertex]; }
+};
+
+/**
+ * FIFO cache by timestamps: a vertex is cached while fewer than cacheSize vertices were loaded after it.
+ * Returns the misses of one triangle.
+ */
+inline int SimulateTriangle(const uint32_t* triangle, std::vector<uint32_t>& cacheTime, uint32_t& time, int cacheSize)
+{
+	int misses = 0;
+	for (int c = 0; c < 3; ++c)
+	{
+		if (time - cacheTime[triangle[c]] > uint32_t(cacheSize))
+		{
+			cacheTime[triangle[c]] = time++;
+			++misses;
+		}
+	}
+	return misses;
+}
+
+// Tipsify's fallback when the fan ends: the latest vertex still used by a triangle, else the next in order
+uint32_t SkipDeadEnd(const std::vector<uint32_t>& live, std::vector<uint32_t>& deadEnd, uint32_t& cursor)
+{
+	while (!deadEnd.empty())
+	{
+		const uint32_t vertex = deadEnd.back();
+		deadEnd.pop_back();
+		if (live[vertex])
+			return vertex;
+	}
+
+	for (; cursor < live.size(); ++cursor)
+	{
+		if (live[cursor])
+			return cursor;
+	}
+	return InvalidIndex;
+}
+
+float ForsythVertexScore(int cachePosition, uint32_t live)
+{
+	// No triangles left to draw with it
+	if (live == 0)
+		return -1.0f;
+
+	float score = 0;
+	if (cachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score so the next one doesn't just fan around them
+		if (cachePosition < 3)
+			score = LastTriangleScore;
+		else
+			score = powf(1.0f - float(cachePosition - 3) / (ForsythCacheSize - 3), CacheDecayPower);
+	}
+
+	// Get rid of vertices with few triangles left, lone triangles get expensive later on
+	return score + ValenceBoostScale * powf(float(live), -ValenceBoostPower);
+}
+
+inline D3DXVECTOR3 ReadPosition(const uint8_t* positions, size_t stride, uint32_t vertex)
+{
+	D3DXVECTOR3 position;
+	memcpy(&position, positions + vertex * stride, sizeof(position));
+	return position;
+}
+
+/**
+ * A subset's range of an index buffer, what the optimizer reorders. Subsets drawing the same range with the
+ * same base vertex share one.
+ */
+struct SubsetRange
+{
+	uint32_t Mesh;
+	uint32_t IndexBuffer;
+	uint32_t VertexBuffer;      // Stream 0
+	uint64_t IndexStart;
+	uint64_t IndexCount;
+	uint64_t VertexStart;
+	uint32_t NumVertices;       // Highest index + 1
+	bool Skipped;
+
+	bool SameDraw(const SubsetRange& other) const
+	{
+		return IndexBuffer == other.IndexBuffer && IndexStart == other.IndexStart && IndexCount == other.IndexCount &&
+			VertexStart == other.VertexStart && VertexBuffer == other.VertexBuffer;
+	}
+
+	bool operator<(const SubsetRange& other) const
+	{
+		if (IndexBuffer != other.IndexBuffer) return IndexBuffer < other.IndexBuffer;
+		if (IndexStart != other.IndexStart) return IndexStart < other.IndexStart;
+		if (IndexCount != other.IndexCount) return IndexCount < other.IndexCount;
+		if (VertexStart != other.VertexStart) return VertexStart < other.VertexStart;
+		return VertexBuffer < other.VertexBuffer;
+	}
+};
+
+void ReadIndices(const uint8_t* data, const SDKMeshIndexBuffer& buffer, const SubsetRange& range, std::vector<uint32_t>& indices)
+{
+	indices.resize(size_t(range.IndexCount));
+	if (buffer.IndexType == SDKMeshIndex_16Bit)
+	{
+		const uint16_t* source = reinterpret_cast<const uint16_t*>(data + buffer.DataOffset) + range.IndexStart;
+		std::copy(source, source + range.IndexCount, indices.begin());
+	}
+	else
+	{
+		const uint32_t* source = reinterpret_cast<const uint32_t*>(data + buffer.DataOffset) + range.IndexStart;
+		std::copy(source, source + range.IndexCount, indices.begin());
+	}
+}
+
+void WriteIndices(uint8_t* data, const SDKMeshIndexBuffer& buffer, const SubsetRange& range, const std::vector<uint32_t>& indices)
+{
+	// Only reordered or renumbered within the range, 16 bit indices still fit
+	if (buffer.IndexType == SDKMeshIndex_16Bit)
+	{
+		uint16_t* destination = reinterpret_cast<uint16_t*>(data + buffer.DataOffset) + range.IndexStart;
+		for (size_t i = 0; i < indices.size(); ++i)
+			destination[i] = uint16_t(indices[i]);
+	}
+	else
+		std::copy(indices.begin(), indices.end(), reinterpret_cast<uint32_t*>(data + buffer.DataOffset) + range.IndexStart);
+}
+
+// The data of every buffer in bytes of its own. Both passes write the file in place, in parallel, and read
+// back what they wrote
+bool BuffersDisjoint(const ArrayView<SDKMeshVertexBuffer>& vertexBuffers, const ArrayView<SDKMeshIndexBuffer>& indexBuffers)
+{
+	// Validate checked them against the file size, the ends don't wrap
+	std::vector<std::pair<uint64_t, uint64_t> > ranges;
+	for (size_t i = 0; i < vertexBuffers.Size; ++i)
+	{
+		if (vertexBuffers[i].SizeBytes)
+			ranges.push_back(std::make_pair(vertexBuffers[i].DataOffset, vertexBuffers[i].DataOffset + vertexBuffers[i].SizeBytes));
+	}
+	for (size_t i = 0; i < indexBuffers.Size; ++i)
+	{
+		if (indexBuffers[i].SizeBytes)
+			ranges.push_back(std::make_pair(indexBuffers[i].DataOffset, indexBuffers[i].DataOffset + indexBuffers[i].SizeBytes));
+	}
+
+	std::sort(ranges.begin(), ranges.end());
+	for (size_t i = 1; i < ranges.size(); ++i)
+	{
+		if (ranges[i].first < ranges[i - 1].second)
+			return false;
+	}
+
+	return true;
+}
+
+void AddStatistics(VertexCacheStatistics& total, const VertexCacheStatistics& statistics)
+{
+	total.NumTriangles += statistics.NumTriangles;
+	total.NumVertices += statistics.NumVertices;
+	total.NumMisses += statistics.NumMisses;
+}
+
+}
+
+VertexCacheStatistics AnalyzeVertexCache( const uint32_t* indices, size_t numIndices, uint32_t numVertices, int cacheSize )
+{
+	VertexCacheStatistics result = { uint32_t(numIndices / 3), 0, 0 };
+
+	// Load time of each vertex, 0 for never loaded
+	std::vector<uint32_t> loadedAt(numVertices, 0);
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		const uint32_t vertex = indices[i];
+		result.NumVertices += loadedAt[vertex] == 0;
+
+		if (loadedAt[vertex] == 0 || result.NumMisses - loadedAt[vertex] >= uint32_t(cacheSize))
+			loadedAt[vertex] = ++result.NumMisses;
+	}
+
+	return result;
+}
+
+void OptimizeVertexCacheTipsify( uint32_t* destination, const uint32_t* indices, size_t numIndices, uint32_t numVertices, int cacheSize )
+{
+	const size_t numTriangles = numIndices / 3;
+
+	VertexTriangles adjacency;
+	adjacency.Build(indices, numTriangles * 3, numVertices);
+
+	// Triangles not emitted yet per vertex
+	std::vector<uint32_t> live(numVertices);
+	for (uint32_t v = 0; v < numVertices; ++v)
+		live[v] = adjacency.Count(v);
+
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	std::vector<uint8_t> emitted(numTriangles, 0);
+	std::vector<uint32_t> deadEnd, candidates;
+
+	uint32_t time = cacheSize + 1;
+	uint32_t cursor = 0;
+
+	uint32_t fanning = SkipDeadEnd(live, deadEnd, cursor);
+	while (fanning != InvalidIndex)
+	{
+		// Emit every triangle left around the fanning vertex
+		candidates.clear();
+		for (uint32_t k = adjacency.Offsets[fanning]; k < adjacency.Offsets[fanning + 1]; ++k)
+		{
+			const uint32_t triangle = adjacency.Triangles[k];
+			if (emitted[triangle])
+				continue;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				const uint32_t vertex = indices[triangle * 3 + c];
+				*destination++ = vertex;
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				--live[vertex];
+
+				if (time - cacheTime[vertex] > uint32_t(cacheSize))
+					cacheTime[vertex] = time++;
+			}
+			emitted[triangle] = 1;
+		}
+
+		// Next fan around the oldest vertex that will still be cached after its triangles are emitted
+		int bestPriority = -1;
+		fanning = InvalidIndex;
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			const uint32_t vertex = candidates[i];
+			if (!live[vertex])
+				continue;
+
+			int priority = 0;
+			if (int(time - cacheTime[vertex] + 2 * live[vertex]) <= cacheSize)
+				priority = int(time - cacheTime[vertex]);
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = vertex;
+			}
+		}
+
+		if (fanning == InvalidIndex)
+			fanning = SkipDeadEnd(live, deadEnd, cursor);
+	}
+}
+
+void OptimizeVertexCacheForsyth( uint32_t* destination, const uint32_t* indices, size_t numIndices, uint32_t numVertices )
+{
+	const uint32_t numTriangles = uint32_t(numIndices / 3);
+	if (numTriangles == 0)
+		return;
+
+	VertexTriangles adjacency;
+	adjacency.Build(indices, numTriangles * 3, numVertices);
+
+	// Triangles not emitted yet per vertex, they are kept at the front of the vertex's adjacency list
+	std::vector<uint32_t> live(numVertices);
+	std::vector<int> cachePosition(numVertices, -1);
+	std::vector<float> vertexScore(numVertices);
+	for (uint32_t v = 0; v < numVertices; ++v)
+	{
+		live[v] = adjacency.Count(v);
+		vertexScore[v] = ForsythVertexScore(-1, live[v]);
+	}
+
+	std::vector<float> triangleScore(numTriangles);
+	std::vector<uint8_t> emitted(numTriangles, 0);
+	uint32_t best = 0;
+	for (uint32_t t = 0; t < numTriangles; ++t)
+	{
+		const uint32_t* triangle = indices + t * 3;
+		triangleScore[t] = vertexScore[triangle[0]] + vertexScore[triangle[1]] + vertexScore[triangle[2]];
+		if (triangleScore[t] > triangleScore[best])
+			best = t;
+	}
+
+	// LRU order, with room for the three vertices pushed in front
+	uint32_t cache[ForsythCacheSize + 3], newCache[ForsythCacheSize + 3];
+	int cacheCount = 0;
+	uint32_t cursor = 0;
+
+	for (uint32_t n = 0; n < numTriangles; ++n)
+	{
+		// Nothing in the cache has triangles left, continue in input order
+		if (best == InvalidIndex)
+		{
+			while (emitted[cursor])
+				++cursor;
+			best = cursor;
+		}
+
+		const uint32_t* triangle = indices + best * 3;
+		destination[n * 3 + 0] = triangle[0];
+		destination[n * 3 + 1] = triangle[1];
+		destination[n * 3 + 2] = triangle[2];
+		emitted[best] = 1;
+
+		int newCount = 0;
+		for (int c = 0; c < 3; ++c)
+		{
+			const uint32_t vertex = triangle[c];
+			uint32_t* triangles = &adjacency.Triangles[adjacency.Offsets[vertex]];
+			for (uint32_t k = 0; k < live[vertex]; ++k)
+			{
+				if (triangles[k] == best)
+				{
+					triangles[k] = triangles[--live[vertex]];
+					break;
+				}
+			}
+
+			if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount)
+				newCache[newCount++] = vertex;
+		}
+
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				newCache[newCount++] = cache[i];
+		}
+
+		// Pushed out vertices lose their cache score
+		for (int i = 0; i < newCount; ++i)
+		{
+			const uint32_t vertex = newCache[i];
+			cachePosition[vertex] = i < ForsythCacheSize ? i : -1;
+			vertexScore[vertex] = ForsythVertexScore(cachePosition[vertex], live[vertex]);
+		}
+
+		cacheCount = (std::min)(newCount, ForsythCacheSize);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		// Only triangles around the cache changed score, the best of them goes next
+		float bestScore = -1.0f;
+		best = InvalidIndex;
+		for (int i = 0; i < cacheCount; ++i)
+		{
+			const uint32_t vertex = cache[i];
+			const uint32_t* triangles = &adjacency.Triangles[adjacency.Offsets[vertex]];
+			for (uint32_t k = 0; k < live[vertex]; ++k)
+			{
+				const uint32_t t = triangles[k];
+				const uint32_t* other = indices + t * 3;
+				triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+		}
+	}
+}
+
+void OptimizeOverdraw( uint32_t* destination, const uint32_t* indices, size_t numIndices, const uint8_t* positions,
+	                   size_t positionStride, uint32_t numVertices, int cacheSize, float threshold )
+{
+	const uint32_t numTriangles = uint32_t(numIndices / 3);
+	if (numTriangles == 0)
+		return;
+
+	std::vector<uint32_t> cacheTime(numVertices, 0);
+	uint32_t time = cacheSize + 1;
+
+	// Hard boundaries where a triangle misses all its vertices, the cache was flushed there anyway
+	std::vector<uint32_t> hardClusters;
+	for (uint32_t t = 0; t < numTriangles; ++t)
+	{
+		if (SimulateTriangle(indices + t * 3, cacheTime, time, cacheSize) == 3 || t == 0)
+			hardClusters.push_back(t);
+	}
+	hardClusters.push_back(numTriangles);
+
+	// Soft boundaries inside them, as soon as the cluster's running ACMR is within threshold of the whole one
+	std::vector<uint32_t> clusters;
+	for (size_t h = 0; h + 1 < hardClusters.size(); ++h)
+	{
+		const uint32_t start = hardClusters[h], end = hardClusters[h + 1];
+
+		time += cacheSize + 1;
+		int clusterMisses = 0;
+		for (uint32_t t = start; t < end; ++t)
+			clusterMisses += SimulateTriangle(indices + t * 3, cacheTime, time, cacheSize);
+		const float clusterThreshold = threshold * clusterMisses / (end - start);
+
+		time += cacheSize + 1;
+		clusters.push_back(start);
+
+		int runningMisses = 0, runningTriangles = 0;
+		for (uint32_t t = start; t + 1 < end; ++t)
+		{
+			runningMisses += SimulateTriangle(indices + t * 3, cacheTime, time, cacheSize);
+			++runningTriangles;
+
+			if (runningMisses <= clusterThreshold * runningTriangles)
+			{
+				clusters.push_back(t + 1);
+				time += cacheSize + 1;
+				runningMisses = runningTriangles = 0;
+			}
+		}
+	}
+
+	const size_t numClusters = clusters.size();
+	clusters.push_back(numTriangles);
+
+	// Area weighted centroid and normal of each cluster and of the whole mesh
+	std::vector<D3DXVECTOR3> clusterCentroids(numClusters), clusterNormals(numClusters);
+	D3DXVECTOR3 meshCentroid(0, 0, 0);
+	float meshArea = 0;
+
+	for (size_t c = 0; c < numClusters; ++c)
+	{
+		D3DXVECTOR3 centroid(0, 0, 0), normal(0, 0, 0);
+		float area = 0;
+
+		for (uint32_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const D3DXVECTOR3 p0 = ReadPosition(positions, positionStride, indices[t * 3 + 0]);
+			const D3DXVECTOR3 p1 = ReadPosition(positions, positionStride, indices[t * 3 + 1]);
+			const D3DXVECTOR3 p2 = ReadPosition(positions, positionStride, indices[t * 3 + 2]);
+
+			const D3DXVECTOR3 edge1 = p1 - p0, edge2 = p2 - p0;
+			D3DXVECTOR3 cross;
+			D3DXVec3Cross(&cross, &edge1, &edge2);
+
+			const float triangleArea = D3DXVec3Length(&cross);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += cross;
+			area += triangleArea;
+		}
+
+		meshCentroid += centroid;
+		meshArea += area;
+
+		clusterCentroids[c] = area > 0 ? centroid / area : centroid;
+		D3DXVec3Normalize(&clusterNormals[c], &normal);
+	}
+
+	if (meshArea > 0)
+		meshCentroid /= meshArea;
+
+	// Clusters facing away from the center are drawn first, they are the ones likely to occlude the others
+	std::vector<float> sortKeys(numClusters);
+	std::vector<uint32_t> order(numClusters);
+	for (size_t c = 0; c < numClusters; ++c)
+	{
+		const D3DXVECTOR3 offset = clusterCentroids[c] - meshCentroid;
+		sortKeys[c] = D3DXVec3Dot(&offset, &clusterNormals[c]);
+		order[c] = uint32_t(c);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	for (size_t c = 0; c < numClusters; ++c)
+	{
+		const uint32_t* begin = indices + clusters[order[c]] * 3;
+		destination = std::copy(begin, indices + clusters[order[c] + 1] * 3, destination);
+	}
+}
+
+uint32_t BuildVertexFetchRemap( uint32_t* remap, const uint32_t* indices, size_t numIndices, uint32_t numVertices )
+{
+	std::fill(remap, remap + numVertices, InvalidIndex);
+
+	uint32_t next = 0;
+	for (size_t i = 0; i < numIndices; ++i)
+	{
+		if (remap[indices[i]] == InvalidIndex)
+			remap[indices[i]] = next++;
+	}
+
+	const uint32_t numReferenced = next;
+	for (uint32_t v = 0; v < numVertices; ++v)
+	{
+		if (remap[v] == InvalidIndex)
+			remap[v] = next++;
+	}
+
+	return numReferenced;
+}
+
+bool OptimizeSDKMesh( uint8_t* data, uint64_t size, int cacheSize, SDKMeshOptimizeStatistics* statistics )
+{
+	SDKMeshFile file;
+	if (!file.OpenMemory(data, size))
+		return false;
+
+	const ArrayView<SDKMeshVertexBuffer> vertexBuffers = file.GetVertexBuffers();
+	const ArrayView<SDKMeshIndexBuffer> indexBuffers = file.GetIndexBuffers();
+	const ArrayView<SDKMeshMesh> meshes = file.GetMeshes();
+	const ArrayView<SDKMeshSubset> subsets = file.GetSubsets();
+
+	// Shared or overlapping data is fine to draw, but not to rewrite
+	if (!BuffersDisjoint(vertexBuffers, indexBuffers))
+		return false;
+
+	SDKMeshOptimizeStatistics result;
+	memset(&result, 0, sizeof(result));
+
+	// Vertex buffers that are one of several streams of a mesh, renumbering would need all streams at once
+	std::vector<bool> multiStream(vertexBuffers.Size, false);
+
+	std::vector<SubsetRange> ranges;
+	for (uint32_t m = 0; m < meshes.Size; ++m)
+	{
+		const SDKMeshMesh& mesh = meshes[m];
+		for (uint32_t s = 0; mesh.NumVertexBuffers > 1 && s < mesh.NumVertexBuffers; ++s)
+			multiStream[mesh.VertexBuffers[s]] = true;
+
+		const ArrayView<uint32_t> meshSubsets = file.GetMeshSubsets(m);
+		for (size_t s = 0; s < meshSubsets.Size; ++s)
+		{
+			const SDKMeshSubset& subset = subsets[meshSubsets[s]];
+			if (subset.IndexCount == 0)
+				continue;
+
+			SubsetRange range = { m, mesh.IndexBuffer, mesh.VertexBuffers[0], subset.IndexStart, subset.IndexCount, subset.VertexStart, 0,
+				subset.PrimitiveType != PrimitiveTriangleList || subset.IndexCount % 3 != 0 };
+			ranges.push_back(range);
+		}
+	}
+
+	std::sort(ranges.begin(), ranges.end());
+	ranges.erase(std::unique(ranges.begin(), ranges.end(), [](const SubsetRange& a, const SubsetRange& b) { return a.SameDraw(b); }), ranges.end());
+
+	// Overlapping ranges, or one range drawn with different base vertices, can't be reordered on their own
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		for (size_t j = i + 1; j < ranges.size() && ranges[j].IndexBuffer == ranges[i].IndexBuffer &&
+			ranges[j].IndexStart < ranges[i].IndexStart + ranges[i].IndexCount; ++j)
+		{
+			ranges[i].Skipped = ranges[j].Skipped = true;
+		}
+	}
+
+	std::vector<VertexCacheStatistics> before(ranges.size()), after(ranges.size());
+
+	// Ranges are disjoint now, big files have many subsets
+	Concurrency::parallel_for(size_t(0), ranges.size(), [&](size_t r) {
+		SubsetRange& range = ranges[r];
+		if (range.Skipped)
+			return;
+
+		std::vector<uint32_t> indices, optimized, clustered;
+		ReadIndices(data, indexBuffers[range.IndexBuffer], range, indices);
+		range.NumVertices = *std::max_element(indices.begin(), indices.end()) + 1;
+
+		// Indices aren't validated against the buffers, every stream has to have the vertices
+		const SDKMeshMesh& mesh = meshes[range.Mesh];
+		for (uint32_t s = 0; s < mesh.NumVertexBuffers; ++s)
+			range.Skipped |= range.VertexStart + range.NumVertices > vertexBuffers[mesh.VertexBuffers[s]].NumVertices;
+		if (range.Skipped)
+			return;
+
+		optimized.resize(indices.size());
+		OptimizeVertexCacheTipsify(&optimized[0], &indices[0], indices.size(), range.NumVertices, cacheSize);
+
+		const int positionOffset = file.GetPositionOffset(range.VertexBuffer);
+		if (positionOffset >= 0)
+		{
+			const SDKMeshVertexBuffer& vertexBuffer = vertexBuffers[range.VertexBuffer];
+			const uint8_t* positions = data + vertexBuffer.DataOffset + range.VertexStart * vertexBuffer.StrideBytes + positionOffset;
+
+			clustered.resize(indices.size());
+			OptimizeOverdraw(&clustered[0], &optimized[0], optimized.size(), positions, size_t(vertexBuffer.StrideBytes),
+				range.NumVertices, cacheSize);
+			optimized.swap(clustered);
+		}
+
+		before[r] = after[r] = AnalyzeVertexCache(&indices[0], indices.size(), range.NumVertices, cacheSize);
+
+		// Meshes the exporter already optimized can come out a little worse, keep those as they are
+		const VertexCacheStatistics optimizedStatistics = AnalyzeVertexCache(&optimized[0], optimized.size(), range.NumVertices, cacheSize);
+		if (optimizedStatistics.NumMisses < before[r].NumMisses)
+		{
+			after[r] = optimizedStatistics;
+			WriteIndices(data, indexBuffers[range.IndexBuffer], range, optimized);
+		}
+	});
+
+	for (size_t r = 0; r < ranges.size(); ++r)
+	{
+		if (ranges[r].Skipped)
+		{
+			++result.NumSkippedSubsets;
+			continue;
+		}
+
+		++result.NumSubsets;
+		AddStatistics(result.Before, before[r]);
+		AddStatistics(result.After, after[r]);
+	}
+
+	// Renumber the vertices of each buffer in fetch order. Subsets with the same base vertex are renumbered
+	// together, the groups have to use disjoint parts of the buffer. A buffer is renumbered only when none of
+	// its ranges was skipped, the index ranges it rewrites are then its own and the buffers can go in parallel.
+	enum RenumberResult { Renumber_Unused, Renumber_Done, Renumber_Skipped };
+	std::vector<RenumberResult> renumbered(vertexBuffers.Size, Renumber_Unused);
+
+	Concurrency::parallel_for(uint32_t(0), uint32_t(vertexBuffers.Size), [&](uint32_t vb) {
+		std::vector<SubsetRange*> users;
+		bool skipped = multiStream[vb];
+		for (size_t r = 0; r < ranges.size(); ++r)
+		{
+			if (ranges[r].VertexBuffer == vb)
+			{
+				users.push_back(&ranges[r]);
+				skipped |= ranges[r].Skipped;
+			}
+		}
+
+		if (users.empty())
+			return;
+
+		std::stable_sort(users.begin(), users.end(), [](const SubsetRange* a, const SubsetRange* b) { return a->VertexStart < b->VertexStart; });
+
+		std::vector<size_t> groups;
+		uint64_t groupEnd = 0;
+		for (size_t u = 0; u < users.size() && !skipped; ++u)
+		{
+			if (u == 0 || users[u]->VertexStart != users[u - 1]->VertexStart)
+			{
+				skipped |= users[u]->VertexStart < groupEnd;
+				groups.push_back(u);
+			}
+			groupEnd = (std::max)(groupEnd, users[u]->VertexStart + users[u]->NumVertices);
+		}
+
+		if (skipped)
+		{
+			renumbered[vb] = Renumber_Skipped;
+			return;
+		}
+
+		groups.push_back(users.size());
+
+		const SDKMeshVertexBuffer& vertexBuffer = vertexBuffers[vb];
+		const size_t stride = size_t(vertexBuffer.StrideBytes);
+		uint8_t* vertices = data + vertexBuffer.DataOffset;
+
+		std::vector<uint32_t> groupIndices, indices, remap;
+		std::vector<uint8_t> groupVertices;
+		for (size_t g = 0; g + 1 < groups.size(); ++g)
+		{
+			uint32_t numVertices = 0;
+			groupIndices.clear();
+			for (size_t u = groups[g]; u < groups[g + 1]; ++u)
+			{
+				ReadIndices(data, indexBuffers[users[u]->IndexBuffer], *users[u], indices);
+				groupIndices.insert(groupIndices.end(), indices.begin(), indices.end());
+				numVertices = (std::max)(numVertices, users[u]->NumVertices);
+			}
+
+			// NumVertices is from the first pass, before anything is moved make sure the indices still fit it
+			bool inRange = true;
+			for (size_t i = 0; i < groupIndices.size(); ++i)
+				inRange &= groupIndices[i] < numVertices;
+
+			if (!inRange)
+			{
+				renumbered[vb] = Renumber_Skipped;
+				return;
+			}
+
+			remap.resize(numVertices);
+			BuildVertexFetchRemap(&remap[0], &groupIndices[0], groupIndices.size(), numVertices);
+
+			uint8_t* groupStart = vertices + users[groups[g]]->VertexStart * stride;
+			groupVertices.assign(groupStart, groupStart + numVertices * stride);
+			for (uint32_t v = 0; v < numVertices; ++v)
+				memcpy(groupStart + remap[v] * stride, &groupVertices[v * stride], stride);
+
+			// The indices as checked above, not read again after the vertices moved
+			size_t first = 0;
+			for (size_t u = groups[g]; u < groups[g + 1]; ++u)
+			{
+				indices.resize(size_t(users[u]->IndexCount));
+				for (size_t i = 0; i < indices.size(); ++i)
+					indices[i] = remap[groupIndices[first + i]];
+				first += indices.size();
+
+				WriteIndices(data, indexBuffers[users[u]->IndexBuffer], *users[u], indices);
+			}
+		}
+
+		renumbered[vb] = Renumber_Done;
+	});
+
+	for (size_t vb = 0; vb < renumbered.size(); ++vb)
+	{
+		result.NumVertexBuffers += renumbered[vb] == Renumber_Done;
+		result.NumSkippedVertexBuffers += renumbered[vb] == Renumber_Skipped;
+	}
+
+	if (statistics)
+		*statistics = result;
+
+	return true;
+}
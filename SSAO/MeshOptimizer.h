@@ -0,0 +1,75 @@
+#ifndef MeshOptimizer_h__
+#define MeshOptimizer_h__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Index and vertex reordering for GPU friendly triangle lists.
+ *
+ * The pipeline from Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw":
+ * Tipsify orders triangles for the post transform vertex cache, the result is cut into clusters where the
+ * cache would have been flushed anyway, and the clusters are sorted outside in so the triangles facing away
+ * from the mesh center, the ones likely to be occluded, come last. Finally the vertices are renumbered in
+ * order of first use so the fetches stream through the vertex buffer. Forsyth's linear speed optimizer is
+ * there too, as the cache only alternative that doesn't need to know the cache size.
+ *
+ * All functions work on 32 bit triangle list indices and never change the set of triangles or their winding.
+ */
+
+// Cache misses of a triangle list through a FIFO post transform cache of cacheSize vertices.
+struct VertexCacheStatistics
+{
+	uint32_t NumTriangles;
+	uint32_t NumVertices;   // Distinct vertices referenced
+	uint32_t NumMisses;     // Vertices transformed
+
+	// Average cache miss ratio, misses per triangle, 0.5 at best for large regular meshes and 3 at worst
+	float ACMR() const      { return NumTriangles ? float(NumMisses) / NumTriangles : 0; }
+
+	// Average transform to vertex ratio, 1 means each vertex is transformed only once
+	float ATVR() const      { return NumVertices ? float(NumMisses) / NumVertices : 0; }
+};
+
+// Pre DX11 hardware has 16 to 24 entries, newer parts batch differently but still reward the same locality.
+const int DefaultVertexCacheSize = 16;
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t* indices, size_t numIndices, uint32_t numVertices, int cacheSize);
+
+// Tipsify, destination receives the reordered indices and must not alias indices.
+void OptimizeVertexCacheTipsify(uint32_t* destination, const uint32_t* indices, size_t numIndices, uint32_t numVertices,
+	                            int cacheSize = DefaultVertexCacheSize);
+
+// Forsyth's scoring over a simulated 32 entry LRU cache, destination must not alias indices.
+void OptimizeVertexCacheForsyth(uint32_t* destination, const uint32_t* indices, size_t numIndices, uint32_t numVertices);
+
+// Reorder the clusters of an already cache optimized list for less overdraw. positions are float3 found every
+// positionStride bytes. threshold is how much the ACMR of a cluster may grow over the list's, 1.05 costs a few
+// percent of the cache gain.
+void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t numIndices, const uint8_t* positions,
+	                  size_t positionStride, uint32_t numVertices, int cacheSize = DefaultVertexCacheSize, float threshold = 1.05f);
+
+// remap[old] = new vertex, in order of first use with the unreferenced vertices at the end in their old order.
+// Returns the number of referenced vertices.
+uint32_t BuildVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t numIndices, uint32_t numVertices);
+
+struct SDKMeshOptimizeStatistics
+{
+	VertexCacheStatistics Before;
+	VertexCacheStatistics After;
+
+	uint32_t NumSubsets;                  // Triangle list subsets reordered
+	uint32_t NumSkippedSubsets;           // Other topologies, overlapping index ranges, out of range indices
+	uint32_t NumVertexBuffers;            // Vertex buffers renumbered in fetch order
+	uint32_t NumSkippedVertexBuffers;     // Shared by multi stream meshes, skipped subsets or overlapping ranges
+};
+
+/**
+ * Run the whole pipeline on every subset of a .sdkmesh file image in place, e.g. the buffer CDXUTSDKMesh is
+ * about to be created from. Subsets keep their index ranges and VertexStart, their vertex ranges are renumbered
+ * only when the subsets sharing a vertex buffer use disjoint ranges of it. Returns false, leaving the data
+ * untouched, if the file isn't a valid sdkmesh.
+ */
+bool OptimizeSDKMesh(uint8_t* data, uint64_t size, int cacheSize = DefaultVertexCacheSize, SDKMeshOptimizeStatistics* statistics = NULL);
+
+#endif // MeshOptimizer_h__
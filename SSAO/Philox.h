@@ -0,0 +1,62 @@
+#ifndef Philox_h__
+#define Philox_h__
+
+#include <cstdint>
+
+/**
+ * Philox4x32-10 counter based random number generator (Salmon et al., "Parallel Random Numbers: As Easy
+ * as 1, 2, 3"). Every (counter, key) pair maps to four independent 32 bit numbers with no state in
+ * between, so work items can draw their numbers from their own counter in any order or on any thread.
+ */
+struct Philox4x32
+{
+	uint32_t Key[2];
+
+	Philox4x32(uint32_t key0, uint32_t key1 = 0)
+	{
+		Key[0] = key0;
+		Key[1] = key1;
+	}
+
+	void Generate(const uint32_t counter[4], uint32_t result[4]) const
+	{
+		uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+		uint32_t k0 = Key[0], k1 = Key[1];
+
+		for (int round = 0; round < 10; ++round)
+		{
+			const uint64_t product0 = uint64_t(0xD2511F53) * c0;
+			const uint64_t product1 = uint64_t(0xCD9E8D57) * c2;
+
+			const uint32_t n0 = uint32_t(product1 >> 32) ^ c1 ^ k0;
+			const uint32_t n2 = uint32_t(product0 >> 32) ^ c3 ^ k1;
+			c1 = uint32_t(product1);
+			c3 = uint32_t(product0);
+			c0 = n0;
+			c2 = n2;
+
+			// Weyl sequence key schedule
+			k0 += 0x9E3779B9;
+			k1 += 0xBB67AE85;
+		}
+
+		result[0] = c0;
+		result[1] = c1;
+		result[2] = c2;
+		result[3] = c3;
+	}
+
+	void Generate(uint32_t counter0, uint32_t counter1, uint32_t counter2, uint32_t counter3, uint32_t result[4]) const
+	{
+		const uint32_t counter[4] = { counter0, counter1, counter2, counter3 };
+		Generate(counter, result);
+	}
+
+	// Uniform float in [0, 1) from the top 24 bits
+	static float ToFloat(uint32_t bits)
+	{
+		return float(bits >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+#endif // Philox_h__
@@ -0,0 +1,181 @@
+#include "PortableBenchmark.h"
+#include "VectorMath.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+// Same camera setup as Main.cpp
+const float CameraNear = 0.5f;
+const float CameraFar = 300.0f;
+
+void Log(BenchmarkLogFunction log, const char* format, ...)
+{
+	char buffer[1024];
+
+	va_list args;
+	va_start(args, format);
+	vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+
+	log(buffer);
+}
+
+double Now()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Reference row vector product, what the SIMD versions are checked against
+void ScalarMatrixMultiply(const Float4x4& a, const Float4x4& b, Float4x4& result)
+{
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+			result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+	}
+}
+
+}
+
+void BenchmarkMatrixChain( BenchmarkLogFunction log )
+{
+	const int NumObjects = 100000;
+	const int NumIterations = 20;
+
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> positionDist(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * D3DX_PI);
+	std::uniform_real_distribution<float> scaleDist(0.5f, 2.0f);
+
+	// World matrices from scale, rotation and translation, as the scene objects would have them
+	std::vector<Float4x4> world(NumObjects);
+	std::vector<Float3> points(NumObjects);
+	for (int i = 0; i < NumObjects; ++i)
+	{
+		const Quaternion rotation = QuaternionRotationAxis(Float3(positionDist(rng), positionDist(rng), positionDist(rng)), angleDist(rng));
+		const float scale = scaleDist(rng);
+		world[i] = MatrixScaling(scale, scale, scale) * MatrixRotationQuaternion(rotation) * 
+			MatrixTranslation(positionDist(rng), positionDist(rng), positionDist(rng));
+		points[i] = Float3(positionDist(rng), positionDist(rng), positionDist(rng));
+	}
+
+	const Float4x4 view = MatrixLookAtLH(Float3(0.0f, 50.0f, -300.0f), Float3(0.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f));
+	const Float4x4 proj = MatrixPerspectiveFovLH(D3DX_PI / 4, 16.0f / 9.0f, CameraNear, CameraFar);
+
+	std::vector<Float4x4> scalarResult(NumObjects), simdResult(NumObjects), batchResult(NumObjects);
+	std::vector<Float3> scalarPoints(NumObjects), simdPoints(NumObjects);
+
+	double scalarTime = 0, simdTime = 0, batchTime = 0, scalarPointTime = 0, simdPointTime = 0;
+
+	for (int iteration = 0; iteration < NumIterations; ++iteration)
+	{
+		// world * view * projection per object
+		double start = Now();
+		for (int i = 0; i < NumObjects; ++i)
+		{
+			Float4x4 worldView;
+			ScalarMatrixMultiply(world[i], view, worldView);
+			ScalarMatrixMultiply(worldView, proj, scalarResult[i]);
+		}
+		scalarTime += Now() - start;
+
+		start = Now();
+		for (int i = 0; i < NumObjects; ++i)
+			simdResult[i] = world[i] * view * proj;
+		simdTime += Now() - start;
+
+		// Same chain with view * projection folded first and one batched product per object
+		start = Now();
+		MatrixMultiplyArray(&world[0], &batchResult[0], NumObjects, view * proj);
+		batchTime += Now() - start;
+
+		const Float4x4 viewProj = view * proj;
+
+		start = Now();
+		for (int i = 0; i < NumObjects; ++i)
+		{
+			const Float3& p = points[i];
+			const float w = p.x * viewProj._14 + p.y * viewProj._24 + p.z * viewProj._34 + viewProj._44;
+			scalarPoints[i] = Float3(
+				(p.x * viewProj._11 + p.y * viewProj._21 + p.z * viewProj._31 + viewProj._41) / w,
+				(p.x * viewProj._12 + p.y * viewProj._22 + p.z * viewProj._32 + viewProj._42) / w,
+				(p.x * viewProj._13 + p.y * viewProj._23 + p.z * viewProj._33 + viewProj._43) / w);
+		}
+		scalarPointTime += Now() - start;
+
+		start = Now();
+		Vec3TransformCoordArray(&points[0], &simdPoints[0], NumObjects, viewProj);
+		simdPointTime += Now() - start;
+	}
+
+	// Relative to the largest element, the SIMD chain rounds in the same order so it should match closely
+	float maxError = 0, maxBatchError = 0, maxPointError = 0;
+	for (int i = 0; i < NumObjects; ++i)
+	{
+		float magnitude = 1.0f;
+		for (int e = 0; e < 16; ++e)
+			magnitude = (std::max)(magnitude, fabsf(scalarResult[i][e]));
+
+		for (int e = 0; e < 16; ++e)
+		{
+			maxError = (std::max)(maxError, fabsf(simdResult[i][e] - scalarResult[i][e]) / magnitude);
+			maxBatchError = (std::max)(maxBatchError, fabsf(batchResult[i][e] - scalarResult[i][e]) / magnitude);
+		}
+
+		for (int e = 0; e < 3; ++e)
+			maxPointError = (std::max)(maxPointError, fabsf(simdPoints[i][e] - scalarPoints[i][e]) / (std::max)(1.0f, fabsf(scalarPoints[i][e])));
+	}
+
+	// Round trip through the inverse
+	int inverseFailures = 0;
+	for (int i = 0; i < NumObjects; i += 97)
+	{
+		Float4x4 inverse;
+		if (!MatrixInverse(world[i], inverse))
+		{
+			inverseFailures++;
+			continue;
+		}
+
+		const Float4x4 identity = world[i] * inverse;
+		for (int e = 0; e < 16; ++e)
+		{
+			if (fabsf(identity[e] - (e % 5 == 0 ? 1.0f : 0.0f)) > 1e-4f)
+			{
+				inverseFailures++;
+				break;
+			}
+		}
+	}
+
+	const double numChains = double(NumObjects) * NumIterations;
+	Log(log, "MatrixChain world*view*proj %d matrices: scalar %.1f M/s, SIMD %.1f M/s, SIMD batch %.1f M/s, max error %g / %g\n", NumObjects,
+		numChains / scalarTime * 1e-6, numChains / simdTime * 1e-6, numChains / batchTime * 1e-6, maxError, maxBatchError);
+	Log(log, "MatrixChain TransformCoord %d points: scalar %.1f M/s, SIMD %.1f M/s, max error %g, %d inverse failures\n", NumObjects,
+		numChains / scalarPointTime * 1e-6, numChains / simdPointTime * 1e-6, maxPointError, inverseFailures);
+}
+
+#ifdef PORTABLE_BENCHMARK_MAIN
+
+namespace {
+
+void PrintLine(const char* line)
+{
+	fputs(line, stdout);
+	fflush(stdout);
+}
+
+}
+
+int main()
+{
+	BenchmarkMatrixChain(PrintLine);
+	return 0;
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef PortableBenchmark_h__
+#define PortableBenchmark_h__
+
+/**
+ * Benchmarks of the header only math, written without DXUT or Windows calls. RunCPUBenchmarks runs them with
+ * the others, and PortableBenchmark.cpp also builds alone into a command line program, e.g. on Linux:
+ *
+ *   g++ -O2 -std=c++11 -DPORTABLE_BENCHMARK_MAIN PortableBenchmark.cpp -o PortableBenchmark
+ */
+
+// Receives every result line
+typedef void (*BenchmarkLogFunction)(const char* line);
+
+// world*view*proj chains and point transforms, scalar against SIMD
+void BenchmarkMatrixChain(BenchmarkLogFunction log);
+
+#endif // PortableBenchmark_h__
@@ -0,0 +1,1148 @@
+#include "DXUT.h"
+#include "RecordingDeviceContext.h"
+#include <algorithm>
+
+// {5B1F0C3E-8D2A-4C71-9E40-3A6D12F7B895}
+const IID IID_RecordingDeviceContext = { 0x5b1f0c3e, 0x8d2a, 0x4c71, { 0x9e, 0x40, 0x3a, 0x6d, 0x12, 0xf7, 0xb8, 0x95 } };
+
+namespace {
+
+// Null mode texture rows are sized for the widest format
+const UINT ScratchBytesPerTexel = 16;
+
+double Now()
+{
+	static CDXUTTimer timer;
+	return timer.GetAbsoluteTime();
+}
+
+void Accumulate( SubmissionStats& sum, const SubmissionStats& stats )
+{
+	sum.Calls += stats.Calls;
+	sum.Draws += stats.Draws;
+	sum.Vertices += stats.Vertices;
+	sum.Dispatches += stats.Dispatches;
+	sum.Maps += stats.Maps;
+	sum.MappedBytes += stats.MappedBytes;
+	sum.StateChanges += stats.StateChanges;
+	sum.RedundantStateChanges += stats.RedundantStateChanges;
+	sum.Bindings += stats.Bindings;
+	sum.RedundantBindings += stats.RedundantBindings;
+	sum.Clears += stats.Clears;
+	sum.Copies += stats.Copies;
+	sum.Seconds += stats.Seconds;
+}
+
+void ReportLine( FILE* file, const char* name, const SubmissionStats& stats, double frames )
+{
+	fprintf(file, "%-14s %9.1f %7.1f %10.0f %6.1f %9.2f %7.1f %9.1f %8.1f %9.1f %6.1f %6.1f %8.3f\n",
+		name, stats.Calls / frames, stats.Draws / frames, stats.Vertices / frames, stats.Maps / frames,
+		stats.MappedBytes / 1024.0 / frames, stats.StateChanges / frames, stats.RedundantStateChanges / frames,
+		stats.Bindings / frames, stats.RedundantBindings / frames, stats.Clears / frames, stats.Copies / frames,
+		stats.Seconds * 1000.0 / frames);
+}
+
+// Mip of a subresource and the size of one level of the resource, pitches as Map returns them
+UINT64 GetSubresourceSize( ID3D11Resource* resource, UINT subresource, UINT* rowPitch, UINT* depthPitch )
+{
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	UINT width = 1, height = 1, depth = 1, mipLevels = 1;
+	switch (dimension)
+	{
+	case D3D11_RESOURCE_DIMENSION_BUFFER:
+		{
+			D3D11_BUFFER_DESC desc;
+			static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+			*rowPitch = *depthPitch = desc.ByteWidth;
+			return desc.ByteWidth;
+		}
+	case D3D11_RESOURCE_DIMENSION_TEXTURE1D:
+		{
+			D3D11_TEXTURE1D_DESC desc;
+			static_cast<ID3D11Texture1D*>(resource)->GetDesc(&desc);
+			width = desc.Width;
+			mipLevels = desc.MipLevels;
+		}
+		break;
+	case D3D11_RESOURCE_DIMENSION_TEXTURE2D:
+		{
+			D3D11_TEXTURE2D_DESC desc;
+			static_cast<ID3D11Texture2D*>(resource)->GetDesc(&desc);
+			width = desc.Width;
+			height = desc.Height;
+			mipLevels = desc.MipLevels;
+		}
+		break;
+	case D3D11_RESOURCE_DIMENSION_TEXTURE3D:
+		{
+			D3D11_TEXTURE3D_DESC desc;
+			static_cast<ID3D11Texture3D*>(resource)->GetDesc(&desc);
+			width = desc.Width;
+			height = desc.Height;
+			depth = desc.Depth;
+			mipLevels = desc.MipLevels;
+		}
+		break;
+	default:
+		*rowPitch = *depthPitch = 0;
+		return 0;
+	}
+
+	const UINT mip = subresource % (std::max)(mipLevels, 1u);
+	width = (std::max)(width >> mip, 1u);
+	height = (std::max)(height >> mip, 1u);
+	depth = (std::max)(depth >> mip, 1u);
+
+	*rowPitch = width * ScratchBytesPerTexel;
+	*depthPitch = *rowPitch * height;
+	return UINT64(*depthPitch) * depth;
+}
+
+// What a map of the subresource covers, from the pitches the map returned
+UINT64 GetMappedSize( ID3D11Resource* resource, UINT subresource, const D3D11_MAPPED_SUBRESOURCE& mapped )
+{
+	D3D11_RESOURCE_DIMENSION dimension;
+	resource->GetType(&dimension);
+
+	if (dimension == D3D11_RESOURCE_DIMENSION_BUFFER)
+	{
+		D3D11_BUFFER_DESC desc;
+		static_cast<ID3D11Buffer*>(resource)->GetDesc(&desc);
+		return desc.ByteWidth;
+	}
+
+	UINT rowPitch, depthPitch;
+	const UINT64 size = GetSubresourceSize(resource, subresource, &rowPitch, &depthPitch);
+	if (rowPitch == 0)
+		return 0;
+
+	// Rows and slices of the level, times the pitches the driver picked
+	const UINT64 rows = depthPitch / rowPitch;
+	const UINT64 slices = size / depthPitch;
+	return dimension == D3D11_RESOURCE_DIMENSION_TEXTURE3D ? slices * mapped.DepthPitch : rows * mapped.RowPitch;
+}
+
+}
+
+RecordingDeviceContext::RecordingDeviceContext( ID3D11DeviceContext* inner, ID3D11Device* device )
+	: mInner(inner),
+	  mDevice(device),
+	  mRefCount(1),
+	  mCurrent(NULL),
+	  mNumFrames(0),
+	  mInFrame(false),
+	  mSliceStart(0)
+{
+	if (mInner)
+		mInner->AddRef();
+	if (mDevice)
+		mDevice->AddRef();
+
+	ClearBoundState();
+
+	PassRecord frame;
+	frame.Name = "Frame";
+	memset(&frame.Stats, 0, sizeof(frame.Stats));
+	mPasses.push_back(frame);
+
+	mPassStack.push_back(0);
+	mCurrent = &mPasses[0].Stats;
+}
+
+RecordingDeviceContext::~RecordingDeviceContext()
+{
+	SAFE_RELEASE(mInner);
+	SAFE_RELEASE(mDevice);
+}
+
+void RecordingDeviceContext::BeginFrame()
+{
+	mInFrame = true;
+	mSliceStart = Now();
+}
+
+void RecordingDeviceContext::EndFrame()
+{
+	AccumulateTime();
+	mInFrame = false;
+	++mNumFrames;
+}
+
+void RecordingDeviceContext::BeginPass( const char* name )
+{
+	AccumulateTime();
+
+	size_t index = 0;
+	while (index < mPasses.size() && mPasses[index].Name != name)
+		++index;
+
+	if (index == mPasses.size())
+	{
+		PassRecord pass;
+		pass.Name = name;
+		memset(&pass.Stats, 0, sizeof(pass.Stats));
+		mPasses.push_back(pass);
+	}
+
+	mPassStack.push_back(index);
+	mCurrent = &mPasses[index].Stats;
+}
+
+void RecordingDeviceContext::EndPass()
+{
+	AccumulateTime();
+
+	// The frame pass stays at the bottom
+	if (mPassStack.size() > 1)
+		mPassStack.pop_back();
+	mCurrent = &mPasses[mPassStack.back()].Stats;
+}
+
+void RecordingDeviceContext::Reset()
+{
+	for (size_t i = 0; i < mPasses.size(); ++i)
+		memset(&mPasses[i].Stats, 0, sizeof(mPasses[i].Stats));
+
+	mNumFrames = 0;
+	mSliceStart = Now();
+}
+
+void RecordingDeviceContext::AccumulateTime()
+{
+	if (!mInFrame)
+		return;
+
+	const double now = Now();
+	mCurrent->Seconds += now - mSliceStart;
+	mSliceStart = now;
+}
+
+const SubmissionStats* RecordingDeviceContext::GetPassStats( const char* name ) const
+{
+	for (size_t i = 0; i < mPasses.size(); ++i)
+	{
+		if (mPasses[i].Name == name)
+			return &mPasses[i].Stats;
+	}
+	return NULL;
+}
+
+SubmissionStats RecordingDeviceContext::GetTotalStats() const
+{
+	SubmissionStats total;
+	memset(&total, 0, sizeof(total));
+
+	for (size_t i = 0; i < mPasses.size(); ++i)
+		Accumulate(total, mPasses[i].Stats);
+	return total;
+}
+
+void RecordingDeviceContext::Report( FILE* file ) const
+{
+	const double frames = (std::max)(mNumFrames, 1u);
+
+	fprintf(file, "%u frames, %s context, per frame:\n", mNumFrames, mInner ? "forwarding" : "null");
+	fprintf(file, "%-14s %9s %7s %10s %6s %9s %7s %9s %8s %9s %6s %6s %8s\n",
+		"Pass", "Calls", "Draws", "Vertices", "Maps", "MappedKB", "States", "Redundant", "Bindings", "Redundant", "Clears", "Copies", "ms");
+
+	for (size_t i = 0; i < mPasses.size(); ++i)
+		ReportLine(file, mPasses[i].Name.c_str(), mPasses[i].Stats, frames);
+	ReportLine(file, "Total", GetTotalStats(), frames);
+}
+
+void RecordingDeviceContext::ClearBoundState()
+{
+	memset(&mBound, 0, sizeof(mBound));
+	mBound.SampleMask = 0xFFFFFFFF;
+	for (int i = 0; i < 4; ++i)
+		mBound.BlendFactor[i] = 1.0f;
+}
+
+template<typename T>
+void RecordingDeviceContext::BindSlots( const void** bound, UINT maxSlots, UINT startSlot, UINT count, T* const* objects )
+{
+	for (UINT i = 0; i < count && startSlot + i < maxSlots; ++i)
+	{
+		const void* object = objects ? objects[i] : NULL;
+
+		++mCurrent->Bindings;
+		if (bound[startSlot + i] == object)
+			++mCurrent->RedundantBindings;
+		bound[startSlot + i] = object;
+	}
+}
+
+void RecordingDeviceContext::SetState( bool redundant )
+{
+	++mCurrent->StateChanges;
+	if (redundant)
+		++mCurrent->RedundantStateChanges;
+}
+
+void RecordingDeviceContext::SetStageShaderResources( Stage stage, UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views )
+{
+	++mCurrent->Calls;
+	BindSlots(mBound.Stages[stage].ShaderResources, D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT, startSlot, numViews, views);
+}
+
+void RecordingDeviceContext::SetStageShader( Stage stage, const void* shader )
+{
+	++mCurrent->Calls;
+	SetState(mBound.Stages[stage].Shader == shader);
+	mBound.Stages[stage].Shader = shader;
+}
+
+void RecordingDeviceContext::SetStageSamplers( Stage stage, UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers )
+{
+	++mCurrent->Calls;
+	BindSlots(mBound.Stages[stage].Samplers, D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT, startSlot, numSamplers, samplers);
+}
+
+void RecordingDeviceContext::SetStageConstantBuffers( Stage stage, UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers )
+{
+	++mCurrent->Calls;
+	BindSlots(mBound.Stages[stage].ConstantBuffers, D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT, startSlot, numBuffers, buffers);
+}
+
+void RecordingDeviceContext::SetRenderTargets( UINT numViews, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depthStencil )
+{
+	numViews = (std::min)(numViews, UINT(D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT));
+
+	bool redundant = numViews == mBound.NumRenderTargets && depthStencil == mBound.DepthStencil;
+	for (UINT i = 0; i < numViews; ++i)
+	{
+		const void* view = views ? views[i] : NULL;
+		redundant = redundant && mBound.RenderTargets[i] == view;
+		mBound.RenderTargets[i] = view;
+	}
+	for (UINT i = numViews; i < D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT; ++i)
+		mBound.RenderTargets[i] = NULL;
+
+	mBound.NumRenderTargets = numViews;
+	mBound.DepthStencil = depthStencil;
+	SetState(redundant);
+}
+
+void RecordingDeviceContext::RecordDraw( UINT64 vertices )
+{
+	++mCurrent->Calls;
+	++mCurrent->Draws;
+	mCurrent->Vertices += vertices;
+}
+
+void RecordingDeviceContext::RecordCopy()
+{
+	++mCurrent->Calls;
+	++mCurrent->Copies;
+}
+
+void* RecordingDeviceContext::GetScratchMemory( ID3D11Resource* resource, UINT subresource, D3D11_MAPPED_SUBRESOURCE* mapped )
+{
+	UINT rowPitch, depthPitch;
+	const UINT64 size = GetSubresourceSize(resource, subresource, &rowPitch, &depthPitch);
+	if (size == 0)
+		return NULL;
+
+	std::vector<BYTE>& scratch = mScratch[std::make_pair(resource, subresource)];
+	if (scratch.size() < size)
+		scratch.resize(size_t(size), 0);
+
+	mapped->pData = &scratch[0];
+	mapped->RowPitch = rowPitch;
+	mapped->DepthPitch = depthPitch;
+	return mapped->pData;
+}
+
+//--------------------------------------------------------------------------------------
+// IUnknown and ID3D11DeviceChild
+//--------------------------------------------------------------------------------------
+STDMETHODIMP RecordingDeviceContext::QueryInterface( REFIID riid, void** ppvObject )
+{
+	if (!ppvObject)
+		return E_POINTER;
+
+	if (riid == IID_RecordingDeviceContext)
+		*ppvObject = this;
+	else if (riid == __uuidof(ID3D11DeviceContext) || riid == __uuidof(ID3D11DeviceChild) || riid == __uuidof(IUnknown))
+		*ppvObject = static_cast<ID3D11DeviceContext*>(this);
+	else
+	{
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+
+	AddRef();
+	return S_OK;
+}
+
+STDMETHODIMP_(ULONG) RecordingDeviceContext::AddRef()
+{
+	return ++mRefCount;
+}
+
+STDMETHODIMP_(ULONG) RecordingDeviceContext::Release()
+{
+	return --mRefCount;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::GetDevice( ID3D11Device** ppDevice )
+{
+	if (mInner)
+		mInner->GetDevice(ppDevice);
+	else
+	{
+		*ppDevice = mDevice;
+		if (mDevice)
+			mDevice->AddRef();
+	}
+}
+
+STDMETHODIMP RecordingDeviceContext::GetPrivateData( REFGUID guid, UINT* pDataSize, void* pData )
+{
+	return mInner ? mInner->GetPrivateData(guid, pDataSize, pData) : E_NOTIMPL;
+}
+
+STDMETHODIMP RecordingDeviceContext::SetPrivateData( REFGUID guid, UINT DataSize, const void* pData )
+{
+	return mInner ? mInner->SetPrivateData(guid, DataSize, pData) : E_NOTIMPL;
+}
+
+STDMETHODIMP RecordingDeviceContext::SetPrivateDataInterface( REFGUID guid, const IUnknown* pData )
+{
+	return mInner ? mInner->SetPrivateDataInterface(guid, pData) : E_NOTIMPL;
+}
+
+//--------------------------------------------------------------------------------------
+// Shader stages, Get* return nothing in null mode
+//--------------------------------------------------------------------------------------
+#define RECORDING_STAGE_METHODS(Stage, ShaderType, StageIndex) \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##SetShaderResources( UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews ) \
+	{ \
+		SetStageShaderResources(StageIndex, StartSlot, NumViews, ppShaderResourceViews); \
+		if (mInner) \
+			mInner->Stage##SetShaderResources(StartSlot, NumViews, ppShaderResourceViews); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##SetShader( ShaderType* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances ) \
+	{ \
+		SetStageShader(StageIndex, pShader); \
+		if (mInner) \
+			mInner->Stage##SetShader(pShader, ppClassInstances, NumClassInstances); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##SetSamplers( UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers ) \
+	{ \
+		SetStageSamplers(StageIndex, StartSlot, NumSamplers, ppSamplers); \
+		if (mInner) \
+			mInner->Stage##SetSamplers(StartSlot, NumSamplers, ppSamplers); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##SetConstantBuffers( UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers ) \
+	{ \
+		SetStageConstantBuffers(StageIndex, StartSlot, NumBuffers, ppConstantBuffers); \
+		if (mInner) \
+			mInner->Stage##SetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##GetShaderResources( UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews ) \
+	{ \
+		++mCurrent->Calls; \
+		if (mInner) \
+			mInner->Stage##GetShaderResources(StartSlot, NumViews, ppShaderResourceViews); \
+		else \
+			memset(ppShaderResourceViews, 0, NumViews * sizeof(*ppShaderResourceViews)); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##GetShader( ShaderType** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances ) \
+	{ \
+		++mCurrent->Calls; \
+		if (mInner) \
+			mInner->Stage##GetShader(ppShader, ppClassInstances, pNumClassInstances); \
+		else \
+		{ \
+			*ppShader = NULL; \
+			if (pNumClassInstances) \
+				*pNumClassInstances = 0; \
+		} \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##GetSamplers( UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers ) \
+	{ \
+		++mCurrent->Calls; \
+		if (mInner) \
+			mInner->Stage##GetSamplers(StartSlot, NumSamplers, ppSamplers); \
+		else \
+			memset(ppSamplers, 0, NumSamplers * sizeof(*ppSamplers)); \
+	} \
+	STDMETHODIMP_(void) RecordingDeviceContext::Stage##GetConstantBuffers( UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers ) \
+	{ \
+		++mCurrent->Calls; \
+		if (mInner) \
+			mInner->Stage##GetConstantBuffers(StartSlot, NumBuffers, ppConstantBuffers); \
+		else \
+			memset(ppConstantBuffers, 0, NumBuffers * sizeof(*ppConstantBuffers)); \
+	}
+
+RECORDING_STAGE_METHODS(VS, ID3D11VertexShader, Stage_Vertex)
+RECORDING_STAGE_METHODS(HS, ID3D11HullShader, Stage_Hull)
+RECORDING_STAGE_METHODS(DS, ID3D11DomainShader, Stage_Domain)
+RECORDING_STAGE_METHODS(GS, ID3D11GeometryShader, Stage_Geometry)
+RECORDING_STAGE_METHODS(PS, ID3D11PixelShader, Stage_Pixel)
+RECORDING_STAGE_METHODS(CS, ID3D11ComputeShader, Stage_Compute)
+#undef RECORDING_STAGE_METHODS
+
+//--------------------------------------------------------------------------------------
+// Draw and dispatch
+//--------------------------------------------------------------------------------------
+STDMETHODIMP_(void) RecordingDeviceContext::Draw( UINT VertexCount, UINT StartVertexLocation )
+{
+	RecordDraw(VertexCount);
+	if (mInner)
+		mInner->Draw(VertexCount, StartVertexLocation);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawIndexed( UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation )
+{
+	RecordDraw(IndexCount);
+	if (mInner)
+		mInner->DrawIndexed(IndexCount, StartIndexLocation, BaseVertexLocation);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawInstanced( UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation )
+{
+	RecordDraw(UINT64(VertexCountPerInstance) * InstanceCount);
+	if (mInner)
+		mInner->DrawInstanced(VertexCountPerInstance, InstanceCount, StartVertexLocation, StartInstanceLocation);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawIndexedInstanced( UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation )
+{
+	RecordDraw(UINT64(IndexCountPerInstance) * InstanceCount);
+	if (mInner)
+		mInner->DrawIndexedInstanced(IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation, StartInstanceLocation);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawAuto()
+{
+	RecordDraw(0);
+	if (mInner)
+		mInner->DrawAuto();
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawIndexedInstancedIndirect( ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs )
+{
+	RecordDraw(0);
+	if (mInner)
+		mInner->DrawIndexedInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DrawInstancedIndirect( ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs )
+{
+	RecordDraw(0);
+	if (mInner)
+		mInner->DrawInstancedIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::Dispatch( UINT ThreadGroupCountX, UINT ThreadGroupCountY, UINT ThreadGroupCountZ )
+{
+	++mCurrent->Calls;
+	++mCurrent->Dispatches;
+	if (mInner)
+		mInner->Dispatch(ThreadGroupCountX, ThreadGroupCountY, ThreadGroupCountZ);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::DispatchIndirect( ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs )
+{
+	++mCurrent->Calls;
+	++mCurrent->Dispatches;
+	if (mInner)
+		mInner->DispatchIndirect(pBufferForArgs, AlignedByteOffsetForArgs);
+}
+
+//--------------------------------------------------------------------------------------
+// Resources
+//--------------------------------------------------------------------------------------
+STDMETHODIMP RecordingDeviceContext::Map( ID3D11Resource* pResource, UINT Subresource, D3D11_MAP MapType, UINT MapFlags, D3D11_MAPPED_SUBRESOURCE* pMappedResource )
+{
+	++mCurrent->Calls;
+	++mCurrent->Maps;
+
+	HRESULT hr;
+	if (mInner)
+		hr = mInner->Map(pResource, Subresource, MapType, MapFlags, pMappedResource);
+	else
+		hr = pMappedResource && GetScratchMemory(pResource, Subresource, pMappedResource) ? S_OK : E_INVALIDARG;
+
+	if (SUCCEEDED(hr) && pMappedResource)
+		mCurrent->MappedBytes += GetMappedSize(pResource, Subresource, *pMappedResource);
+	return hr;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::Unmap( ID3D11Resource* pResource, UINT Subresource )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->Unmap(pResource, Subresource);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::CopySubresourceRegion( ID3D11Resource* pDstResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+	ID3D11Resource* pSrcResource, UINT SrcSubresource, const D3D11_BOX* pSrcBox )
+{
+	RecordCopy();
+	if (mInner)
+		mInner->CopySubresourceRegion(pDstResource, DstSubresource, DstX, DstY, DstZ, pSrcResource, SrcSubresource, pSrcBox);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::CopyResource( ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource )
+{
+	RecordCopy();
+	if (mInner)
+		mInner->CopyResource(pDstResource, pSrcResource);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::UpdateSubresource( ID3D11Resource* pDstResource, UINT DstSubresource, const D3D11_BOX* pDstBox,
+	const void* pSrcData, UINT SrcRowPitch, UINT SrcDepthPitch )
+{
+	RecordCopy();
+	if (mInner)
+		mInner->UpdateSubresource(pDstResource, DstSubresource, pDstBox, pSrcData, SrcRowPitch, SrcDepthPitch);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::CopyStructureCount( ID3D11Buffer* pDstBuffer, UINT DstAlignedByteOffset, ID3D11UnorderedAccessView* pSrcView )
+{
+	RecordCopy();
+	if (mInner)
+		mInner->CopyStructureCount(pDstBuffer, DstAlignedByteOffset, pSrcView);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ResolveSubresource( ID3D11Resource* pDstResource, UINT DstSubresource, ID3D11Resource* pSrcResource,
+	UINT SrcSubresource, DXGI_FORMAT Format )
+{
+	RecordCopy();
+	if (mInner)
+		mInner->ResolveSubresource(pDstResource, DstSubresource, pSrcResource, SrcSubresource, Format);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ClearRenderTargetView( ID3D11RenderTargetView* pRenderTargetView, const FLOAT ColorRGBA[4] )
+{
+	++mCurrent->Calls;
+	++mCurrent->Clears;
+	if (mInner)
+		mInner->ClearRenderTargetView(pRenderTargetView, ColorRGBA);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ClearUnorderedAccessViewUint( ID3D11UnorderedAccessView* pUnorderedAccessView, const UINT Values[4] )
+{
+	++mCurrent->Calls;
+	++mCurrent->Clears;
+	if (mInner)
+		mInner->ClearUnorderedAccessViewUint(pUnorderedAccessView, Values);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ClearUnorderedAccessViewFloat( ID3D11UnorderedAccessView* pUnorderedAccessView, const FLOAT Values[4] )
+{
+	++mCurrent->Calls;
+	++mCurrent->Clears;
+	if (mInner)
+		mInner->ClearUnorderedAccessViewFloat(pUnorderedAccessView, Values);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ClearDepthStencilView( ID3D11DepthStencilView* pDepthStencilView, UINT ClearFlags, FLOAT Depth, UINT8 Stencil )
+{
+	++mCurrent->Calls;
+	++mCurrent->Clears;
+	if (mInner)
+		mInner->ClearDepthStencilView(pDepthStencilView, ClearFlags, Depth, Stencil);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::GenerateMips( ID3D11ShaderResourceView* pShaderResourceView )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->GenerateMips(pShaderResourceView);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::SetResourceMinLOD( ID3D11Resource* pResource, FLOAT MinLOD )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->SetResourceMinLOD(pResource, MinLOD);
+}
+
+STDMETHODIMP_(FLOAT) RecordingDeviceContext::GetResourceMinLOD( ID3D11Resource* pResource )
+{
+	++mCurrent->Calls;
+	return mInner ? mInner->GetResourceMinLOD(pResource) : 0.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// Input assembler
+//--------------------------------------------------------------------------------------
+STDMETHODIMP_(void) RecordingDeviceContext::IASetInputLayout( ID3D11InputLayout* pInputLayout )
+{
+	++mCurrent->Calls;
+	SetState(mBound.InputLayout == pInputLayout);
+	mBound.InputLayout = pInputLayout;
+
+	if (mInner)
+		mInner->IASetInputLayout(pInputLayout);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IASetVertexBuffers( UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets )
+{
+	++mCurrent->Calls;
+
+	for (UINT i = 0; i < NumBuffers && StartSlot + i < D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; ++i)
+	{
+		const UINT slot = StartSlot + i;
+		const void* buffer = ppVertexBuffers ? ppVertexBuffers[i] : NULL;
+		const UINT stride = pStrides ? pStrides[i] : 0;
+		const UINT offset = pOffsets ? pOffsets[i] : 0;
+
+		++mCurrent->Bindings;
+		if (mBound.VertexBuffers[slot] == buffer && mBound.VertexStrides[slot] == stride && mBound.VertexOffsets[slot] == offset)
+			++mCurrent->RedundantBindings;
+
+		mBound.VertexBuffers[slot] = buffer;
+		mBound.VertexStrides[slot] = stride;
+		mBound.VertexOffsets[slot] = offset;
+	}
+
+	if (mInner)
+		mInner->IASetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IASetIndexBuffer( ID3D11Buffer* pIndexBuffer, DXGI_FORMAT Format, UINT Offset )
+{
+	++mCurrent->Calls;
+	SetState(mBound.IndexBuffer == pIndexBuffer && mBound.IndexFormat == Format && mBound.IndexOffset == Offset);
+	mBound.IndexBuffer = pIndexBuffer;
+	mBound.IndexFormat = Format;
+	mBound.IndexOffset = Offset;
+
+	if (mInner)
+		mInner->IASetIndexBuffer(pIndexBuffer, Format, Offset);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IASetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY Topology )
+{
+	++mCurrent->Calls;
+	SetState(mBound.Topology == Topology);
+	mBound.Topology = Topology;
+
+	if (mInner)
+		mInner->IASetPrimitiveTopology(Topology);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IAGetInputLayout( ID3D11InputLayout** ppInputLayout )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->IAGetInputLayout(ppInputLayout);
+	else
+		*ppInputLayout = NULL;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IAGetVertexBuffers( UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppVertexBuffers, UINT* pStrides, UINT* pOffsets )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->IAGetVertexBuffers(StartSlot, NumBuffers, ppVertexBuffers, pStrides, pOffsets);
+	else
+	{
+		if (ppVertexBuffers)
+			memset(ppVertexBuffers, 0, NumBuffers * sizeof(*ppVertexBuffers));
+		if (pStrides)
+			memset(pStrides, 0, NumBuffers * sizeof(*pStrides));
+		if (pOffsets)
+			memset(pOffsets, 0, NumBuffers * sizeof(*pOffsets));
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IAGetIndexBuffer( ID3D11Buffer** pIndexBuffer, DXGI_FORMAT* Format, UINT* Offset )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->IAGetIndexBuffer(pIndexBuffer, Format, Offset);
+	else
+	{
+		if (pIndexBuffer)
+			*pIndexBuffer = NULL;
+		if (Format)
+			*Format = mBound.IndexFormat;
+		if (Offset)
+			*Offset = mBound.IndexOffset;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::IAGetPrimitiveTopology( D3D11_PRIMITIVE_TOPOLOGY* pTopology )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->IAGetPrimitiveTopology(pTopology);
+	else
+		*pTopology = mBound.Topology;
+}
+
+//--------------------------------------------------------------------------------------
+// Stream output and rasterizer
+//--------------------------------------------------------------------------------------
+STDMETHODIMP_(void) RecordingDeviceContext::SOSetTargets( UINT NumBuffers, ID3D11Buffer* const* ppSOTargets, const UINT* pOffsets )
+{
+	++mCurrent->Calls;
+
+	bool redundant = true;
+	for (UINT i = 0; i < D3D11_SO_BUFFER_SLOT_COUNT; ++i)
+	{
+		const void* target = i < NumBuffers && ppSOTargets ? ppSOTargets[i] : NULL;
+		const UINT offset = i < NumBuffers && pOffsets ? pOffsets[i] : 0;
+
+		redundant = redundant && mBound.StreamOutTargets[i] == target && mBound.StreamOutOffsets[i] == offset;
+		mBound.StreamOutTargets[i] = target;
+		mBound.StreamOutOffsets[i] = offset;
+	}
+	SetState(redundant);
+
+	if (mInner)
+		mInner->SOSetTargets(NumBuffers, ppSOTargets, pOffsets);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::SOGetTargets( UINT NumBuffers, ID3D11Buffer** ppSOTargets )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->SOGetTargets(NumBuffers, ppSOTargets);
+	else
+		memset(ppSOTargets, 0, NumBuffers * sizeof(*ppSOTargets));
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSSetState( ID3D11RasterizerState* pRasterizerState )
+{
+	++mCurrent->Calls;
+	SetState(mBound.RasterizerState == pRasterizerState);
+	mBound.RasterizerState = pRasterizerState;
+
+	if (mInner)
+		mInner->RSSetState(pRasterizerState);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSSetViewports( UINT NumViewports, const D3D11_VIEWPORT* pViewports )
+{
+	++mCurrent->Calls;
+
+	const UINT numViewports = pViewports ? (std::min)(NumViewports, UINT(D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE)) : 0;
+	SetState(numViewports == mBound.NumViewports && (numViewports == 0 || memcmp(mBound.Viewports, pViewports, numViewports * sizeof(*pViewports)) == 0));
+	if (numViewports)
+		memcpy(mBound.Viewports, pViewports, numViewports * sizeof(*pViewports));
+	mBound.NumViewports = numViewports;
+
+	if (mInner)
+		mInner->RSSetViewports(NumViewports, pViewports);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSSetScissorRects( UINT NumRects, const D3D11_RECT* pRects )
+{
+	++mCurrent->Calls;
+
+	const UINT numRects = pRects ? (std::min)(NumRects, UINT(D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE)) : 0;
+	SetState(numRects == mBound.NumScissorRects && (numRects == 0 || memcmp(mBound.ScissorRects, pRects, numRects * sizeof(*pRects)) == 0));
+	if (numRects)
+		memcpy(mBound.ScissorRects, pRects, numRects * sizeof(*pRects));
+	mBound.NumScissorRects = numRects;
+
+	if (mInner)
+		mInner->RSSetScissorRects(NumRects, pRects);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSGetState( ID3D11RasterizerState** ppRasterizerState )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->RSGetState(ppRasterizerState);
+	else
+		*ppRasterizerState = NULL;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSGetViewports( UINT* pNumViewports, D3D11_VIEWPORT* pViewports )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->RSGetViewports(pNumViewports, pViewports);
+	else
+	{
+		if (pViewports)
+			memcpy(pViewports, mBound.Viewports, (std::min)(*pNumViewports, mBound.NumViewports) * sizeof(*pViewports));
+		*pNumViewports = mBound.NumViewports;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::RSGetScissorRects( UINT* pNumRects, D3D11_RECT* pRects )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->RSGetScissorRects(pNumRects, pRects);
+	else
+	{
+		if (pRects)
+			memcpy(pRects, mBound.ScissorRects, (std::min)(*pNumRects, mBound.NumScissorRects) * sizeof(*pRects));
+		*pNumRects = mBound.NumScissorRects;
+	}
+}
+
+//--------------------------------------------------------------------------------------
+// Output merger and unordered access views
+//--------------------------------------------------------------------------------------
+STDMETHODIMP_(void) RecordingDeviceContext::OMSetRenderTargets( UINT NumViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView )
+{
+	++mCurrent->Calls;
+	SetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+
+	if (mInner)
+		mInner->OMSetRenderTargets(NumViews, ppRenderTargetViews, pDepthStencilView);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMSetRenderTargetsAndUnorderedAccessViews( UINT NumRTVs, ID3D11RenderTargetView* const* ppRenderTargetViews,
+	ID3D11DepthStencilView* pDepthStencilView, UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews,
+	const UINT* pUAVInitialCounts )
+{
+	++mCurrent->Calls;
+	if (NumRTVs != D3D11_KEEP_RENDER_TARGETS_AND_DEPTH_STENCIL)
+		SetRenderTargets(NumRTVs, ppRenderTargetViews, pDepthStencilView);
+	if (NumUAVs != D3D11_KEEP_UNORDERED_ACCESS_VIEWS)
+		BindSlots(mBound.UnorderedAccessViews, D3D11_PS_CS_UAV_REGISTER_COUNT, UAVStartSlot, NumUAVs, ppUnorderedAccessViews);
+
+	if (mInner)
+		mInner->OMSetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, pDepthStencilView, UAVStartSlot, NumUAVs,
+			ppUnorderedAccessViews, pUAVInitialCounts);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMSetBlendState( ID3D11BlendState* pBlendState, const FLOAT BlendFactor[4], UINT SampleMask )
+{
+	++mCurrent->Calls;
+
+	// NULL blend factor is all ones
+	FLOAT factor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (BlendFactor)
+		memcpy(factor, BlendFactor, sizeof(factor));
+
+	SetState(mBound.BlendState == pBlendState && mBound.SampleMask == SampleMask && memcmp(mBound.BlendFactor, factor, sizeof(factor)) == 0);
+	mBound.BlendState = pBlendState;
+	mBound.SampleMask = SampleMask;
+	memcpy(mBound.BlendFactor, factor, sizeof(factor));
+
+	if (mInner)
+		mInner->OMSetBlendState(pBlendState, BlendFactor, SampleMask);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMSetDepthStencilState( ID3D11DepthStencilState* pDepthStencilState, UINT StencilRef )
+{
+	++mCurrent->Calls;
+	SetState(mBound.DepthStencilState == pDepthStencilState && mBound.StencilRef == StencilRef);
+	mBound.DepthStencilState = pDepthStencilState;
+	mBound.StencilRef = StencilRef;
+
+	if (mInner)
+		mInner->OMSetDepthStencilState(pDepthStencilState, StencilRef);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMGetRenderTargets( UINT NumViews, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->OMGetRenderTargets(NumViews, ppRenderTargetViews, ppDepthStencilView);
+	else
+	{
+		if (ppRenderTargetViews)
+			memset(ppRenderTargetViews, 0, NumViews * sizeof(*ppRenderTargetViews));
+		if (ppDepthStencilView)
+			*ppDepthStencilView = NULL;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMGetRenderTargetsAndUnorderedAccessViews( UINT NumRTVs, ID3D11RenderTargetView** ppRenderTargetViews,
+	ID3D11DepthStencilView** ppDepthStencilView, UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->OMGetRenderTargetsAndUnorderedAccessViews(NumRTVs, ppRenderTargetViews, ppDepthStencilView, UAVStartSlot, NumUAVs, ppUnorderedAccessViews);
+	else
+	{
+		if (ppRenderTargetViews)
+			memset(ppRenderTargetViews, 0, NumRTVs * sizeof(*ppRenderTargetViews));
+		if (ppDepthStencilView)
+			*ppDepthStencilView = NULL;
+		if (ppUnorderedAccessViews)
+			memset(ppUnorderedAccessViews, 0, NumUAVs * sizeof(*ppUnorderedAccessViews));
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMGetBlendState( ID3D11BlendState** ppBlendState, FLOAT BlendFactor[4], UINT* pSampleMask )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->OMGetBlendState(ppBlendState, BlendFactor, pSampleMask);
+	else
+	{
+		if (ppBlendState)
+			*ppBlendState = NULL;
+		if (BlendFactor)
+			memcpy(BlendFactor, mBound.BlendFactor, sizeof(mBound.BlendFactor));
+		if (pSampleMask)
+			*pSampleMask = mBound.SampleMask;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::OMGetDepthStencilState( ID3D11DepthStencilState** ppDepthStencilState, UINT* pStencilRef )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->OMGetDepthStencilState(ppDepthStencilState, pStencilRef);
+	else
+	{
+		if (ppDepthStencilState)
+			*ppDepthStencilState = NULL;
+		if (pStencilRef)
+			*pStencilRef = mBound.StencilRef;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::CSSetUnorderedAccessViews( UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts )
+{
+	++mCurrent->Calls;
+	BindSlots(mBound.ComputeUnorderedAccessViews, D3D11_PS_CS_UAV_REGISTER_COUNT, StartSlot, NumUAVs, ppUnorderedAccessViews);
+
+	if (mInner)
+		mInner->CSSetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews, pUAVInitialCounts);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::CSGetUnorderedAccessViews( UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->CSGetUnorderedAccessViews(StartSlot, NumUAVs, ppUnorderedAccessViews);
+	else
+		memset(ppUnorderedAccessViews, 0, NumUAVs * sizeof(*ppUnorderedAccessViews));
+}
+
+//--------------------------------------------------------------------------------------
+// Queries, predication, command lists
+//--------------------------------------------------------------------------------------
+STDMETHODIMP_(void) RecordingDeviceContext::Begin( ID3D11Asynchronous* pAsync )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->Begin(pAsync);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::End( ID3D11Asynchronous* pAsync )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->End(pAsync);
+}
+
+STDMETHODIMP RecordingDeviceContext::GetData( ID3D11Asynchronous* pAsync, void* pData, UINT DataSize, UINT GetDataFlags )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		return mInner->GetData(pAsync, pData, DataSize, GetDataFlags);
+
+	// Done at once, so nobody spins on a query that never completes
+	if (pData)
+		memset(pData, 0, DataSize);
+	return S_OK;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::SetPredication( ID3D11Predicate* pPredicate, BOOL PredicateValue )
+{
+	++mCurrent->Calls;
+	SetState(mBound.Predicate == pPredicate && mBound.PredicateValue == PredicateValue);
+	mBound.Predicate = pPredicate;
+	mBound.PredicateValue = PredicateValue;
+
+	if (mInner)
+		mInner->SetPredication(pPredicate, PredicateValue);
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::GetPredication( ID3D11Predicate** ppPredicate, BOOL* pPredicateValue )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->GetPredication(ppPredicate, pPredicateValue);
+	else
+	{
+		if (ppPredicate)
+			*ppPredicate = NULL;
+		if (pPredicateValue)
+			*pPredicateValue = mBound.PredicateValue;
+	}
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ExecuteCommandList( ID3D11CommandList* pCommandList, BOOL RestoreContextState )
+{
+	++mCurrent->Calls;
+
+	// What the list binds isn't known here, without restore the context ends up cleared
+	if (!RestoreContextState)
+		ClearBoundState();
+
+	if (mInner)
+		mInner->ExecuteCommandList(pCommandList, RestoreContextState);
+}
+
+STDMETHODIMP RecordingDeviceContext::FinishCommandList( BOOL RestoreDeferredContextState, ID3D11CommandList** ppCommandList )
+{
+	++mCurrent->Calls;
+	if (mInner)
+		return mInner->FinishCommandList(RestoreDeferredContextState, ppCommandList);
+
+	if (ppCommandList)
+		*ppCommandList = NULL;
+	return DXGI_ERROR_INVALID_CALL;
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::ClearState()
+{
+	++mCurrent->Calls;
+	SetState(false);
+	ClearBoundState();
+
+	if (mInner)
+		mInner->ClearState();
+}
+
+STDMETHODIMP_(void) RecordingDeviceContext::Flush()
+{
+	++mCurrent->Calls;
+	if (mInner)
+		mInner->Flush();
+}
+
+STDMETHODIMP_(D3D11_DEVICE_CONTEXT_TYPE) RecordingDeviceContext::GetType()
+{
+	++mCurrent->Calls;
+	return mInner ? mInner->GetType() : D3D11_DEVICE_CONTEXT_IMMEDIATE;
+}
+
+STDMETHODIMP_(UINT) RecordingDeviceContext::GetContextFlags()
+{
+	++mCurrent->Calls;
+	return mInner ? mInner->GetContextFlags() : 0;
+}
+
+//--------------------------------------------------------------------------------------
+RecordingPass::RecordingPass( ID3D11DeviceContext* context, const char* name )
+	: mRecorder(NULL)
+{
+	void* recorder = NULL;
+	if (context && SUCCEEDED(context->QueryInterface(IID_RecordingDeviceContext, &recorder)))
+	{
+		mRecorder = static_cast<RecordingDeviceContext*>(recorder);
+		mRecorder->BeginPass(name);
+	}
+}
+
+RecordingPass::~RecordingPass()
+{
+	if (mRecorder)
+	{
+		mRecorder->EndPass();
+		mRecorder->Release();
+	}
+}
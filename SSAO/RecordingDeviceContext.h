@@ -0,0 +1,311 @@
+#ifndef RecordingDeviceContext_h__
+#define RecordingDeviceContext_h__
+
+#include <d3d11.h>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * A device context that counts what is submitted through it, per pass.
+ *
+ * Wrapping the immediate context, every call is forwarded after it is recorded, so the pass times include
+ * the driver. Without an inner context nothing is forwarded: Map hands out zeroed scratch memory sized from
+ * the resource description, the other calls only update the bound state kept here, and the pass times are
+ * the cost of Renderer alone. The difference of the two is what the runtime and driver add.
+ *
+ * Renderer marks its passes with RecordingPass, calls outside of any pass go to "Frame". A bind of the
+ * object already bound is counted as redundant, resources per slot, states per call. Only pointers are
+ * compared, bound objects aren't AddRef'd.
+ *
+ * Reference counting doesn't delete, whoever creates the recorder deletes it.
+ */
+
+// Counters of one pass, summed over the recorded frames
+struct SubmissionStats
+{
+	UINT64 Calls;                   // Every context call, Get* included
+	UINT64 Draws;
+	UINT64 Vertices;                // Vertices or indices times instances, indirect draws add none
+	UINT64 Dispatches;
+	UINT64 Maps;
+	UINT64 MappedBytes;             // Whole buffer, row pitch times rows for textures
+	UINT64 StateChanges;            // Shaders, input assembler, rasterizer and output merger state
+	UINT64 RedundantStateChanges;
+	UINT64 Bindings;                // Constant buffers, views, samplers and vertex buffers, per slot
+	UINT64 RedundantBindings;
+	UINT64 Clears;
+	UINT64 Copies;                  // Copy*, UpdateSubresource and ResolveSubresource
+	double Seconds;                 // CPU time between the pass marks
+};
+
+class RecordingDeviceContext : public ID3D11DeviceContext
+{
+public:
+	/**
+	 * Forward to inner, or record only when it is NULL. In null mode GetDevice hands out device, so what
+	 * Renderer creates on demand still gets created.
+	 */
+	explicit RecordingDeviceContext(ID3D11DeviceContext* inner, ID3D11Device* device = NULL);
+	~RecordingDeviceContext();
+
+	// Pass times count from BeginFrame to EndFrame only
+	void BeginFrame();
+	void EndFrame();
+
+	// Passes nest, name is copied
+	void BeginPass(const char* name);
+	void EndPass();
+
+	// Drop the counters, the bound state is kept
+	void Reset();
+
+	UINT GetNumFrames() const                     { return mNumFrames; }
+	bool IsForwarding() const                     { return mInner != NULL; }
+
+	// Stats of a pass summed over the recorded frames, NULL if it never ran
+	const SubmissionStats* GetPassStats(const char* name) const;
+	SubmissionStats GetTotalStats() const;
+
+	// Per frame averages of every pass and the total, one line each
+	void Report(FILE* file) const;
+
+	// IUnknown
+	STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject);
+	STDMETHOD_(ULONG, AddRef)();
+	STDMETHOD_(ULONG, Release)();
+
+	// ID3D11DeviceChild
+	STDMETHOD_(void, GetDevice)(ID3D11Device** ppDevice);
+	STDMETHOD(GetPrivateData)(REFGUID guid, UINT* pDataSize, void* pData);
+	STDMETHOD(SetPrivateData)(REFGUID guid, UINT DataSize, const void* pData);
+	STDMETHOD(SetPrivateDataInterface)(REFGUID guid, const IUnknown* pData);
+
+	// Shader stages, the same eight calls each
+#define RECORDING_STAGE_METHODS(Stage, ShaderType) \
+	STDMETHOD_(void, Stage##SetShaderResources)(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews); \
+	STDMETHOD_(void, Stage##SetShader)(ShaderType* pShader, ID3D11ClassInstance* const* ppClassInstances, UINT NumClassInstances); \
+	STDMETHOD_(void, Stage##SetSamplers)(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState* const* ppSamplers); \
+	STDMETHOD_(void, Stage##SetConstantBuffers)(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppConstantBuffers); \
+	STDMETHOD_(void, Stage##GetShaderResources)(UINT StartSlot, UINT NumViews, ID3D11ShaderResourceView** ppShaderResourceViews); \
+	STDMETHOD_(void, Stage##GetShader)(ShaderType** ppShader, ID3D11ClassInstance** ppClassInstances, UINT* pNumClassInstances); \
+	STDMETHOD_(void, Stage##GetSamplers)(UINT StartSlot, UINT NumSamplers, ID3D11SamplerState** ppSamplers); \
+	STDMETHOD_(void, Stage##GetConstantBuffers)(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppConstantBuffers);
+
+	RECORDING_STAGE_METHODS(VS, ID3D11VertexShader)
+	RECORDING_STAGE_METHODS(HS, ID3D11HullShader)
+	RECORDING_STAGE_METHODS(DS, ID3D11DomainShader)
+	RECORDING_STAGE_METHODS(GS, ID3D11GeometryShader)
+	RECORDING_STAGE_METHODS(PS, ID3D11PixelShader)
+	RECORDING_STAGE_METHODS(CS, ID3D11ComputeShader)
+#undef RECORDING_STAGE_METHODS
+
+	// Draw and dispatch
+	STDMETHOD_(void, Draw)(UINT VertexCount, UINT StartVertexLocation);
+	STDMETHOD_(void, DrawIndexed)(UINT IndexCount, UINT StartIndexLocation, INT BaseVertexLocation);
+	STDMETHOD_(void, DrawInstanced)(UINT VertexCountPerInstance, UINT InstanceCount, UINT StartVertexLocation, UINT StartInstanceLocation);
+	STDMETHOD_(void, DrawIndexedInstanced)(UINT IndexCountPerInstance, UINT InstanceCount, UINT StartIndexLocation, INT BaseVertexLocation, UINT StartInstanceLocation);
+	STDMETHOD_(void, DrawAuto)();
+	STDMETHOD_(void, DrawIndexedInstancedIndirect)(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs);
+	STDMETHOD_(void, DrawInstancedIndirect)(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs);
+	STDMETHOD_(void, Dispatch)(UINT ThreadGroupCountX, UINT ThreadGroupCountY, UINT ThreadGroupCountZ);
+	STDMETHOD_(void, DispatchIndirect)(ID3D11Buffer* pBufferForArgs, UINT AlignedByteOffsetForArgs);
+
+	// Resources
+	STDMETHOD(Map)(ID3D11Resource* pResource, UINT Subresource, D3D11_MAP MapType, UINT MapFlags, D3D11_MAPPED_SUBRESOURCE* pMappedResource);
+	STDMETHOD_(void, Unmap)(ID3D11Resource* pResource, UINT Subresource);
+	STDMETHOD_(void, CopySubresourceRegion)(ID3D11Resource* pDstResource, UINT DstSubresource, UINT DstX, UINT DstY, UINT DstZ,
+		ID3D11Resource* pSrcResource, UINT SrcSubresource, const D3D11_BOX* pSrcBox);
+	STDMETHOD_(void, CopyResource)(ID3D11Resource* pDstResource, ID3D11Resource* pSrcResource);
+	STDMETHOD_(void, UpdateSubresource)(ID3D11Resource* pDstResource, UINT DstSubresource, const D3D11_BOX* pDstBox,
+		const void* pSrcData, UINT SrcRowPitch, UINT SrcDepthPitch);
+	STDMETHOD_(void, CopyStructureCount)(ID3D11Buffer* pDstBuffer, UINT DstAlignedByteOffset, ID3D11UnorderedAccessView* pSrcView);
+	STDMETHOD_(void, ClearRenderTargetView)(ID3D11RenderTargetView* pRenderTargetView, const FLOAT ColorRGBA[4]);
+	STDMETHOD_(void, ClearUnorderedAccessViewUint)(ID3D11UnorderedAccessView* pUnorderedAccessView, const UINT Values[4]);
+	STDMETHOD_(void, ClearUnorderedAccessViewFloat)(ID3D11UnorderedAccessView* pUnorderedAccessView, const FLOAT Values[4]);
+	STDMETHOD_(void, ClearDepthStencilView)(ID3D11DepthStencilView* pDepthStencilView, UINT ClearFlags, FLOAT Depth, UINT8 Stencil);
+	STDMETHOD_(void, GenerateMips)(ID3D11ShaderResourceView* pShaderResourceView);
+	STDMETHOD_(void, SetResourceMinLOD)(ID3D11Resource* pResource, FLOAT MinLOD);
+	STDMETHOD_(FLOAT, GetResourceMinLOD)(ID3D11Resource* pResource);
+	STDMETHOD_(void, ResolveSubresource)(ID3D11Resource* pDstResource, UINT DstSubresource, ID3D11Resource* pSrcResource,
+		UINT SrcSubresource, DXGI_FORMAT Format);
+
+	// Input assembler
+	STDMETHOD_(void, IASetInputLayout)(ID3D11InputLayout* pInputLayout);
+	STDMETHOD_(void, IASetVertexBuffers)(UINT StartSlot, UINT NumBuffers, ID3D11Buffer* const* ppVertexBuffers, const UINT* pStrides, const UINT* pOffsets);
+	STDMETHOD_(void, IASetIndexBuffer)(ID3D11Buffer* pIndexBuffer, DXGI_FORMAT Format, UINT Offset);
+	STDMETHOD_(void, IASetPrimitiveTopology)(D3D11_PRIMITIVE_TOPOLOGY Topology);
+	STDMETHOD_(void, IAGetInputLayout)(ID3D11InputLayout** ppInputLayout);
+	STDMETHOD_(void, IAGetVertexBuffers)(UINT StartSlot, UINT NumBuffers, ID3D11Buffer** ppVertexBuffers, UINT* pStrides, UINT* pOffsets);
+	STDMETHOD_(void, IAGetIndexBuffer)(ID3D11Buffer** pIndexBuffer, DXGI_FORMAT* Format, UINT* Offset);
+	STDMETHOD_(void, IAGetPrimitiveTopology)(D3D11_PRIMITIVE_TOPOLOGY* pTopology);
+
+	// Stream output, rasterizer, output merger
+	STDMETHOD_(void, SOSetTargets)(UINT NumBuffers, ID3D11Buffer* const* ppSOTargets, const UINT* pOffsets);
+	STDMETHOD_(void, SOGetTargets)(UINT NumBuffers, ID3D11Buffer** ppSOTargets);
+	STDMETHOD_(void, RSSetState)(ID3D11RasterizerState* pRasterizerState);
+	STDMETHOD_(void, RSSetViewports)(UINT NumViewports, const D3D11_VIEWPORT* pViewports);
+	STDMETHOD_(void, RSSetScissorRects)(UINT NumRects, const D3D11_RECT* pRects);
+	STDMETHOD_(void, RSGetState)(ID3D11RasterizerState** ppRasterizerState);
+	STDMETHOD_(void, RSGetViewports)(UINT* pNumViewports, D3D11_VIEWPORT* pViewports);
+	STDMETHOD_(void, RSGetScissorRects)(UINT* pNumRects, D3D11_RECT* pRects);
+	STDMETHOD_(void, OMSetRenderTargets)(UINT NumViews, ID3D11RenderTargetView* const* ppRenderTargetViews, ID3D11DepthStencilView* pDepthStencilView);
+	STDMETHOD_(void, OMSetRenderTargetsAndUnorderedAccessViews)(UINT NumRTVs, ID3D11RenderTargetView* const* ppRenderTargetViews,
+		ID3D11DepthStencilView* pDepthStencilView, UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews,
+		const UINT* pUAVInitialCounts);
+	STDMETHOD_(void, OMSetBlendState)(ID3D11BlendState* pBlendState, const FLOAT BlendFactor[4], UINT SampleMask);
+	STDMETHOD_(void, OMSetDepthStencilState)(ID3D11DepthStencilState* pDepthStencilState, UINT StencilRef);
+	STDMETHOD_(void, OMGetRenderTargets)(UINT NumViews, ID3D11RenderTargetView** ppRenderTargetViews, ID3D11DepthStencilView** ppDepthStencilView);
+	STDMETHOD_(void, OMGetRenderTargetsAndUnorderedAccessViews)(UINT NumRTVs, ID3D11RenderTargetView** ppRenderTargetViews,
+		ID3D11DepthStencilView** ppDepthStencilView, UINT UAVStartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews);
+	STDMETHOD_(void, OMGetBlendState)(ID3D11BlendState** ppBlendState, FLOAT BlendFactor[4], UINT* pSampleMask);
+	STDMETHOD_(void, OMGetDepthStencilState)(ID3D11DepthStencilState** ppDepthStencilState, UINT* pStencilRef);
+	STDMETHOD_(void, CSSetUnorderedAccessViews)(UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView* const* ppUnorderedAccessViews, const UINT* pUAVInitialCounts);
+	STDMETHOD_(void, CSGetUnorderedAccessViews)(UINT StartSlot, UINT NumUAVs, ID3D11UnorderedAccessView** ppUnorderedAccessViews);
+
+	// Queries, predication, command lists
+	STDMETHOD_(void, Begin)(ID3D11Asynchronous* pAsync);
+	STDMETHOD_(void, End)(ID3D11Asynchronous* pAsync);
+	STDMETHOD(GetData)(ID3D11Asynchronous* pAsync, void* pData, UINT DataSize, UINT GetDataFlags);
+	STDMETHOD_(void, SetPredication)(ID3D11Predicate* pPredicate, BOOL PredicateValue);
+	STDMETHOD_(void, GetPredication)(ID3D11Predicate** ppPredicate, BOOL* pPredicateValue);
+	STDMETHOD_(void, ExecuteCommandList)(ID3D11CommandList* pCommandList, BOOL RestoreContextState);
+	STDMETHOD(FinishCommandList)(BOOL RestoreDeferredContextState, ID3D11CommandList** ppCommandList);
+	STDMETHOD_(void, ClearState)();
+	STDMETHOD_(void, Flush)();
+	STDMETHOD_(D3D11_DEVICE_CONTEXT_TYPE, GetType)();
+	STDMETHOD_(UINT, GetContextFlags)();
+
+private:
+	enum Stage
+	{
+		Stage_Vertex = 0,
+		Stage_Hull,
+		Stage_Domain,
+		Stage_Geometry,
+		Stage_Pixel,
+		Stage_Compute,
+		Stage_Count
+	};
+
+	struct StageState
+	{
+		const void* Shader;
+		const void* ConstantBuffers[D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT];
+		const void* ShaderResources[D3D11_COMMONSHADER_INPUT_RESOURCE_SLOT_COUNT];
+		const void* Samplers[D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT];
+	};
+
+	// What the pipeline has bound, as far as the calls through here tell
+	struct BoundState
+	{
+		StageState Stages[Stage_Count];
+
+		const void* InputLayout;
+		const void* VertexBuffers[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		UINT VertexStrides[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		UINT VertexOffsets[D3D11_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+		const void* IndexBuffer;
+		DXGI_FORMAT IndexFormat;
+		UINT IndexOffset;
+		D3D11_PRIMITIVE_TOPOLOGY Topology;
+
+		const void* StreamOutTargets[D3D11_SO_BUFFER_SLOT_COUNT];
+		UINT StreamOutOffsets[D3D11_SO_BUFFER_SLOT_COUNT];
+
+		const void* RasterizerState;
+		UINT NumViewports;
+		D3D11_VIEWPORT Viewports[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+		UINT NumScissorRects;
+		D3D11_RECT ScissorRects[D3D11_VIEWPORT_AND_SCISSORRECT_OBJECT_COUNT_PER_PIPELINE];
+
+		UINT NumRenderTargets;
+		const void* RenderTargets[D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT];
+		const void* DepthStencil;
+		const void* UnorderedAccessViews[D3D11_PS_CS_UAV_REGISTER_COUNT];   // Pixel stage UAVs, compute below
+		const void* ComputeUnorderedAccessViews[D3D11_PS_CS_UAV_REGISTER_COUNT];
+		const void* BlendState;
+		FLOAT BlendFactor[4];
+		UINT SampleMask;
+		const void* DepthStencilState;
+		UINT StencilRef;
+
+		const void* Predicate;
+		BOOL PredicateValue;
+	};
+
+	struct PassRecord
+	{
+		std::string Name;
+		SubmissionStats Stats;
+	};
+
+	void ClearBoundState();
+
+	// Compare against the bound slots and take the new ones, counting bindings and redundant ones
+	template<typename T>
+	void BindSlots(const void** bound, UINT maxSlots, UINT startSlot, UINT count, T* const* objects);
+	void SetState(bool redundant);
+	void SetRenderTargets(UINT numViews, ID3D11RenderTargetView* const* views, ID3D11DepthStencilView* depthStencil);
+
+	void SetStageShaderResources(Stage stage, UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* views);
+	void SetStageShader(Stage stage, const void* shader);
+	void SetStageSamplers(Stage stage, UINT startSlot, UINT numSamplers, ID3D11SamplerState* const* samplers);
+	void SetStageConstantBuffers(Stage stage, UINT startSlot, UINT numBuffers, ID3D11Buffer* const* buffers);
+
+	void RecordDraw(UINT64 vertices);
+	void RecordCopy();
+
+	// Close the time slice of the current pass
+	void AccumulateTime();
+
+	void* GetScratchMemory(ID3D11Resource* resource, UINT subresource, D3D11_MAPPED_SUBRESOURCE* mapped);
+
+private:
+	ID3D11DeviceContext* mInner;
+	ID3D11Device* mDevice;
+	ULONG mRefCount;
+
+	BoundState mBound;
+
+	std::vector<PassRecord> mPasses;
+	std::vector<size_t> mPassStack;
+	SubmissionStats* mCurrent;
+
+	UINT mNumFrames;
+	bool mInFrame;
+	double mSliceStart;
+
+	// Null mode Map targets, per resource and subresource
+	std::map<std::pair<ID3D11Resource*, UINT>, std::vector<BYTE> > mScratch;
+
+private:
+	// Not implemented
+	RecordingDeviceContext(const RecordingDeviceContext&);
+	RecordingDeviceContext& operator=(const RecordingDeviceContext&);
+};
+
+/**
+ * Marks a pass for the recorder while in scope. Finding the recorder is one QueryInterface, which a real
+ * context fails, so Renderer keeps the marks in every build.
+ */
+class RecordingPass
+{
+public:
+	RecordingPass(ID3D11DeviceContext* context, const char* name);
+	~RecordingPass();
+
+private:
+	RecordingDeviceContext* mRecorder;
+
+private:
+	// Not implemented
+	RecordingPass(const RecordingPass&);
+	RecordingPass& operator=(const RecordingPass&);
+};
+
+// QueryInterface of a RecordingDeviceContext answers it with the recorder itself
+extern const IID IID_RecordingDeviceContext;
+
+#endif // RecordingDeviceContext_h__
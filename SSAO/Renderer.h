@@ -4,12 +4,14 @@
 #include "SDKmisc.h"
 #include "Shader.h"
 #include "ShaderContanst.h"
+#include "AmbientOcclusionParams.h"
+#include "LightVolumeBatch.h"
+#include "ConstantRing.h"
+#include "DrawQueue.h"
 #include <vector>
 #include <memory>
 #include <algorithm>
 
-#define Float4Align __declspec(align(16))
-
 using std::shared_ptr;
 
 template<typename T> class Shader;
@@ -35,14 +37,6 @@ enum LightingMethod
 	Lighting_Deferred,
 };
 
-enum AmbientOcclusionTechnique
-{
-	AO_Cryteck = 0,
-	AO_HBAO,
-	AO_Unreal4,
-	AO_Alchemy
-};
-
 class Renderer
 {
 public:
@@ -61,10 +55,41 @@ public:
 	void RenderDeferred(ID3D11DeviceContext* d3dDeviceContext, ID3D11RenderTargetView* backBuffer, ID3D11DepthStencilView* backDepth,
 		const Scene& scene, const LightAnimation& lights, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
 
+	// Dump depth, GBuffer and AO of the last rendered frame into a FrameCapture file
+	bool CaptureFrame(ID3D11DeviceContext* d3dDeviceContext, const CFirstPersonCamera& viewerCamera, const char* filename);
+
 private:
 
 	void RenderGBuffer(ID3D11DeviceContext* d3dDeviceContext, const Scene& scene, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
 
+	/**
+	 * Draw the opaque subsets in mVisibleOpaque. With firstObjectInstance InvalidOffset the per object constants
+	 * are mapped when the SceneMesh changes, otherwise they come from UploadObjectConstants and each SceneMesh
+	 * is one instance further into the constant ring.
+	 */
+	void RenderVisibleOpaque(ID3D11DeviceContext* d3dDeviceContext, const Scene& scene, const CFirstPersonCamera& viewerCamera, UINT diffuseSlot, UINT firstObjectInstance);
+
+	/**
+	 * Fill mOpaqueQueue with the subsets in mVisibleOpaque, drawn with shader, keyed by pass, material and
+	 * view depth, and sort it. Instances are the same as RenderVisibleOpaque with the ring.
+	 */
+	void BuildOpaqueQueue(const Scene& scene, const CFirstPersonCamera& viewerCamera, UINT firstObjectInstance, uint32_t pass, const DrawShader& shader);
+
+	/**
+	 * PerObjectConstants of every SceneMesh run in mVisibleOpaque in one ring upload, returns the first instance.
+	 * With lights the DirectionalLightInstance of each directional light follows in the same allocation, a second
+	 * map could start the ring over before the draws, firstLightOffset is the byte offset of the first one then.
+	 */
+	UINT UploadObjectConstants(ID3D11DeviceContext* d3dDeviceContext, const Scene& scene, const CFirstPersonCamera& viewerCamera,
+		const LightAnimation* lights = nullptr, UINT* firstLightOffset = nullptr);
+
+	// Map size bytes of mConstantRingBuffer at offset, growing it when they don't fit, see MapRing
+	void* MapConstants(ID3D11DeviceContext* d3dDeviceContext, UINT size, UINT alignment, UINT* offset);
+
+	// Free the ring space of the frames the GPU has finished, and fence the frame just recorded
+	void RetireConstantFrames(ID3D11DeviceContext* d3dDeviceContext);
+	void EndConstantFrame(ID3D11DeviceContext* d3dDeviceContext);
+
 	void ComputeShading(ID3D11DeviceContext* d3dDeviceContext, const LightAnimation& lights, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
 
 	void RenderCryteckSSAO(ID3D11DeviceContext* d3dDeviceContext, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
@@ -74,6 +99,9 @@ private:
 	void RenderAlchemyAO(ID3D11DeviceContext* d3dDeviceContext, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
 
 	void RenderUnreal4AO(ID3D11DeviceContext* d3dDeviceContext, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
+
+	// Separable cross bilateral blur of mAOBuffer, expects the full screen triangle state of the AO pass
+	void BlurAO(ID3D11DeviceContext* d3dDeviceContext, const CFirstPersonCamera& viewerCamera, const D3D11_VIEWPORT* viewport);
 	
 	void DrawPointLight(ID3D11DeviceContext* d3dDeviceContext, const LightAnimation& lights, const CFirstPersonCamera& viewerCamera);
 
@@ -83,6 +111,9 @@ private:
 
 	void DrawLightVolumeDebug(ID3D11DeviceContext* d3dDeviceContext, const LightAnimation& lights, const CFirstPersonCamera& viewerCamera);
 
+	// Instance buffer with room for numInstances lights, recreated when it is too small
+	ID3D11Buffer* ReserveLightVolumeInstances(ID3D11DeviceContext* d3dDeviceContext, size_t numInstances);
+
 	void PostProcess(ID3D11DeviceContext* d3dDeviceContext, ID3D11RenderTargetView* backBuffer, ID3D11DepthStencilView* backDepth, const D3D11_VIEWPORT* viewport);
 
 	void EdgeAA(ID3D11DeviceContext* d3dDeviceContext, ID3D11RenderTargetView* backBuffer, const D3D11_VIEWPORT* viewport);
@@ -96,14 +127,29 @@ private:
 
 	void CreateConstantBuffers(ID3D11Device* d3dDevice);
 
+	void CreateConstantRing(ID3D11Device* d3dDevice, UINT capacity);
+
 	void CreateRenderStates(ID3D11Device* d3dDevice);
 
+	void FillPerFrameConstants(PerFrameConstants* constants, const CFirstPersonCamera& viewerCamera) const;
+
 public:
 
 	bool mLightPrePass;
 	bool mUseSSAO;
 	bool mShowAO;
 
+	// Point light volumes as one instanced draw per LightVolumeGroup, otherwise one draw per light
+	bool mInstancedLightVolumes;
+
+	// Per object constants, point light instances and directional lights written once per pass into the
+	// constant ring, otherwise mapped with WRITE_DISCARD per draw
+	bool mUseConstantRing;
+
+	// Opaque draws of the GBuffer and forward passes sorted by material and depth with the redundant state
+	// left out, otherwise in scene order. Needs the constant ring
+	bool mSortDraws;
+
 	LightingMethod mLightingMethod;
 	LightCullTechnique mCullTechnique;
 	AmbientOcclusionTechnique mAOTechnique;
@@ -119,6 +165,10 @@ private:
 
 	ID3D11InputLayout* mMeshVertexLayout;
 	ID3D11InputLayout* mLightProxyVertexLayout;
+	ID3D11InputLayout* mLightVolumeInstanceLayout;
+	ID3D11InputLayout* mMeshObjectStreamLayout;   // mMeshVertexLayout plus the PerObjectConstants instance stream
+	ID3D11InputLayout* mMeshObjectLightStreamLayout;   // mMeshObjectStreamLayout plus a DirectionalLightInstance
+	ID3D11InputLayout* mDirectionalLightInstanceLayout;
 
 	ID3D11Buffer* mPerFrameConstants;
 	ID3D11Buffer* mPerObjectConstants;
@@ -146,11 +196,15 @@ private:
 
 	// GBuffer Shaders
 	shared_ptr<VertexShader> mGBufferVS;
+	shared_ptr<VertexShader> mGBufferStreamVS;   // ObjectConstantStream
 	shared_ptr<PixelShader> mGBufferPS;
 
 	// forward shader
 	shared_ptr<VertexShader> mForwardDirectionalVS;
+	shared_ptr<VertexShader> mForwardDirectionalStreamVS;
 	shared_ptr<PixelShader> mForwardDirectionalPS;
+	shared_ptr<VertexShader> mForwardDirectionalLightStreamVS;   // ObjectConstantStream, LightInstanceStream
+	shared_ptr<PixelShader> mForwardDirectionalLightStreamPS;
 
 	// classic deferred shading, for each light type
 	shared_ptr<VertexShader> mDeferredShadingVS[3];
@@ -159,6 +213,16 @@ private:
 	// deferred lighting, lighting pass
 	shared_ptr<PixelShader> mDeferredLightingPS[3];
 
+	// instanced point light volumes
+	shared_ptr<VertexShader> mLightVolumeInstancedVS;
+	shared_ptr<PixelShader> mDeferredShadingInstancedPS;
+	shared_ptr<PixelShader> mDeferredLightingInstancedPS;
+
+	// Directional lights as instances of the full screen triangle, light comes from the instance data
+	shared_ptr<VertexShader> mDirectionalLightInstancedVS;
+	shared_ptr<PixelShader> mDeferredShadingDirectionalInstancedPS;
+	shared_ptr<PixelShader> mDeferredLightingDirectionalInstancedPS;
+
 	// deferred lighting, shading pass
 	shared_ptr<PixelShader> mDeferredLightingShadingPS;
 
@@ -208,5 +272,27 @@ private:
 
 	CDXUTSDKMesh* mPointLightProxy;
 	CDXUTSDKMesh* mSpotLightProxy;	
+
+	// Point light volumes of this frame, packed and drawn by the instanced path
+	LightVolumePass mLightVolumePass;
+	LightVolumeBatch mLightVolumeBatch;
+	ID3D11Buffer* mLightVolumeInstances;
+	UINT mLightVolumeInstanceCapacity;
+
+	// Dynamic vertex buffer suballocated by mConstantRing, per draw constants are read as instance data
+	ConstantRing mConstantRing;
+	ID3D11Buffer* mConstantRingBuffer;
+
+	// Event query at the end of each frame, the ring frees a frame once its query is signaled
+	static const UINT MaxFramesInFlight = 4;
+	ID3D11Query* mFrameFences[MaxFramesInFlight];
+	UINT64 mFrameIndex;
+	UINT64 mRetiredFrames;
+
+	// Scene::mSceneObjectsOpaque inside the camera frustum this frame
+	std::vector<uint32_t> mVisibleOpaque;
+
+	// mVisibleOpaque of the current pass, sorted
+	DrawQueue mOpaqueQueue;
 };
 
@@ -0,0 +1,228 @@
+#include "SDKMeshFile.h"
+
+namespace {
+
+const uint32_t InvalidIndex = 0xFFFFFFFF;
+
+const uint16_t DeclEndStream = 0xFF;
+
+// Bytes of each D3DDECLTYPE, FLOAT1 to FLOAT16_4
+const uint32_t DeclTypeSizes[] = { 4, 8, 12, 16, 4, 4, 4, 8, 4, 4, 8, 4, 8, 4, 4, 4, 8 };
+
+// The structures are read in place, their layout has to be the one the DXUT structures have in the file
+static_assert(sizeof(SDKMeshHeader) == 104, "SDKMESH_HEADER layout");
+static_assert(sizeof(SDKMeshVertexBuffer) == 288, "SDKMESH_VERTEX_BUFFER_HEADER layout");
+static_assert(sizeof(SDKMeshIndexBuffer) == 32, "SDKMESH_INDEX_BUFFER_HEADER layout");
+static_assert(sizeof(SDKMeshMesh) == 224, "SDKMESH_MESH layout");
+static_assert(sizeof(SDKMeshSubset) == 144, "SDKMESH_SUBSET layout");
+static_assert(sizeof(SDKMeshFrame) == 184, "SDKMESH_FRAME layout");
+static_assert(sizeof(SDKMeshMaterial) == 1256, "SDKMESH_MATERIAL layout");
+
+inline bool InRange(uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t size)
+{
+	return offset <= size && count <= (size - offset) / elementSize;
+}
+
+inline uint64_t IndexSize(const SDKMeshIndexBuffer& buffer)
+{
+	return buffer.IndexType == SDKMeshIndex_16Bit ? 2 : 4;
+}
+
+}
+
+SDKMeshFile::SDKMeshFile()
+	: mData(NULL), mHeader(NULL), mSize(0)
+{
+
+}
+
+SDKMeshFile::~SDKMeshFile()
+{
+	Close();
+}
+
+bool SDKMeshFile::Open( const char* filename )
+{
+	Close();
+
+	if (!mFile.Open(filename) || mFile.GetSize() < sizeof(SDKMeshHeader))
+	{
+		mFile.Close();
+		return false;
+	}
+
+	mData = mFile.GetData();
+	mSize = mFile.GetSize();
+	mHeader = reinterpret_cast<const SDKMeshHeader*>(mData);
+
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+bool SDKMeshFile::OpenMemory( const void* data, uint64_t size )
+{
+	Close();
+
+	if (data == NULL || size < sizeof(SDKMeshHeader))
+		return false;
+
+	mData = static_cast<const uint8_t*>(data);
+	mHeader = reinterpret_cast<const SDKMeshHeader*>(mData);
+	mSize = size;
+
+	if (!Validate())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void SDKMeshFile::Close()
+{
+	mFile.Close();
+
+	mData = NULL;
+	mHeader = NULL;
+	mSize = 0;
+}
+
+bool SDKMeshFile::Validate() const
+{
+	// IsBigEndian is not checked, the exporter sets it on little endian files too and DXUT ignores it
+	const SDKMeshHeader& header = *mHeader;
+	if (header.Version != SDKMeshFileVersion)
+		return false;
+
+	if (!InRange(header.VertexStreamHeadersOffset, header.NumVertexBuffers, sizeof(SDKMeshVertexBuffer), mSize) ||
+		!InRange(header.IndexStreamHeadersOffset, header.NumIndexBuffers, sizeof(SDKMeshIndexBuffer), mSize) ||
+		!InRange(header.MeshDataOffset, header.NumMeshes, sizeof(SDKMeshMesh), mSize) ||
+		!InRange(header.SubsetDataOffset, header.NumTotalSubsets, sizeof(SDKMeshSubset), mSize) ||
+		!InRange(header.FrameDataOffset, header.NumFrames, sizeof(SDKMeshFrame), mSize) ||
+		!InRange(header.MaterialDataOffset, header.NumMaterials, sizeof(SDKMeshMaterial), mSize))
+		return false;
+
+	const ArrayView<SDKMeshVertexBuffer> vertexBuffers = GetVertexBuffers();
+	for (size_t i = 0; i < vertexBuffers.Size; ++i)
+	{
+		const SDKMeshVertexBuffer& buffer = vertexBuffers[i];
+		if (buffer.StrideBytes == 0 || buffer.NumVertices > buffer.SizeBytes / buffer.StrideBytes ||
+			!InRange(buffer.DataOffset, buffer.SizeBytes, 1, mSize))
+			return false;
+	}
+
+	const ArrayView<SDKMeshIndexBuffer> indexBuffers = GetIndexBuffers();
+	for (size_t i = 0; i < indexBuffers.Size; ++i)
+	{
+		const SDKMeshIndexBuffer& buffer = indexBuffers[i];
+		if (buffer.IndexType > SDKMeshIndex_32Bit || buffer.NumIndices > buffer.SizeBytes / IndexSize(buffer) ||
+			!InRange(buffer.DataOffset, buffer.SizeBytes, 1, mSize))
+			return false;
+	}
+
+	const ArrayView<SDKMeshSubset> subsets = GetSubsets();
+	for (size_t i = 0; i < subsets.Size; ++i)
+	{
+		if (subsets[i].MaterialID >= header.NumMaterials && subsets[i].MaterialID != InvalidIndex)
+			return false;
+	}
+
+	// Subset ranges are checked against the buffers of the meshes using them
+	const ArrayView<SDKMeshMesh> meshes = GetMeshes();
+	for (size_t i = 0; i < meshes.Size; ++i)
+	{
+		const SDKMeshMesh& mesh = meshes[i];
+		if (mesh.NumVertexBuffers == 0 || mesh.NumVertexBuffers > SDKMeshMaxVertexStreams || mesh.IndexBuffer >= header.NumIndexBuffers ||
+			!InRange(mesh.SubsetOffset, mesh.NumSubsets, sizeof(uint32_t), mSize) ||
+			!InRange(mesh.FrameInfluenceOffset, mesh.NumFrameInfluences, sizeof(uint32_t), mSize))
+			return false;
+
+		for (uint32_t s = 0; s < mesh.NumVertexBuffers; ++s)
+		{
+			if (mesh.VertexBuffers[s] >= header.NumVertexBuffers)
+				return false;
+		}
+
+		const uint64_t numIndices = indexBuffers[mesh.IndexBuffer].NumIndices;
+		const uint64_t numVertices = vertexBuffers[mesh.VertexBuffers[0]].NumVertices;
+
+		const ArrayView<uint32_t> meshSubsets = GetMeshSubsets(uint32_t(i));
+		for (size_t s = 0; s < meshSubsets.Size; ++s)
+		{
+			if (meshSubsets[s] >= header.NumTotalSubsets)
+				return false;
+
+			const SDKMeshSubset& subset = subsets[meshSubsets[s]];
+			if (subset.IndexStart > numIndices || subset.IndexCount > numIndices - subset.IndexStart ||
+				subset.VertexStart > numVertices || subset.VertexCount > numVertices - subset.VertexStart)
+				return false;
+		}
+	}
+
+	const ArrayView<SDKMeshFrame> frames = GetFrames();
+	for (size_t i = 0; i < frames.Size; ++i)
+	{
+		const SDKMeshFrame& frame = frames[i];
+		if ((frame.Mesh >= header.NumMeshes && frame.Mesh != InvalidIndex) ||
+			(frame.ParentFrame >= header.NumFrames && frame.ParentFrame != InvalidIndex) ||
+			(frame.ChildFrame >= header.NumFrames && frame.ChildFrame != InvalidIndex) ||
+			(frame.SiblingFrame >= header.NumFrames && frame.SiblingFrame != InvalidIndex))
+			return false;
+	}
+
+	return true;
+}
+
+ArrayView<uint32_t> SDKMeshFile::GetMeshSubsets( uint32_t mesh ) const
+{
+	const SDKMeshMesh& meshHeader = GetMeshes()[mesh];
+	return Table<uint32_t>(meshHeader.SubsetOffset, meshHeader.NumSubsets);
+}
+
+ArrayView<uint8_t> SDKMeshFile::GetVertexData( uint32_t vertexBuffer ) const
+{
+	const SDKMeshVertexBuffer& buffer = GetVertexBuffers()[vertexBuffer];
+	return Table<uint8_t>(buffer.DataOffset, buffer.NumVertices * buffer.StrideBytes);
+}
+
+ArrayView<uint16_t> SDKMeshFile::GetIndices16( uint32_t indexBuffer ) const
+{
+	const SDKMeshIndexBuffer& buffer = GetIndexBuffers()[indexBuffer];
+	if (buffer.IndexType != SDKMeshIndex_16Bit)
+		return ArrayView<uint16_t>();
+
+	return Table<uint16_t>(buffer.DataOffset, buffer.NumIndices);
+}
+
+ArrayView<uint32_t> SDKMeshFile::GetIndices32( uint32_t indexBuffer ) const
+{
+	const SDKMeshIndexBuffer& buffer = GetIndexBuffers()[indexBuffer];
+	if (buffer.IndexType != SDKMeshIndex_32Bit)
+		return ArrayView<uint32_t>();
+
+	return Table<uint32_t>(buffer.DataOffset, buffer.NumIndices);
+}
+
+int SDKMeshFile::GetElementOffset( uint32_t vertexBuffer, SDKMeshDeclUsage usage, uint8_t usageIndex, SDKMeshDeclType type ) const
+{
+	const SDKMeshVertexBuffer& buffer = GetVertexBuffers()[vertexBuffer];
+	for (int i = 0; i < SDKMeshMaxVertexElements && buffer.Decl[i].Stream != DeclEndStream; ++i)
+	{
+		const SDKMeshVertexElement& element = buffer.Decl[i];
+		if (element.Usage == usage && element.UsageIndex == usageIndex && element.Type == type &&
+			element.Offset + DeclTypeSizes[type] <= buffer.StrideBytes)
+			return element.Offset;
+	}
+	return -1;
+}
+
+int SDKMeshFile::GetPositionOffset( uint32_t vertexBuffer ) const
+{
+	return GetElementOffset(vertexBuffer, SDKMeshUsage_Position, 0, SDKMeshType_Float3);
+}
@@ -0,0 +1,244 @@
+#ifndef SDKMeshFile_h__
+#define SDKMeshFile_h__
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The on disk structures of the .sdkmesh format (version 101), as SDKmesh.h declares them but without the
+ * D3D9/D3D11 pointers the loader patches into the unions, so they can be read on any platform. Offsets are
+ * from the start of the file.
+ */
+const uint32_t SDKMeshFileVersion = 101;
+const int SDKMeshMaxVertexElements = 32;
+const int SDKMeshMaxVertexStreams = 16;
+const int SDKMeshMaxName = 100;
+const int SDKMeshMaxPath = 260;
+
+// D3DDECLUSAGE and D3DDECLTYPE values of the vertex declarations, the ones used here
+enum SDKMeshDeclUsage
+{
+	SDKMeshUsage_Position = 0,
+	SDKMeshUsage_Normal = 3,
+	SDKMeshUsage_TexCoord = 5
+};
+
+enum SDKMeshDeclType
+{
+	SDKMeshType_Float2 = 1,
+	SDKMeshType_Float3 = 2,
+	SDKMeshType_Short2N = 9,
+	SDKMeshType_UShort4N = 12,
+	SDKMeshType_Float16_2 = 15
+};
+
+enum SDKMeshIndexType
+{
+	SDKMeshIndex_16Bit = 0,
+	SDKMeshIndex_32Bit
+};
+
+struct SDKMeshHeader
+{
+	uint32_t Version;
+	uint8_t IsBigEndian;
+	uint64_t HeaderSize;
+	uint64_t NonBufferDataSize;
+	uint64_t BufferDataSize;
+
+	uint32_t NumVertexBuffers;
+	uint32_t NumIndexBuffers;
+	uint32_t NumMeshes;
+	uint32_t NumTotalSubsets;
+	uint32_t NumFrames;
+	uint32_t NumMaterials;
+
+	uint64_t VertexStreamHeadersOffset;
+	uint64_t IndexStreamHeadersOffset;
+	uint64_t MeshDataOffset;
+	uint64_t SubsetDataOffset;
+	uint64_t FrameDataOffset;
+	uint64_t MaterialDataOffset;
+};
+
+// D3DVERTEXELEMENT9, a Stream of 0xFF ends the declaration
+struct SDKMeshVertexElement
+{
+	uint16_t Stream;
+	uint16_t Offset;
+	uint8_t Type;
+	uint8_t Method;
+	uint8_t Usage;
+	uint8_t UsageIndex;
+};
+
+struct SDKMeshVertexBuffer
+{
+	uint64_t NumVertices;
+	uint64_t SizeBytes;
+	uint64_t StrideBytes;
+	SDKMeshVertexElement Decl[SDKMeshMaxVertexElements];
+	uint64_t DataOffset;
+};
+
+struct SDKMeshIndexBuffer
+{
+	uint64_t NumIndices;
+	uint64_t SizeBytes;
+	uint32_t IndexType;
+	uint64_t DataOffset;
+};
+
+struct SDKMeshMesh
+{
+	char Name[SDKMeshMaxName];
+	uint8_t NumVertexBuffers;
+	uint32_t VertexBuffers[SDKMeshMaxVertexStreams];
+	uint32_t IndexBuffer;
+	uint32_t NumSubsets;
+	uint32_t NumFrameInfluences;
+
+	float BoundingBoxCenter[3];
+	float BoundingBoxExtents[3];
+
+	uint64_t SubsetOffset;              // uint32_t[NumSubsets], indices into the subset table
+	uint64_t FrameInfluenceOffset;      // uint32_t[NumFrameInfluences]
+};
+
+struct SDKMeshSubset
+{
+	char Name[SDKMeshMaxName];
+	uint32_t MaterialID;
+	uint32_t PrimitiveType;             // SDKMESH_PRIMITIVE_TYPE
+	uint64_t IndexStart;
+	uint64_t IndexCount;
+	uint64_t VertexStart;
+	uint64_t VertexCount;
+};
+
+struct SDKMeshFrame
+{
+	char Name[SDKMeshMaxName];
+	uint32_t Mesh;
+	uint32_t ParentFrame;
+	uint32_t ChildFrame;
+	uint32_t SiblingFrame;
+	float Matrix[16];
+	uint32_t AnimationDataIndex;
+};
+
+struct SDKMeshMaterial
+{
+	char Name[SDKMeshMaxName];
+	char MaterialInstancePath[SDKMeshMaxPath];
+	char DiffuseTexture[SDKMeshMaxPath];
+	char NormalTexture[SDKMeshMaxPath];
+	char SpecularTexture[SDKMeshMaxPath];
+
+	float Diffuse[4];
+	float Ambient[4];
+	float Specular[4];
+	float Emissive[4];
+	float Power;
+
+	// Texture and view pointers at run time, unused in the file
+	uint64_t Reserved[6];
+};
+
+/**
+ * Read only run of elements inside a mapping, nothing is owned or copied.
+ */
+template <typename T>
+struct ArrayView
+{
+	const T* Data;
+	size_t Size;
+
+	ArrayView() : Data(NULL), Size(0) {}
+	ArrayView(const T* data, size_t size) : Data(data), Size(size) {}
+
+	const T& operator[](size_t i) const         { return Data[i]; }
+	const T* begin() const                      { return Data; }
+	const T* end() const                        { return Data + Size; }
+	bool empty() const                          { return Size == 0; }
+};
+
+/**
+ * Device independent .sdkmesh reader. CDXUTSDKMesh reads the file into the heap and creates D3D buffers and
+ * textures while parsing, this one memory maps the file and hands out views of the tables and buffers,
+ * so tools without a device (culling, BVH builds, AO baking) can use the scene meshes. It needs neither DXUT
+ * nor Windows, files are mapped with mmap on other platforms.
+ *
+ * All tables, buffer ranges and cross references are validated when the file is opened, the getters don't
+ * check again. Views are valid until Close() or destruction.
+ */
+class SDKMeshFile
+{
+public:
+	SDKMeshFile();
+	~SDKMeshFile();
+
+	bool Open(const char* filename);
+
+	/**
+	 * Parse a file already in memory, e.g. read by the caller. The memory is not copied and must outlive the
+	 * views, Close() does not free it.
+	 */
+	bool OpenMemory(const void* data, uint64_t size);
+
+	void Close();
+
+	bool IsOpen() const                                          { return mData != NULL; }
+
+	const SDKMeshHeader& GetHeader() const                       { return *mHeader; }
+
+	ArrayView<SDKMeshVertexBuffer> GetVertexBuffers() const      { return Table<SDKMeshVertexBuffer>(mHeader->VertexStreamHeadersOffset, mHeader->NumVertexBuffers); }
+	ArrayView<SDKMeshIndexBuffer> GetIndexBuffers() const        { return Table<SDKMeshIndexBuffer>(mHeader->IndexStreamHeadersOffset, mHeader->NumIndexBuffers); }
+	ArrayView<SDKMeshMesh> GetMeshes() const                     { return Table<SDKMeshMesh>(mHeader->MeshDataOffset, mHeader->NumMeshes); }
+	ArrayView<SDKMeshSubset> GetSubsets() const                  { return Table<SDKMeshSubset>(mHeader->SubsetDataOffset, mHeader->NumTotalSubsets); }
+	ArrayView<SDKMeshFrame> GetFrames() const                    { return Table<SDKMeshFrame>(mHeader->FrameDataOffset, mHeader->NumFrames); }
+	ArrayView<SDKMeshMaterial> GetMaterials() const              { return Table<SDKMeshMaterial>(mHeader->MaterialDataOffset, mHeader->NumMaterials); }
+
+	// Indices into GetSubsets() of the subsets of a mesh
+	ArrayView<uint32_t> GetMeshSubsets(uint32_t mesh) const;
+
+	// Raw vertex bytes, NumVertices * StrideBytes
+	ArrayView<uint8_t> GetVertexData(uint32_t vertexBuffer) const;
+
+	// Only the one matching the buffer's IndexType is valid, the other is empty
+	ArrayView<uint16_t> GetIndices16(uint32_t indexBuffer) const;
+	ArrayView<uint32_t> GetIndices32(uint32_t indexBuffer) const;
+
+	/**
+	 * Byte offset of the first element of a usage and type in a vertex, -1 if the declaration has none
+	 * or it doesn't fit in the stride.
+	 */
+	int GetElementOffset(uint32_t vertexBuffer, SDKMeshDeclUsage usage, uint8_t usageIndex, SDKMeshDeclType type) const;
+
+	// The first float3 POSITION
+	int GetPositionOffset(uint32_t vertexBuffer) const;
+
+private:
+	template <typename T>
+	ArrayView<T> Table(uint64_t offset, uint64_t count) const
+	{
+		return ArrayView<T>(reinterpret_cast<const T*>(mData + offset), size_t(count));
+	}
+
+	bool Validate() const;
+
+	// Not implemented
+	SDKMeshFile(const SDKMeshFile&);
+	SDKMeshFile& operator=(const SDKMeshFile&);
+
+private:
+	// File mapping of Open, not used by OpenMemory
+	MappedFile mFile;
+
+	const uint8_t* mData;
+	const SDKMeshHeader* mHeader;
+	uint64_t mSize;
+};
+
+#endif // SDKMeshFile_h__
@@ -1,5 +1,32 @@
 #include "DXUT.h"
 #include "Scene.h"
+#include "Utility.h"
+#include <algorithm>
+
+namespace {
+
+// CDXUTSDKMesh over a file SceneLoader has read, the data is taken over like CreateFromFile does with its own
+class LoadedSDKMesh : public CDXUTSDKMesh
+{
+public:
+	HRESULT CreateFromLoaded(ID3D11Device* d3dDevice, SceneLoader::LoadedMesh& loaded)
+	{
+		// Textures are found relative to the mesh
+		strcpy_s(m_strPath, MAX_PATH, loaded.Filename.c_str());
+		char* lastSlash = strrchr(m_strPath, '\\');
+		if (lastSlash)
+			*(lastSlash + 1) = '\0';
+		else
+			*m_strPath = '\0';
+		MultiByteToWideChar(CP_ACP, 0, m_strPath, -1, m_strPathW, MAX_PATH);
+
+		BYTE* data = loaded.Data;
+		loaded.Data = NULL;
+		return CreateFromMemory(d3dDevice, NULL, data, loaded.DataBytes, false, false);
+	}
+};
+
+}
 
 Scene::Scene(void)
 {
@@ -19,19 +46,108 @@ Scene::~Scene(void)
 
 void Scene::LoadOpaqueMesh( ID3D11Device* d3dDevice, LPCTSTR filename, const D3DXMATRIX& worldMatrix )
 {
+	AddOpaqueMesh(filename, worldMatrix);
+	StartLoading();
+
+	mLoader.Wait();
+	UpdateLoading(d3dDevice);
+}
+
+void Scene::AddOpaqueMesh( LPCTSTR filename, const D3DXMATRIX& worldMatrix )
+{
+	WCHAR path[MAX_PATH];
+	if (FAILED(DXUTFindDXSDKMediaFileCch(path, MAX_PATH, filename)))
+	{
+		OutputDebugString(L"Scene: mesh not found\n");
+		return;
+	}
+
+	char pathA[MAX_PATH];
+	WideCharToMultiByte(CP_ACP, 0, path, -1, pathA, MAX_PATH, NULL, FALSE);
+	mLoader.Add(pathA, worldMatrix);
+}
+
+void Scene::StartLoading()
+{
+	mLoader.Start();
+}
+
+bool Scene::UpdateLoading( ID3D11Device* d3dDevice )
+{
+	bool added = false;
+	while (SceneLoader::LoadedMesh* loaded = mLoader.PopNext())
+	{
+		AddLoadedMesh(d3dDevice, *loaded);
+		delete loaded;
+		added = true;
+	}
+
+	// Static scene, rebuild once per batch of finished meshes
+	if (added)
+	{
+		std::vector<BoundingBox> objectBounds(mSceneObjectsOpaque.size());
+		for (size_t i = 0; i < mSceneObjectsOpaque.size(); ++i)
+			objectBounds[i] = mSceneObjectsOpaque[i].Bound;
+
+		mOpaqueCulling.Build(objectBounds);
+	}
+
+	return mLoader.IsDone();
+}
+
+void Scene::AddLoadedMesh( ID3D11Device* d3dDevice, SceneLoader::LoadedMesh& loaded )
+{
+	if (!loaded.Data)
+	{
+		OutputDebugStringA(("Scene: failed to read " + loaded.Filename + "\n").c_str());
+		return;
+	}
+
+	LoadedSDKMesh* mesh = new LoadedSDKMesh;
+	if (FAILED(mesh->CreateFromLoaded(d3dDevice, loaded)))
+	{
+		OutputDebugStringA(("Scene: failed to create " + loaded.Filename + "\n").c_str());
+		delete mesh;
+		return;
+	}
+
 	SceneMesh entity;
-	entity.Mesh = new CDXUTSDKMesh;
-	entity.Mesh->Create(d3dDevice, filename);
-	entity.World = worldMatrix;
+	entity.Mesh = mesh;
+	entity.World = loaded.World;
 	mSceneMeshesOpaque.push_back(entity);
 
-
-	for (size_t i = 0; i < entity.Mesh->GetNumMeshes(); ++i)
+	// The loader bounded the subsets in this order
+	size_t subsetBound = 0;
+	for (UINT i = 0; i < mesh->GetNumMeshes(); ++i)
 	{
-		D3DXVECTOR3 center = entity.Mesh->GetMeshBBoxCenter(i);
-		D3DXVECTOR3 extent = entity.Mesh->GetMeshBBoxExtents(i);
-		
-		BoundingBox box(center - extent * 0.5f, center + extent * 0.5f);	
-		mWorldBound.Merge(box);
+		for (UINT subset = 0; subset < mesh->GetNumSubsets(i); ++subset)
+		{
+			SceneObject object;
+			object.SceneMeshIndex = static_cast<uint32_t>(mSceneMeshesOpaque.size() - 1);
+			object.Mesh = i;
+			object.Subset = subset;
+			object.Bound = loaded.SubsetBounds[subsetBound++];
+
+			const SDKMESH_MATERIAL* material = mesh->GetMaterial(mesh->GetSubset(i, subset)->MaterialID);
+			ID3D11ShaderResourceView* diffuse = IsErrorResource(material->pDiffuseRV11) ? NULL : material->pDiffuseRV11;
+
+			std::map<ID3D11ShaderResourceView*, uint32_t>::iterator materialId = mMaterialIds.find(diffuse);
+			if (materialId == mMaterialIds.end())
+				materialId = mMaterialIds.insert(std::make_pair(diffuse, static_cast<uint32_t>(mMaterialIds.size()))).first;
+			object.Material = materialId->second;
+
+			mWorldBound.Merge(object.Bound);
+			mSceneObjectsOpaque.push_back(object);
+		}
 	}
 }
+
+void Scene::CullOpaque( const D3DXMATRIX& viewProj, std::vector<uint32_t>& visible ) const
+{
+	D3DXPLANE planes[6];
+	ExtractFrustumPlanes(viewProj, D3DXVECTOR4(-1, -1, 1, 1), 0.0f, 1.0f, planes);
+
+	visible.clear();
+	mOpaqueCulling.CullFrustum(planes, visible);
+	std::sort(visible.begin(), visible.end());
+}
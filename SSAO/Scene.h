@@ -3,7 +3,10 @@
 #include "LightAnimation.h"
 #include "SDKmesh.h"
 #include "BoundingVolume.h"
+#include "SceneCulling.h"
+#include "SceneLoader.h"
 #include <vector>
+#include <map>
 
 class Scene
 {
@@ -11,8 +14,28 @@ public:
 	Scene(void);
 	~Scene(void);
 
+	/**
+	 * Load a mesh and wait for it.
+	 */
 	void LoadOpaqueMesh(ID3D11Device* d3dDevice, LPCTSTR filename, const D3DXMATRIX& worldMatrix);
 
+	/**
+	 * Background loading: AddOpaqueMesh queues meshes, StartLoading has mLoader read, validate and bound them
+	 * on worker threads. UpdateLoading, called on the device thread, creates the D3D resources of the meshes
+	 * that are done and adds them to the scene in the order they were queued. Returns true once all are in.
+	 */
+	void AddOpaqueMesh(LPCTSTR filename, const D3DXMATRIX& worldMatrix);
+	void StartLoading();
+	bool UpdateLoading(ID3D11Device* d3dDevice);
+
+	bool IsLoading() const		{ return !mLoader.IsDone(); }
+
+	/**
+	 * Indices into mSceneObjectsOpaque of the subsets inside the view frustum. They come out sorted, so
+	 * subsets of the same SceneMesh and SDKMESH mesh are next to each other and share state changes.
+	 */
+	void CullOpaque(const D3DXMATRIX& viewProj, std::vector<uint32_t>& visible) const;
+
 public:
 	LightAnimation mLightAnimation;
 
@@ -24,7 +47,28 @@ public:
 		D3DXMATRIX World;
 	};
 
+	// One draw, a subset of a mesh in a SceneMesh, with its world space box
+	struct SceneObject
+	{
+		uint32_t SceneMeshIndex;
+		UINT Mesh;
+		UINT Subset;
+		uint32_t Material;    // Same for the subsets with the same diffuse texture, over all meshes, from 0
+		BoundingBox Bound;
+	};
+
 	std::vector<SceneMesh> mSceneMeshesOpaque;
 	std::vector<SceneMesh*> mSceneMeshesAlpha;
-};
 
+	std::vector<SceneObject> mSceneObjectsOpaque;
+	SceneCulling mOpaqueCulling;
+
+private:
+	void AddLoadedMesh(ID3D11Device* d3dDevice, SceneLoader::LoadedMesh& loaded);
+
+private:
+	SceneLoader mLoader;
+
+	// Diffuse texture to SceneObject::Material, NULL for the subsets without one
+	std::map<ID3D11ShaderResourceView*, uint32_t> mMaterialIds;
+};
@@ -0,0 +1,176 @@
+#include "DXUT.h"
+#include "SceneCulling.h"
+#include <algorithm>
+
+namespace {
+
+const uint32_t AllPlanes = 0x3F;
+
+// A few registers per leaf, a leaf test is much cheaper than an interior node visit
+const uint32_t MaxLeafObjects = SimdNative::Width * 4;
+
+}
+
+SceneCulling::SceneCulling()
+{
+
+}
+
+SceneCulling::~SceneCulling()
+{
+
+}
+
+void SceneCulling::Build( const std::vector<BoundingBox>& objectBounds )
+{
+	const uint32_t numObjects = static_cast<uint32_t>(objectBounds.size());
+
+	mNodes.clear();
+	mObjectIds.resize(numObjects);
+	for (uint32_t i = 0; i < numObjects; ++i)
+		mObjectIds[i] = i;
+
+	if (numObjects)
+	{
+		mNodes.reserve(2 * numObjects / MaxLeafObjects + 1);
+		BuildRecursive(objectBounds, 0, numObjects, 0);
+	}
+
+	// Boxes in leaf order
+	mBoxes.Clear();
+	for (uint32_t i = 0; i < numObjects; ++i)
+		mBoxes.Add(objectBounds[mObjectIds[i]]);
+}
+
+uint32_t SceneCulling::BuildRecursive( const std::vector<BoundingBox>& objectBounds, uint32_t begin, uint32_t end, uint32_t depth )
+{
+	const uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size());
+	mNodes.push_back(Node());
+
+	BoundingBox bound, centroidBound;
+	for (uint32_t i = begin; i < end; ++i)
+	{
+		bound.Merge(objectBounds[mObjectIds[i]]);
+		centroidBound.Merge(objectBounds[mObjectIds[i]].Center());
+	}
+
+	const uint32_t count = end - begin;
+
+	if (count <= MaxLeafObjects)
+	{
+		Node& leaf = mNodes[nodeIndex];
+		leaf.Bound = bound;
+		leaf.Offset = begin;
+		leaf.NumObjects = static_cast<uint16_t>(count);
+		leaf.Axis = 0;
+		return nodeIndex;
+	}
+
+	const int axis = centroidBound.MaximumExtent();
+	const float axisMin = centroidBound.Min[axis];
+	const float axisExtent = centroidBound.Max[axis] - axisMin;
+
+	uint32_t* first = &mObjectIds[0] + begin;
+	uint32_t* last = &mObjectIds[0] + end;
+	uint32_t* middle = first;
+
+	if (axisExtent > 0 && depth < MaxSAHDepth)
+	{
+		// Bin centroids along the axis and evaluate the SAH at every bin boundary, the cost counts leaves
+		// since a leaf is tested in a few SIMD passes
+		SAHBinning binning(axisMin, axisExtent);
+		for (uint32_t i = begin; i < end; ++i)
+		{
+			const BoundingBox& box = objectBounds[mObjectIds[i]];
+			binning.Add(box.Center()[axis], box);
+		}
+
+		const int bestSplit = binning.FindSplit([](uint32_t n) { return float((n + MaxLeafObjects - 1) / MaxLeafObjects); }, NULL);
+
+		middle = std::partition(first, last, [&](uint32_t id)
+		{
+			return binning.Bin(objectBounds[id].Center()[axis]) <= bestSplit;
+		});
+	}
+
+	// All on one side or too deep, fall back to the median
+	if (middle == first || middle == last)
+	{
+		middle = SplitAtMedian(first, last, [&](uint32_t a, uint32_t b)
+		{
+			return objectBounds[a].Center()[axis] < objectBounds[b].Center()[axis];
+		});
+	}
+
+	const uint32_t mid = begin + static_cast<uint32_t>(middle - first);
+
+	BuildRecursive(objectBounds, begin, mid, depth + 1);
+	const uint32_t secondChild = BuildRecursive(objectBounds, mid, end, depth + 1);
+
+	Node& interior = mNodes[nodeIndex];
+	interior.Bound = bound;
+	interior.Offset = secondChild;
+	interior.NumObjects = 0;
+	interior.Axis = static_cast<uint16_t>(axis);
+	return nodeIndex;
+}
+
+void SceneCulling::CullObjects( const D3DXPLANE planes[6], uint32_t planeMask, uint32_t first, uint32_t count, std::vector<uint32_t>& visible ) const
+{
+	D3DXPLANE activePlanes[6];
+	int numPlanes = 0;
+	for (int p = 0; p < 6; ++p)
+	{
+		if (planeMask & (1 << p))
+			activePlanes[numPlanes++] = planes[p];
+	}
+
+	// Slots to object ids
+	const size_t begin = visible.size();
+	mBoxes.Intersects(activePlanes, numPlanes, first, count, visible);
+	for (size_t i = begin; i < visible.size(); ++i)
+		visible[i] = mObjectIds[visible[i]];
+}
+
+void SceneCulling::CullFrustum( const D3DXPLANE planes[6], std::vector<uint32_t>& visible ) const
+{
+	if (mNodes.empty())
+		return;
+
+	// Node and the planes it still has to be tested against
+	uint32_t stack[BVHTraversalStackSize][2];
+	int stackSize = 0;
+	stack[stackSize][0] = 0;
+	stack[stackSize++][1] = AllPlanes;
+
+	while (stackSize)
+	{
+		--stackSize;
+		const uint32_t nodeIndex = stack[stackSize][0];
+		uint32_t planeMask = stack[stackSize][1];
+
+		const Node& node = mNodes[nodeIndex];
+		if (planeMask && !BoxInsidePlanes(node.Bound, planes, planeMask))
+			continue;
+
+		if (node.NumObjects)
+		{
+			if (planeMask)
+				CullObjects(planes, planeMask, node.Offset, node.NumObjects, visible);
+			else
+				visible.insert(visible.end(), mObjectIds.begin() + node.Offset, mObjectIds.begin() + node.Offset + node.NumObjects);
+		}
+		else
+		{
+			stack[stackSize][0] = node.Offset;
+			stack[stackSize++][1] = planeMask;
+			stack[stackSize][0] = nodeIndex + 1;
+			stack[stackSize++][1] = planeMask;
+		}
+	}
+}
+
+void SceneCulling::CullFrustumLinear( const D3DXPLANE planes[6], std::vector<uint32_t>& visible ) const
+{
+	CullObjects(planes, AllPlanes, 0, GetNumObjects(), visible);
+}
@@ -0,0 +1,58 @@
+#ifndef SceneCulling_h__
+#define SceneCulling_h__
+
+#include "BoundingVolume.h"
+#include <vector>
+#include <cstdint>
+
+/**
+ * Frustum culling of static scene objects.
+ *
+ * Object boxes go into a BVH built with the surface area heuristic. Leaves hold a few SIMD registers of
+ * objects, their boxes are kept in a BoundingBoxBatch in leaf order so a plane is tested against a
+ * register of boxes at once. Interior nodes fully inside a plane stop testing it for their subtree, and
+ * a subtree inside all planes is accepted without tests.
+ */
+class SceneCulling
+{
+public:
+	struct Node
+	{
+		BoundingBox Bound;
+		uint32_t Offset;        // First object slot of a leaf, second child of an interior node
+		uint16_t NumObjects;    // Zero for interior nodes
+		uint16_t Axis;
+	};
+
+public:
+	SceneCulling();
+	~SceneCulling();
+
+	// Object i is identified by i in the cull results
+	void Build(const std::vector<BoundingBox>& objectBounds);
+
+	// Objects whose box intersects the volume of six inward facing planes, see ExtractFrustumPlanes. Results
+	// are in BVH order.
+	void CullFrustum(const D3DXPLANE planes[6], std::vector<uint32_t>& visible) const;
+
+	// Same test on every object without the hierarchy, as reference and for tiny scenes
+	void CullFrustumLinear(const D3DXPLANE planes[6], std::vector<uint32_t>& visible) const;
+
+	uint32_t GetNumObjects() const                 { return static_cast<uint32_t>(mObjectIds.size()); }
+	const std::vector<Node>& GetNodes() const      { return mNodes; }
+
+private:
+	uint32_t BuildRecursive(const std::vector<BoundingBox>& objectBounds, uint32_t begin, uint32_t end, uint32_t depth);
+
+	// Append the objects of slots [first, first + count) inside the planes of planeMask
+	void CullObjects(const D3DXPLANE planes[6], uint32_t planeMask, uint32_t first, uint32_t count, std::vector<uint32_t>& visible) const;
+
+private:
+	std::vector<Node> mNodes;
+
+	// Object ids and boxes in leaf order
+	std::vector<uint32_t> mObjectIds;
+	BoundingBoxBatch mBoxes;
+};
+
+#endif // SceneCulling_h__
@@ -0,0 +1,172 @@
+#include "DXUT.h"
+#include "SceneLoader.h"
+#include "SDKMeshFile.h"
+#include <utility>
+
+namespace {
+
+BoundingBox TransformBound(const BoundingBox& box, const D3DXMATRIX& world)
+{
+	BoundingBox result;
+	for (int corner = 0; corner < 8; ++corner)
+	{
+		const D3DXVECTOR3 point(
+			(corner & 1) ? box.Max.x : box.Min.x,
+			(corner & 2) ? box.Max.y : box.Min.y,
+			(corner & 4) ? box.Max.z : box.Min.z);
+
+		D3DXVECTOR3 transformed;
+		D3DXVec3TransformCoord(&transformed, &point, &world);
+		result.Merge(transformed);
+	}
+	return result;
+}
+
+// Object space box of the vertices a subset indexes, position is the first element of the first stream
+BoundingBox CalculateSubsetBound(const SDKMeshFile& file, uint32_t meshIndex, const SDKMeshSubset& subset)
+{
+	const SDKMeshMesh& mesh = file.GetMeshes()[meshIndex];
+
+	// Nothing to index, take the mesh box (extents are half sizes)
+	if (subset.IndexCount == 0)
+	{
+		const D3DXVECTOR3 center(mesh.BoundingBoxCenter), extents(mesh.BoundingBoxExtents);
+		return BoundingBox(center - extents, center + extents);
+	}
+
+	const ArrayView<uint8_t> vertices = file.GetVertexData(mesh.VertexBuffers[0]);
+	const ArrayView<uint16_t> indices16 = file.GetIndices16(mesh.IndexBuffer);
+	const ArrayView<uint32_t> indices32 = file.GetIndices32(mesh.IndexBuffer);
+	const uint64_t stride = file.GetVertexBuffers()[mesh.VertexBuffers[0]].StrideBytes;
+
+	BoundingBox bound;
+	for (uint64_t i = subset.IndexStart; i < subset.IndexStart + subset.IndexCount; ++i)
+	{
+		const uint64_t index = indices16.empty() ? indices32[size_t(i)] : indices16[size_t(i)];
+		const uint64_t offset = (subset.VertexStart + index) * stride;
+
+		// Indices are not validated against the buffer
+		if (offset + sizeof(D3DXVECTOR3) <= vertices.Size)
+			bound.Merge(D3DXVECTOR3(reinterpret_cast<const float*>(vertices.Data + offset)));
+	}
+
+	return bound;
+}
+
+}
+
+SceneLoader::SceneLoader()
+	: mNumStarted(0), mOptimizeMeshes(true), mNextPop(0)
+{
+
+}
+
+SceneLoader::~SceneLoader()
+{
+	Wait();
+
+	LoadedMesh* mesh;
+	while (mFinished.try_pop(mesh))
+		delete mesh;
+
+	for (size_t i = 0; i < mReorder.size(); ++i)
+		delete mReorder[i];
+}
+
+void SceneLoader::Add( const std::string& filename, const D3DXMATRIX& world )
+{
+	Job job;
+	job.Filename = filename;
+	job.World = world;
+	mJobs.push_back(job);
+}
+
+void SceneLoader::Start()
+{
+	mReorder.resize(mJobs.size(), NULL);
+
+	for (; mNumStarted < mJobs.size(); ++mNumStarted)
+	{
+		// The job is set up here, Add may grow mJobs while it runs
+		LoadedMesh* mesh = new LoadedMesh;
+		mesh->Job = mNumStarted;
+		mesh->Filename = mJobs[mNumStarted].Filename;
+		mesh->World = mJobs[mNumStarted].World;
+
+		const bool optimize = mOptimizeMeshes;
+		mTasks.run([this, mesh, optimize]() {
+			LoadMesh(*mesh, optimize);
+			mFinished.push(mesh);
+		});
+	}
+}
+
+SceneLoader::LoadedMesh* SceneLoader::PopNext()
+{
+	LoadedMesh* mesh;
+	while (mFinished.try_pop(mesh))
+		mReorder[mesh->Job] = mesh;
+
+	if (mNextPop == mNumStarted || !mReorder[mNextPop])
+		return NULL;
+
+	mesh = mReorder[mNextPop];
+	mReorder[mNextPop++] = NULL;
+	return mesh;
+}
+
+void SceneLoader::Wait()
+{
+	mTasks.wait();
+}
+
+void SceneLoader::LoadMesh( LoadedMesh& mesh, bool optimize )
+{
+	FILE* file = NULL;
+	if (fopen_s(&file, mesh.Filename.c_str(), "rb") != 0)
+		return;
+
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	if (size > 0)
+	{
+		mesh.Data = new BYTE[size];
+		mesh.DataBytes = static_cast<UINT>(fread(mesh.Data, 1, size, file));
+	}
+	fclose(file);
+
+	SDKMeshFile meshFile;
+	if (!mesh.Data || !meshFile.OpenMemory(mesh.Data, mesh.DataBytes))
+	{
+		delete[] mesh.Data;
+		mesh.Data = NULL;
+		mesh.DataBytes = 0;
+		return;
+	}
+
+	// The buffers are created from this data, reorder it before. Bounds don't change, it's the same triangles.
+	if (optimize)
+		OptimizeSDKMesh(mesh.Data, mesh.DataBytes, DefaultVertexCacheSize, &mesh.Optimization);
+
+	const ArrayView<SDKMeshMesh> meshes = meshFile.GetMeshes();
+	const ArrayView<SDKMeshSubset> subsets = meshFile.GetSubsets();
+
+	// Mesh and subset of each entry of SubsetBounds, mesh by mesh
+	std::vector<std::pair<uint32_t, uint32_t> > subsetOwners;
+	for (uint32_t m = 0; m < meshes.Size; ++m)
+	{
+		const ArrayView<uint32_t> meshSubsets = meshFile.GetMeshSubsets(m);
+		for (size_t s = 0; s < meshSubsets.Size; ++s)
+			subsetOwners.push_back(std::make_pair(m, meshSubsets[s]));
+	}
+
+	mesh.SubsetBounds.resize(subsetOwners.size());
+
+	// One file can hold a whole scene, bound every subset on its own
+	Concurrency::parallel_for(size_t(0), subsetOwners.size(), [&](size_t i) {
+		const BoundingBox bound = CalculateSubsetBound(meshFile, subsetOwners[i].first, subsets[subsetOwners[i].second]);
+		mesh.SubsetBounds[i] = TransformBound(bound, mesh.World);
+	});
+}
@@ -0,0 +1,105 @@
+#ifndef SceneLoader_h__
+#define SceneLoader_h__
+
+#include "BoundingVolume.h"
+#include "MeshOptimizer.h"
+#include <concurrent_queue.h>
+#include <ppl.h>
+#include <string>
+#include <vector>
+
+/**
+ * Background part of scene loading, everything that doesn't need the device.
+ *
+ * Each added mesh is a job on the PPL scheduler: read the .sdkmesh into the heap, validate it with
+ * SDKMeshFile, reorder its subsets for the vertex cache and overdraw with OptimizeSDKMesh and compute the
+ * world space box of every subset. Inside a job the index ranges are optimized, the vertex buffers renumbered
+ * and the subsets bounded in parallel, so a scene exported into one file, like Power Plant and Sponza, still
+ * loads on all cores. Finished jobs go into a concurrent queue,
+ * the device thread takes them out with PopNext and creates the D3D resources from the data that was read,
+ * so the file is read only once. Results come out in Add order whatever order the jobs finish in, the
+ * scene built from them is the same for any number of threads.
+ */
+class SceneLoader
+{
+public:
+	struct LoadedMesh
+	{
+		uint32_t Job;
+		std::string Filename;
+		D3DXMATRIX World;
+
+		// The whole file in a new[] buffer, the mesh created from it takes it over. NULL if the file could
+		// not be read or is not a valid sdkmesh.
+		BYTE* Data;
+		UINT DataBytes;
+
+		// World space boxes of all subsets, mesh by mesh
+		std::vector<BoundingBox> SubsetBounds;
+
+		// Vertex cache misses before and after reordering, zero if it was turned off
+		SDKMeshOptimizeStatistics Optimization;
+
+		LoadedMesh() : Job(0), Data(NULL), DataBytes(0)    { memset(&Optimization, 0, sizeof(Optimization)); }
+		~LoadedMesh()                                      { delete[] Data; }
+	};
+
+public:
+	SceneLoader();
+	~SceneLoader();
+
+	/**
+	 * Queue a mesh. Jobs added after Start() run on the next Start().
+	 */
+	void Add(const std::string& filename, const D3DXMATRIX& world);
+
+	void Start();
+
+	/**
+	 * Next finished mesh in Add order, NULL if it isn't done yet or there is none. The caller deletes it.
+	 */
+	LoadedMesh* PopNext();
+
+	// Every started mesh has been popped
+	bool IsDone() const                                    { return mNextPop == mNumStarted; }
+
+	uint32_t GetNumJobs() const                            { return static_cast<uint32_t>(mJobs.size()); }
+
+	// Reorder indices and vertices while loading, on by default. Affects jobs started afterwards.
+	void SetOptimizeMeshes(bool optimize)                  { mOptimizeMeshes = optimize; }
+
+	/**
+	 * Block until the running jobs are finished.
+	 */
+	void Wait();
+
+	/**
+	 * The job itself: read, validate, optionally optimize and bound one mesh file.
+	 */
+	static void LoadMesh(LoadedMesh& mesh, bool optimize);
+
+private:
+	// Not implemented
+	SceneLoader(const SceneLoader&);
+	SceneLoader& operator=(const SceneLoader&);
+
+private:
+	struct Job
+	{
+		std::string Filename;
+		D3DXMATRIX World;
+	};
+
+	std::vector<Job> mJobs;
+	uint32_t mNumStarted;
+	bool mOptimizeMeshes;
+
+	Concurrency::task_group mTasks;
+	Concurrency::concurrent_queue<LoadedMesh*> mFinished;
+
+	// Finished meshes waiting for the ones added before them, by job
+	std::vector<LoadedMesh*> mReorder;
+	uint32_t mNextPop;
+};
+
+#endif // SceneLoader_h__
@@ -2,11 +2,13 @@
 #include "Shader.h"
 #include <exception>
 
+ShaderCache* ShaderFactory::mBatchCache = NULL;
+std::vector<std::function<void()> > ShaderFactory::mBatchFixups;
 
-HRESULT ShaderFactory::CompileShaderFromFile( LPCTSTR szFileName, LPCSTR szEntryPoint, CONST D3D10_SHADER_MACRO *defines, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
-{
-	HRESULT hr = S_OK;
+namespace {
 
+DWORD GetCompileFlags()
+{
 	DWORD dwShaderFlags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_PACK_MATRIX_ROW_MAJOR;
 #if defined( DEBUG ) || defined( _DEBUG )
 	// Set the D3DCOMPILE_DEBUG flag to embed debug information in the shaders.
@@ -15,6 +17,17 @@ HRESULT ShaderFactory::CompileShaderFromFile( LPCTSTR szFileName, LPCSTR szEntry
 	// the release configuration of this program.
 	dwShaderFlags |= D3DCOMPILE_DEBUG;
 #endif
+	return dwShaderFlags;
+}
+
+}
+
+
+HRESULT ShaderFactory::CompileShaderFromFile( LPCTSTR szFileName, LPCSTR szEntryPoint, CONST D3D10_SHADER_MACRO *defines, LPCSTR szShaderModel, ID3DBlob** ppBlobOut )
+{
+	HRESULT hr = S_OK;
+
+	DWORD dwShaderFlags = GetCompileFlags();
 
 	ID3DBlob* pErrorBlob;
 	hr = D3DX11CompileFromFile( szFileName, defines, NULL, szEntryPoint, szShaderModel, 
@@ -35,6 +48,18 @@ HRESULT ShaderFactory::CompileShaderFromFile( LPCTSTR szFileName, LPCSTR szEntry
 
 ID3D11InputLayout* ShaderFactory::CreateVertexLayout( ID3D11Device* d3dDevice, const D3D11_INPUT_ELEMENT_DESC* layout, int size, LPCTSTR srcFile, LPCSTR functionName, CONST D3D10_SHADER_MACRO *defines /*= 0*/ )
 {
+	if (mBatchCache)
+	{
+		const uint32_t index = AddToBatch(srcFile, functionName, defines, GetShaderProfileString<ID3D11VertexShader>());
+		mBatchCache->Wait();
+
+		const std::vector<uint8_t>& bytecode = GetBatchBytecode(*mBatchCache, index);
+
+		ID3D11InputLayout* retVal = nullptr;
+		d3dDevice->CreateInputLayout(layout, size, &bytecode[0], bytecode.size(), &retVal);
+		return retVal;
+	}
+
 	ID3DBlob* pBytecode = NULL;
 	HRESULT hr = CompileShaderFromFile(srcFile, functionName, defines, GetShaderProfileString<ID3D11VertexShader>(), &pBytecode);
 
@@ -66,3 +91,90 @@ shared_ptr<GeometryShader> ShaderFactory::CreateGeometryShaderWithStreamOutput(
 
 	return retVal;
 }
+
+ShaderFactory::Batch::Batch( ShaderCache* cache )
+{
+	mBatchCache = cache;
+	mBatchFixups.clear();
+}
+
+ShaderFactory::Batch::~Batch()
+{
+	// Nothing left after End, otherwise unwinding: the cache and the fixups pointing into it go away
+	mBatchCache = NULL;
+	mBatchFixups.clear();
+}
+
+void ShaderFactory::Batch::End()
+{
+	mBatchCache->Wait();
+	mBatchCache = NULL;
+
+	// Out of the batch first, a shader that didn't compile throws from here
+	std::vector<std::function<void()> > fixups;
+	fixups.swap(mBatchFixups);
+
+	for (size_t i = 0; i < fixups.size(); ++i)
+		fixups[i]();
+}
+
+bool ShaderFactory::CompileBytecode( const ShaderCompileRequest& request, std::vector<uint8_t>* bytecode, std::string* errors )
+{
+	std::vector<D3D10_SHADER_MACRO> macros;
+	for (size_t i = 0; i < request.Defines.size(); ++i)
+	{
+		D3D10_SHADER_MACRO macro = { request.Defines[i].first.c_str(), request.Defines[i].second.c_str() };
+		macros.push_back(macro);
+	}
+
+	D3D10_SHADER_MACRO last = { NULL, NULL };
+	macros.push_back(last);
+
+	ID3DBlob* pBytecode = NULL;
+	ID3DBlob* pErrorBlob = NULL;
+	HRESULT hr = D3DX11CompileFromFile( request.Filename.c_str(), &macros[0], NULL, request.EntryPoint.c_str(), request.Profile.c_str(), 
+		request.Flags, 0, NULL, &pBytecode, &pErrorBlob, NULL );
+
+	if( pErrorBlob != NULL )
+		errors->assign(static_cast<const char*>(pErrorBlob->GetBufferPointer()));
+
+	if (SUCCEEDED(hr))
+	{
+		const uint8_t* data = static_cast<const uint8_t*>(pBytecode->GetBufferPointer());
+		bytecode->assign(data, data + pBytecode->GetBufferSize());
+	}
+
+	SAFE_RELEASE( pBytecode );
+	SAFE_RELEASE( pErrorBlob );
+
+	return SUCCEEDED(hr);
+}
+
+uint32_t ShaderFactory::AddToBatch( LPCTSTR srcFile, LPCSTR functionName, CONST D3D10_SHADER_MACRO *defines, LPCSTR profile )
+{
+	ShaderCompileRequest request;
+	request.Filename = srcFile;
+	request.EntryPoint = functionName;
+	request.Profile = profile;
+	request.Flags = GetCompileFlags();
+
+	for (const D3D10_SHADER_MACRO* define = defines; define && define->Name; ++define)
+		request.Defines.push_back(std::make_pair(std::string(define->Name), std::string(define->Definition ? define->Definition : "")));
+
+	const uint32_t index = mBatchCache->Add(request);
+	mBatchCache->Start();
+
+	return index;
+}
+
+const std::vector<uint8_t>& ShaderFactory::GetBatchBytecode( const ShaderCache& cache, uint32_t index )
+{
+	const std::vector<uint8_t>& bytecode = cache.GetBytecode(index);
+	if (bytecode.empty())
+	{
+		OutputDebugStringA(cache.GetErrors(index).c_str());
+		throw std::exception("Error compiling shader");
+	}
+
+	return bytecode;
+}
@@ -3,10 +3,18 @@
 #include <d3d11.h>
 #include <d3dx11.h>
 #include <memory>
+#include <functional>
+#include <vector>
+#include "ShaderCache.h"
+
+struct ShaderFactory;
 
 template<typename T>
 class Shader
 {
+	// Sets mShader of the shaders created in a batch
+	friend struct ShaderFactory;
+
 public:
 	typedef T shader_type;
 
@@ -38,6 +46,21 @@ struct ShaderFactory
 	{
 		shared_ptr<T> retVal;
 
+		if (mBatchCache)
+		{
+			const uint32_t index = AddToBatch(srcFile, functionName, defines, GetShaderProfileString<T::shader_type>());
+			const ShaderCache* cache = mBatchCache;
+
+			// The D3D object comes in Batch::End, once the bytecode is there
+			retVal = std::make_shared<T>(nullptr);
+			mBatchFixups.push_back([=]() {
+				const std::vector<uint8_t>& bytecode = GetBatchBytecode(*cache, index);
+				retVal->mShader = CreateShaderD3D11<T::shader_type>(d3dDevice, &bytecode[0], bytecode.size());
+			});
+
+			return retVal;
+		}
+
 		ID3DBlob* pBytecode = nullptr;
 		HRESULT hr = CompileShaderFromFile(srcFile, functionName, defines, GetShaderProfileString<T::shader_type>(), &pBytecode);
 
@@ -53,8 +76,41 @@ struct ShaderFactory
 
 	static shared_ptr<GeometryShader> CreateGeometryShaderWithStreamOutput(ID3D11Device* d3dDevice, const D3D11_SO_DECLARATION_ENTRY *pSODeclaration, UINT NumEntries, const UINT *pBufferStrides, UINT NumStrides, UINT RasterizedStream, LPCTSTR srcFile, LPCSTR functionName, CONST D3D10_SHADER_MACRO *defines = 0);
 
+	/**
+	 * While a Batch is open the bytecode comes from cache. CreateShader only queues the request and returns a
+	 * shader that gets its D3D object in End, so the cache misses compile in parallel. The vertex layouts need
+	 * their bytecode right away, CreateVertexLayout waits for everything queued so far. End throws like
+	 * CompileShaderFromFile when a shader didn't compile. A Batch left without End, by an exception from
+	 * CreateVertexLayout say, closes on destruction and its queued shaders keep no D3D object.
+	 */
+	class Batch
+	{
+	public:
+		explicit Batch(ShaderCache* cache);
+		~Batch();
+
+		void End();
+
+	private:
+		// Not implemented
+		Batch(const Batch&);
+		Batch& operator=(const Batch&);
+	};
+
+	// ShaderCache::CompileFunction, D3DX11CompileFromFile with the flags of CompileShaderFromFile
+	static bool CompileBytecode(const ShaderCompileRequest& request, std::vector<uint8_t>* bytecode, std::string* errors);
+
 private:
 	static HRESULT CompileShaderFromFile( LPCTSTR szFileName, LPCSTR szEntryPoint, CONST D3D10_SHADER_MACRO *defines, LPCSTR szShaderModel, ID3DBlob** ppBlobOut );
+
+	// Queue a compile in mBatchCache and start it, returns its index in the cache
+	static uint32_t AddToBatch(LPCTSTR srcFile, LPCSTR functionName, CONST D3D10_SHADER_MACRO *defines, LPCSTR profile);
+
+	// Bytecode of a finished batch request, throws when it didn't compile
+	static const std::vector<uint8_t>& GetBatchBytecode(const ShaderCache& cache, uint32_t index);
+
+	static ShaderCache* mBatchCache;
+	static std::vector<std::function<void()> > mBatchFixups;
 	
 	template <typename T> static LPCSTR GetShaderProfileString();
 	template <typename T> static T* CreateShaderD3D11(ID3D11Device* d3dDevice, const void* shaderBytecode, size_t bytecodeLength);
@@ -0,0 +1,298 @@
+#include "DXUT.h"
+#include "ShaderCache.h"
+#include <cstdio>
+
+namespace {
+
+// Part of every key, bump it when the entry format or the compiler changes
+const uint32_t CacheVersion = 1;
+
+const uint32_t EntryMagic = 0x31434253;   // "SBC1"
+
+struct EntryHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t Key;
+	uint64_t BytecodeHash;
+	uint32_t BytecodeSize;
+	uint32_t Reserved;
+};
+
+bool ReadWholeFile( const std::wstring& filename, std::vector<uint8_t>* contents )
+{
+	FILE* file;
+	if (_wfopen_s(&file, filename.c_str(), L"rb") != 0)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	contents->resize(size > 0 ? size : 0);
+	const bool read = size <= 0 || fread(&(*contents)[0], 1, size, file) == size_t(size);
+	fclose(file);
+
+	return read;
+}
+
+// Length first, so "ab" "c" and "a" "bc" hash differently
+uint64_t HashString( const std::string& s, uint64_t hash )
+{
+	const uint32_t length = static_cast<uint32_t>(s.size());
+	hash = HashBytes(&length, sizeof(length), hash);
+	return HashBytes(s.data(), s.size(), hash);
+}
+
+// The quoted names of the #include lines, in order. Commented out ones count too, which only costs a
+// recompile when they change
+void FindIncludes( const std::vector<uint8_t>& contents, std::vector<std::string>* includes )
+{
+	const char Directive[] = "#include";
+	const size_t directiveLength = sizeof(Directive) - 1;
+
+	const char* text = reinterpret_cast<const char*>(contents.empty() ? NULL : &contents[0]);
+	const size_t size = contents.size();
+
+	for (size_t i = 0; i + directiveLength < size; ++i)
+	{
+		if (text[i] != '#' || memcmp(text + i, Directive, directiveLength) != 0)
+			continue;
+
+		size_t begin = i + directiveLength;
+		while (begin < size && (text[begin] == ' ' || text[begin] == '\t'))
+			begin++;
+
+		if (begin == size || text[begin] != '"')
+			continue;
+
+		size_t end = ++begin;
+		while (end < size && text[end] != '"' && text[end] != '\n')
+			end++;
+
+		if (end < size && text[end] == '"')
+			includes->push_back(std::string(text + begin, text + end));
+		i = end;
+	}
+}
+
+}
+
+uint64_t HashBytes( const void* data, size_t size, uint64_t hash )
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+ShaderCache::ShaderCache( const std::wstring& directory, CompileFunction compile )
+	: mDirectory(directory), mCompile(compile), mNumStarted(0)
+{
+	// Fails when it exists already, a missing directory only makes every entry a miss
+	CreateDirectoryW(mDirectory.c_str(), NULL);
+}
+
+ShaderCache::~ShaderCache()
+{
+	mTasks.wait();
+}
+
+uint32_t ShaderCache::Add( const ShaderCompileRequest& request )
+{
+	std::set<std::wstring> visiting;
+	const uint64_t sourceHash = HashSourceFile(request.Filename, visiting);
+
+	uint64_t key = HashBytes(&CacheVersion, sizeof(CacheVersion));
+	key = HashBytes(request.Filename.data(), request.Filename.size() * sizeof(wchar_t), key);
+	key = HashBytes(&sourceHash, sizeof(sourceHash), key);
+	key = HashString(request.EntryPoint, key);
+	key = HashString(request.Profile, key);
+	key = HashBytes(&request.Flags, sizeof(request.Flags), key);
+
+	const uint32_t numDefines = static_cast<uint32_t>(request.Defines.size());
+	key = HashBytes(&numDefines, sizeof(numDefines), key);
+	for (size_t i = 0; i < request.Defines.size(); ++i)
+	{
+		key = HashString(request.Defines[i].first, key);
+		key = HashString(request.Defines[i].second, key);
+	}
+
+	std::map<uint64_t, uint32_t>::const_iterator found = mEntryIndices.find(key);
+	if (found != mEntryIndices.end())
+		return found->second;
+
+	Entry entry;
+	entry.Request = request;
+	entry.Key = key;
+	entry.Status = Entry_Pending;
+	entry.Rejected = false;
+	mEntries.push_back(entry);
+
+	const uint32_t index = static_cast<uint32_t>(mEntries.size() - 1);
+	mEntryIndices[key] = index;
+	return index;
+}
+
+void ShaderCache::Start()
+{
+	for (; mNumStarted < mEntries.size(); ++mNumStarted)
+	{
+		Entry* entry = &mEntries[mNumStarted];
+		mTasks.run([this, entry]() {
+			Resolve(*entry);
+		});
+	}
+}
+
+void ShaderCache::Wait()
+{
+	mTasks.wait();
+}
+
+void ShaderCache::RemoveEntries()
+{
+	for (size_t i = 0; i < mEntries.size(); ++i)
+		DeleteFileW(GetEntryFilename(mEntries[i].Key).c_str());
+}
+
+ShaderCacheStats ShaderCache::GetStats() const
+{
+	ShaderCacheStats stats = { static_cast<uint32_t>(mEntries.size()), 0, 0, 0, 0 };
+
+	for (size_t i = 0; i < mEntries.size(); ++i)
+	{
+		stats.Loaded += mEntries[i].Status == Entry_Loaded;
+		stats.Compiled += mEntries[i].Status == Entry_Compiled;
+		stats.Failed += mEntries[i].Status == Entry_Failed;
+		stats.Rejected += mEntries[i].Rejected;
+	}
+
+	return stats;
+}
+
+void ShaderCache::Resolve( Entry& entry ) const
+{
+	const std::wstring filename = GetEntryFilename(entry.Key);
+
+	if (LoadEntry(filename, entry.Key, &entry.Bytecode, &entry.Rejected))
+	{
+		entry.Status = Entry_Loaded;
+		return;
+	}
+
+	entry.Bytecode.clear();
+	if (mCompile(entry.Request, &entry.Bytecode, &entry.Errors))
+	{
+		SaveEntry(filename, entry.Key, entry.Bytecode);
+		entry.Status = Entry_Compiled;
+	}
+	else
+	{
+		entry.Bytecode.clear();
+		entry.Status = Entry_Failed;
+	}
+}
+
+bool ShaderCache::LoadEntry( const std::wstring& filename, uint64_t key, std::vector<uint8_t>* bytecode, bool* rejected ) const
+{
+	*rejected = false;
+
+	std::vector<uint8_t> contents;
+	if (!ReadWholeFile(filename, &contents))
+		return false;
+
+	// Anything but a complete entry of this key, e.g. a write cut short or a file from another version
+	EntryHeader header;
+	if (contents.size() < sizeof(header))
+	{
+		*rejected = true;
+		return false;
+	}
+
+	memcpy(&header, &contents[0], sizeof(header));
+
+	const size_t bytecodeSize = contents.size() - sizeof(header);
+	if (header.Magic != EntryMagic || header.Version != CacheVersion || header.Key != key || header.BytecodeSize != bytecodeSize || bytecodeSize == 0 ||
+		HashBytes(&contents[sizeof(header)], bytecodeSize) != header.BytecodeHash)
+	{
+		*rejected = true;
+		return false;
+	}
+
+	bytecode->assign(contents.begin() + sizeof(header), contents.end());
+	return true;
+}
+
+void ShaderCache::SaveEntry( const std::wstring& filename, uint64_t key, const std::vector<uint8_t>& bytecode ) const
+{
+	EntryHeader header;
+	header.Magic = EntryMagic;
+	header.Version = CacheVersion;
+	header.Key = key;
+	header.BytecodeHash = HashBytes(&bytecode[0], bytecode.size());
+	header.BytecodeSize = static_cast<uint32_t>(bytecode.size());
+	header.Reserved = 0;
+
+	// A failed or partial write is rejected by the next load
+	FILE* file;
+	if (_wfopen_s(&file, filename.c_str(), L"wb") != 0)
+		return;
+
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&bytecode[0], 1, bytecode.size(), file);
+	fclose(file);
+}
+
+std::wstring ShaderCache::GetEntryFilename( uint64_t key ) const
+{
+	const wchar_t Digits[] = L"0123456789abcdef";
+
+	wchar_t name[17];
+	for (int i = 0; i < 16; ++i)
+		name[i] = Digits[(key >> (60 - i * 4)) & 0xF];
+	name[16] = 0;
+
+	return mDirectory + L"\\" + name + L".cso";
+}
+
+uint64_t ShaderCache::HashSourceFile( const std::wstring& filename, std::set<std::wstring>& visiting )
+{
+	std::map<std::wstring, uint64_t>::const_iterator found = mFileHashes.find(filename);
+	if (found != mFileHashes.end())
+		return found->second;
+
+	// Included again further down, the include guard ends it there
+	if (!visiting.insert(filename).second)
+		return HashBytes(filename.data(), filename.size() * sizeof(wchar_t));
+
+	std::vector<uint8_t> contents;
+	if (!ReadWholeFile(filename, &contents))
+	{
+		visiting.erase(filename);
+		return 0;
+	}
+
+	uint64_t hash = HashBytes(contents.empty() ? NULL : &contents[0], contents.size());
+
+	// Quoted includes are relative to the including file
+	const size_t slash = filename.find_last_of(L"\\/");
+	const std::wstring directory = slash == std::wstring::npos ? std::wstring() : filename.substr(0, slash + 1);
+
+	std::vector<std::string> includes;
+	FindIncludes(contents, &includes);
+
+	for (size_t i = 0; i < includes.size(); ++i)
+	{
+		const std::wstring includeName(includes[i].begin(), includes[i].end());
+		const uint64_t includeHash = HashSourceFile(directory + includeName, visiting);
+		hash = HashBytes(&includeHash, sizeof(includeHash), hash);
+	}
+
+	visiting.erase(filename);
+	mFileHashes[filename] = hash;
+	return hash;
+}
@@ -0,0 +1,137 @@
+#ifndef ShaderCache_h__
+#define ShaderCache_h__
+
+#include <ppl.h>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Persistent shader bytecode cache, one file per compiled permutation in a directory.
+ *
+ * The key of a request hashes everything the compiler output depends on: the source file and every file it
+ * #includes (recursively, by contents), the defines, the profile, the entry point and the compile flags.
+ * A changed include gives new keys to the shaders using it and nothing else. The entry is named after its
+ * key and holds the bytecode with its hash, a loaded entry that doesn't match its key, size or hash is
+ * rejected and compiled again, so a torn write or a stale file never reaches the device.
+ *
+ * Like SceneLoader, requests are queued with Add and run as jobs on the PPL scheduler from Start(): each
+ * job loads its entry, or compiles and writes it on a miss. The same request added twice is compiled once.
+ */
+
+struct ShaderCompileRequest
+{
+	std::wstring Filename;
+	std::string EntryPoint;
+	std::string Profile;
+	std::vector<std::pair<std::string, std::string> > Defines;
+	uint32_t Flags;
+};
+
+struct ShaderCacheStats
+{
+	uint32_t Requests;
+	uint32_t Loaded;     // Valid entry on disk
+	uint32_t Compiled;   // No entry, or a rejected one
+	uint32_t Rejected;   // Entry on disk that failed validation
+	uint32_t Failed;     // Didn't compile, no bytecode
+};
+
+class ShaderCache
+{
+public:
+	/**
+	 * Compile request into bytecode, false with the compiler output in errors when it fails. Called from the
+	 * jobs, so it must be thread safe. ShaderFactory::CompileBytecode in the application.
+	 */
+	typedef bool (*CompileFunction)(const ShaderCompileRequest& request, std::vector<uint8_t>* bytecode, std::string* errors);
+
+public:
+	ShaderCache(const std::wstring& directory, CompileFunction compile);
+	~ShaderCache();
+
+	/**
+	 * Hash the request and its sources into a key and queue it, returns the index for GetBytecode. A request
+	 * with the key of one already added returns that one's index.
+	 */
+	uint32_t Add(const ShaderCompileRequest& request);
+
+	// Load or compile the requests added since the last Start
+	void Start();
+
+	// Block until the started jobs are finished
+	void Wait();
+
+	/**
+	 * Bytecode of a finished request, empty when it failed to compile, errors has the compiler output then.
+	 */
+	const std::vector<uint8_t>& GetBytecode(uint32_t index) const        { return mEntries[index].Bytecode; }
+	const std::string& GetErrors(uint32_t index) const                   { return mEntries[index].Errors; }
+
+	uint64_t GetKey(uint32_t index) const                                { return mEntries[index].Key; }
+
+	// Delete the files of the added requests, their next job compiles. Not while jobs are running
+	void RemoveEntries();
+
+	// Where the entry of key is stored
+	std::wstring GetEntryFilename(uint64_t key) const;
+
+	// Over all finished requests, after Wait
+	ShaderCacheStats GetStats() const;
+
+private:
+	// Not implemented
+	ShaderCache(const ShaderCache&);
+	ShaderCache& operator=(const ShaderCache&);
+
+	enum EntryStatus
+	{
+		Entry_Pending,
+		Entry_Loaded,
+		Entry_Compiled,
+		Entry_Failed
+	};
+
+	struct Entry
+	{
+		ShaderCompileRequest Request;
+		uint64_t Key;
+		std::vector<uint8_t> Bytecode;
+		std::string Errors;
+		EntryStatus Status;
+		bool Rejected;
+	};
+
+	// The job of one entry
+	void Resolve(Entry& entry) const;
+
+	// False when there is no valid entry, rejected tells if there was an invalid one
+	bool LoadEntry(const std::wstring& filename, uint64_t key, std::vector<uint8_t>* bytecode, bool* rejected) const;
+	void SaveEntry(const std::wstring& filename, uint64_t key, const std::vector<uint8_t>& bytecode) const;
+
+	// Hash of the file contents and of everything it includes, 0 if it can't be read
+	uint64_t HashSourceFile(const std::wstring& filename, std::set<std::wstring>& visiting);
+
+private:
+	std::wstring mDirectory;
+	CompileFunction mCompile;
+
+	// Stable addresses, jobs keep working on their entry while more are added
+	std::deque<Entry> mEntries;
+	std::map<uint64_t, uint32_t> mEntryIndices;
+	uint32_t mNumStarted;
+
+	// Source file hashes, every file is read once per cache
+	std::map<std::wstring, uint64_t> mFileHashes;
+
+	Concurrency::task_group mTasks;
+};
+
+// 64 bit FNV-1a of size bytes, continuing from hash
+uint64_t HashBytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+#endif // ShaderCache_h__
@@ -1,7 +1,10 @@
 #ifndef ShaderContanst_h__
 #define ShaderContanst_h__
 
-#include <d3dx9math.h>
+#include "VectorMath.h"
+#include "AmbientOcclusionParams.h"
+
+// NOTE: Must match layout of shader constant buffers
 
 struct PerFrameConstants
 {
@@ -15,26 +18,6 @@ struct PerFrameConstants
 };
 
 
-struct HBAOParams
-{
-	D3DXVECTOR2 AOResolution;
-	D3DXVECTOR2 InvAOResolution;
-
-	D3DXVECTOR2 FocalLen;
-	D3DXVECTOR2 ClipInfo; //(M33, M43)
-
-	float Radius;
-	float RadiusSquared;
-	float InvRadiusSquared;
-	float MaxRadiusPixels;
-
-	float TanAngleBias;
-	float Strength;
-
-	float pad[2];
-};
-
-
 struct BlurParams
 {
 	D3DXVECTOR2 InvResolution;
@@ -48,5 +31,27 @@ struct BlurParams
 	float Pading[1];
 };
 
+struct alignas(16) PerObjectConstants
+{
+	D3DXMATRIX WorldView;
+	D3DXMATRIX WorldViewProj;
+};
+
+// Every member starts a new float4 register in the cbuffer
+struct LightCBuffer
+{
+	alignas(16) D3DXVECTOR3 LightColor;
+	alignas(16) D3DXVECTOR3 LightPosition;        // View space light position
+	alignas(16) D3DXVECTOR3 LightDirection;       // View space normalized direction 
+	alignas(16) D3DXVECTOR3 SpotFalloff;
+	alignas(16) D3DXVECTOR2 LightAttenuation;     // begin and end
+};
+
+// One directional light per instance out of the constant ring, LIGHT_DIRECTION and LIGHT_COLOR
+struct DirectionalLightInstance
+{
+	D3DXVECTOR4 Direction;       // View space normalized direction, w unused
+	D3DXVECTOR4 Color;           // w unused
+};
 
 #endif // ShaderContanst_h__
@@ -0,0 +1,212 @@
+#ifndef SimdMath_h__
+#define SimdMath_h__
+
+#include <emmintrin.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * Thin wrappers over the SSE, AVX2 and AVX-512 float intrinsics, so one kernel template can be
+ * instantiated for 4, 8 or 16 lanes. Masks are whatever the instruction set compares into.
+ *
+ * SimdAVX2 and SimdAVX512 only exist in files built for them (/arch:AVX2, /arch:AVX512), see CpuFeatures.h
+ * for picking one at runtime. SimdNative is the widest set the compiler is targeting, kernels fall back to
+ * scalar code for the remainder that doesn't fill a register.
+ */
+struct SimdSSE
+{
+	typedef __m128 Float;
+	typedef __m128 Mask;
+	enum { Width = 4 };
+
+	static Float Load(const float* p)                      { return _mm_loadu_ps(p); }
+	static void  Store(float* p, Float a)                  { _mm_storeu_ps(p, a); }
+	static Float Set(float a)                              { return _mm_set1_ps(a); }
+	static Float Zero()                                    { return _mm_setzero_ps(); }
+
+	static Float Add(Float a, Float b)                     { return _mm_add_ps(a, b); }
+	static Float Sub(Float a, Float b)                     { return _mm_sub_ps(a, b); }
+	static Float Mul(Float a, Float b)                     { return _mm_mul_ps(a, b); }
+	static Float Div(Float a, Float b)                     { return _mm_div_ps(a, b); }
+	static Float Sqrt(Float a)                             { return _mm_sqrt_ps(a); }
+	static Float Min(Float a, Float b)                     { return _mm_min_ps(a, b); }
+	static Float Max(Float a, Float b)                     { return _mm_max_ps(a, b); }
+	static Float Neg(Float a)                              { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+	static Float Abs(Float a)                              { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+	// SSE2 has no floor, truncate and fix up negative values (|a| < 2^31)
+	static Float Floor(Float a)
+	{
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+	}
+
+	static Mask  CmpGt(Float a, Float b)                   { return _mm_cmpgt_ps(a, b); }
+	static Mask  CmpGe(Float a, Float b)                   { return _mm_cmpge_ps(a, b); }
+	static Mask  CmpLt(Float a, Float b)                   { return _mm_cmplt_ps(a, b); }
+	static Mask  CmpLe(Float a, Float b)                   { return _mm_cmple_ps(a, b); }
+	static Mask  And(Mask a, Mask b)                       { return _mm_and_ps(a, b); }
+	static Mask  Or(Mask a, Mask b)                        { return _mm_or_ps(a, b); }
+	static Mask  AndNot(Mask a, Mask b)                    { return _mm_andnot_ps(a, b); }   // ~a & b
+	static bool  Any(Mask m)                               { return _mm_movemask_ps(m) != 0; }
+	static int   Bits(Mask m)                              { return _mm_movemask_ps(m); }
+
+	// m ? a : b per lane
+	static Float Select(Mask m, Float a, Float b)          { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+	// 2^n for integral n in [-126, 127]
+	static Float Exp2i(Float n)                            { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23)); }
+};
+
+#if defined(__AVX2__)
+struct SimdAVX2
+{
+	typedef __m256 Float;
+	typedef __m256 Mask;
+	enum { Width = 8 };
+
+	static Float Load(const float* p)                      { return _mm256_loadu_ps(p); }
+	static void  Store(float* p, Float a)                  { _mm256_storeu_ps(p, a); }
+	static Float Set(float a)                              { return _mm256_set1_ps(a); }
+	static Float Zero()                                    { return _mm256_setzero_ps(); }
+
+	static Float Add(Float a, Float b)                     { return _mm256_add_ps(a, b); }
+	static Float Sub(Float a, Float b)                     { return _mm256_sub_ps(a, b); }
+	static Float Mul(Float a, Float b)                     { return _mm256_mul_ps(a, b); }
+	static Float Div(Float a, Float b)                     { return _mm256_div_ps(a, b); }
+	static Float Sqrt(Float a)                             { return _mm256_sqrt_ps(a); }
+	static Float Min(Float a, Float b)                     { return _mm256_min_ps(a, b); }
+	static Float Max(Float a, Float b)                     { return _mm256_max_ps(a, b); }
+	static Float Neg(Float a)                              { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+	static Float Abs(Float a)                              { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	static Float Floor(Float a)                            { return _mm256_floor_ps(a); }
+
+	static Mask  CmpGt(Float a, Float b)                   { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static Mask  CmpGe(Float a, Float b)                   { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static Mask  CmpLt(Float a, Float b)                   { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Mask  CmpLe(Float a, Float b)                   { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static Mask  And(Mask a, Mask b)                       { return _mm256_and_ps(a, b); }
+	static Mask  Or(Mask a, Mask b)                        { return _mm256_or_ps(a, b); }
+	static Mask  AndNot(Mask a, Mask b)                    { return _mm256_andnot_ps(a, b); }
+	static bool  Any(Mask m)                               { return _mm256_movemask_ps(m) != 0; }
+	static int   Bits(Mask m)                              { return _mm256_movemask_ps(m); }
+
+	static Float Select(Mask m, Float a, Float b)          { return _mm256_blendv_ps(b, a, m); }
+
+	static Float Exp2i(Float n)                            { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct SimdAVX512
+{
+	typedef __m512 Float;
+	typedef __mmask16 Mask;
+	enum { Width = 16 };
+
+	static Float Load(const float* p)                      { return _mm512_loadu_ps(p); }
+	static void  Store(float* p, Float a)                  { _mm512_storeu_ps(p, a); }
+	static Float Set(float a)                              { return _mm512_set1_ps(a); }
+	static Float Zero()                                    { return _mm512_setzero_ps(); }
+
+	static Float Add(Float a, Float b)                     { return _mm512_add_ps(a, b); }
+	static Float Sub(Float a, Float b)                     { return _mm512_sub_ps(a, b); }
+	static Float Mul(Float a, Float b)                     { return _mm512_mul_ps(a, b); }
+	static Float Div(Float a, Float b)                     { return _mm512_div_ps(a, b); }
+	static Float Sqrt(Float a)                             { return _mm512_sqrt_ps(a); }
+	static Float Min(Float a, Float b)                     { return _mm512_min_ps(a, b); }
+	static Float Max(Float a, Float b)                     { return _mm512_max_ps(a, b); }
+	static Float Neg(Float a)                              { return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000))); }
+	static Float Abs(Float a)                              { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+	static Float Floor(Float a)                            { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	static Mask  CmpGt(Float a, Float b)                   { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static Mask  CmpGe(Float a, Float b)                   { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	static Mask  CmpLt(Float a, Float b)                   { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static Mask  CmpLe(Float a, Float b)                   { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static Mask  And(Mask a, Mask b)                       { return Mask(a & b); }
+	static Mask  Or(Mask a, Mask b)                        { return Mask(a | b); }
+	static Mask  AndNot(Mask a, Mask b)                    { return Mask(~a & b); }
+	static bool  Any(Mask m)                               { return m != 0; }
+	static int   Bits(Mask m)                              { return m; }
+
+	static Float Select(Mask m, Float a, Float b)          { return _mm512_mask_blend_ps(m, b, a); }
+
+	static Float Exp2i(Float n)                            { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(n), _mm512_set1_epi32(127)), 23)); }
+};
+#endif
+
+#if defined(__AVX512F__)
+typedef SimdAVX512 SimdNative;
+#elif defined(__AVX2__)
+typedef SimdAVX2 SimdNative;
+#else
+typedef SimdSSE SimdNative;
+#endif
+
+/**
+ * Sine and cosine of every lane. The argument is reduced to [-pi, pi] in two steps (Cody-Waite), folded to
+ * [-pi/2, pi/2] and evaluated with Taylor polynomials of degree 11 and 12, absolute error is below 3e-7 for
+ * angles up to a few thousand radians.
+ */
+template <typename S>
+inline void SinCos(typename S::Float x, typename S::Float& sinx, typename S::Float& cosx)
+{
+	typedef typename S::Float Float;
+
+	// x - 2pi * round(x / 2pi), 2pi split in an exact high part and a low correction
+	Float n = S::Floor(S::Add(S::Mul(x, S::Set(0.15915494f)), S::Set(0.5f)));
+	Float y = S::Sub(x, S::Mul(n, S::Set(6.28125f)));
+	y = S::Sub(y, S::Mul(n, S::Set(1.9353071795864769e-3f)));
+
+	// sin(y) = sin(+-pi - y) and cos(y) = -cos(+-pi - y) outside [-pi/2, pi/2]
+	typename S::Mask fold = S::CmpGt(S::Abs(y), S::Set(1.57079633f));
+	Float signedPi = S::Select(S::CmpLt(y, S::Zero()), S::Set(-3.14159265f), S::Set(3.14159265f));
+	Float f = S::Select(fold, S::Sub(signedPi, y), y);
+	Float f2 = S::Mul(f, f);
+
+	Float s = S::Set(-2.5052108e-8f);
+	s = S::Add(S::Mul(s, f2), S::Set(2.7557319e-6f));
+	s = S::Add(S::Mul(s, f2), S::Set(-1.9841270e-4f));
+	s = S::Add(S::Mul(s, f2), S::Set(8.3333333e-3f));
+	s = S::Add(S::Mul(s, f2), S::Set(-1.6666667e-1f));
+	sinx = S::Add(S::Mul(S::Mul(s, f2), f), f);
+
+	Float c = S::Set(2.0876757e-9f);
+	c = S::Add(S::Mul(c, f2), S::Set(-2.7557319e-7f));
+	c = S::Add(S::Mul(c, f2), S::Set(2.4801587e-5f));
+	c = S::Add(S::Mul(c, f2), S::Set(-1.3888889e-3f));
+	c = S::Add(S::Mul(c, f2), S::Set(4.1666667e-2f));
+	c = S::Add(S::Mul(c, f2), S::Set(-0.5f));
+	c = S::Add(S::Mul(c, f2), S::Set(1.0f));
+	cosx = S::Select(fold, S::Neg(c), c);
+}
+
+/**
+ * exp(x) for x <= 0. Range reduced to 2^n * exp(f) with |f| <= ln2/2 and a degree 5 polynomial,
+ * relative error is below 2e-7, close to what the GPU exp gives.
+ */
+template <typename S>
+inline typename S::Float Exp(typename S::Float x)
+{
+	typedef typename S::Float Float;
+
+	x = S::Max(x, S::Set(-87.0f));
+
+	Float n = S::Floor(S::Add(S::Mul(x, S::Set(1.44269504f)), S::Set(0.5f)));
+	Float f = S::Sub(x, S::Mul(n, S::Set(0.693359375f)));
+	f = S::Sub(f, S::Mul(n, S::Set(-2.12194440e-4f)));
+
+	Float p = S::Set(1.9875691500e-4f);
+	p = S::Add(S::Mul(p, f), S::Set(1.3981999507e-3f));
+	p = S::Add(S::Mul(p, f), S::Set(8.3334519073e-3f));
+	p = S::Add(S::Mul(p, f), S::Set(4.1665795894e-2f));
+	p = S::Add(S::Mul(p, f), S::Set(1.6666665459e-1f));
+	p = S::Add(S::Mul(p, f), S::Set(5.0000001201e-1f));
+	p = S::Add(S::Mul(S::Mul(p, f), f), S::Add(f, S::Set(1.0f)));
+
+	return S::Mul(p, S::Exp2i(n));
+}
+
+#endif // SimdMath_h__
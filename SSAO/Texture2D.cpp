@@ -150,23 +150,14 @@ Texture2D::~Texture2D( void )
 
 void Texture2D::SaveTextureToPfm( ID3D11DeviceContext *pContext, const char* pDestFile  )
 {
-	HRESULT hr;
+	std::vector<unsigned char> pixels;
+	UINT bytesPerPixel = ReadTexture(pContext, pixels);
+	if (bytesPerPixel == 0)
+		return;
 
 	D3D11_TEXTURE2D_DESC desc;
 	mTexture->GetDesc(&desc);
 
-	desc.CPUAccessFlags	= D3D11_CPU_ACCESS_READ;
-	desc.Usage			= D3D11_USAGE_STAGING;
-	desc.BindFlags      =  0;
-	ID3D11Texture2D* pTextureStaging;
-
-	hr = mDevice->CreateTexture2D(&desc, NULL, &pTextureStaging);
-
-	pContext->CopyResource( pTextureStaging, mTexture );
-
-	D3D11_MAPPED_SUBRESOURCE texmap;
-	hr = pContext->Map(pTextureStaging, 0, D3D11_MAP_READ, 0, &texmap);
-
 	const int width = desc.Width;
 	const int height = desc.Height;
 
@@ -175,11 +166,12 @@ void Texture2D::SaveTextureToPfm( ID3D11DeviceContext *pContext, const char* pDe
 	switch(desc.Format)
 	{
 	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R32_TYPELESS:
 		{
 			float* pDest = &texData[0];
 			for (int y = 0; y < height; ++y)
 			{
-				float* pColor = (float*)((unsigned char*)texmap.pData + texmap.RowPitch * (height - 1 - y));
+				const float* pColor = (const float*)&pixels[bytesPerPixel * width * (height - 1 - y)];
 				for (int x = 0; x < width; ++x)
 				{
 					*pDest++ = *pColor;
@@ -198,7 +190,7 @@ void Texture2D::SaveTextureToPfm( ID3D11DeviceContext *pContext, const char* pDe
 			float* pDest = &texData[0];
 			for (int y = 0; y < height; ++y)
 			{
-				float* pColor = (float*)((unsigned char*)texmap.pData + texmap.RowPitch * (height - 1 - y));
+				const float* pColor = (const float*)&pixels[bytesPerPixel * width * (height - 1 - y)];
 				for (int x = 0; x < width; ++x)
 				{
 					*pDest++ = *pColor++;
@@ -215,7 +207,71 @@ void Texture2D::SaveTextureToPfm( ID3D11DeviceContext *pContext, const char* pDe
 	default:
 		break;
 	}
-	
+}
+
+UINT Texture2D::ReadTexture( ID3D11DeviceContext *pContext, std::vector<unsigned char>& pixels )
+{
+	HRESULT hr;
+
+	D3D11_TEXTURE2D_DESC desc;
+	mTexture->GetDesc(&desc);
+
+	UINT bytesPerPixel = 0;
+	switch(desc.Format)
+	{
+	case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		bytesPerPixel = 16;
+		break;
+	case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R16G16B16A16_SNORM:
+		bytesPerPixel = 8;
+		break;
+	case DXGI_FORMAT_R32_TYPELESS:
+	case DXGI_FORMAT_R32_FLOAT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+		bytesPerPixel = 4;
+		break;
+	case DXGI_FORMAT_R16_TYPELESS:
+	case DXGI_FORMAT_R16_UNORM:
+		bytesPerPixel = 2;
+		break;
+	default:
+		return 0;
+	}
+
+	desc.MipLevels      = 1;
+	desc.CPUAccessFlags	= D3D11_CPU_ACCESS_READ;
+	desc.Usage			= D3D11_USAGE_STAGING;
+	desc.BindFlags      = 0;
+	desc.MiscFlags      = 0;
+	ID3D11Texture2D* pTextureStaging;
+
+	hr = mDevice->CreateTexture2D(&desc, NULL, &pTextureStaging);
+	if (FAILED(hr))
+		return 0;
+
+	pContext->CopySubresourceRegion( pTextureStaging, 0, 0, 0, 0, mTexture, 0, NULL );
+
+	D3D11_MAPPED_SUBRESOURCE texmap;
+	hr = pContext->Map(pTextureStaging, 0, D3D11_MAP_READ, 0, &texmap);
+	if (FAILED(hr))
+	{
+		SAFE_RELEASE(pTextureStaging);
+		return 0;
+	}
+
+	const UINT rowSize = desc.Width * bytesPerPixel;
+
+	pixels.resize(rowSize * desc.Height);
+	for (UINT y = 0; y < desc.Height; ++y)
+		memcpy(&pixels[rowSize * y], (unsigned char*)texmap.pData + texmap.RowPitch * y, rowSize);
+
 	pContext->Unmap(pTextureStaging, 0);
-	SAFE_RELEASE(pTextureStaging);	
+	SAFE_RELEASE(pTextureStaging);
+
+	return bytesPerPixel;
 }
@@ -2,6 +2,7 @@
 
 #include <d3d11.h>
 #include <d3dx11tex.h>
+#include <vector>
 
 class Texture2D
 {
@@ -25,6 +26,10 @@ public:
 
 	void SaveTextureToPfm(ID3D11DeviceContext *pContext, const char* pDestFile);
 
+	// Copy mip 0 back to CPU memory, tightly packed with the top row first. Only formats with a fixed
+	// texel size are supported, returns 0 bytes per pixel otherwise.
+	UINT ReadTexture(ID3D11DeviceContext *pContext, std::vector<unsigned char>& pixels);
+
 private:
 	// Not implemented
 	Texture2D(const Texture2D&);
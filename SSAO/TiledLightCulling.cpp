@@ -0,0 +1,223 @@
+#include "DXUT.h"
+#include "TiledLightCulling.h"
+#include "Utility.h"
+#include <ppl.h>
+#include <algorithm>
+#include <cfloat>
+
+TiledLightCulling::TiledLightCulling( int tileSize )
+	: mTileSize(tileSize), mWidth(0), mHeight(0), mNumTilesX(0), mNumTilesY(0)
+{
+
+}
+
+TiledLightCulling::~TiledLightCulling()
+{
+
+}
+
+void TiledLightCulling::ComputeTileDepthBounds( const float* depthBuffer, int width, int height, const D3DXMATRIX& cameraProj )
+{
+	mWidth = width;
+	mHeight = height;
+	mNumTilesX = (width + mTileSize - 1) / mTileSize;
+	mNumTilesY = (height + mTileSize - 1) / mTileSize;
+
+	mTileDepthBounds.resize(mNumTilesX * mNumTilesY);
+
+	// View depth = _43 / (z - _33)
+	const float clipX = cameraProj._33;
+	const float clipY = cameraProj._43;
+
+	Concurrency::parallel_for(0, mNumTilesY, [&](int tileY)
+	{
+		const int y0 = tileY * mTileSize;
+		const int y1 = (std::min)(y0 + mTileSize, mHeight);
+
+		for (int tileX = 0; tileX < mNumTilesX; ++tileX)
+		{
+			const int x0 = tileX * mTileSize;
+			const int x1 = (std::min)(x0 + mTileSize, mWidth);
+
+			// Post projection depth is monotonic in view depth, so reduce first and convert twice
+			float minDepth = 1.0f, maxDepth = 0.0f;
+			for (int y = y0; y < y1; ++y)
+			{
+				const float* row = depthBuffer + y * mWidth;
+				for (int x = x0; x < x1; ++x)
+				{
+					if (row[x] < 1.0f)
+					{
+						minDepth = (std::min)(minDepth, row[x]);
+						maxDepth = (std::max)(maxDepth, row[x]);
+					}
+				}
+			}
+
+			D3DXVECTOR2& bounds = mTileDepthBounds[tileY * mNumTilesX + tileX];
+			if (minDepth <= maxDepth)
+				bounds = D3DXVECTOR2(clipY / (minDepth - clipX), clipY / (maxDepth - clipX));
+			else
+				bounds = D3DXVECTOR2(FLT_MAX, -FLT_MAX);
+		}
+	});
+}
+
+void TiledLightCulling::CullLights( const LightAnimation& lights, const D3DXMATRIX& cameraView, const D3DXMATRIX& cameraProj )
+{
+	// Gather point and spot lights as view space spheres
+	mLightIds.clear();
+	mLightX.clear();
+	mLightY.clear();
+	mLightZ.clear();
+	mLightRadius.clear();
+
+	const LightType SphereTypes[] = { LT_PointLight, LT_SpotLight };
+	for (int t = 0; t < 2; ++t)
+	{
+		const LightAnimation::LightArrays& arrays = lights.GetLightArrays(SphereTypes[t]);
+		for (size_t i = 0; i < arrays.Count; ++i)
+		{
+			D3DXVECTOR3 lightPosView;
+			const D3DXVECTOR3 lightPosition(arrays.PositionX[i], arrays.PositionY[i], arrays.PositionZ[i]);
+			D3DXVec3TransformCoord(&lightPosView, &lightPosition, &cameraView);
+
+			mLightIds.push_back(uint32_t(arrays.Begin + i));
+			mLightX.push_back(lightPosView.x);
+			mLightY.push_back(lightPosView.y);
+			mLightZ.push_back(lightPosView.z);
+			mLightRadius.push_back(arrays.AttenuationEnd[i]);
+		}
+	}
+
+	const int numLights = static_cast<int>(mLightIds.size());
+
+	// Screen rectangles, near plane is derived from the projection
+	const float cameraNear = -cameraProj._43 / cameraProj._33;
+
+	mLightClipRegions.resize(numLights);
+	mLightTileRects.resize(numLights * 4);
+	if (numLights)
+	{
+		CalculateLightBounds(&mLightX[0], &mLightY[0], &mLightZ[0], &mLightRadius[0], numLights,
+			cameraNear, cameraProj._11, cameraProj._22, &mLightClipRegions[0]);
+	}
+
+	// Clip rectangle to inclusive tile range, clip y points up and tile y down
+	for (int i = 0; i < numLights; ++i)
+	{
+		const D3DXVECTOR4& clip = mLightClipRegions[i];
+		int* rect = &mLightTileRects[i * 4];
+
+		if (clip.x >= clip.z || clip.y >= clip.w)
+		{
+			rect[0] = rect[1] = 0;
+			rect[2] = rect[3] = -1;
+			continue;
+		}
+
+		float minX = (clip.x * 0.5f + 0.5f) * mWidth;
+		float maxX = (clip.z * 0.5f + 0.5f) * mWidth;
+		float minY = (0.5f - clip.w * 0.5f) * mHeight;
+		float maxY = (0.5f - clip.y * 0.5f) * mHeight;
+
+		rect[0] = (std::max)(int(minX) / mTileSize, 0);
+		rect[1] = (std::max)(int(minY) / mTileSize, 0);
+		rect[2] = (std::min)(int(maxX) / mTileSize, mNumTilesX - 1);
+		rect[3] = (std::min)(int(maxY) / mTileSize, mNumTilesY - 1);
+	}
+
+	// Each tile row fills its own lists, rows run in parallel
+	mRowLightIndices.resize(mNumTilesY);
+	mRowTileEnds.resize(mNumTilesY);
+	mRowHits.resize(mNumTilesY);
+
+	Concurrency::parallel_for(0, mNumTilesY, [&](int tileY)
+	{
+		std::vector<uint32_t>& rowIndices = mRowLightIndices[tileY];
+		std::vector<uint32_t>& rowEnds = mRowTileEnds[tileY];
+		rowIndices.clear();
+		rowEnds.assign(mNumTilesX, 0);
+
+		// Depth range of the whole row rejects most lights before any tile is visited
+		const D3DXVECTOR2* rowBounds = &mTileDepthBounds[tileY * mNumTilesX];
+
+		float rowMinZ = FLT_MAX, rowMaxZ = -FLT_MAX;
+		for (int tileX = 0; tileX < mNumTilesX; ++tileX)
+		{
+			rowMinZ = (std::min)(rowMinZ, rowBounds[tileX].x);
+			rowMaxZ = (std::max)(rowMaxZ, rowBounds[tileX].y);
+		}
+
+		// Tile and light of each hit, bucketed per tile afterwards to keep the lights of a tile contiguous
+		std::vector<uint32_t>& rowHits = mRowHits[tileY];
+		rowHits.clear();
+
+		for (int i = 0; i < numLights; ++i)
+		{
+			const int* rect = &mLightTileRects[i * 4];
+			if (tileY < rect[1] || tileY > rect[3])
+				continue;
+
+			const float lightMinZ = mLightZ[i] - mLightRadius[i];
+			const float lightMaxZ = mLightZ[i] + mLightRadius[i];
+			if (lightMaxZ < rowMinZ || lightMinZ > rowMaxZ)
+				continue;
+
+			for (int tileX = rect[0]; tileX <= rect[2]; ++tileX)
+			{
+				// Sphere against tile depth range
+				if (lightMaxZ < rowBounds[tileX].x || lightMinZ > rowBounds[tileX].y)
+					continue;
+
+				rowEnds[tileX]++;
+				rowHits.push_back(uint32_t(tileX));
+				rowHits.push_back(uint32_t(i));
+			}
+		}
+
+		uint32_t offset = 0;
+		for (int tileX = 0; tileX < mNumTilesX; ++tileX)
+		{
+			const uint32_t count = rowEnds[tileX];
+			rowEnds[tileX] = offset;
+			offset += count;
+		}
+
+		rowIndices.resize(offset);
+		for (size_t h = 0; h < rowHits.size(); h += 2)
+			rowIndices[rowEnds[rowHits[h]]++] = mLightIds[rowHits[h + 1]];
+	});
+
+	// Pack the rows into the flat buffer
+	const int numTiles = mNumTilesX * mNumTilesY;
+	mTileOffsets.resize(numTiles + 1);
+
+	uint32_t offset = 0;
+	for (int tileY = 0; tileY < mNumTilesY; ++tileY)
+	{
+		for (int tileX = 0; tileX < mNumTilesX; ++tileX)
+		{
+			const uint32_t rowBegin = tileX ? mRowTileEnds[tileY][tileX - 1] : 0;
+			mTileOffsets[tileY * mNumTilesX + tileX] = offset;
+			offset += mRowTileEnds[tileY][tileX] - rowBegin;
+		}
+	}
+	mTileOffsets[numTiles] = offset;
+
+	mLightIndices.resize(offset);
+	Concurrency::parallel_for(0, mNumTilesY, [&](int tileY)
+	{
+		const std::vector<uint32_t>& rowIndices = mRowLightIndices[tileY];
+		if (!rowIndices.empty())
+			std::copy(rowIndices.begin(), rowIndices.end(), mLightIndices.begin() + mTileOffsets[tileY * mNumTilesX]);
+	});
+}
+
+const uint32_t* TiledLightCulling::GetTileLights( int tileX, int tileY, uint32_t& numLights ) const
+{
+	const int tile = tileY * mNumTilesX + tileX;
+
+	numLights = mTileOffsets[tile + 1] - mTileOffsets[tile];
+	return numLights ? &mLightIndices[mTileOffsets[tile]] : NULL;
+}
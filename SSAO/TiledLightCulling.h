@@ -0,0 +1,70 @@
+#ifndef TiledLightCulling_h__
+#define TiledLightCulling_h__
+
+#include "LightAnimation.h"
+#include <vector>
+#include <cstdint>
+
+/**
+ * CPU implementation of the Cull_Deferred_Tile light culling.
+ *
+ * The screen is split in TileSize x TileSize pixel tiles. Each tile gets the min/max view depth of the
+ * geometry it covers, and a light is assigned to a tile when its projected screen rectangle (from
+ * CalculateLightBounds) overlaps the tile and its sphere overlaps the tile depth range. Results are stored
+ * as one flat index buffer plus a prefix offset per tile, the layout a structured buffer upload wants.
+ */
+class TiledLightCulling
+{
+public:
+	TiledLightCulling(int tileSize = 16);
+	~TiledLightCulling();
+
+	/**
+	 * Compute per tile view depth range from a post projection depth buffer. Pixels on the far plane
+	 * (cleared depth) are skipped, tiles without geometry end up empty and receive no lights.
+	 */
+	void ComputeTileDepthBounds(const float* depthBuffer, int width, int height, const D3DXMATRIX& cameraProj);
+
+	/**
+	 * Build the tile light lists for the point and spot lights, must follow ComputeTileDepthBounds.
+	 * Directional lights affect every tile and are left out.
+	 */
+	void CullLights(const LightAnimation& lights, const D3DXMATRIX& cameraView, const D3DXMATRIX& cameraProj);
+
+	int GetTileSize() const         { return mTileSize; }
+	int GetNumTilesX() const        { return mNumTilesX; }
+	int GetNumTilesY() const        { return mNumTilesY; }
+
+	// Light indices (LightAnimation::GetLight) of a tile
+	const uint32_t* GetTileLights(int tileX, int tileY, uint32_t& numLights) const;
+
+	// The flat lists, tile t owns [TileOffsets[t], TileOffsets[t+1])
+	const std::vector<uint32_t>& GetTileOffsets() const   { return mTileOffsets; }
+	const std::vector<uint32_t>& GetLightIndices() const  { return mLightIndices; }
+
+	// Min/max view depth, x > y for an empty tile
+	const std::vector<D3DXVECTOR2>& GetTileDepthBounds() const { return mTileDepthBounds; }
+
+private:
+	int mTileSize;
+	int mWidth, mHeight;
+	int mNumTilesX, mNumTilesY;
+
+	std::vector<D3DXVECTOR2> mTileDepthBounds;
+
+	std::vector<uint32_t> mTileOffsets;
+	std::vector<uint32_t> mLightIndices;
+
+	// View space spheres and their tile rectangles, reused between frames
+	std::vector<uint32_t> mLightIds;
+	std::vector<float> mLightX, mLightY, mLightZ, mLightRadius;
+	std::vector<D3DXVECTOR4> mLightClipRegions;
+	std::vector<int> mLightTileRects;
+
+	// Per tile row lists before they are packed into mLightIndices, and the row relative end of each tile
+	std::vector<std::vector<uint32_t>> mRowLightIndices;
+	std::vector<std::vector<uint32_t>> mRowTileEnds;
+	std::vector<std::vector<uint32_t>> mRowHits;       // (tileX, light) pairs
+};
+
+#endif // TiledLightCulling_h__
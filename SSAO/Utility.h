@@ -1,11 +1,44 @@
 #ifndef Utility_h__
 #define Utility_h__
 
-#include <d3dx9math.h>
+#include "VectorMath.h"
+#include <cstdint>
+#include "ShaderContanst.h"
+#include "CpuFeatures.h"
+
+// Width of the tiled (cos(alpha), sin(alpha), jitter) texture used by the HBAO style shaders.
+const int HBAORandomTextureWidth = 4;
 
 // Returns bounding box [min.xy, max.xy] in clip [-1, 1] space.
 D3DXVECTOR4 CalculateLightBound(const D3DXVECTOR3& lightPosView, float lightRadius, float CamearaNear, 
 	                            float cameraScaleX, float cameraScaleY);
 
+// CalculateLightBound for numLights lights given in structure of arrays layout (view space position and radius).
+// Runs 4, 8 or 16 lights at once with SSE2, AVX2 or AVX-512, whichever GetSimdLevel reports, and gives exactly
+// the same rectangles, as long as the scalar path isn't contracted to FMA. Utility.cpp and the LightBounds files
+// are built with /fp:precise for that, the rest of the project is /fp:fast.
+void CalculateLightBounds(const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius,
+	                      int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, D3DXVECTOR4* clipRegions);
+
+// Same with the kernels of simdLevel, or of GetSimdLevel if the CPU doesn't run those
+void CalculateLightBounds(const float* lightPosViewX, const float* lightPosViewY, const float* lightPosViewZ, const float* lightRadius,
+	                      int numLights, float cameraNear, float cameraScaleX, float cameraScaleY, D3DXVECTOR4* clipRegions,
+						  SimdLevel simdLevel);
+
+// Normalized planes (left, right, bottom, top, near, far) of the part of a view projection frustum covering
+// clipRect [min.xy, max.xy] in clip space and [minDepth, maxDepth] of post projection depth, normals point
+// inside. The whole frustum is clipRect (-1, -1, 1, 1) with depth [0, 1], a tile gives the tile frustum.
+void ExtractFrustumPlanes(const D3DXMATRIX& viewProj, const D3DXVECTOR4& clipRect, float minDepth, float maxDepth,
+	                      D3DXPLANE planes[6]);
+
+// Fill HBAORandomTextureWidth^2 texels in DXGI_FORMAT_R16G16B16A16_SNORM layout. Shared by the GPU 
+// random texture and the CPU AO reference so both sample exactly the same rotations.
+void GenerateHBAORandomTexels(uint16_t* texels);
+
+// Fill the resolution and projection dependent fields of HBAOParams, the same way for every AO technique.
+void UpdateHBAOParams(HBAOParams& params, const D3DXMATRIX& cameraProj, float width, float height);
+
+// Fill everything except BlurRadius in BlurParams, the falloff follows the radius.
+void UpdateBlurParams(BlurParams& params, float cameraNear, float cameraFar, float width, float height);
 
 #endif // Utility_h__
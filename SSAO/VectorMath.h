@@ -0,0 +1,601 @@
+#ifndef VectorMath_h__
+#define VectorMath_h__
+
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+
+#if defined(__ARM_NEON) || defined(_M_ARM) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define VECTORMATH_NEON
+#else
+#include <xmmintrin.h>
+#endif
+
+/**
+ * Portable vector, matrix and quaternion math for the CPU side code, header only.
+ *
+ * Conventions follow D3DX: row vectors, v' = v * M, matrices are row major with _41.._43 holding the
+ * translation, left handed builders. Matrix products and transforms run on four lane SSE or NEON registers,
+ * the rest is plain scalar code the compiler handles well.
+ *
+ * When d3dx9math.h or d3dx10math.h was included before (DXUT.h, first in every precompiled translation unit)
+ * the D3DX types are left to it. Otherwise the D3DX names the CPU code uses are defined on top of these
+ * types, so this header, BoundingVolume.h and LightAnimation.h compile on their own without the DirectX SDK.
+ */
+
+//////////////////////////////////////////////////////////////////////////
+// Four float register
+
+#ifdef VECTORMATH_NEON
+
+typedef float32x4_t Vector4Register;
+
+inline Vector4Register VectorLoad(const float* p)                                                { return vld1q_f32(p); }
+inline void VectorStore(float* p, Vector4Register v)                                             { vst1q_f32(p, v); }
+inline Vector4Register VectorSplat(float f)                                                      { return vdupq_n_f32(f); }
+inline Vector4Register VectorAdd(Vector4Register a, Vector4Register b)                           { return vaddq_f32(a, b); }
+inline Vector4Register VectorMul(Vector4Register a, Vector4Register b)                           { return vmulq_f32(a, b); }
+inline Vector4Register VectorMultiplyAdd(Vector4Register a, Vector4Register b, Vector4Register c) { return vmlaq_f32(c, a, b); }
+
+inline void VectorTranspose(Vector4Register& r0, Vector4Register& r1, Vector4Register& r2, Vector4Register& r3)
+{
+	const float32x4x2_t t01 = vtrnq_f32(r0, r1);
+	const float32x4x2_t t23 = vtrnq_f32(r2, r3);
+	r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+	r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+	r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+	r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+typedef __m128 Vector4Register;
+
+inline Vector4Register VectorLoad(const float* p)                                                { return _mm_loadu_ps(p); }
+inline void VectorStore(float* p, Vector4Register v)                                             { _mm_storeu_ps(p, v); }
+inline Vector4Register VectorSplat(float f)                                                      { return _mm_set1_ps(f); }
+inline Vector4Register VectorAdd(Vector4Register a, Vector4Register b)                           { return _mm_add_ps(a, b); }
+inline Vector4Register VectorMul(Vector4Register a, Vector4Register b)                           { return _mm_mul_ps(a, b); }
+inline Vector4Register VectorMultiplyAdd(Vector4Register a, Vector4Register b, Vector4Register c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+inline void VectorTranspose(Vector4Register& r0, Vector4Register& r1, Vector4Register& r2, Vector4Register& r3)
+{
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+// Types
+
+struct Float2
+{
+	float x, y;
+
+	Float2() { }
+	Float2(float fx, float fy) : x(fx), y(fy) { }
+	Float2(const float* f) : x(f[0]), y(f[1]) { }
+
+	operator float* ()                                 { return &x; }
+	operator const float* () const                     { return &x; }
+
+	Float2& operator += (const Float2& v)              { x += v.x; y += v.y; return *this; }
+	Float2& operator -= (const Float2& v)              { x -= v.x; y -= v.y; return *this; }
+	Float2& operator *= (float f)                      { x *= f; y *= f; return *this; }
+	Float2& operator /= (float f)                      { return *this *= 1.0f / f; }
+
+	Float2 operator + () const                         { return *this; }
+	Float2 operator - () const                         { return Float2(-x, -y); }
+
+	Float2 operator + (const Float2& v) const          { return Float2(x + v.x, y + v.y); }
+	Float2 operator - (const Float2& v) const          { return Float2(x - v.x, y - v.y); }
+	Float2 operator * (float f) const                  { return Float2(x * f, y * f); }
+	Float2 operator / (float f) const                  { return *this * (1.0f / f); }
+
+	bool operator == (const Float2& v) const           { return x == v.x && y == v.y; }
+	bool operator != (const Float2& v) const           { return !(*this == v); }
+};
+
+struct Float3
+{
+	float x, y, z;
+
+	Float3() { }
+	Float3(float fx, float fy, float fz) : x(fx), y(fy), z(fz) { }
+	Float3(const float* f) : x(f[0]), y(f[1]), z(f[2]) { }
+
+	operator float* ()                                 { return &x; }
+	operator const float* () const                     { return &x; }
+
+	Float3& operator += (const Float3& v)              { x += v.x; y += v.y; z += v.z; return *this; }
+	Float3& operator -= (const Float3& v)              { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	Float3& operator *= (float f)                      { x *= f; y *= f; z *= f; return *this; }
+	Float3& operator /= (float f)                      { return *this *= 1.0f / f; }
+
+	Float3 operator + () const                         { return *this; }
+	Float3 operator - () const                         { return Float3(-x, -y, -z); }
+
+	Float3 operator + (const Float3& v) const          { return Float3(x + v.x, y + v.y, z + v.z); }
+	Float3 operator - (const Float3& v) const          { return Float3(x - v.x, y - v.y, z - v.z); }
+	Float3 operator * (float f) const                  { return Float3(x * f, y * f, z * f); }
+	Float3 operator / (float f) const                  { return *this * (1.0f / f); }
+
+	bool operator == (const Float3& v) const           { return x == v.x && y == v.y && z == v.z; }
+	bool operator != (const Float3& v) const           { return !(*this == v); }
+};
+
+struct Float4
+{
+	float x, y, z, w;
+
+	Float4() { }
+	Float4(float fx, float fy, float fz, float fw) : x(fx), y(fy), z(fz), w(fw) { }
+	Float4(const Float3& v, float fw) : x(v.x), y(v.y), z(v.z), w(fw) { }
+	Float4(const float* f) : x(f[0]), y(f[1]), z(f[2]), w(f[3]) { }
+
+	operator float* ()                                 { return &x; }
+	operator const float* () const                     { return &x; }
+
+	Float4& operator += (const Float4& v)              { x += v.x; y += v.y; z += v.z; w += v.w; return *this; }
+	Float4& operator -= (const Float4& v)              { x -= v.x; y -= v.y; z -= v.z; w -= v.w; return *this; }
+	Float4& operator *= (float f)                      { x *= f; y *= f; z *= f; w *= f; return *this; }
+	Float4& operator /= (float f)                      { return *this *= 1.0f / f; }
+
+	Float4 operator + () const                         { return *this; }
+	Float4 operator - () const                         { return Float4(-x, -y, -z, -w); }
+
+	Float4 operator + (const Float4& v) const          { return Float4(x + v.x, y + v.y, z + v.z, w + v.w); }
+	Float4 operator - (const Float4& v) const          { return Float4(x - v.x, y - v.y, z - v.z, w - v.w); }
+	Float4 operator * (float f) const                  { return Float4(x * f, y * f, z * f, w * f); }
+	Float4 operator / (float f) const                  { return *this * (1.0f / f); }
+
+	bool operator == (const Float4& v) const           { return x == v.x && y == v.y && z == v.z && w == v.w; }
+	bool operator != (const Float4& v) const           { return !(*this == v); }
+};
+
+inline Float2 operator * (float f, const Float2& v)   { return v * f; }
+inline Float3 operator * (float f, const Float3& v)   { return v * f; }
+inline Float4 operator * (float f, const Float4& v)   { return v * f; }
+
+// ax + by + cz + d = 0
+struct Plane
+{
+	float a, b, c, d;
+
+	Plane() { }
+	Plane(float fa, float fb, float fc, float fd) : a(fa), b(fb), c(fc), d(fd) { }
+
+	operator float* ()                                 { return &a; }
+	operator const float* () const                     { return &a; }
+};
+
+struct Quaternion
+{
+	float x, y, z, w;
+
+	Quaternion() { }
+	Quaternion(float fx, float fy, float fz, float fw) : x(fx), y(fy), z(fz), w(fw) { }
+
+	bool operator == (const Quaternion& q) const       { return x == q.x && y == q.y && z == q.z && w == q.w; }
+	bool operator != (const Quaternion& q) const       { return !(*this == q); }
+};
+
+struct Float4x4
+{
+	union
+	{
+		struct
+		{
+			float _11, _12, _13, _14;
+			float _21, _22, _23, _24;
+			float _31, _32, _33, _34;
+			float _41, _42, _43, _44;
+		};
+		float m[4][4];
+	};
+
+	Float4x4() { }
+	Float4x4(const float* f) { memcpy(m, f, sizeof(m)); }
+	Float4x4(float f11, float f12, float f13, float f14,
+			 float f21, float f22, float f23, float f24,
+			 float f31, float f32, float f33, float f34,
+			 float f41, float f42, float f43, float f44)
+	{
+		_11 = f11; _12 = f12; _13 = f13; _14 = f14;
+		_21 = f21; _22 = f22; _23 = f23; _24 = f24;
+		_31 = f31; _32 = f32; _33 = f33; _34 = f34;
+		_41 = f41; _42 = f42; _43 = f43; _44 = f44;
+	}
+
+	float& operator () (int row, int col)              { return m[row][col]; }
+	float operator () (int row, int col) const         { return m[row][col]; }
+
+	operator float* ()                                 { return &_11; }
+	operator const float* () const                     { return &_11; }
+
+	inline Float4x4 operator * (const Float4x4& rhs) const;
+	Float4x4& operator *= (const Float4x4& rhs)        { return *this = *this * rhs; }
+
+	bool operator == (const Float4x4& rhs) const       { return memcmp(m, rhs.m, sizeof(m)) == 0; }
+	bool operator != (const Float4x4& rhs) const       { return !(*this == rhs); }
+};
+
+//////////////////////////////////////////////////////////////////////////
+// Vectors
+
+inline float Vec2Dot(const Float2& a, const Float2& b)     { return a.x * b.x + a.y * b.y; }
+inline float Vec3Dot(const Float3& a, const Float3& b)     { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float Vec4Dot(const Float4& a, const Float4& b)     { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+inline float Vec3Length(const Float3& v)                   { return sqrtf(Vec3Dot(v, v)); }
+inline float Vec3LengthSq(const Float3& v)                 { return Vec3Dot(v, v); }
+
+inline Float3 Vec3Cross(const Float3& a, const Float3& b)
+{
+	return Float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// Zero stays zero
+inline Float3 Vec3Normalize(const Float3& v)
+{
+	const float length = Vec3Length(v);
+	return length > 0 ? v / length : Float3(0, 0, 0);
+}
+
+inline Float3 Vec3Minimize(const Float3& a, const Float3& b)
+{
+	return Float3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+}
+
+inline Float3 Vec3Maximize(const Float3& a, const Float3& b)
+{
+	return Float3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+}
+
+inline Plane PlaneNormalize(const Plane& p)
+{
+	const float length = sqrtf(p.a * p.a + p.b * p.b + p.c * p.c);
+	const float scale = length > 0 ? 1.0f / length : 0.0f;
+	return Plane(p.a * scale, p.b * scale, p.c * scale, p.d * scale);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Transforms
+
+// (x, y, z, w) * M
+inline Vector4Register TransformRegister(float x, float y, float z, float w, const Float4x4& mat)
+{
+	Vector4Register r = VectorMul(VectorSplat(x), VectorLoad(mat.m[0]));
+	r = VectorMultiplyAdd(VectorSplat(y), VectorLoad(mat.m[1]), r);
+	r = VectorMultiplyAdd(VectorSplat(z), VectorLoad(mat.m[2]), r);
+	return VectorMultiplyAdd(VectorSplat(w), VectorLoad(mat.m[3]), r);
+}
+
+// (x, y, z, 1) * M
+inline Float4 Vec3Transform(const Float3& v, const Float4x4& mat)
+{
+	Float4 result;
+	VectorStore(result, TransformRegister(v.x, v.y, v.z, 1.0f, mat));
+	return result;
+}
+
+inline Float4 Vec4Transform(const Float4& v, const Float4x4& mat)
+{
+	Float4 result;
+	VectorStore(result, TransformRegister(v.x, v.y, v.z, v.w, mat));
+	return result;
+}
+
+// (x, y, z, 1) * M, projected back to w = 1
+inline Float3 Vec3TransformCoord(const Float3& v, const Float4x4& mat)
+{
+	const Float4 result = Vec3Transform(v, mat);
+	const float invW = 1.0f / result.w;
+	return Float3(result.x * invW, result.y * invW, result.z * invW);
+}
+
+// (x, y, z, 0) * M
+inline Float3 Vec3TransformNormal(const Float3& v, const Float4x4& mat)
+{
+	Float4 result;
+	VectorStore(result, TransformRegister(v.x, v.y, v.z, 0.0f, mat));
+	return Float3(result.x, result.y, result.z);
+}
+
+// Vec3TransformCoord of count points, in and out may be the same array
+inline void Vec3TransformCoordArray(const Float3* in, Float3* out, size_t count, const Float4x4& mat)
+{
+	const Vector4Register row0 = VectorLoad(mat.m[0]), row1 = VectorLoad(mat.m[1]);
+	const Vector4Register row2 = VectorLoad(mat.m[2]), row3 = VectorLoad(mat.m[3]);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		Vector4Register r = VectorMultiplyAdd(VectorSplat(in[i].x), row0, row3);
+		r = VectorMultiplyAdd(VectorSplat(in[i].y), row1, r);
+		r = VectorMultiplyAdd(VectorSplat(in[i].z), row2, r);
+
+		float result[4];
+		VectorStore(result, r);
+		const float invW = 1.0f / result[3];
+		out[i] = Float3(result[0] * invW, result[1] * invW, result[2] * invW);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Matrices
+
+inline Float4x4 MatrixIdentity()
+{
+	return Float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+}
+
+inline Float4x4 MatrixMultiply(const Float4x4& a, const Float4x4& b)
+{
+	const Vector4Register b0 = VectorLoad(b.m[0]), b1 = VectorLoad(b.m[1]);
+	const Vector4Register b2 = VectorLoad(b.m[2]), b3 = VectorLoad(b.m[3]);
+
+	Float4x4 result;
+	for (int i = 0; i < 4; ++i)
+	{
+		Vector4Register row = VectorMul(VectorSplat(a.m[i][0]), b0);
+		row = VectorMultiplyAdd(VectorSplat(a.m[i][1]), b1, row);
+		row = VectorMultiplyAdd(VectorSplat(a.m[i][2]), b2, row);
+		row = VectorMultiplyAdd(VectorSplat(a.m[i][3]), b3, row);
+		VectorStore(result.m[i], row);
+	}
+	return result;
+}
+
+inline Float4x4 Float4x4::operator * (const Float4x4& rhs) const
+{
+	return MatrixMultiply(*this, rhs);
+}
+
+// out[i] = in[i] * mat, e.g. world matrices into world view projection
+inline void MatrixMultiplyArray(const Float4x4* in, Float4x4* out, size_t count, const Float4x4& mat)
+{
+	const Vector4Register b0 = VectorLoad(mat.m[0]), b1 = VectorLoad(mat.m[1]);
+	const Vector4Register b2 = VectorLoad(mat.m[2]), b3 = VectorLoad(mat.m[3]);
+
+	for (size_t n = 0; n < count; ++n)
+	{
+		for (int i = 0; i < 4; ++i)
+		{
+			Vector4Register row = VectorMul(VectorSplat(in[n].m[i][0]), b0);
+			row = VectorMultiplyAdd(VectorSplat(in[n].m[i][1]), b1, row);
+			row = VectorMultiplyAdd(VectorSplat(in[n].m[i][2]), b2, row);
+			row = VectorMultiplyAdd(VectorSplat(in[n].m[i][3]), b3, row);
+			VectorStore(out[n].m[i], row);
+		}
+	}
+}
+
+inline Float4x4 MatrixTranspose(const Float4x4& mat)
+{
+	Vector4Register r0 = VectorLoad(mat.m[0]), r1 = VectorLoad(mat.m[1]);
+	Vector4Register r2 = VectorLoad(mat.m[2]), r3 = VectorLoad(mat.m[3]);
+	VectorTranspose(r0, r1, r2, r3);
+
+	Float4x4 result;
+	VectorStore(result.m[0], r0);
+	VectorStore(result.m[1], r1);
+	VectorStore(result.m[2], r2);
+	VectorStore(result.m[3], r3);
+	return result;
+}
+
+/**
+ * General inverse by cofactors. Returns false and leaves result untouched for a singular matrix.
+ */
+inline bool MatrixInverse(const Float4x4& mat, Float4x4& result, float* determinant = NULL)
+{
+	const float* m = mat;
+	float inv[16];
+
+	inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+	inv[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+	inv[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+	inv[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+	inv[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+	inv[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+	inv[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+	const float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if (determinant)
+		*determinant = det;
+
+	if (det == 0)
+		return false;
+
+	const float invDet = 1.0f / det;
+	for (int i = 0; i < 16; ++i)
+		result[i] = inv[i] * invDet;
+
+	return true;
+}
+
+inline Float4x4 MatrixScaling(float sx, float sy, float sz)
+{
+	return Float4x4(sx, 0, 0, 0, 0, sy, 0, 0, 0, 0, sz, 0, 0, 0, 0, 1);
+}
+
+inline Float4x4 MatrixTranslation(float tx, float ty, float tz)
+{
+	return Float4x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, tx, ty, tz, 1);
+}
+
+inline Float4x4 MatrixRotationX(float angle)
+{
+	const float s = sinf(angle), c = cosf(angle);
+	return Float4x4(1, 0, 0, 0, 0, c, s, 0, 0, -s, c, 0, 0, 0, 0, 1);
+}
+
+inline Float4x4 MatrixRotationY(float angle)
+{
+	const float s = sinf(angle), c = cosf(angle);
+	return Float4x4(c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1);
+}
+
+inline Float4x4 MatrixRotationZ(float angle)
+{
+	const float s = sinf(angle), c = cosf(angle);
+	return Float4x4(c, s, 0, 0, -s, c, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+}
+
+// Left handed, depth to [0, 1]
+inline Float4x4 MatrixPerspectiveFovLH(float fovy, float aspect, float zn, float zf)
+{
+	const float yScale = 1.0f / tanf(fovy * 0.5f);
+	const float xScale = yScale / aspect;
+	const float q = zf / (zf - zn);
+	return Float4x4(xScale, 0, 0, 0, 0, yScale, 0, 0, 0, 0, q, 1, 0, 0, -zn * q, 0);
+}
+
+inline Float4x4 MatrixLookAtLH(const Float3& eye, const Float3& at, const Float3& up)
+{
+	const Float3 zAxis = Vec3Normalize(at - eye);
+	const Float3 xAxis = Vec3Normalize(Vec3Cross(up, zAxis));
+	const Float3 yAxis = Vec3Cross(zAxis, xAxis);
+
+	return Float4x4(
+		xAxis.x, yAxis.x, zAxis.x, 0,
+		xAxis.y, yAxis.y, zAxis.y, 0,
+		xAxis.z, yAxis.z, zAxis.z, 0,
+		-Vec3Dot(xAxis, eye), -Vec3Dot(yAxis, eye), -Vec3Dot(zAxis, eye), 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Quaternions
+
+inline Quaternion QuaternionIdentity()
+{
+	return Quaternion(0, 0, 0, 1);
+}
+
+inline Quaternion QuaternionRotationAxis(const Float3& axis, float angle)
+{
+	const Float3 v = Vec3Normalize(axis) * sinf(angle * 0.5f);
+	return Quaternion(v.x, v.y, v.z, cosf(angle * 0.5f));
+}
+
+// Rotation by a followed by b, the D3DXQuaternionMultiply order
+inline Quaternion QuaternionMultiply(const Quaternion& a, const Quaternion& b)
+{
+	return Quaternion(
+		b.w * a.x + b.x * a.w + b.y * a.z - b.z * a.y,
+		b.w * a.y - b.x * a.z + b.y * a.w + b.z * a.x,
+		b.w * a.z + b.x * a.y - b.y * a.x + b.z * a.w,
+		b.w * a.w - b.x * a.x - b.y * a.y - b.z * a.z);
+}
+
+inline Quaternion QuaternionNormalize(const Quaternion& q)
+{
+	const float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+	const float scale = length > 0 ? 1.0f / length : 0.0f;
+	return Quaternion(q.x * scale, q.y * scale, q.z * scale, q.w * scale);
+}
+
+inline Quaternion QuaternionSlerp(const Quaternion& a, const Quaternion& b, float t)
+{
+	float cosAngle = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	const float sign = cosAngle < 0 ? -1.0f : 1.0f;
+	cosAngle *= sign;
+
+	float wa = 1.0f - t, wb = t;
+	if (cosAngle < 0.9999f)
+	{
+		const float angle = acosf(cosAngle);
+		const float invSin = 1.0f / sinf(angle);
+		wa = sinf((1.0f - t) * angle) * invSin;
+		wb = sinf(t * angle) * invSin;
+	}
+
+	wb *= sign;
+	return Quaternion(a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb);
+}
+
+inline Float4x4 MatrixRotationQuaternion(const Quaternion& q)
+{
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float xw = q.x * q.w, yw = q.y * q.w, zw = q.z * q.w;
+
+	return Float4x4(
+		1 - 2 * (yy + zz), 2 * (xy + zw), 2 * (xz - yw), 0,
+		2 * (xy - zw), 1 - 2 * (xx + zz), 2 * (yz + xw), 0,
+		2 * (xz + yw), 2 * (yz - xw), 1 - 2 * (xx + yy), 0,
+		0, 0, 0, 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// D3DX names where d3dx9math.h was not included
+
+#if defined(__D3DX9MATH_H__) || defined(__D3DX10MATH_H__)
+
+// The SDK types are used
+
+#else
+
+#ifndef D3DX_PI
+#define D3DX_PI    (3.14159265358979323846f)
+#endif
+
+#define D3DXToRadian(degree) ((degree) * (D3DX_PI / 180.0f))
+#define D3DXToDegree(radian) ((radian) * (180.0f / D3DX_PI))
+
+typedef Float2 D3DXVECTOR2;
+typedef Float3 D3DXVECTOR3;
+typedef Float4 D3DXVECTOR4;
+typedef Plane D3DXPLANE;
+typedef Quaternion D3DXQUATERNION;
+typedef Float4x4 D3DXMATRIX;
+
+inline float D3DXVec3Dot(const D3DXVECTOR3* a, const D3DXVECTOR3* b)                                       { return Vec3Dot(*a, *b); }
+inline float D3DXVec3Length(const D3DXVECTOR3* v)                                                         { return Vec3Length(*v); }
+inline float D3DXVec3LengthSq(const D3DXVECTOR3* v)                                                       { return Vec3LengthSq(*v); }
+inline D3DXVECTOR3* D3DXVec3Cross(D3DXVECTOR3* out, const D3DXVECTOR3* a, const D3DXVECTOR3* b)            { *out = Vec3Cross(*a, *b); return out; }
+inline D3DXVECTOR3* D3DXVec3Normalize(D3DXVECTOR3* out, const D3DXVECTOR3* v)                             { *out = Vec3Normalize(*v); return out; }
+inline D3DXVECTOR3* D3DXVec3Minimize(D3DXVECTOR3* out, const D3DXVECTOR3* a, const D3DXVECTOR3* b)         { *out = Vec3Minimize(*a, *b); return out; }
+inline D3DXVECTOR3* D3DXVec3Maximize(D3DXVECTOR3* out, const D3DXVECTOR3* a, const D3DXVECTOR3* b)         { *out = Vec3Maximize(*a, *b); return out; }
+inline D3DXVECTOR4* D3DXVec3Transform(D3DXVECTOR4* out, const D3DXVECTOR3* v, const D3DXMATRIX* m)         { *out = Vec3Transform(*v, *m); return out; }
+inline D3DXVECTOR3* D3DXVec3TransformCoord(D3DXVECTOR3* out, const D3DXVECTOR3* v, const D3DXMATRIX* m)    { *out = Vec3TransformCoord(*v, *m); return out; }
+inline D3DXVECTOR3* D3DXVec3TransformNormal(D3DXVECTOR3* out, const D3DXVECTOR3* v, const D3DXMATRIX* m)   { *out = Vec3TransformNormal(*v, *m); return out; }
+inline D3DXVECTOR4* D3DXVec4Transform(D3DXVECTOR4* out, const D3DXVECTOR4* v, const D3DXMATRIX* m)         { *out = Vec4Transform(*v, *m); return out; }
+inline D3DXPLANE* D3DXPlaneNormalize(D3DXPLANE* out, const D3DXPLANE* p)                                   { *out = PlaneNormalize(*p); return out; }
+
+inline D3DXMATRIX* D3DXMatrixIdentity(D3DXMATRIX* out)                                                     { *out = MatrixIdentity(); return out; }
+inline D3DXMATRIX* D3DXMatrixMultiply(D3DXMATRIX* out, const D3DXMATRIX* a, const D3DXMATRIX* b)           { *out = MatrixMultiply(*a, *b); return out; }
+inline D3DXMATRIX* D3DXMatrixTranspose(D3DXMATRIX* out, const D3DXMATRIX* m)                               { *out = MatrixTranspose(*m); return out; }
+inline D3DXMATRIX* D3DXMatrixInverse(D3DXMATRIX* out, float* determinant, const D3DXMATRIX* m)             { return MatrixInverse(*m, *out, determinant) ? out : NULL; }
+inline D3DXMATRIX* D3DXMatrixScaling(D3DXMATRIX* out, float sx, float sy, float sz)                        { *out = MatrixScaling(sx, sy, sz); return out; }
+inline D3DXMATRIX* D3DXMatrixTranslation(D3DXMATRIX* out, float tx, float ty, float tz)                    { *out = MatrixTranslation(tx, ty, tz); return out; }
+inline D3DXMATRIX* D3DXMatrixRotationX(D3DXMATRIX* out, float angle)                                       { *out = MatrixRotationX(angle); return out; }
+inline D3DXMATRIX* D3DXMatrixRotationY(D3DXMATRIX* out, float angle)                                       { *out = MatrixRotationY(angle); return out; }
+inline D3DXMATRIX* D3DXMatrixRotationZ(D3DXMATRIX* out, float angle)                                       { *out = MatrixRotationZ(angle); return out; }
+inline D3DXMATRIX* D3DXMatrixRotationQuaternion(D3DXMATRIX* out, const D3DXQUATERNION* q)                  { *out = MatrixRotationQuaternion(*q); return out; }
+inline D3DXMATRIX* D3DXMatrixPerspectiveFovLH(D3DXMATRIX* out, float fovy, float aspect, float zn, float zf) { *out = MatrixPerspectiveFovLH(fovy, aspect, zn, zf); return out; }
+
+inline D3DXMATRIX* D3DXMatrixLookAtLH(D3DXMATRIX* out, const D3DXVECTOR3* eye, const D3DXVECTOR3* at, const D3DXVECTOR3* up)
+{
+	*out = MatrixLookAtLH(*eye, *at, *up);
+	return out;
+}
+
+inline D3DXQUATERNION* D3DXQuaternionRotationAxis(D3DXQUATERNION* out, const D3DXVECTOR3* axis, float angle) { *out = QuaternionRotationAxis(*axis, angle); return out; }
+inline D3DXQUATERNION* D3DXQuaternionMultiply(D3DXQUATERNION* out, const D3DXQUATERNION* a, const D3DXQUATERNION* b) { *out = QuaternionMultiply(*a, *b); return out; }
+inline D3DXQUATERNION* D3DXQuaternionNormalize(D3DXQUATERNION* out, const D3DXQUATERNION* q)                { *out = QuaternionNormalize(*q); return out; }
+inline D3DXQUATERNION* D3DXQuaternionSlerp(D3DXQUATERNION* out, const D3DXQUATERNION* a, const D3DXQUATERNION* b, float t) { *out = QuaternionSlerp(*a, *b, t); return out; }
+
+#endif
+
+#endif // VectorMath_h__
@@ -0,0 +1,306 @@
+#include "DXUT.h"
+#include "VertexCompression.h"
+#include "SDKMeshFile.h"
+#include <algorithm>
+
+namespace {
+
+// Read by the input assembler as it is
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex layout");
+static_assert(sizeof(MeshVertex) == 32, "MeshVertex layout");
+
+const float UnormScale = 65535.0f;
+const float SnormScale = 32767.0f;
+
+inline float SnormToFloat(int16_t value)
+{
+	// D3D maps -32768 to -1 too
+	return (std::max)(value / SnormScale, -1.0f);
+}
+
+inline int16_t FloatToSnorm(float value)
+{
+	return int16_t((std::min)((std::max)(value, -SnormScale), SnormScale));
+}
+
+inline uint16_t FloatToUnorm(float value)
+{
+	return uint16_t((std::min)((std::max)(value, 0.0f), 1.0f) * UnormScale + 0.5f);
+}
+
+}
+
+VertexQuantization ComputeVertexQuantization( const MeshVertex* vertices, size_t numVertices )
+{
+	D3DXVECTOR3 minPosition(0, 0, 0), maxPosition(0, 0, 0);
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		if (i == 0)
+			minPosition = maxPosition = vertices[i].Position;
+
+		D3DXVec3Minimize(&minPosition, &minPosition, &vertices[i].Position);
+		D3DXVec3Maximize(&maxPosition, &maxPosition, &vertices[i].Position);
+	}
+
+	VertexQuantization quantization;
+	quantization.Min = minPosition;
+	quantization.Scale = maxPosition - minPosition;
+	quantization.Scale.x = quantization.Scale.x > 0 ? quantization.Scale.x : 1.0f;
+	quantization.Scale.y = quantization.Scale.y > 0 ? quantization.Scale.y : 1.0f;
+	quantization.Scale.z = quantization.Scale.z > 0 ? quantization.Scale.z : 1.0f;
+	return quantization;
+}
+
+D3DXMATRIX GetDequantizeMatrix( const VertexQuantization& quantization )
+{
+	const D3DXVECTOR3& scale = quantization.Scale;
+	const D3DXVECTOR3& offset = quantization.Min;
+
+	return D3DXMATRIX(
+		scale.x, 0, 0, 0,
+		0, scale.y, 0, 0,
+		0, 0, scale.z, 0,
+		offset.x, offset.y, offset.z, 1);
+}
+
+D3DXVECTOR3 DecodeOctahedralNormal( const int16_t encoded[2] )
+{
+	const float x = SnormToFloat(encoded[0]);
+	const float y = SnormToFloat(encoded[1]);
+	D3DXVECTOR3 normal(x, y, 1.0f - fabsf(x) - fabsf(y));
+
+	// The lower hemisphere is folded over the diagonals of the square
+	const float t = (std::max)(-normal.z, 0.0f);
+	normal.x += normal.x >= 0 ? -t : t;
+	normal.y += normal.y >= 0 ? -t : t;
+
+	D3DXVec3Normalize(&normal, &normal);
+	return normal;
+}
+
+void EncodeOctahedralNormal( const D3DXVECTOR3& normal, int16_t encoded[2] )
+{
+	const float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (length == 0)
+	{
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+
+	// Project on the octahedron, unfold the lower half
+	float u = normal.x / length, v = normal.y / length;
+	if (normal.z < 0)
+	{
+		const float foldedU = (1.0f - fabsf(v)) * (u >= 0 ? 1.0f : -1.0f);
+		const float foldedV = (1.0f - fabsf(u)) * (v >= 0 ? 1.0f : -1.0f);
+		u = foldedU;
+		v = foldedV;
+	}
+
+	// Rounding each coordinate on its own can be a step off the nearest direction, take the best of the
+	// four snorm pairs around it
+	D3DXVECTOR3 unit;
+	D3DXVec3Normalize(&unit, &normal);
+
+	const float baseU = floorf(u * SnormScale), baseV = floorf(v * SnormScale);
+	float bestCosine = -2.0f;
+	for (int i = 0; i < 4; ++i)
+	{
+		const int16_t candidate[2] = { FloatToSnorm(baseU + (i & 1)), FloatToSnorm(baseV + (i >> 1)) };
+		const D3DXVECTOR3 decoded = DecodeOctahedralNormal(candidate);
+
+		const float cosine = D3DXVec3Dot(&decoded, &unit);
+		if (cosine > bestCosine)
+		{
+			bestCosine = cosine;
+			encoded[0] = candidate[0];
+			encoded[1] = candidate[1];
+		}
+	}
+}
+
+uint16_t FloatToHalf( float value )
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	// NaN stays NaN, from 65520 up everything rounds to infinity
+	if (magnitude > 0x7F800000)
+		return uint16_t(sign | 0x7E00);
+	if (magnitude >= 0x477FF000)
+		return uint16_t(sign | 0x7C00);
+
+	// Below the smallest normal half, 2^-14, the result is denormal
+	if (magnitude < 0x38800000)
+	{
+		if (magnitude < 0x33000000)
+			return uint16_t(sign);
+
+		const uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		const uint32_t shift = 126 - (magnitude >> 23);
+
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			++half;
+		return uint16_t(sign | half);
+	}
+
+	// Rebias the exponent and round the mantissa, a carry correctly moves into the exponent
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	const uint32_t remainder = magnitude & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		++half;
+	return uint16_t(sign | half);
+}
+
+float HalfToFloat( uint16_t value )
+{
+	const uint32_t sign = uint32_t(value & 0x8000) << 16;
+	const uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0x1F)
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	else if (exponent != 0)
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	else if (mantissa == 0)
+		bits = sign;
+	else
+	{
+		// Denormal, normalize it
+		uint32_t floatExponent = 113;
+		while (!(mantissa & 0x400))
+		{
+			mantissa <<= 1;
+			--floatExponent;
+		}
+		bits = sign | (floatExponent << 23) | ((mantissa & 0x3FF) << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+void EncodeVertices( const MeshVertex* vertices, size_t numVertices, const VertexQuantization& quantization, PackedVertex* packed )
+{
+	const D3DXVECTOR3 invScale(1.0f / quantization.Scale.x, 1.0f / quantization.Scale.y, 1.0f / quantization.Scale.z);
+
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		const MeshVertex& vertex = vertices[i];
+		PackedVertex& result = packed[i];
+
+		result.Position[0] = FloatToUnorm((vertex.Position.x - quantization.Min.x) * invScale.x);
+		result.Position[1] = FloatToUnorm((vertex.Position.y - quantization.Min.y) * invScale.y);
+		result.Position[2] = FloatToUnorm((vertex.Position.z - quantization.Min.z) * invScale.z);
+		result.Position[3] = 0;
+
+		EncodeOctahedralNormal(vertex.Normal, result.Normal);
+
+		result.Tex[0] = FloatToHalf(vertex.Tex.x);
+		result.Tex[1] = FloatToHalf(vertex.Tex.y);
+	}
+}
+
+void DecodeVertices( const PackedVertex* packed, size_t numVertices, const VertexQuantization& quantization, MeshVertex* vertices )
+{
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		const PackedVertex& vertex = packed[i];
+		MeshVertex& result = vertices[i];
+
+		result.Position.x = quantization.Min.x + vertex.Position[0] / UnormScale * quantization.Scale.x;
+		result.Position.y = quantization.Min.y + vertex.Position[1] / UnormScale * quantization.Scale.y;
+		result.Position.z = quantization.Min.z + vertex.Position[2] / UnormScale * quantization.Scale.z;
+
+		result.Normal = DecodeOctahedralNormal(vertex.Normal);
+
+		result.Tex.x = HalfToFloat(vertex.Tex[0]);
+		result.Tex.y = HalfToFloat(vertex.Tex[1]);
+	}
+}
+
+VertexCompressionError MeasureCompressionError( const MeshVertex* original, const MeshVertex* decoded, size_t numVertices )
+{
+	VertexCompressionError error = { 0, 0, 0, 0, 0 };
+
+	double sumNormalDegrees = 0;
+	size_t numNormals = 0;
+
+	// The box scale is 1 on flat axes, take the real extent for the relative error
+	D3DXVECTOR3 minPosition = numVertices ? original[0].Position : D3DXVECTOR3(0, 0, 0);
+	D3DXVECTOR3 maxPosition = minPosition;
+
+	for (size_t i = 0; i < numVertices; ++i)
+	{
+		D3DXVec3Minimize(&minPosition, &minPosition, &original[i].Position);
+		D3DXVec3Maximize(&maxPosition, &maxPosition, &original[i].Position);
+
+		const D3DXVECTOR3 positionError = decoded[i].Position - original[i].Position;
+		error.MaxPosition = (std::max)(error.MaxPosition, D3DXVec3Length(&positionError));
+
+		if (D3DXVec3LengthSq(&original[i].Normal) > 0)
+		{
+			D3DXVECTOR3 normal;
+			D3DXVec3Normalize(&normal, &original[i].Normal);
+
+			// acos of a float cosine can't resolve angles this small
+			D3DXVECTOR3 cross;
+			D3DXVec3Cross(&cross, &normal, &decoded[i].Normal);
+			const float degrees = D3DXToDegree(atan2f(D3DXVec3Length(&cross), D3DXVec3Dot(&normal, &decoded[i].Normal)));
+			error.MaxNormalDegrees = (std::max)(error.MaxNormalDegrees, degrees);
+			sumNormalDegrees += degrees;
+			++numNormals;
+		}
+
+		error.MaxTex = (std::max)(error.MaxTex, fabsf(decoded[i].Tex.x - original[i].Tex.x));
+		error.MaxTex = (std::max)(error.MaxTex, fabsf(decoded[i].Tex.y - original[i].Tex.y));
+	}
+
+	const D3DXVECTOR3 extent = maxPosition - minPosition;
+	const float diagonal = D3DXVec3Length(&extent);
+	error.MaxPositionRelative = diagonal > 0 ? error.MaxPosition / diagonal : 0;
+	error.MeanNormalDegrees = numNormals ? float(sumNormalDegrees / numNormals) : 0;
+	return error;
+}
+
+bool ReadMeshVertices( const SDKMeshFile& file, uint32_t vertexBuffer, std::vector<MeshVertex>& vertices )
+{
+	const int positionOffset = file.GetPositionOffset(vertexBuffer);
+	if (positionOffset < 0)
+		return false;
+
+	const int normalOffset = file.GetElementOffset(vertexBuffer, SDKMeshUsage_Normal, 0, SDKMeshType_Float3);
+	const int texOffset = file.GetElementOffset(vertexBuffer, SDKMeshUsage_TexCoord, 0, SDKMeshType_Float2);
+
+	const ArrayView<uint8_t> data = file.GetVertexData(vertexBuffer);
+	const size_t stride = size_t(file.GetVertexBuffers()[vertexBuffer].StrideBytes);
+
+	vertices.resize(data.Size / stride);
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		const uint8_t* vertex = data.Data + i * stride;
+		MeshVertex& result = vertices[i];
+
+		memcpy(&result.Position, vertex + positionOffset, sizeof(result.Position));
+
+		if (normalOffset >= 0)
+			memcpy(&result.Normal, vertex + normalOffset, sizeof(result.Normal));
+		else
+			result.Normal = D3DXVECTOR3(0, 0, 0);
+
+		if (texOffset >= 0)
+			memcpy(&result.Tex, vertex + texOffset, sizeof(result.Tex));
+		else
+			result.Tex = D3DXVECTOR2(0, 0);
+	}
+
+	return true;
+}
@@ -0,0 +1,81 @@
+#ifndef VertexCompression_h__
+#define VertexCompression_h__
+
+#include "VectorMath.h"
+#include <cstdint>
+#include <vector>
+
+class SDKMeshFile;
+
+/**
+ * The POSITION/NORMAL/TEXCOORD0 vertex of the scene meshes as mMeshVertexLayout reads it, 32 bytes.
+ */
+struct MeshVertex
+{
+	D3DXVECTOR3 Position;
+	D3DXVECTOR3 Normal;
+	D3DXVECTOR2 Tex;
+};
+
+/**
+ * The same vertex in 16 bytes:
+ *
+ *   POSITION    R16G16B16A16_UNORM   relative to the box of its vertex buffer, w is unused
+ *   NORMAL      R16G16_SNORM         octahedral mapping of the unit normal
+ *   TEXCOORD0   R16G16_FLOAT
+ *
+ * The input assembler hands the shader positions in [0, 1]^3, GetDequantizeMatrix in front of the world
+ * matrix takes them back to object space, so only the normal needs decoding in the vertex shader (the
+ * QuantizedVertices variant of GBufferVS).
+ */
+struct PackedVertex
+{
+	uint16_t Position[4];
+	int16_t Normal[2];
+	uint16_t Tex[2];
+};
+
+// Object space position = Min + unorm * Scale
+struct VertexQuantization
+{
+	D3DXVECTOR3 Min;
+	D3DXVECTOR3 Scale;
+};
+
+// Largest and average differences between original and decoded vertices
+struct VertexCompressionError
+{
+	float MaxPosition;              // Object space distance
+	float MaxPositionRelative;      // Of the box diagonal
+	float MaxNormalDegrees;
+	float MeanNormalDegrees;
+	float MaxTex;
+};
+
+// The box of the positions, flat axes get a scale of 1 so they still decode
+VertexQuantization ComputeVertexQuantization(const MeshVertex* vertices, size_t numVertices);
+
+// Unorm position to object space, row vector convention like the other D3DX matrices
+D3DXMATRIX GetDequantizeMatrix(const VertexQuantization& quantization);
+
+// The snorm pair nearest to the normal in angle, a zero normal encodes as +z
+void EncodeOctahedralNormal(const D3DXVECTOR3& normal, int16_t encoded[2]);
+D3DXVECTOR3 DecodeOctahedralNormal(const int16_t encoded[2]);
+
+// IEEE half, round to nearest even
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+void EncodeVertices(const MeshVertex* vertices, size_t numVertices, const VertexQuantization& quantization, PackedVertex* packed);
+void DecodeVertices(const PackedVertex* packed, size_t numVertices, const VertexQuantization& quantization, MeshVertex* vertices);
+
+// Vertices with a zero normal are left out of the normal errors
+VertexCompressionError MeasureCompressionError(const MeshVertex* original, const MeshVertex* decoded, size_t numVertices);
+
+/**
+ * Read a vertex buffer of a mesh file as MeshVertex whatever its stride, false without a float3 POSITION.
+ * A missing float3 NORMAL or float2 TEXCOORD0 reads as zero.
+ */
+bool ReadMeshVertices(const SDKMeshFile& file, uint32_t vertexBuffer, std::vector<MeshVertex>& vertices);
+
+#endif // VertexCompression_h__